@@ -0,0 +1,89 @@
+// chunks.js
+const AWS = require('aws-sdk');
+const dynamo = new AWS.DynamoDB.DocumentClient();
+
+const CHUNK_TABLE = process.env.CHUNK_TABLE;
+// Chunks of a message that never completes are removed by the table TTL
+const CHUNK_TTL_SECONDS = 5 * 60;
+// Same limits as the Thing, see MQTT_PAYLOAD_MAX_LEN and MQTT_CHUNK_ID_MAX in mqtt.h and mqtt.c.
+// The chunk count depends on the Thing's MQTT buffer size, so it is only bounded loosely.
+const CHUNK_PAYLOAD_MAX_LEN = 4096;
+const CHUNK_ID_MAX = 65535;
+const CHUNK_COUNT_MAX = 16;
+
+const isChunk = (payload) => {
+    return payload !== null && typeof payload === 'object' && typeof payload.chunk === 'object';
+};
+
+const isIndex = (value, max) => {
+    return Number.isInteger(value) && value >= 0 && value <= max;
+};
+
+// Things publish documents larger than their MQTT buffer as
+// {"chunk":{"id":1,"index":0,"count":3},"data":"<base64 slice>"}. Each chunk is a separate
+// Lambda invocation, so chunks are stored until all of them have arrived.
+// Returns the reassembled bytes, or null while chunks are still missing.
+const chunkReassemble = async (thingId, action, payload) => {
+    const { id, index, count } = payload.chunk;
+    const data = payload.data;
+    if (!isIndex(id, CHUNK_ID_MAX) || !isIndex(count, CHUNK_COUNT_MAX) || count < 1 ||
+        !isIndex(index, count - 1) || typeof data !== 'string') {
+        throw new Error('Invalid chunk header');
+    }
+    const key = thingId + '/' + action + '/' + id;
+
+    await dynamo.put({
+        TableName: CHUNK_TABLE,
+        Item: {
+            key: key,
+            index: index,
+            count: count,
+            data: data,
+            expires: Math.floor(Date.now() / 1000) + CHUNK_TTL_SECONDS,
+        },
+    }).promise();
+
+    const result = await dynamo.query({
+        TableName: CHUNK_TABLE,
+        KeyConditionExpression: '#key = :key',
+        ExpressionAttributeNames: { '#key': 'key' },
+        ExpressionAttributeValues: { ':key': key },
+        ConsistentRead: true,
+    }).promise();
+
+    const chunks = result.Items.filter((item) => item.count === count);
+    if (chunks.length < count) {
+        console.log('CHUNK:', key, index + 1, 'of', count, 'stored');
+        return null;
+    }
+
+    // Two invocations may both see the last chunk, only the one removing the first chunk delivers
+    try {
+        await dynamo.delete({
+            TableName: CHUNK_TABLE,
+            Key: { key: key, index: 0 },
+            ConditionExpression: 'attribute_exists(#key)',
+            ExpressionAttributeNames: { '#key': 'key' },
+        }).promise();
+    } catch (error) {
+        if (error.code === 'ConditionalCheckFailedException') {
+            return null;
+        }
+        throw error;
+    }
+    for (const chunk of chunks) {
+        if (chunk.index !== 0) {
+            await dynamo.delete({ TableName: CHUNK_TABLE, Key: { key: key, index: chunk.index } }).promise();
+        }
+    }
+
+    // Items come back sorted by index, the sort key
+    const buffer = Buffer.concat(chunks.map((chunk) => Buffer.from(chunk.data, 'base64')));
+    if (buffer.length > CHUNK_PAYLOAD_MAX_LEN) {
+        throw new Error('Reassembled chunk payload too large');
+    }
+    console.log('CHUNK:', key, 'reassembled', buffer.length, 'bytes from', count, 'chunks');
+    return buffer;
+};
+
+module.exports = { isChunk, chunkReassemble };
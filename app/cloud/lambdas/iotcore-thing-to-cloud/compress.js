@@ -0,0 +1,53 @@
+// compress.js
+
+// Mirror of the preset dictionary in the Thing's utilities/compress.c. Only append words,
+// in the same order as the Thing, or payloads from older firmware can't be decoded.
+const COMPRESS_HEADER = Buffer.from('\x1bZ1', 'latin1');
+const COMPRESS_DICTIONARY = {
+    0x01: 'mobile_value',
+    0x02: 'thing_value',
+    0x03: 'hw_version',
+    0x04: 'fw_version',
+    0x05: 'sw_version',
+    0x06: 'readwrite',
+    0x07: 'wifi_scan',
+    0x08: 'nickname',
+    0x0B: 'network',
+    0x0C: 'offline',
+    0x0E: 'online',
+    0x0F: 'status',
+    0x10: 'false',
+    0x11: 'value',
+    0x12: 'count',
+    0x13: 'index',
+    0x14: 'chunk',
+    0x15: 'true',
+    0x16: 'read',
+    0x17: 'type',
+    0x18: 'ssid',
+    0x19: 'rssi',
+    0x1A: '\\"',
+};
+
+const compressIsEncoded = (buffer) => {
+    return buffer.length >= COMPRESS_HEADER.length &&
+           buffer.subarray(0, COMPRESS_HEADER.length).equals(COMPRESS_HEADER);
+};
+
+// Each control character below 0x20 in the dictionary stands for a word, every other byte
+// is copied as is, so UTF-8 sequences pass through untouched
+const compressDecode = (buffer) => {
+    const parts = [];
+    let start = COMPRESS_HEADER.length;
+    for (let i = start; i < buffer.length; i++) {
+        const word = buffer[i] < 0x20 ? COMPRESS_DICTIONARY[buffer[i]] : undefined;
+        if (word !== undefined) {
+            parts.push(buffer.subarray(start, i), Buffer.from(word, 'latin1'));
+            start = i + 1;
+        }
+    }
+    parts.push(buffer.subarray(start));
+    return Buffer.concat(parts);
+};
+
+module.exports = { compressIsEncoded, compressDecode };
@@ -2,6 +2,29 @@
 const { actionOtaurl } = require('./actionOtaurl');
 const { actionValue } = require('./actionValue');
 const { actionBootup } = require('./actionBootup');
+const { isChunk, chunkReassemble } = require('./chunks');
+const { compressIsEncoded, compressDecode } = require('./compress');
+
+// The rule forwards the raw message as base64, as compressed payloads are not JSON.
+// Returns the decoded document, or null while chunks of it are still missing.
+const decodePayload = async (event) => {
+    let buffer = Buffer.from(event.raw, 'base64');
+    // Chunks are JSON, the document they carry may be compressed
+    if (!compressIsEncoded(buffer)) {
+        const payload = JSON.parse(buffer.toString('utf8'));
+        if (!isChunk(payload)) {
+            return payload;
+        }
+        buffer = await chunkReassemble(event.id, event.action, payload);
+        if (buffer === null) {
+            return null;
+        }
+    }
+    if (compressIsEncoded(buffer)) {
+        buffer = compressDecode(buffer);
+    }
+    return JSON.parse(buffer.toString('utf8'));
+};
 
 exports.handler = async (event) => {
     console.log('EVENT:', event);
@@ -9,6 +32,18 @@ exports.handler = async (event) => {
 
     let success = true;
 
+    try {
+        event.payload = await decodePayload(event);
+    } catch (error) {
+        console.log('ERROR:', error);
+        return { statusCode: 500, body: 'Payload could not be decoded.' };
+    }
+    // Continue with the whole document once its last chunk has arrived
+    if (event.payload === null) {
+        return { statusCode: 200, body: 'Chunk stored.' };
+    }
+    console.log('PAYLOAD:', event.payload);
+
     if (success && (event.action == 'otaurl')) {
         success = await actionOtaurl(event);
     }
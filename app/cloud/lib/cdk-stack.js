@@ -9,7 +9,7 @@ const { PolicyStatement, Effect, Policy } = require('aws-cdk-lib/aws-iam');
 const { StartingPosition } = require('aws-cdk-lib/aws-lambda');
 const { TopicRule, IotSql } = require('@aws-cdk/aws-iot-alpha');
 const { CfnThing } = require('aws-cdk-lib/aws-iot');
-const { LambdaFunctionAction } = require('@aws-cdk/aws-iot-actions-alpha');
+const { LambdaFunctionAction, IotRepublishMqttAction } = require('@aws-cdk/aws-iot-actions-alpha');
 const { Bucket, BlockPublicAccess } = require('aws-cdk-lib/aws-s3');
 const { IdentityPool, UserPoolAuthenticationProvider } = require('@aws-cdk/aws-cognito-identitypool-alpha');
 
@@ -179,6 +179,22 @@ class CdkStack extends Stack {
       }
     });
 
+    // Chunks of Thing messages larger than its MQTT buffer, kept until all chunks have arrived
+    const dynamoTableThingChunks = new Table(this, `${prefix}DynamoTableThingChunks`, {
+      tableName: `${prefix}DynamoTableThingChunks`,
+      billingMode: BillingMode.PAY_PER_REQUEST,
+      removalPolicy: RemovalPolicy.DESTROY,
+      partitionKey: {
+        name: 'key',
+        type: AttributeType.STRING,
+      },
+      sortKey: {
+        name: 'index',
+        type: AttributeType.NUMBER,
+      },
+      timeToLiveAttribute: 'expires',
+    });
+
     /********************************************************************************/
 
     // Create policy for Lambdas to publish to IoT Core 
@@ -249,17 +265,26 @@ class CdkStack extends Stack {
         APPSYNC_API_URL: appSyncApiThings.graphqlUrl,
         APPSYNC_API_ARN: appSyncApiThings.arn,
         BUCKET_NAME: bucketThingOtaFw.bucketName,
+        CHUNK_TABLE: dynamoTableThingChunks.tableName,
       },
     });
 
-    // Format incoming Thing message for the Lambda function to handle
-    const sql = "SELECT topic(2) as id, topic(3) as action, * as payload FROM 'thingpub/+/+'";
+    // Format incoming Thing message for the Lambda function to handle. The message is passed on
+    // base64 encoded, as compressed payloads are not JSON and can't be selected as such.
+    const sql = "SELECT topic(2) as id, topic(3) as action, encode(*, 'base64') as raw FROM 'thingpub/+/+' WHERE topic(3) <> 'echo'";
     new TopicRule(this, `${prefix}IotCoreMessageRoutingRule`, {
       topicRuleName: `${prefix}IotCoreMessageRoutingRule`,
       sql: IotSql.fromStringAsVer20151008(sql),
       actions: [new LambdaFunctionAction(lambdaIotCoreThingToCloud)],
     });
 
+    // Route Thing latency probes straight back to the Thing, without involving any Lambda
+    new TopicRule(this, `${prefix}IotCoreEchoRule`, {
+      topicRuleName: `${prefix}IotCoreEchoRule`,
+      sql: IotSql.fromStringAsVer20151008("SELECT * FROM 'thingpub/+/echo'"),
+      actions: [new IotRepublishMqttAction('thingsub/${topic(2)}/echo')],
+    });
+
     /********************************************************************************/
 
     // Grant Lambda permissions to fetch IoT Core broker endpoint URL
@@ -276,6 +301,8 @@ class CdkStack extends Stack {
     appSyncApiThings.grantMutation(lambdaIotCoreThingToCloud);
     // Grant the Lambda permissions to perform AppSync queries using IAM
     appSyncApiThings.grantQuery(lambdaIotCoreThingToCloud);
+    // Grant the Lambda permissions to store and reassemble Thing message chunks
+    dynamoTableThingChunks.grantReadWriteData(lambdaIotCoreThingToCloud);
     // Trigger Lambda function on DynamoDB updates
     lambdaIotCoreCloudToThing.addEventSource(dynamoTableThingsEvent);
     // Grant Lambda full access to Dynamo (using Cognito)
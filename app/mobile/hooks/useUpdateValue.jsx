@@ -16,8 +16,10 @@ const useUpdateValue = (thingId) => {
       console.log(appVersion);
       setIsUpdatingValue(true);
   
+      // Ask for the next version, the thing rejects it if it changed locally meanwhile
       const updatedThingValue = {
         ...initialThingValue,
+        version: (initialThingValue.version || 0) + 1,
         mobile_value: {
           ...initialThingValue.mobile_value,
           readwrite: {
@@ -17,6 +17,7 @@
 #include "middlewares/auth.h"
 #include "app/provision.h"
 #include "utilities/auth_aws_provision.h"
+#include "utilities/arena.h"
 #include "esp_log.h"
 
 static const char *TAG = "APP";
@@ -24,6 +25,9 @@ static const char *TAG = "APP";
 void app_main(void)
 {
     bool ok = true;
+    if (ok){
+        ok = arena_init();
+    }
     if (ok){
         ok = event_init();
     }
@@ -57,6 +61,9 @@ void app_main(void)
     if (ok){
         ok = mqtt_init();
     }
+    uint32_t nvs_ops, nvs_us;
+    storage_get_stats(&nvs_ops, &nvs_us);
+    ESP_LOGI(TAG, "Boot NVS: %"PRIu32" sessions, %"PRIu32" us", nvs_ops, nvs_us);
 
     // Wait for either BLE or WiFi events on boot
     event_expect(EVENT_BLE_GAP_CONNECTED | EVENT_WIFI_START);
@@ -66,6 +73,8 @@ void app_main(void)
     ESP_LOGI(TAG, "App version: %s: ", PROJECT_VER);
     
     while (ok){
+        // Each handled event is one operation, cJSON memory is released in one go afterwards
+        arena_begin();
         switch (state_get()){
             case STATE_PROVISION:
                 ok = provision_run();
@@ -80,6 +89,7 @@ void app_main(void)
                 ok = false;
                 break;
         }
+        arena_end();
     }
 
     thing_reboot();
@@ -0,0 +1,306 @@
+/*
+ * automation.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "app/automation.h"
+#include "app/types/type.h"
+#include <cJSON.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "mbedtls/base64.h"
+#include "drivers/storage.h"
+#include "utilities/json_reader.h"
+#include "utilities/json_writer.h"
+#include "utilities/dirty.h"
+#include "utilities/version.h"
+#include "utilities/rules.h"
+
+#define AUTOMATION_STORAGE_KEY_RULES    "rules"
+#define AUTOMATION_POLL_MS              100     // Latency from a value change to its rules
+#define AUTOMATION_TICK_MS              1000    // Hold times count in whole seconds
+#define AUTOMATION_SNAPSHOT_SIZE        512
+#define AUTOMATION_SNAPSHOT_MAX_TOKENS  64
+
+// Fields of one endpoint, serialized at most once per evaluation
+typedef struct automation_snapshot_t {
+    bool valid;
+    char buffer[AUTOMATION_SNAPSHOT_SIZE];
+    json_token_t tokens[AUTOMATION_SNAPSHOT_MAX_TOKENS];
+    json_reader_t reader;
+} automation_snapshot_t;
+
+typedef struct automation_stats_t {
+    uint32_t evaluations;
+    uint32_t instructions;  // Of the last evaluation
+    uint32_t fired;
+    uint32_t failed;
+    uint32_t last_us;
+    uint32_t max_us;
+} automation_stats_t;
+
+static const char *TAG = "AUTOMATION";
+
+static SemaphoreHandle_t automation_lock = NULL;
+static rules_t automation_rules;
+static uint8_t automation_bytecode[RULES_MAX_SIZE];
+static automation_snapshot_t automation_snapshots[TYPE_MAX_ENDPOINTS];
+static automation_stats_t automation_stats;
+
+static callback_t automation_publish_value = NULL;
+
+static void automation_task(void* arg);
+static bool automation_take_lock(void);
+static void automation_give_lock(void);
+static bool automation_load_rules(void);
+static automation_snapshot_t *automation_get_snapshot(int endpoint);
+static bool automation_get_field(void *context, int endpoint, const char *name, float *value);
+static bool automation_set_field(void *context, int endpoint, const char *name, float value);
+static void automation_evaluate(void);
+
+
+static bool automation_take_lock(void)
+{
+    if (!(xSemaphoreTake(automation_lock, portMAX_DELAY) == pdTRUE)){
+        ESP_LOGE(TAG, "Error: xSemaphoreTake");
+        return false;
+    }
+    return true;
+}
+
+static void automation_give_lock(void)
+{
+    xSemaphoreGive(automation_lock);
+}
+
+static bool automation_load_rules(void)
+{
+    // The blob is read back without its size, the header holds it
+    if (!storage_get_blob(AUTOMATION_STORAGE_KEY_RULES, (char *)automation_bytecode, sizeof(automation_bytecode))) {
+        ESP_LOGI(TAG, "No rules stored");
+        return true;
+    }
+    size_t size = rules_get_size(automation_bytecode, sizeof(automation_bytecode));
+    if (!rules_load(&automation_rules, automation_bytecode, size, TYPE_MAX_ENDPOINTS)) {
+        ESP_LOGE(TAG, "Error: rules_load");
+        return false;
+    }
+    ESP_LOGI(TAG, "Loaded %d rules", automation_rules.rule_count);
+    return true;
+}
+
+static automation_snapshot_t *automation_get_snapshot(int endpoint)
+{
+    automation_snapshot_t *snapshot = &automation_snapshots[endpoint];
+    if (snapshot->valid) {
+        return snapshot;
+    }
+    json_writer_t writer;
+    json_writer_init(&writer, snapshot->buffer, sizeof(snapshot->buffer));
+    json_writer_object_begin(&writer, NULL);
+    json_writer_object_begin(&writer, "readwrite");
+    if (!type_get_readwrite_writer(endpoint, &writer)) {
+        ESP_LOGE(TAG, "Error: type_get_readwrite_writer");
+        return NULL;
+    }
+    json_writer_object_end(&writer);
+    json_writer_object_begin(&writer, "read");
+    if (!type_get_read_writer(endpoint, &writer)) {
+        ESP_LOGE(TAG, "Error: type_get_read_writer");
+        return NULL;
+    }
+    json_writer_object_end(&writer);
+    json_writer_object_end(&writer);
+    if (!json_writer_finish(&writer) ||
+        !json_reader_parse(&snapshot->reader, snapshot->tokens, AUTOMATION_SNAPSHOT_MAX_TOKENS, snapshot->buffer, writer.len)) {
+        ESP_LOGE(TAG, "Error: Snapshot of endpoint %d", endpoint);
+        return NULL;
+    }
+    snapshot->valid = true;
+    return snapshot;
+}
+
+static bool automation_get_field(void *context, int endpoint, const char *name, float *value)
+{
+    automation_snapshot_t *snapshot = automation_get_snapshot(endpoint);
+    if (!snapshot) {
+        return false;
+    }
+    const json_reader_t *reader = &snapshot->reader;
+    int field = json_reader_find(reader, json_reader_find(reader, 0, "readwrite"), name);
+    if (field < 0) {
+        field = json_reader_find(reader, json_reader_find(reader, 0, "read"), name);
+    }
+
+    bool flag;
+    double number;
+    if (json_reader_get_bool(reader, field, &flag)) {
+        *value = flag;
+        return true;
+    }
+    if (json_reader_get_number(reader, field, &number)) {
+        *value = (float)number;
+        return true;
+    }
+    return false;
+}
+
+static bool automation_set_field(void *context, int endpoint, const char *name, float value)
+{
+    // Only this field is set, on the current value rather than the snapshot, so a change
+    // to another field since the snapshot was taken is kept
+    if (!type_set_field(endpoint, name, value)) {
+        automation_stats.failed++;
+        ESP_LOGE(TAG, "Error: type_set_field %s", name);
+        return false;
+    }
+
+    // Fields read later in this evaluation see the action
+    automation_snapshots[endpoint].valid = false;
+    automation_stats.fired++;
+    ESP_LOGI(TAG, "Set %s of endpoint %d to %g", name, endpoint, value);
+    // A local change, so a command sent before the app saw it can't undo it
+    version_local_change();
+    automation_publish_value();
+    return true;
+}
+
+static void automation_evaluate(void)
+{
+    if (!automation_take_lock()) {
+        ESP_LOGE(TAG, "Error: automation_take_lock");
+        return;
+    }
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        automation_snapshots[endpoint].valid = false;
+    }
+    int64_t start_us = esp_timer_get_time();
+    uint32_t now_s = (uint32_t)(start_us / 1000000);
+    uint32_t instructions = rules_evaluate(&automation_rules, now_s, automation_get_field, automation_set_field, NULL);
+    uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start_us);
+
+    automation_stats.evaluations++;
+    automation_stats.instructions = instructions;
+    automation_stats.last_us = elapsed_us;
+    if (elapsed_us > automation_stats.max_us) {
+        automation_stats.max_us = elapsed_us;
+    }
+    automation_give_lock();
+}
+
+static void automation_task(void* arg)
+{
+    uint32_t generation = dirty_get_generation(DIRTY_TYPE);
+    TickType_t last_tick = xTaskGetTickCount();
+    while(true) {
+        vTaskDelay(AUTOMATION_POLL_MS / portTICK_PERIOD_MS);
+        // Nothing to do without rules, checked unlocked as a stale count only delays one poll
+        if (automation_rules.rule_count == 0) {
+            continue;
+        }
+        bool changed = dirty_get_generation(DIRTY_TYPE) != generation;
+        bool ticked = xTaskGetTickCount() - last_tick >= AUTOMATION_TICK_MS / portTICK_PERIOD_MS;
+        if (!changed && !ticked) {
+            continue;
+        }
+        automation_evaluate();
+        // Picks up the changes made by the actions too, which evaluates their effects once more
+        generation = dirty_get_generation(DIRTY_TYPE);
+        if (ticked) {
+            last_tick = xTaskGetTickCount();
+        }
+    }
+}
+
+bool automation_set_rules(const char *data, int data_len)
+{
+    cJSON *root = cJSON_ParseWithLength(data, data_len);
+    cJSON *bytecode = cJSON_GetObjectItem(root, "bytecode");
+    if (!cJSON_IsString(bytecode)) {
+        cJSON_Delete(root);
+        ESP_LOGE(TAG, "Error: No bytecode");
+        return false;
+    }
+    if (!automation_take_lock()) {
+        cJSON_Delete(root);
+        ESP_LOGE(TAG, "Error: automation_take_lock");
+        return false;
+    }
+
+    size_t size = 0;
+    if (mbedtls_base64_decode(automation_bytecode, sizeof(automation_bytecode), &size,
+                              (const unsigned char *)bytecode->valuestring, strlen(bytecode->valuestring)) != 0) {
+        automation_give_lock();
+        cJSON_Delete(root);
+        ESP_LOGE(TAG, "Error: mbedtls_base64_decode");
+        return false;
+    }
+    cJSON_Delete(root);
+
+    if (size == 0) {
+        rules_clear(&automation_rules);
+        automation_give_lock();
+        ESP_LOGI(TAG, "Rules cleared");
+        return storage_erase_blob(AUTOMATION_STORAGE_KEY_RULES);
+    }
+    // Verified as a whole first, a bad rule set leaves the running one in place
+    if (!rules_load(&automation_rules, automation_bytecode, size, TYPE_MAX_ENDPOINTS)) {
+        automation_give_lock();
+        ESP_LOGE(TAG, "Error: rules_load, keep the current rules");
+        return false;
+    }
+    automation_give_lock();
+    ESP_LOGI(TAG, "Received %d rules", automation_rules.rule_count);
+
+    if (!storage_set_blob(AUTOMATION_STORAGE_KEY_RULES, (const char *)automation_bytecode, size)) {
+        ESP_LOGE(TAG, "Error: storage_set_blob");
+        return false;
+    }
+    return true;
+}
+
+bool automation_get_json(cJSON *root)
+{
+    cJSON *automation = cJSON_CreateObject();
+    if (!automation || !cJSON_AddItemToObject(root, "automation", automation)) {
+        cJSON_Delete(automation);
+        ESP_LOGE(TAG, "Error: cJSON_AddItemToObject");
+        return false;
+    }
+    cJSON_AddNumberToObject(automation, "rules", automation_rules.rule_count);
+    cJSON_AddNumberToObject(automation, "evaluations", automation_stats.evaluations);
+    cJSON_AddNumberToObject(automation, "instructions", automation_stats.instructions);
+    cJSON_AddNumberToObject(automation, "fired", automation_stats.fired);
+    cJSON_AddNumberToObject(automation, "failed", automation_stats.failed);
+    cJSON_AddNumberToObject(automation, "last_us", automation_stats.last_us);
+    cJSON_AddNumberToObject(automation, "max_us", automation_stats.max_us);
+    return true;
+}
+
+bool automation_init(callback_t callback_publish_value)
+{
+    ESP_LOGI(TAG, "Initialise");
+    automation_publish_value = callback_publish_value;
+
+    automation_lock = xSemaphoreCreateMutex();
+    if (!automation_lock) {
+        ESP_LOGE(TAG, "Error: xSemaphoreCreateMutex");
+        return false;
+    }
+    if (!automation_load_rules()) {
+        // Don't return false, the device works without its rules until new ones arrive
+        ESP_LOGE(TAG, "Error: automation_load_rules");
+    }
+    if (xTaskCreate(automation_task, "automation_task", 4096, NULL, 5, NULL) != pdTRUE){
+        ESP_LOGE(TAG, "Error: xTaskCreate");
+        return false;
+    }
+    return true;
+}
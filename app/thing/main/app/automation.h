@@ -0,0 +1,21 @@
+/*
+ * automation.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _AUTOMATION_H_
+#define _AUTOMATION_H_
+
+#include <stdbool.h>
+#include <cJSON.h>
+#include "utilities/misc.h"
+
+// Runs the rule set from utilities/rules.h against the type's fields, on every value
+// change and once a second, so simple automations work without the cloud.
+// Rule sets arrive as {"bytecode": "<base64>"} and are kept in NVS, an empty string clears them.
+bool automation_set_rules(const char *data, int data_len);
+bool automation_get_json(cJSON *root);
+bool automation_init(callback_t callback_publish_value);
+
+#endif /* _AUTOMATION_H_ */
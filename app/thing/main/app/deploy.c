@@ -12,6 +12,7 @@
 #include "app/deploy.h"
 #include "middlewares/ble.h"
 #include "utilities/aes.h"
+#include "drivers/storage.h"
 #include "app/thing.h"
 #include "mbedtls/base64.h"
 #include <cJSON.h>
@@ -67,11 +68,11 @@ static bool deploy_write_thing_id(void)
 
     if (!uart_write_bytes(DEPLOY_UART_PORT_NUM, base64_encode_buffer, base64_size)){
         cJSON_Delete(message_root);
-        free(json_str);
+        cJSON_free(json_str);
         return false;
     }
     cJSON_Delete(message_root);
-    free(json_str);
+    cJSON_free(json_str);
 
     return true;
 }
@@ -114,28 +115,38 @@ static bool deploy_read_thing_blob(void)
         return false;
     }
 
+    // Written in one commit, so a failed deploy leaves nothing behind that blocks the next one
+    if (!storage_begin()){
+        cJSON_Delete(root);
+        return false;
+    }
+
     if (!thing_set_type(type->valuestring)){
+        storage_abort();
         cJSON_Delete(root);
         return false;
     }
 
     if (!thing_set_hw_version(hw_version->valuestring)){
+        storage_abort();
         cJSON_Delete(root);
         return false;
     }
     
     if (!ble_set_pop(pop->valuestring)){
+        storage_abort();
         cJSON_Delete(root);
         return false;
     }
 
     if (!aes_set_key(aes->valuestring)){
+        storage_abort();
         cJSON_Delete(root);
         return false;
     }
 
     cJSON_Delete(root);
-    return true;
+    return storage_commit();
 }
 
 static bool deploy_write_status(bool status)
@@ -152,7 +163,7 @@ static bool deploy_write_status(bool status)
     mbedtls_base64_encode(base64_encode_buffer, sizeof(base64_encode_buffer), &base64_size, (unsigned char*)json_str, strlen(json_str));
     int bytes_sent = uart_write_bytes(DEPLOY_UART_PORT_NUM, base64_encode_buffer, base64_size);
     cJSON_Delete(message_root);
-    free(json_str);
+    cJSON_free(json_str);
 
     if (!bytes_sent){
         return false;
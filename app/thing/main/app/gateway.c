@@ -0,0 +1,252 @@
+/*
+ * gateway.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "app/gateway.h"
+#include <cJSON.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "middlewares/ble.h"
+#include "middlewares/mqtt.h"
+#include "utilities/json_writer.h"
+#include "utilities/peers.h"
+
+#define GATEWAY_POLL_MS             50
+#define GATEWAY_PUBLISH_MS          10000
+#define GATEWAY_SCAN_INTERVAL_MS    5000
+#define GATEWAY_SCAN_WINDOW_MS      1000    // Catches a sensor advertising every second at least once
+#define GATEWAY_READ_INTERVAL_MS    (CONFIG_RIOTBOX_GATEWAY_READ_INTERVAL_S * 1000)
+#define GATEWAY_TIMEOUT_MS          (5 * 60 * 1000)
+#define GATEWAY_ADDR_STR_SIZE       (PEERS_ADDR_SIZE * 2 + 1)
+
+static const char *TAG = "GATEWAY";
+
+// Written by the NimBLE host task and the gateway task
+static SemaphoreHandle_t gateway_lock = NULL;
+static peers_t gateway_peers;
+static uint32_t gateway_batches = 0;
+
+static const char *gateway_topic = NULL;
+static char gateway_buffer[MQTT_PAYLOAD_MAX_LEN + 1];
+
+static void gateway_task(void* arg);
+static uint32_t gateway_now_ms(void);
+static void gateway_take_lock(void);
+static void gateway_give_lock(void);
+static void gateway_advertised(const uint8_t *addr, uint8_t addr_type, int8_t rssi, const uint8_t *data, uint8_t data_len);
+static void gateway_scan_done(void);
+static void gateway_connected(int id, bool ok);
+static void gateway_read_done(int id, const uint8_t *data, uint16_t data_len);
+static void gateway_schedule(void);
+static void gateway_batch_sensor(void *context, const peers_sensor_t *sensor);
+static bool gateway_publish(void);
+
+static const ble_central_callbacks_t gateway_callbacks = {
+    .advertised = gateway_advertised,
+    .scan_done = gateway_scan_done,
+    .connected = gateway_connected,
+    .read_done = gateway_read_done,
+};
+
+
+static uint32_t gateway_now_ms(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+static void gateway_take_lock(void)
+{
+    // Only held for table updates, never across a radio operation
+    xSemaphoreTake(gateway_lock, portMAX_DELAY);
+}
+
+static void gateway_give_lock(void)
+{
+    xSemaphoreGive(gateway_lock);
+}
+
+static void gateway_advertised(const uint8_t *addr, uint8_t addr_type, int8_t rssi, const uint8_t *data, uint8_t data_len)
+{
+    bool connectable;
+    peers_reading_t reading;
+    // Most advertisements are from other devices, they are dropped before taking the lock
+    if (!peers_parse_adv(data, data_len, &connectable, &reading)) {
+        return;
+    }
+    gateway_take_lock();
+    peers_advertised(&gateway_peers, addr, addr_type, rssi, connectable, &reading, gateway_now_ms());
+    gateway_give_lock();
+}
+
+static void gateway_scan_done(void)
+{
+    gateway_take_lock();
+    peers_scan_done(&gateway_peers);
+    gateway_give_lock();
+}
+
+static void gateway_connected(int id, bool ok)
+{
+    gateway_take_lock();
+    peers_connected(&gateway_peers, id, ok, gateway_now_ms());
+    gateway_give_lock();
+}
+
+static void gateway_read_done(int id, const uint8_t *data, uint16_t data_len)
+{
+    peers_reading_t reading = {0};
+    if (data && data_len >= 2) {
+        reading.temperature = (int16_t)(data[0] | (data[1] << 8)) * 0.01f;
+        reading.fields = PEERS_HAS_TEMPERATURE;
+    }
+    gateway_take_lock();
+    peers_read_done(&gateway_peers, id, reading.fields ? &reading : NULL, gateway_now_ms());
+    gateway_give_lock();
+}
+
+static void gateway_schedule(void)
+{
+    int sensor = -1;
+    uint8_t addr[PEERS_ADDR_SIZE];
+    uint8_t addr_type = 0;
+    gateway_take_lock();
+    peers_action_t action = peers_schedule(&gateway_peers, gateway_now_ms(), &sensor);
+    if (action == PEERS_ACTION_READ) {
+        memcpy(addr, gateway_peers.sensors[sensor].addr, PEERS_ADDR_SIZE);
+        addr_type = gateway_peers.sensors[sensor].addr_type;
+    }
+    gateway_give_lock();
+
+    // Started unlocked, NimBLE may call back before they return
+    if (action == PEERS_ACTION_SCAN && !ble_central_scan(GATEWAY_SCAN_WINDOW_MS)) {
+        gateway_scan_done();
+    } else if (action == PEERS_ACTION_READ && !ble_central_read(sensor, addr, addr_type, PEERS_ESS_TEMPERATURE_UUID)) {
+        gateway_connected(sensor, false);
+    }
+}
+
+static void gateway_batch_sensor(void *context, const peers_sensor_t *sensor)
+{
+    json_writer_t *writer = context;
+    char addr[GATEWAY_ADDR_STR_SIZE];
+    // Most significant byte first, as addresses are usually written
+    for (int i = 0; i < PEERS_ADDR_SIZE; i++) {
+        snprintf(&addr[i * 2], 3, "%02x", sensor->addr[PEERS_ADDR_SIZE - 1 - i]);
+    }
+    json_writer_object_begin(writer, addr);
+    json_writer_int(writer, "rssi", sensor->rssi);
+    json_writer_int(writer, "age_ms", gateway_now_ms() - sensor->updated_ms);
+    if (sensor->reading_value.fields & PEERS_HAS_TEMPERATURE) {
+        json_writer_number(writer, "temperature", sensor->reading_value.temperature);
+    }
+    if (sensor->reading_value.fields & PEERS_HAS_HUMIDITY) {
+        json_writer_number(writer, "humidity", sensor->reading_value.humidity);
+    }
+    if (sensor->reading_value.fields & PEERS_HAS_BATTERY) {
+        json_writer_number(writer, "battery", sensor->reading_value.battery);
+    }
+    json_writer_object_end(writer);
+}
+
+static bool gateway_publish(void)
+{
+    // One TLS publish for every sensor that reported since the last batch
+    json_writer_t writer;
+    json_writer_init(&writer, gateway_buffer, sizeof(gateway_buffer));
+    json_writer_object_begin(&writer, NULL);
+    json_writer_object_begin(&writer, "sensors");
+    gateway_take_lock();
+    int count = peers_collect(&gateway_peers, gateway_now_ms(), gateway_batch_sensor, &writer);
+    gateway_give_lock();
+    json_writer_object_end(&writer);
+    json_writer_object_end(&writer);
+    if (count == 0) {
+        return true;
+    }
+    if (!json_writer_finish(&writer)) {
+        ESP_LOGE(TAG, "Error: json_writer_finish");
+        return false;
+    }
+    gateway_batches++;
+    ESP_LOGI(TAG, "Publish %d sensors", count);
+    return mqtt_publish(gateway_topic, gateway_buffer);
+}
+
+static void gateway_task(void* arg)
+{
+    while (!ble_central_is_ready()) {
+        vTaskDelay(GATEWAY_POLL_MS / portTICK_PERIOD_MS);
+    }
+    TickType_t published = xTaskGetTickCount();
+    while(true) {
+        vTaskDelay(GATEWAY_POLL_MS / portTICK_PERIOD_MS);
+        gateway_schedule();
+        if (xTaskGetTickCount() - published >= GATEWAY_PUBLISH_MS / portTICK_PERIOD_MS) {
+            published = xTaskGetTickCount();
+            if (!gateway_publish()) {
+                ESP_LOGE(TAG, "Error: gateway_publish");
+            }
+        }
+    }
+}
+
+bool gateway_get_json(cJSON *root)
+{
+    cJSON *gateway = cJSON_CreateObject();
+    if (!gateway || !cJSON_AddItemToObject(root, "gateway", gateway)) {
+        cJSON_Delete(gateway);
+        ESP_LOGE(TAG, "Error: cJSON_AddItemToObject");
+        return false;
+    }
+    int sensors = 0;
+    gateway_take_lock();
+    for (int i = 0; i < PEERS_MAX; i++) {
+        sensors += gateway_peers.sensors[i].used;
+    }
+    peers_stats_t stats = gateway_peers.stats;
+    gateway_give_lock();
+
+    cJSON_AddNumberToObject(gateway, "sensors", sensors);
+    cJSON_AddNumberToObject(gateway, "batches", gateway_batches);
+    cJSON_AddNumberToObject(gateway, "adverts", stats.adverts);
+    cJSON_AddNumberToObject(gateway, "reads", stats.reads);
+    cJSON_AddNumberToObject(gateway, "read_failures", stats.read_failures);
+    cJSON_AddNumberToObject(gateway, "dropped", stats.dropped);
+    cJSON_AddNumberToObject(gateway, "expired", stats.expired);
+    cJSON_AddNumberToObject(gateway, "latency_max_ms", stats.latency_max_ms);
+    return true;
+}
+
+bool gateway_init(const char *topic)
+{
+    ESP_LOGI(TAG, "Initialise");
+    gateway_topic = topic;
+
+    const peers_config_t config = {
+        .scan_interval_ms = GATEWAY_SCAN_INTERVAL_MS,
+        .read_interval_ms = GATEWAY_READ_INTERVAL_MS,
+        .timeout_ms = GATEWAY_TIMEOUT_MS,
+        .max_connections = BLE_CENTRAL_MAX_CONNECTIONS,
+    };
+    peers_init(&gateway_peers, &config);
+
+    gateway_lock = xSemaphoreCreateMutex();
+    if (!gateway_lock) {
+        ESP_LOGE(TAG, "Error: xSemaphoreCreateMutex");
+        return false;
+    }
+    ble_central_register(&gateway_callbacks);
+    if (xTaskCreate(gateway_task, "gateway_task", 4096, NULL, 5, NULL) != pdTRUE){
+        ESP_LOGE(TAG, "Error: xTaskCreate");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,19 @@
+/*
+ * gateway.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _GATEWAY_H_
+#define _GATEWAY_H_
+
+#include <stdbool.h>
+#include <cJSON.h>
+
+// Bridges the BLE sensors around the thing to MQTT, see utilities/peers.h. Readings are
+// published in batches to topic, one document for all sensors updated since the last one:
+// {"sensors":{"<addr>":{"rssi":-70,"age_ms":800,"temperature":21.5,"humidity":40,"battery":90}}}
+bool gateway_get_json(cJSON *root);
+bool gateway_init(const char *topic);
+
+#endif /* _GATEWAY_H_ */
@@ -0,0 +1,728 @@
+/*
+ * history.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "app/history.h"
+#include "app/types/type.h"
+#include <cJSON.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "drivers/storage.h"
+#include "middlewares/mqtt.h"
+#include "utilities/json_reader.h"
+#include "utilities/json_writer.h"
+#include "utilities/dirty.h"
+#include "utilities/timeseries.h"
+
+#define HISTORY_PARTITION_LABEL         "history"
+#define HISTORY_PARTITION_SUBTYPE       0x40
+#define HISTORY_SECTOR_SIZE             4096
+#define HISTORY_MAGIC                   0x32534948 // "HIS2", the header has the time offset
+#define HISTORY_UNSYNCED                0xFFFFFFFF // Erased, the time offset isn't known yet
+#define HISTORY_SYNCED_TS               1767225600 // 2026-01-01, SNTP has synced once the time is past it
+#define HISTORY_SAMPLE_MS               1000
+#define HISTORY_UPLOAD_MS               (60 * 1000) // Connected, records are uploaded at least this often
+#define HISTORY_STORAGE_KEY_CURSOR      "hist_cursor"
+#define HISTORY_FIELD_NAME_MAX_SIZE     24
+#define HISTORY_SNAPSHOT_SIZE           512
+#define HISTORY_SNAPSHOT_MAX_TOKENS     64
+#define HISTORY_RECORD_JSON_MAX_LEN     (32 + TIMESERIES_MAX_FIELDS * 24)
+#define HISTORY_FNV_OFFSET_BASIS        2166136261UL
+#define HISTORY_FNV_PRIME               16777619UL
+#define HISTORY_SNTP_SERVER             "pool.ntp.org"
+
+_Static_assert(TYPE_MAX_ENDPOINTS <= TIMESERIES_MAX_ENDPOINTS, "History records up to 8 endpoints");
+
+// First bytes of every sector. The sequence orders the sectors of the ring, the layout
+// tells which fields the records hold, so a type change starts a new sector.
+// Records taken before SNTP has synced are stamped with the uptime, in sectors of their
+// own. Their time offset is left erased and written once the time is known, flash bits
+// only ever go from 1 to 0 so that needs no erase.
+typedef struct history_header_t {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t layout;
+    uint32_t base_ts;
+    uint32_t time_offset;   // Added to the ts of the sector's records for Unix time
+} history_header_t;
+
+// Position in the log, sector by sequence so it survives the ring wrapping
+typedef struct history_cursor_t {
+    uint32_t sequence;
+    uint32_t offset;
+} history_cursor_t;
+
+typedef bool (*history_record_cb_t)(const timeseries_record_t *record, history_cursor_t next, void *context);
+
+typedef struct history_batch_t {
+    json_writer_t writer;
+    uint32_t since;
+    int count;
+    bool full;
+    history_cursor_t next;
+} history_batch_t;
+
+typedef struct history_stats_t {
+    uint32_t records;
+    uint32_t rotations;
+    uint32_t uploaded;
+    uint32_t batches;
+    uint32_t overwritten;   // Sectors erased before their records were uploaded
+    uint32_t write_errors;
+} history_stats_t;
+
+static const char *TAG = "HISTORY";
+
+// Only used by history_task() after history_init()
+static const esp_partition_t *history_partition = NULL;
+static int history_sectors = 0;
+static int history_sector = 0;
+static uint32_t history_sequence = 0;
+static uint32_t history_sector_layout = 0;
+static uint32_t history_offset = 0;
+static timeseries_state_t history_state;
+static history_cursor_t history_cursor;
+static bool history_synced = false;
+static uint32_t history_unsynced_sequence = 0;  // First sector of this boot stamped with the uptime, 0 if none
+
+static int history_field_count = 0;
+static char history_field_names[TIMESERIES_MAX_FIELDS][HISTORY_FIELD_NAME_MAX_SIZE];
+static uint32_t history_layout = 0;
+static timeseries_record_t history_last[TYPE_MAX_ENDPOINTS];
+static bool history_has_last[TYPE_MAX_ENDPOINTS];
+
+static char history_snapshot[HISTORY_SNAPSHOT_SIZE];
+static json_token_t history_snapshot_tokens[HISTORY_SNAPSHOT_MAX_TOKENS];
+static char history_buffer[MQTT_PAYLOAD_MAX_LEN + 1];
+static const char *history_topic = NULL;
+static history_stats_t history_stats;
+
+// Set from other tasks
+static bool history_connected = false;
+static bool history_upload_requested = false;
+static bool history_query_requested = false;
+static uint32_t history_query_since = 0;
+
+static void history_task(void* arg);
+static uint32_t history_now(void);
+static bool history_is_time_set(void);
+static uint32_t history_uptime_s(void);
+static bool history_rebase(void);
+static void history_check_sync(void);
+static bool history_get_fields(int endpoint, timeseries_record_t *record, bool get_names);
+static uint32_t history_hash_layout(void);
+static bool history_read_header(int sector, history_header_t *header);
+static bool history_start_sector(int sector, uint32_t sequence, uint32_t base_ts);
+static int history_find_sector(uint32_t sequence, history_header_t *header);
+static uint32_t history_oldest_sequence(void);
+static bool history_rotate(uint32_t base_ts);
+static uint32_t history_replay(int sector, const history_header_t *header, uint32_t from_offset,
+                               history_record_cb_t callback, void *context, timeseries_state_t *state, bool *stopped);
+static bool history_walk(history_cursor_t from, history_record_cb_t callback, void *context);
+static bool history_mount(void);
+static bool history_append(const timeseries_record_t *record);
+static void history_sample(void);
+static bool history_add_record(const timeseries_record_t *record, history_cursor_t next, void *context);
+static void history_batch_begin(history_batch_t *batch, uint32_t since);
+static bool history_batch_publish(history_batch_t *batch, bool is_query, bool more);
+static bool history_upload(bool *more);
+static bool history_answer_query(uint32_t since);
+static bool history_load_cursor(void);
+static bool history_save_cursor(void);
+
+
+static uint32_t history_now(void)
+{
+    return history_synced ? (uint32_t)time(NULL) : history_uptime_s();
+}
+
+static bool history_is_time_set(void)
+{
+    // Also set after a reset that kept the RTC running
+    return time(NULL) >= HISTORY_SYNCED_TS;
+}
+
+static uint32_t history_uptime_s(void)
+{
+    return esp_timer_get_time() / 1000000;
+}
+
+static bool history_rebase(void)
+{
+    // Unix time minus the uptime is the same for every record of this boot
+    uint32_t time_offset = (uint32_t)time(NULL) - history_uptime_s();
+    for (uint32_t sequence = history_unsynced_sequence; (int32_t)(history_sequence - sequence) >= 0; sequence++) {
+        history_header_t header;
+        int sector = history_find_sector(sequence, &header);
+        // Already overwritten by the ring
+        if (sector < 0 || header.time_offset != HISTORY_UNSYNCED) {
+            continue;
+        }
+        if (esp_partition_write(history_partition, sector * HISTORY_SECTOR_SIZE + offsetof(history_header_t, time_offset),
+                                &time_offset, sizeof(time_offset)) != ESP_OK) {
+            ESP_LOGE(TAG, "Error: esp_partition_write");
+            return false;
+        }
+    }
+    history_unsynced_sequence = 0;
+    // The records from here on are stamped with Unix time, which a sector can't mix
+    return history_rotate(history_now());
+}
+
+static void history_check_sync(void)
+{
+    if (history_synced || !history_is_time_set()) {
+        return;
+    }
+    history_synced = true;
+    ESP_LOGI(TAG, "Time synced, rebase the records since boot");
+    if (history_unsynced_sequence != 0 && !history_rebase()) {
+        ESP_LOGE(TAG, "Error: history_rebase");
+    }
+}
+
+static bool history_get_fields(int endpoint, timeseries_record_t *record, bool get_names)
+{
+    // The numeric fields in the order the type writes them, readwrite first
+    json_writer_t writer;
+    json_writer_init(&writer, history_snapshot, sizeof(history_snapshot));
+    json_writer_object_begin(&writer, NULL);
+    json_writer_object_begin(&writer, "readwrite");
+    if (!type_get_readwrite_writer(endpoint, &writer)) {
+        ESP_LOGE(TAG, "Error: type_get_readwrite_writer");
+        return false;
+    }
+    json_writer_object_end(&writer);
+    json_writer_object_begin(&writer, "read");
+    if (!type_get_read_writer(endpoint, &writer)) {
+        ESP_LOGE(TAG, "Error: type_get_read_writer");
+        return false;
+    }
+    json_writer_object_end(&writer);
+    json_writer_object_end(&writer);
+
+    json_reader_t reader;
+    if (!json_writer_finish(&writer) ||
+        !json_reader_parse(&reader, history_snapshot_tokens, HISTORY_SNAPSHOT_MAX_TOKENS, history_snapshot, writer.len)) {
+        ESP_LOGE(TAG, "Error: Snapshot of endpoint %d", endpoint);
+        return false;
+    }
+
+    record->endpoint = endpoint;
+    record->count = 0;
+    const char *objects[] = {"readwrite", "read"};
+    for (int i = 0; i < 2; i++) {
+        int object = json_reader_find(&reader, 0, objects[i]);
+        if (object < 0) {
+            continue;
+        }
+        // Type properties are flat, so keys and values alternate
+        int token = object + 1;
+        for (int field = 0; field < reader.tokens[object].size; field++, token += 2) {
+            bool flag;
+            double number;
+            float value;
+            if (json_reader_get_bool(&reader, token + 1, &flag)) {
+                value = flag;
+            } else if (json_reader_get_number(&reader, token + 1, &number)) {
+                value = (float)number;
+            } else {
+                continue;
+            }
+            if (record->count == TIMESERIES_MAX_FIELDS) {
+                break;
+            }
+            if (get_names) {
+                json_reader_get_string(&reader, token, history_field_names[record->count], HISTORY_FIELD_NAME_MAX_SIZE);
+            }
+            record->values[record->count++] = value;
+        }
+    }
+    return true;
+}
+
+static uint32_t history_hash_layout(void)
+{
+    // FNV-1a over the field names
+    uint32_t hash = HISTORY_FNV_OFFSET_BASIS;
+    for (int i = 0; i < history_field_count; i++) {
+        for (const char *c = history_field_names[i]; ; c++) {
+            hash ^= (uint8_t)*c;
+            hash *= HISTORY_FNV_PRIME;
+            if (!*c) {
+                break;
+            }
+        }
+    }
+    return hash;
+}
+
+static bool history_read_header(int sector, history_header_t *header)
+{
+    if (esp_partition_read(history_partition, sector * HISTORY_SECTOR_SIZE, header, sizeof(history_header_t)) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: esp_partition_read");
+        return false;
+    }
+    return header->magic == HISTORY_MAGIC;
+}
+
+static bool history_start_sector(int sector, uint32_t sequence, uint32_t base_ts)
+{
+    history_header_t header = {
+        .magic = HISTORY_MAGIC,
+        .sequence = sequence,
+        .layout = history_layout,
+        .base_ts = base_ts,
+        .time_offset = history_synced ? 0 : HISTORY_UNSYNCED,
+    };
+    if (esp_partition_erase_range(history_partition, sector * HISTORY_SECTOR_SIZE, HISTORY_SECTOR_SIZE) != ESP_OK ||
+        esp_partition_write(history_partition, sector * HISTORY_SECTOR_SIZE, &header, sizeof(header)) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: Start sector %d", sector);
+        return false;
+    }
+    history_sector = sector;
+    history_sequence = sequence;
+    history_sector_layout = history_layout;
+    history_offset = sizeof(history_header_t);
+    timeseries_reset(&history_state, base_ts);
+    if (!history_synced && history_unsynced_sequence == 0) {
+        history_unsynced_sequence = sequence;
+    }
+    return true;
+}
+
+static int history_find_sector(uint32_t sequence, history_header_t *header)
+{
+    // Sectors are used in ring order, so the sequence alone gives the sector
+    uint32_t age = history_sequence - sequence;
+    if (age >= (uint32_t)history_sectors) {
+        return -1;
+    }
+    int sector = (history_sector - (int)age + history_sectors) % history_sectors;
+    if (!history_read_header(sector, header) || header->sequence != sequence) {
+        return -1;
+    }
+    return sector;
+}
+
+static uint32_t history_oldest_sequence(void)
+{
+    history_header_t header;
+    uint32_t sequence = history_sequence >= (uint32_t)history_sectors ? history_sequence - history_sectors + 1 : 1;
+    while (sequence != history_sequence && history_find_sector(sequence, &header) < 0) {
+        sequence++;
+    }
+    return sequence;
+}
+
+static uint32_t history_replay(int sector, const history_header_t *header, uint32_t from_offset,
+                               history_record_cb_t callback, void *context, timeseries_state_t *state, bool *stopped)
+{
+    // Decodes from the start of the sector, the deltas need every record before from_offset.
+    // Returns the offset after the last record, where the next one is written.
+    timeseries_reset(state, header->base_ts);
+    uint8_t data[TIMESERIES_RECORD_MAX_SIZE];
+    uint32_t offset = sizeof(history_header_t);
+    while (offset < HISTORY_SECTOR_SIZE) {
+        size_t size = HISTORY_SECTOR_SIZE - offset < sizeof(data) ? HISTORY_SECTOR_SIZE - offset : sizeof(data);
+        if (esp_partition_read(history_partition, sector * HISTORY_SECTOR_SIZE + offset, data, size) != ESP_OK) {
+            ESP_LOGE(TAG, "Error: esp_partition_read");
+            break;
+        }
+        timeseries_record_t record;
+        size_t used = timeseries_decode(state, data, size, &record);
+        if (used == 0) {
+            break;
+        }
+        offset += used;
+        if (offset > from_offset && callback) {
+            record.ts += header->time_offset;
+            history_cursor_t next = { .sequence = header->sequence, .offset = offset };
+            if (!callback(&record, next, context)) {
+                *stopped = true;
+                break;
+            }
+        }
+    }
+    return offset;
+}
+
+static bool history_rotate(uint32_t base_ts)
+{
+    // The ring moves on one sector at a time, which spreads the erases evenly
+    int sector = (history_sector + 1) % history_sectors;
+    uint32_t sequence = history_sequence + 1;
+    uint32_t oldest = sequence - history_sectors;
+    if (sequence > (uint32_t)history_sectors && (int32_t)(oldest - history_cursor.sequence) >= 0) {
+        history_stats.overwritten++;
+    }
+    history_stats.rotations++;
+    return history_start_sector(sector, sequence, base_ts);
+}
+
+static bool history_walk(history_cursor_t from, history_record_cb_t callback, void *context)
+{
+    // Calls callback for every record after the cursor, oldest first.
+    // Returns false if the callback stopped the walk.
+    uint32_t oldest = history_oldest_sequence();
+    if ((int32_t)(from.sequence - oldest) < 0) {
+        from = (history_cursor_t) { .sequence = oldest, .offset = 0 };
+    }
+    timeseries_state_t state;
+    for (uint32_t sequence = from.sequence; (int32_t)(history_sequence - sequence) >= 0; sequence++) {
+        history_header_t header;
+        int sector = history_find_sector(sequence, &header);
+        // Records of another layout can't be named, and records stamped with the uptime can't be
+        // placed in time until this boot's are rebased. A boot that never synced keeps them so.
+        if (sector < 0 || header.layout != history_layout || header.time_offset == HISTORY_UNSYNCED) {
+            continue;
+        }
+        bool stopped = false;
+        uint32_t from_offset = sequence == from.sequence ? from.offset : 0;
+        history_replay(sector, &header, from_offset, callback, context, &state, &stopped);
+        if (stopped) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool history_mount(void)
+{
+    // The newest sector is the one with the highest sequence, erased sectors have none
+    int newest = -1;
+    history_header_t header;
+    history_header_t newest_header = {0};
+    for (int sector = 0; sector < history_sectors; sector++) {
+        if (history_read_header(sector, &header) &&
+            (newest < 0 || (int32_t)(header.sequence - newest_header.sequence) > 0)) {
+            newest = sector;
+            newest_header = header;
+        }
+    }
+    if (newest < 0) {
+        ESP_LOGI(TAG, "Empty, start sector 0");
+        return history_start_sector(0, 1, history_now());
+    }
+
+    history_sector = newest;
+    history_sequence = newest_header.sequence;
+    history_sector_layout = newest_header.layout;
+    bool stopped = false;
+    history_offset = history_replay(newest, &newest_header, 0, NULL, NULL, &history_state, &stopped);
+
+    // A record cut short by a reset can't be written over, so that starts a new sector too.
+    // So does a sector stamped with another clock, only Unix time carries over a reset.
+    uint8_t next = 0xFF;
+    if (history_offset < HISTORY_SECTOR_SIZE &&
+        esp_partition_read(history_partition, newest * HISTORY_SECTOR_SIZE + history_offset, &next, 1) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: esp_partition_read");
+        return false;
+    }
+    ESP_LOGI(TAG, "Mounted sector %d, sequence %"PRIu32", offset %"PRIu32, newest, history_sequence, history_offset);
+    if (history_sector_layout != history_layout || next != 0xFF || !history_synced || newest_header.time_offset != 0) {
+        return history_rotate(history_now());
+    }
+    return true;
+}
+
+static bool history_append(const timeseries_record_t *record)
+{
+    uint8_t data[TIMESERIES_RECORD_MAX_SIZE];
+    size_t size = timeseries_encode(&history_state, record, data, HISTORY_SECTOR_SIZE - history_offset < sizeof(data) ?
+                                    HISTORY_SECTOR_SIZE - history_offset : sizeof(data));
+    if (size == 0) {
+        if (!history_rotate(record->ts)) {
+            return false;
+        }
+        size = timeseries_encode(&history_state, record, data, sizeof(data));
+        if (size == 0) {
+            ESP_LOGE(TAG, "Error: timeseries_encode");
+            return false;
+        }
+    }
+    if (esp_partition_write(history_partition, history_sector * HISTORY_SECTOR_SIZE + history_offset, data, size) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: esp_partition_write");
+        // The state has moved on, so a new sector keeps the deltas decodable
+        history_stats.write_errors++;
+        history_rotate(record->ts);
+        return false;
+    }
+    history_offset += size;
+    history_stats.records++;
+    return true;
+}
+
+static void history_sample(void)
+{
+    // One record per endpoint whose fields changed since its last record
+    uint32_t now = history_now();
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        timeseries_record_t record;
+        if (!history_get_fields(endpoint, &record, false)) {
+            continue;
+        }
+        record.ts = now;
+        if (history_has_last[endpoint] && record.count == history_last[endpoint].count &&
+            memcmp(record.values, history_last[endpoint].values, record.count * sizeof(float)) == 0) {
+            continue;
+        }
+        if (!history_append(&record)) {
+            ESP_LOGE(TAG, "Error: history_append");
+            continue;
+        }
+        history_last[endpoint] = record;
+        history_has_last[endpoint] = true;
+    }
+}
+
+static bool history_add_record(const timeseries_record_t *record, history_cursor_t next, void *context)
+{
+    history_batch_t *batch = context;
+    if (record->ts < batch->since) {
+        return true;
+    }
+    // Stops while the record still fits, so the writer never runs out mid document
+    if (batch->writer.len + HISTORY_RECORD_JSON_MAX_LEN >= batch->writer.size) {
+        batch->full = true;
+        return false;
+    }
+    json_writer_array_begin(&batch->writer, NULL);
+    json_writer_int(&batch->writer, NULL, record->ts);
+    json_writer_int(&batch->writer, NULL, record->endpoint);
+    for (int i = 0; i < record->count; i++) {
+        json_writer_number(&batch->writer, NULL, round((double)record->values[i] * TIMESERIES_SCALE) / TIMESERIES_SCALE);
+    }
+    json_writer_array_end(&batch->writer);
+    batch->count++;
+    batch->next = next;
+    return true;
+}
+
+static void history_batch_begin(history_batch_t *batch, uint32_t since)
+{
+    memset(batch, 0, sizeof(history_batch_t));
+    batch->since = since;
+    json_writer_init(&batch->writer, history_buffer, sizeof(history_buffer));
+    json_writer_object_begin(&batch->writer, NULL);
+    json_writer_array_begin(&batch->writer, "fields");
+    for (int i = 0; i < history_field_count; i++) {
+        json_writer_string(&batch->writer, NULL, history_field_names[i]);
+    }
+    json_writer_array_end(&batch->writer);
+    json_writer_array_begin(&batch->writer, "records");
+}
+
+static bool history_batch_publish(history_batch_t *batch, bool is_query, bool more)
+{
+    json_writer_array_end(&batch->writer);
+    if (is_query) {
+        json_writer_bool(&batch->writer, "query", true);
+        json_writer_bool(&batch->writer, "more", more);
+    }
+    json_writer_object_end(&batch->writer);
+    if (!json_writer_finish(&batch->writer)) {
+        ESP_LOGE(TAG, "Error: json_writer_finish");
+        return false;
+    }
+    if (!mqtt_publish(history_topic, history_buffer)) {
+        ESP_LOGE(TAG, "Error: mqtt_publish");
+        return false;
+    }
+    history_stats.batches++;
+    return true;
+}
+
+static bool history_upload(bool *more)
+{
+    // One batch of the records after the cursor, the cursor only moves once it is published
+    history_batch_t batch;
+    history_batch_begin(&batch, 0);
+    bool done = history_walk(history_cursor, history_add_record, &batch);
+    *more = !done;
+    if (batch.count == 0) {
+        if (done) {
+            // Everything left was of another layout
+            history_cursor = (history_cursor_t) { .sequence = history_sequence, .offset = history_offset };
+        }
+        return true;
+    }
+    if (!history_batch_publish(&batch, false, false)) {
+        *more = false;
+        return false;
+    }
+    ESP_LOGI(TAG, "Uploaded %d records", batch.count);
+    history_stats.uploaded += batch.count;
+    history_cursor = done ? (history_cursor_t) { .sequence = history_sequence, .offset = history_offset } : batch.next;
+    return history_save_cursor();
+}
+
+static bool history_answer_query(uint32_t since)
+{
+    // Answered from the oldest record on, a longer range is asked for again from the last ts received
+    history_batch_t batch;
+    history_batch_begin(&batch, since);
+    bool done = history_walk((history_cursor_t) {0}, history_add_record, &batch);
+    ESP_LOGI(TAG, "Query since %"PRIu32": %d records", since, batch.count);
+    return history_batch_publish(&batch, true, !done);
+}
+
+static bool history_load_cursor(void)
+{
+    history_cursor_t cursor;
+    if (!storage_get_blob(HISTORY_STORAGE_KEY_CURSOR, (char *)&cursor, sizeof(cursor))) {
+        return false;
+    }
+    history_cursor = cursor;
+    return true;
+}
+
+static bool history_save_cursor(void)
+{
+    if (!storage_set_blob(HISTORY_STORAGE_KEY_CURSOR, (const char *)&history_cursor, sizeof(history_cursor))) {
+        ESP_LOGE(TAG, "Error: storage_set_blob");
+        return false;
+    }
+    return true;
+}
+
+static void history_task(void* arg)
+{
+    uint32_t generation = dirty_get_generation(DIRTY_TYPE);
+    TickType_t uploaded = xTaskGetTickCount();
+    // The fields are sampled once at start, so the log begins with the current state
+    history_sample();
+    while(true) {
+        vTaskDelay(HISTORY_SAMPLE_MS / portTICK_PERIOD_MS);
+        history_check_sync();
+        if (dirty_get_generation(DIRTY_TYPE) != generation) {
+            generation = dirty_get_generation(DIRTY_TYPE);
+            history_sample();
+        }
+        if (history_query_requested) {
+            history_query_requested = false;
+            if (!history_answer_query(history_query_since)) {
+                ESP_LOGE(TAG, "Error: history_answer_query");
+            }
+        }
+        // Records since boot go out once they are rebased, in order with the rest
+        if (!history_connected || !history_synced) {
+            continue;
+        }
+        if (history_upload_requested || xTaskGetTickCount() - uploaded >= HISTORY_UPLOAD_MS / portTICK_PERIOD_MS) {
+            history_upload_requested = false;
+            uploaded = xTaskGetTickCount();
+            // After an outage the backlog goes out batch by batch, one per sample period
+            bool more = false;
+            if (!history_upload(&more)) {
+                ESP_LOGE(TAG, "Error: history_upload");
+            }
+            history_upload_requested = more;
+        }
+    }
+}
+
+void history_set_connected(bool is_connected)
+{
+    if (is_connected && !history_connected) {
+        history_upload_requested = true;
+    }
+    history_connected = is_connected;
+}
+
+bool history_query(const char *data, int data_len)
+{
+    json_token_t tokens[4];
+    json_reader_t reader;
+    double since = 0;
+    if (!json_reader_parse(&reader, tokens, sizeof(tokens) / sizeof(tokens[0]), data, data_len) ||
+        !json_reader_get_number(&reader, json_reader_find(&reader, 0, "since"), &since) || since < 0) {
+        ESP_LOGE(TAG, "Error: No since");
+        return false;
+    }
+    // Answered by the history task, which owns the partition
+    history_query_since = (uint32_t)since;
+    history_query_requested = true;
+    return true;
+}
+
+bool history_get_json(cJSON *root)
+{
+    cJSON *history = cJSON_CreateObject();
+    if (!history || !cJSON_AddItemToObject(root, "history", history)) {
+        cJSON_Delete(history);
+        ESP_LOGE(TAG, "Error: cJSON_AddItemToObject");
+        return false;
+    }
+    cJSON_AddNumberToObject(history, "sectors", history_sectors);
+    cJSON_AddNumberToObject(history, "sequence", history_sequence);
+    cJSON_AddNumberToObject(history, "offset", history_offset);
+    cJSON_AddNumberToObject(history, "pending_sectors", history_sequence - history_cursor.sequence);
+    cJSON_AddNumberToObject(history, "records", history_stats.records);
+    cJSON_AddNumberToObject(history, "rotations", history_stats.rotations);
+    cJSON_AddNumberToObject(history, "uploaded", history_stats.uploaded);
+    cJSON_AddNumberToObject(history, "batches", history_stats.batches);
+    cJSON_AddNumberToObject(history, "overwritten", history_stats.overwritten);
+    cJSON_AddNumberToObject(history, "write_errors", history_stats.write_errors);
+    cJSON_AddBoolToObject(history, "synced", history_synced);
+    return true;
+}
+
+bool history_init(const char *topic)
+{
+    ESP_LOGI(TAG, "Initialise");
+    history_topic = topic;
+
+    history_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, HISTORY_PARTITION_SUBTYPE, HISTORY_PARTITION_LABEL);
+    if (!history_partition) {
+        ESP_LOGE(TAG, "Error: No %s partition", HISTORY_PARTITION_LABEL);
+        return false;
+    }
+    history_sectors = history_partition->size / HISTORY_SECTOR_SIZE;
+    if (history_sectors < 2) {
+        ESP_LOGE(TAG, "Error: The %s partition needs at least 2 sectors", HISTORY_PARTITION_LABEL);
+        return false;
+    }
+
+    // The type's field names, all endpoints share them
+    timeseries_record_t record;
+    if (!history_get_fields(0, &record, true)) {
+        ESP_LOGE(TAG, "Error: history_get_fields");
+        return false;
+    }
+    history_field_count = record.count;
+    history_layout = history_hash_layout();
+
+    if (!history_load_cursor()) {
+        ESP_LOGI(TAG, "No upload cursor, upload from the oldest record");
+    }
+    history_synced = history_is_time_set();
+    history_unsynced_sequence = 0;
+    if (!history_mount()) {
+        ESP_LOGE(TAG, "Error: history_mount");
+        return false;
+    }
+
+    // Unix time for the records, history_task() rebases the ones since boot once it has synced
+    sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    sntp_setservername(0, HISTORY_SNTP_SERVER);
+    sntp_init();
+
+    if (xTaskCreate(history_task, "history_task", 4096, NULL, 5, NULL) != pdTRUE){
+        ESP_LOGE(TAG, "Error: xTaskCreate");
+        return false;
+    }
+    return true;
+}
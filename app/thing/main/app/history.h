@@ -0,0 +1,26 @@
+/*
+ * history.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <stdbool.h>
+#include <cJSON.h>
+
+// Time-series log of the type's numeric fields in the "history" flash partition, one
+// delta encoded record per endpoint and change (see utilities/timeseries.h). The partition
+// is a ring of sectors, the oldest is erased when the newest fills up.
+// Records not yet uploaded are published to topic in batches once connected, as
+// {"fields":["status"],"records":[[<ts>,<endpoint>,<value>...]]}. A query
+// {"since":<ts>} is answered the same way, with "query" and "more" set.
+// Timestamps are Unix time. Records taken before SNTP has synced are uploaded once it has,
+// a boot that never synced leaves records that can't be placed in time and are dropped.
+void history_set_connected(bool is_connected);
+bool history_query(const char *data, int data_len);
+bool history_get_json(cJSON *root);
+bool history_init(const char *topic);
+
+#endif /* _HISTORY_H_ */
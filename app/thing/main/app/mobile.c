@@ -11,12 +11,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
+#include "utilities/dirty.h"
+#include "utilities/seqlock.h"
 
 
 static const char *TAG = "MOBILE";
 
-static SemaphoreHandle_t mobile_value_lock = NULL;
+static seqlock_t mobile_value_lock;
 
 
 static mobile_value_t mobile_value_g = {
@@ -31,43 +32,27 @@ static mobile_value_t mobile_value_g = {
 
 static bool mobile_get_struct(mobile_value_t *mobile_value);
 static bool mobile_set_struct(mobile_value_t mobile_value);
-static bool mobile_take_lock(void);
-static void mobile_give_lock(void);
 
 
-static bool mobile_take_lock(void)
-{
-    if (!(xSemaphoreTake(mobile_value_lock, 0) == pdTRUE)){
-        ESP_LOGE(TAG, "Error: xSemaphoreTake");
-        return false;
-    }
-    return true;
-}
-
-static void mobile_give_lock(void)
-{
-    xSemaphoreGive(mobile_value_lock);
-}
-
 static bool mobile_get_struct(mobile_value_t *mobile_value) 
 {    
-    if(!mobile_take_lock()) {
-        ESP_LOGE(TAG, "Error: mobile_take_lock");
+    if (!seqlock_read(&mobile_value_lock, mobile_value, &mobile_value_g, sizeof(mobile_value_t))) {
+        ESP_LOGE(TAG, "Error: seqlock_read");
         return false;
     }
-    *mobile_value = mobile_value_g; 
-    mobile_give_lock();
     return true;
 }
 
 static bool mobile_set_struct(mobile_value_t mobile_value) 
 {
-    if(!mobile_take_lock()) {
-        ESP_LOGE(TAG, "Error: mobile_take_lock");
+    bool changed = false;
+    if (!seqlock_write(&mobile_value_lock, &mobile_value_g, &mobile_value, sizeof(mobile_value_t), &changed)) {
+        ESP_LOGE(TAG, "Error: seqlock_write");
         return false;
     }
-    mobile_value_g = mobile_value;
-    mobile_give_lock();
+    if (changed) {
+        dirty_mark(DIRTY_MOBILE);
+    }
     return true;
 }
 
@@ -124,13 +109,9 @@ bool mobile_set_value_json(const char* json_str)
         return false;
     }
 
-    // Update the global thing struct thread safely
-    mobile_value_t mobile;
-    if (!mobile_get_struct(&mobile)) {
-        cJSON_Delete(root);
-        ESP_LOGE(TAG, "Error: mobile_get_struct");
-        return false;
-    }
+    // Every field is replaced, so the value is built from scratch rather than from a copy
+    // that a concurrent set could make stale
+    mobile_value_t mobile = {0};
 
     strncpy(mobile.readwrite.network, network->valuestring, MOBILE_STRING_MAX_LEN);
     mobile.readwrite.network[MOBILE_STRING_MAX_LEN - 1] = '\0';
@@ -151,21 +132,52 @@ bool mobile_set_value_json(const char* json_str)
     return true;
 }
 
-bool mobile_get_value_json(cJSON* root)
+bool mobile_set_value_reader(const json_reader_t *reader, int mobile_value)
+{
+    int mobile_value_readwrite = json_reader_find(reader, mobile_value, "readwrite");
+    int mobile_value_read = json_reader_find(reader, mobile_value, "read");
+    if (!json_reader_is_object(reader, mobile_value_readwrite) || !json_reader_is_object(reader, mobile_value_read)) {
+        ESP_LOGE(TAG, "Error: json_reader_is_object mobile_value");
+        return false;
+    }
+
+    // Every field is replaced, so the value is built from scratch rather than from a copy
+    // that a concurrent set could make stale
+    mobile_value_t mobile = {0};
+
+    // Strings are unescaped straight into the struct copy, no intermediate tree
+    if (!json_reader_get_string(reader, json_reader_find(reader, mobile_value_readwrite, "network"),
+                                mobile.readwrite.network, MOBILE_STRING_MAX_LEN) ||
+        !json_reader_get_string(reader, json_reader_find(reader, mobile_value_read, "nickname"),
+                                mobile.read.nickname, MOBILE_STRING_MAX_LEN) ||
+        !json_reader_get_string(reader, json_reader_find(reader, mobile_value_read, "sw_version"),
+                                mobile.read.sw_version, MOBILE_STRING_MAX_LEN)) {
+        ESP_LOGE(TAG, "Error: json_reader_get_string");
+        return false;
+    }
+
+    if (!mobile_set_struct(mobile)) {
+        ESP_LOGE(TAG, "Error: mobile_set_struct");
+        return false;
+    }
+    return true;
+}
+
+bool mobile_get_value_writer(json_writer_t *writer)
 {
     mobile_value_t mobile;
     if (!mobile_get_struct(&mobile)){
-        ESP_LOGE(TAG, "Error: mobile_get_value_json");
+        ESP_LOGE(TAG, "Error: mobile_get_struct");
         return false;
     }
-    
-    cJSON* readwrite = cJSON_CreateObject();
-    cJSON* read = cJSON_CreateObject();
-    cJSON_AddStringToObject(readwrite, "network", "online");
-    cJSON_AddStringToObject(read, "nickname", mobile.read.nickname);
-    cJSON_AddStringToObject(read, "sw_version", mobile.read.sw_version);
-    cJSON_AddItemToObject(root, "readwrite", readwrite);
-    cJSON_AddItemToObject(root, "read", read);
+
+    json_writer_object_begin(writer, "readwrite");
+    json_writer_string(writer, "network", "online");
+    json_writer_object_end(writer);
+    json_writer_object_begin(writer, "read");
+    json_writer_string(writer, "nickname", mobile.read.nickname);
+    json_writer_string(writer, "sw_version", mobile.read.sw_version);
+    json_writer_object_end(writer);
 
     return true;
 }
@@ -173,7 +185,9 @@ bool mobile_get_value_json(cJSON* root)
 bool mobile_init(void)
 {
     ESP_LOGI(TAG, "Initialise");
-    mobile_value_lock = xSemaphoreCreateBinary();
-    mobile_give_lock();
+    if (!seqlock_init(&mobile_value_lock, sizeof(mobile_value_t))) {
+        ESP_LOGE(TAG, "Error: seqlock_init");
+        return false;
+    }
     return true;
 }
\ No newline at end of file
@@ -8,6 +8,9 @@
 #ifndef _MOBILE_H_
 #define _MOBILE_H_
 
+#include "utilities/json_reader.h"
+#include "utilities/json_writer.h"
+
 #define MOBILE_STRING_MAX_LEN 16
 
 typedef struct mobile_readwrite_t
@@ -28,7 +31,8 @@ typedef struct mobile_value_t
 } mobile_value_t;
 
 bool mobile_set_value_json(const char* json_str);
-bool mobile_get_value_json(cJSON* root);
+bool mobile_set_value_reader(const json_reader_t *reader, int mobile_value);
+bool mobile_get_value_writer(json_writer_t *writer);
 bool mobile_init(void);
 
 
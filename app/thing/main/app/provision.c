@@ -82,6 +82,8 @@ static bool provision_set_wifi_creds(void);
 static blob_status_t provision_set_root_ca(void);
 static blob_status_t provision_set_thing_cert(void);
 static blob_status_t provision_set_thing_key(void);
+static bool provision_erase_secrets(void);
+static bool provision_erase_secrets_once(void);
 
 
 const struct ble_gatt_svc_def provision_service[] = {
@@ -281,19 +283,30 @@ static bool provision_set_wifi_creds(void)
         ESP_LOGI(TAG, "Receiving WIFI creds");
         char *ssid = cJSON_GetObjectItemCaseSensitive(root, "ssid")->valuestring;
         char *password = cJSON_GetObjectItemCaseSensitive(root, "password")->valuestring;
+        // Both or neither, so WiFi never tries a new SSID with the old password
+        if (!storage_begin()){
+            cJSON_Delete(root);
+            ESP_LOGE(TAG, "Error: storage_begin");
+            return false;
+        }
         if (!wifi_set_ssid(ssid)){
+            storage_abort();
             cJSON_Delete(root);
             ESP_LOGE(TAG, "Error: wifi_set_ssid");
             return false;
         } 
         if (!wifi_set_pwd(password)){
+            storage_abort();
             cJSON_Delete(root);
             ESP_LOGE(TAG, "Error: wifi_set_pwd");
             return false;
         } 
-        // Setting wifi credentials was successful
         cJSON_Delete(root);
-
+        if (!storage_commit()){
+            ESP_LOGE(TAG, "Error: storage_commit");
+            return false;
+        }
+        // Setting wifi credentials was successful
         return true;
     }
     cJSON_Delete(root);
@@ -484,6 +497,33 @@ static blob_status_t provision_set_thing_key(void)
     return BLOB_FAIL;
 }
 
+static bool provision_erase_secrets_once(void)
+{
+    // All of them even if one fails, so as few as possible are left
+    bool ok = wifi_erase_credentials();
+    ok = auth_aws_provision_erase_root_ca() && ok;
+    ok = auth_aws_provision_erase_thing_cert() && ok;
+    ok = auth_aws_provision_erase_thing_key() && ok;
+    return ok;
+}
+
+static bool provision_erase_secrets(void)
+{
+    // In one commit when a transaction can be opened. Otherwise, or if the commit fails,
+    // one by one: a reset in between leaves some, which the new ones overwrite once received.
+    if (storage_begin()){
+        provision_erase_secrets_once();
+        if (storage_commit()){
+            return true;
+        }
+        ESP_LOGE(TAG, "Error: storage_commit");
+    } else {
+        ESP_LOGE(TAG, "Error: storage_begin");
+    }
+    ESP_LOGW(TAG, "Erasing the secrets without a transaction");
+    return provision_erase_secrets_once();
+}
+
 static bool provision_create_network_message(wifi_ap_record_t ap_record, uint16_t count, char* buffer, size_t size)
 {
     cJSON *message_root = cJSON_CreateObject();
@@ -616,10 +656,9 @@ bool provision_run(void)
                 event_expect(   EVENT_BLE_GAP_DISCONNECTED | 
                                 EVENT_WIFI_SCAN_DONE);
                 // Delete the current secrets
-                wifi_erase_credentials();
-                auth_aws_provision_erase_root_ca();
-                auth_aws_provision_erase_thing_cert();
-                auth_aws_provision_erase_thing_key();
+                if (!provision_erase_secrets()){
+                    ESP_LOGE(TAG, "Error: provision_erase_secrets");
+                }
                 ble_set_allow_connection(true);
                 provision_notify_status(PROV_PROGRESS);
                 // Do a scan of available wifi networks
@@ -9,10 +9,20 @@
 #include "middlewares/mqtt.h"
 #include "middlewares/wifi.h"
 #include "app/mobile.h"
+#include "app/automation.h"
+#include "app/gateway.h"
+#include "app/history.h"
 #include "utilities/auth_aws_provision.h"
 #include "middlewares/ble.h"
 #include "app/ota.h"
 #include "app/types/type.h"
+#include "middlewares/link.h"
+#include "utilities/probe.h"
+#include "utilities/json_reader.h"
+#include "utilities/json_writer.h"
+#include "utilities/dirty.h"
+#include "utilities/version.h"
+#include "esp_timer.h"
 
 #define THING_STORAGE_KEY_TYPE          "thing_type"
 #define THING_STORAGE_KEY_HW_VERSION    "thing_hw"
@@ -23,9 +33,28 @@
 #define MQTT_TOPIC_ACTION_OTAURL        "/otaurl"
 #define MQTT_TOPIC_ACTION_VALUE         "/value"
 #define MQTT_TOPIC_ACTION_BOOTUP        "/bootup"
+#define MQTT_TOPIC_ACTION_ECHO          "/echo"
+#define MQTT_TOPIC_ACTION_LATENCY       "/latency"
+#define MQTT_TOPIC_ACTION_RULES         "/rules"
+#define MQTT_TOPIC_ACTION_GATEWAY       "/gateway"
+#define MQTT_TOPIC_ACTION_HISTORY       "/history"
 
 #define THING_OTA_SCHEDULE_SECONDS      (24 * 60 * 60 * 1000) // 24h
 
+#define THING_VALUE_KEY_VERSION         "version"
+#define THING_VALUE_PENDING_TIMEOUT_MS  10
+
+#define THING_PROBE_INTERVAL_MS         (60 * 1000) // One echo per minute
+#define THING_PROBE_REPORT_INTERVALS    10          // Publish percentiles every 10 echoes
+#define THING_PROBE_PAYLOAD_MAX_LEN     512
+
+#define THING_JSON_MAX_TOKENS           128 // Default value document is ~30 tokens
+
+#define THING_PUBLISH_HEARTBEAT_MS      (CONFIG_RIOTBOX_PUBLISH_HEARTBEAT_S * 1000)
+
+#define THING_ENDPOINTS_KEY             "endpoints"
+#define THING_ENDPOINT_KEY_MAX_SIZE     4
+
 
 static const char *TAG = "THING";
 
@@ -38,12 +67,98 @@ static char thing_mqtt_topic_pub_value[MQTT_TOPIC_MAX_SIZE];
 static char thing_mqtt_topic_sub_value[MQTT_TOPIC_MAX_SIZE];
 static char thing_mqtt_topic_pub_bootup[MQTT_TOPIC_MAX_SIZE];
 static char thing_mqtt_topic_sub_bootup[MQTT_TOPIC_MAX_SIZE];
-
-static char thing_mqtt_data_buffer[MQTT_DATA_MAX_LEN];
+static char thing_mqtt_topic_pub_echo[MQTT_TOPIC_MAX_SIZE];
+static char thing_mqtt_topic_sub_echo[MQTT_TOPIC_MAX_SIZE];
+static char thing_mqtt_topic_pub_latency[MQTT_TOPIC_MAX_SIZE];
+static char thing_mqtt_topic_sub_rules[MQTT_TOPIC_MAX_SIZE];
+static char thing_mqtt_topic_pub_gateway[MQTT_TOPIC_MAX_SIZE];
+static char thing_mqtt_topic_pub_history[MQTT_TOPIC_MAX_SIZE];
+static char thing_mqtt_topic_sub_history[MQTT_TOPIC_MAX_SIZE];
+
+// Only used by thing_probe_task(), so it doesn't need the MQTT data buffer lock
+static char thing_probe_buffer[THING_PROBE_PAYLOAD_MAX_LEN];
+static int64_t thing_bootup_publish_time_us = 0;
+
+// Holds either a received document (otaurl, bootup, value being applied) or the last
+// serialized value document, which is published straight from here
+static char thing_mqtt_data_buffer[MQTT_PAYLOAD_MAX_LEN];
 
 static SemaphoreHandle_t thing_mqtt_data_buffer_lock = NULL;
 
+// The value document in thing_mqtt_data_buffer is reused while the dirty generation is
+// unchanged. Storing a received document invalidates it. Protected by the same lock.
+static uint32_t thing_value_cache_generation = 0;
+static bool thing_value_cache_valid = false;
+static uint32_t thing_value_cache_hits = 0;
+static uint32_t thing_value_cache_misses = 0;
+
+// Tokens of the value in thing_mqtt_data_buffer, protected by the same lock
+static json_token_t thing_json_tokens[THING_JSON_MAX_TOKENS];
+// Tokens of a message in the MQTT task, only used by thing_value_get_version()
+static json_token_t thing_version_tokens[THING_JSON_MAX_TOKENS];
+
+// Latest value command received from the cloud, waiting to be applied by thing_run().
+// A newer command overwrites an older one that has not been applied yet.
+static char thing_value_pending_buffer[MQTT_PAYLOAD_MAX_LEN];
+static bool thing_value_pending = false;
+static bool thing_value_pending_has_version = false;
+static uint32_t thing_value_pending_version = 0;
+// Set when the newest command was older than the device's version, so it is answered
+// with the current value instead of being applied
+static bool thing_value_rejected = false;
+// Version of the command being applied, only taken once thing_set_value() succeeded
+static bool thing_value_loaded_has_version = false;
+static uint32_t thing_value_loaded_version = 0;
+
+static SemaphoreHandle_t thing_value_pending_lock = NULL;
+
+typedef struct thing_value_stats_t {
+    uint32_t received;
+    uint32_t applied;
+    uint32_t collapsed;
+    uint32_t stale;
+} thing_value_stats_t;
+
+static thing_value_stats_t thing_value_stats = {0};
+
+// Why a value document was published. Only CHANGE is skipped when nothing changed,
+// the others answer the cloud or prove the thing is alive.
+typedef enum {
+    THING_PUBLISH_REASON_CONNECT = 0,
+    THING_PUBLISH_REASON_COMMAND,
+    THING_PUBLISH_REASON_CHANGE,
+    THING_PUBLISH_REASON_HEARTBEAT,
+    THING_PUBLISH_REASON_MAX,
+} thing_publish_reason_t;
+
+static const char *thing_publish_reason_names[] = {
+    [THING_PUBLISH_REASON_CONNECT] = "connect",
+    [THING_PUBLISH_REASON_COMMAND] = "command",
+    [THING_PUBLISH_REASON_CHANGE] = "change",
+    [THING_PUBLISH_REASON_HEARTBEAT] = "heartbeat",
+};
+
+// Written by thing_run() only, read by the probe task for the report
+static uint32_t thing_publish_counts[THING_PUBLISH_REASON_MAX] = {0};
+static uint32_t thing_publish_skipped = 0;
+static uint32_t thing_published_generation = 0;
+static bool thing_published_valid = false;
+static int64_t thing_published_time_us = 0;
+
+// Answers a stream of commands once, when it settles, for types with a settle time
+static esp_timer_handle_t thing_settle_timer = NULL;
+static bool thing_settle_due = false;
+
+// Set by the first publish request since the last publish, so a burst of requests from
+// several endpoints results in one event and one publish. Only touched atomically.
+static bool thing_value_publish_requested = false;
+
 static bool thing_set_value(void);
+static bool thing_set_value_reader(const json_reader_t *reader);
+static bool thing_set_value_cjson(void);
+static bool thing_set_endpoints_reader(const json_reader_t *reader, int thing_value);
+static bool thing_set_endpoints_cjson(cJSON *thing_value);
+static bool thing_get_endpoints_writer(json_writer_t *writer);
 static bool thing_get_value(void);
 
 static void thing_mqtt_received_value_cb(const char *data, int data_len);
@@ -62,13 +177,35 @@ static bool thing_create_mqtt_topic_sub_bootup(void);
 
 static bool thing_take_mqtt_buffer_lock(void);
 static void thing_give_mqtt_buffer_lock(void);
+static bool thing_store_mqtt_data(const char *data, int data_len);
+static bool thing_take_value_pending_lock(int timeout_ms);
+static void thing_give_value_pending_lock(void);
+
+static bool thing_value_get_version(const char *data, int data_len, uint32_t *version);
+static bool thing_load_pending_value(void);
+static void thing_commit_value_version(void);
 
 static bool thing_publish_otaurl(void);
-static bool thing_publish_value(void);
+static bool thing_publish_value(thing_publish_reason_t reason);
+static bool thing_heartbeat_is_due(void);
+static bool thing_get_publish_json(cJSON *root);
+static void thing_heartbeat_task(void* arg);
+static void thing_settle_timer_cb(void* arg);
+static bool thing_answer_command(void);
 static bool thing_publish_bootup(void);
 
 
 static void thing_schedule_ota_task(void* arg);
+static void thing_probe_task(void* arg);
+static void thing_mqtt_received_echo_cb(const char *data, int data_len);
+static bool thing_create_mqtt_topic_pub_echo(void);
+static bool thing_create_mqtt_topic_sub_echo(void);
+static bool thing_create_mqtt_topic_pub_latency(void);
+static bool thing_publish_echo(void);
+static bool thing_publish_latency(void);
+static void thing_mqtt_received_rules_cb(const char *data, int data_len);
+static bool thing_create_mqtt_topic_sub_rules(void);
+static bool thing_create_mqtt_topic_pub_gateway(void);
 
 static bool thing_set_has_type(void);
 static bool thing_load_type(void);
@@ -216,6 +353,75 @@ static bool thing_create_mqtt_topic_sub_bootup(void)
     return true;
 }
 
+static bool thing_create_mqtt_topic_pub_echo(void)
+{
+    char thing_id[ID_SIZE];
+    if (!id_get(thing_id)){
+        ESP_LOGE(TAG, "Error: id_get");
+        return false;
+    }
+
+    size_t topic_size = strlen(MQTT_TOPIC_PUB_BASE) + strlen(thing_id) + strlen(MQTT_TOPIC_ACTION_ECHO) + 1;
+    
+    if (topic_size > MQTT_TOPIC_MAX_SIZE) {
+        ESP_LOGE(TAG, "Error: Topic size is too large");
+        return false;
+    }
+
+    int ret = snprintf(thing_mqtt_topic_pub_echo, topic_size, "%s%s%s", MQTT_TOPIC_PUB_BASE, thing_id, MQTT_TOPIC_ACTION_ECHO);
+    if (ret < 0 || ret > topic_size) {
+        ESP_LOGE(TAG, "Error: snprintf");
+        return false;
+    }
+    return true;
+}
+
+static bool thing_create_mqtt_topic_sub_echo(void)
+{
+    char thing_id[ID_SIZE];
+    if (!id_get(thing_id)){
+        ESP_LOGE(TAG, "Error: id_get");
+        return false;
+    }
+
+    size_t topic_size = strlen(MQTT_TOPIC_SUB_BASE) + strlen(thing_id) + strlen(MQTT_TOPIC_ACTION_ECHO) + 1;
+    
+    if (topic_size > MQTT_TOPIC_MAX_SIZE) {
+        ESP_LOGE(TAG, "Error: Topic size is too large");
+        return false;
+    }
+
+    int ret = snprintf(thing_mqtt_topic_sub_echo, topic_size, "%s%s%s", MQTT_TOPIC_SUB_BASE, thing_id, MQTT_TOPIC_ACTION_ECHO);
+    if (ret < 0 || ret > topic_size) {
+        ESP_LOGE(TAG, "Error: snprintf");
+        return false;
+    }
+    return true;
+}
+
+static bool thing_create_mqtt_topic_pub_latency(void)
+{
+    char thing_id[ID_SIZE];
+    if (!id_get(thing_id)){
+        ESP_LOGE(TAG, "Error: id_get");
+        return false;
+    }
+
+    size_t topic_size = strlen(MQTT_TOPIC_PUB_BASE) + strlen(thing_id) + strlen(MQTT_TOPIC_ACTION_LATENCY) + 1;
+    
+    if (topic_size > MQTT_TOPIC_MAX_SIZE) {
+        ESP_LOGE(TAG, "Error: Topic size is too large");
+        return false;
+    }
+
+    int ret = snprintf(thing_mqtt_topic_pub_latency, topic_size, "%s%s%s", MQTT_TOPIC_PUB_BASE, thing_id, MQTT_TOPIC_ACTION_LATENCY);
+    if (ret < 0 || ret > topic_size) {
+        ESP_LOGE(TAG, "Error: snprintf");
+        return false;
+    }
+    return true;
+}
+
 static bool thing_set_otaurl(void)
 {
     if (!ota_set_url(thing_mqtt_data_buffer)){
@@ -228,15 +434,56 @@ static bool thing_set_otaurl(void)
 }
 
 static bool thing_set_value(void)
+{
+    json_reader_t reader;
+    // Parse once without allocating, the cJSON path is kept for documents the reader can't take
+    if (!json_reader_parse(&reader, thing_json_tokens, THING_JSON_MAX_TOKENS,
+                           thing_mqtt_data_buffer, strlen(thing_mqtt_data_buffer))) {
+        ESP_LOGW(TAG, "json_reader_parse failed, fall back to cJSON");
+        return thing_set_value_cjson();
+    }
+    bool success = thing_set_value_reader(&reader);
+    thing_give_mqtt_buffer_lock();
+    return success;
+}
+
+static bool thing_set_value_reader(const json_reader_t *reader)
+{
+    if (!mobile_set_value_reader(reader, json_reader_find(reader, 0, "mobile_value"))){
+        ESP_LOGE(TAG, "Error: mobile_set_value_reader");
+        return false;
+    }
+
+    int thing_value = json_reader_find(reader, 0, "thing_value");
+    if (!json_reader_is_object(reader, thing_value)) {
+        ESP_LOGE(TAG, "Error: json_reader_is_object");
+        return false;
+    }
+
+    if (!type_set_value_reader(0, reader, thing_value)){
+        ESP_LOGE(TAG, "Error: type_set_value_reader");
+        return false;
+    }
+
+    if (!thing_set_endpoints_reader(reader, thing_value)){
+        ESP_LOGE(TAG, "Error: thing_set_endpoints_reader");
+        return false;
+    }
+    return true;
+}
+
+static bool thing_set_value_cjson(void)
 {
     cJSON *value = cJSON_Parse(thing_mqtt_data_buffer);
     
     if(!value) {
+        thing_give_mqtt_buffer_lock();
         ESP_LOGE(TAG, "Error: Value is null");
         return false;
     }
 
     if (!mobile_set_value_json(thing_mqtt_data_buffer)){
+        cJSON_Delete(value);
         thing_give_mqtt_buffer_lock();
         ESP_LOGE(TAG, "Error: mobile_set_value_json");
         return false;
@@ -250,13 +497,20 @@ static bool thing_set_value(void)
         return false;
     }
 
-    if (!type_set_value_json(thing_value)){
+    if (!type_set_value_json(0, thing_value)){
         cJSON_Delete(value);
         thing_give_mqtt_buffer_lock();
         ESP_LOGE(TAG, "Error: type_set_value_json");
         return false;
     }
 
+    if (!thing_set_endpoints_cjson(thing_value)){
+        cJSON_Delete(value);
+        thing_give_mqtt_buffer_lock();
+        ESP_LOGE(TAG, "Error: thing_set_endpoints_cjson");
+        return false;
+    }
+
     // value is not needed anymore, we can delete it to free up memory
     cJSON_Delete(value);
     value = NULL;
@@ -265,115 +519,463 @@ static bool thing_set_value(void)
     return true;
 }
 
+static bool thing_set_endpoints_reader(const json_reader_t *reader, int thing_value)
+{
+    // Endpoint 0 is thing_value itself, the others are optional so a command can target a few
+    int endpoints = json_reader_find(reader, thing_value, THING_ENDPOINTS_KEY);
+    if (endpoints < 0) {
+        return true;
+    }
+    for (int endpoint = 1; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        char key[THING_ENDPOINT_KEY_MAX_SIZE];
+        snprintf(key, sizeof(key), "%d", endpoint);
+        int endpoint_value = json_reader_find(reader, endpoints, key);
+        if (!json_reader_is_object(reader, endpoint_value)) {
+            continue;
+        }
+        if (!type_set_value_reader(endpoint, reader, endpoint_value)){
+            ESP_LOGE(TAG, "Error: type_set_value_reader endpoint %d", endpoint);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool thing_set_endpoints_cjson(cJSON *thing_value)
+{
+    cJSON *endpoints = cJSON_GetObjectItem(thing_value, THING_ENDPOINTS_KEY);
+    if (!endpoints) {
+        return true;
+    }
+    for (int endpoint = 1; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        char key[THING_ENDPOINT_KEY_MAX_SIZE];
+        snprintf(key, sizeof(key), "%d", endpoint);
+        cJSON *endpoint_value = cJSON_GetObjectItem(endpoints, key);
+        if (!cJSON_IsObject(endpoint_value)) {
+            continue;
+        }
+        if (!type_set_value_json(endpoint, endpoint_value)){
+            ESP_LOGE(TAG, "Error: type_set_value_json endpoint %d", endpoint);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool thing_get_endpoints_writer(json_writer_t *writer)
+{
+    if (TYPE_MAX_ENDPOINTS < 2) {
+        return true;
+    }
+    json_writer_object_begin(writer, THING_ENDPOINTS_KEY);
+    for (int endpoint = 1; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        char key[THING_ENDPOINT_KEY_MAX_SIZE];
+        snprintf(key, sizeof(key), "%d", endpoint);
+        json_writer_object_begin(writer, key);
+        json_writer_object_begin(writer, "readwrite");
+        if (!type_get_readwrite_writer(endpoint, writer)){
+            ESP_LOGE(TAG, "Error: type_get_readwrite_writer endpoint %d", endpoint);
+            return false;
+        }
+        json_writer_object_end(writer);
+        json_writer_object_begin(writer, "read");
+        if (!type_get_read_writer(endpoint, writer)){
+            ESP_LOGE(TAG, "Error: type_get_read_writer endpoint %d", endpoint);
+            return false;
+        }
+        json_writer_object_end(writer);
+        json_writer_object_end(writer);
+    }
+    json_writer_object_end(writer);
+    return true;
+}
 
 static bool thing_get_value(void)
 {
-    cJSON *thing_value = cJSON_CreateObject();
-    cJSON *mobile_value = cJSON_CreateObject();
-    cJSON *value = cJSON_CreateObject();
+    int64_t start_us = esp_timer_get_time();
+    // Read before serializing, so a change made meanwhile invalidates this serialization
+    uint32_t generation = dirty_get_generation(DIRTY_ALL);
+    if (thing_value_cache_valid && thing_value_cache_generation == generation) {
+        thing_value_cache_hits++;
+        ESP_LOGI(TAG, "Value cached, reused in %lld us (hits %" PRIu32 ", misses %" PRIu32 ")",
+                 (long long)(esp_timer_get_time() - start_us), thing_value_cache_hits, thing_value_cache_misses);
+        return true;
+    }
+
+    // Overwritten below, so a failed serialization must not be reused
+    thing_value_cache_valid = false;
+    json_writer_t writer;
+    json_writer_init(&writer, thing_mqtt_data_buffer, sizeof(thing_mqtt_data_buffer));
+
+    // {"value":"<escaped value>"} written in one pass, straight into the MQTT buffer
+    json_writer_object_begin(&writer, NULL);
+    json_writer_escaped_begin(&writer, "value");
+    json_writer_object_begin(&writer, NULL);
+
+    json_writer_object_begin(&writer, "thing_value");
+    json_writer_object_begin(&writer, "readwrite");
+    if (!type_get_readwrite_writer(0, &writer)){
+        ESP_LOGE(TAG, "Error: type_get_readwrite_writer");
+        return false;
+    }
+    json_writer_object_end(&writer);
+    json_writer_object_begin(&writer, "read");
+    if (!type_get_read_writer(0, &writer)){
+        ESP_LOGE(TAG, "Error: type_get_read_writer");
+        return false;
+    }
+    json_writer_string(&writer, "hw_version", thing_hw_version);
+    json_writer_string(&writer, "fw_version", PROJECT_VER);
+    if (!link_get_value_writer(&writer)){
+        ESP_LOGE(TAG, "Error: link_get_value_writer");
+        return false;
+    }
+    json_writer_object_end(&writer);
+    // Every endpoint goes out in the same pass and the same publish
+    if (!thing_get_endpoints_writer(&writer)){
+        ESP_LOGE(TAG, "Error: thing_get_endpoints_writer");
+        return false;
+    }
+    json_writer_object_end(&writer);
+
+    json_writer_int(&writer, THING_VALUE_KEY_VERSION, version_get());
+
+    json_writer_object_begin(&writer, "mobile_value");
+    if (!mobile_get_value_writer(&writer)) {
+        ESP_LOGE(TAG, "Error: mobile_get_value_writer");
+        return false;
+    }
+    json_writer_object_end(&writer);
+
+    json_writer_object_end(&writer);
+    json_writer_escaped_end(&writer);
+    json_writer_object_end(&writer);
+
+    if (!json_writer_finish(&writer)) {
+        ESP_LOGE(TAG, "Error: json_writer_finish");
+        return false;
+    }
+    thing_value_cache_generation = generation;
+    thing_value_cache_valid = true;
+    thing_value_cache_misses++;
+    ESP_LOGI(TAG, "Value written in %lld us, %u bytes", (long long)(esp_timer_get_time() - start_us), (unsigned)writer.len);
+    return true;
+}
+
+static void thing_schedule_ota_task(void* arg) 
+{
+    while(true) {
+        vTaskDelay(THING_OTA_SCHEDULE_SECONDS / portTICK_PERIOD_MS);
+        ESP_LOGI(TAG, "thing_mqtt_publish_otaurl_cb triggered!");
+        event_trigger(EVENT_THING_PUBLISH_OTAURL);
+    }
+}
+
+static void thing_probe_task(void* arg)
+{
+    int intervals = 0;
+    while(true) {
+        vTaskDelay(THING_PROBE_INTERVAL_MS / portTICK_PERIOD_MS);
+        thing_publish_echo();
+        if (++intervals >= THING_PROBE_REPORT_INTERVALS) {
+            intervals = 0;
+            thing_publish_latency();
+        }
+    }
+}
+
+static bool thing_publish_echo(void)
+{
+    // The echo rule routes the message straight back, so the timestamp is all the state needed
+    int ret = snprintf(thing_probe_buffer, sizeof(thing_probe_buffer), "{\"t\":%lld}", (long long)(esp_timer_get_time() / 1000));
+    if (ret < 0 || ret >= sizeof(thing_probe_buffer)) {
+        ESP_LOGE(TAG, "Error: snprintf");
+        return false;
+    }
+    return mqtt_publish(thing_mqtt_topic_pub_echo, thing_probe_buffer);
+}
+
+static bool thing_publish_latency(void)
+{
     cJSON *root = cJSON_CreateObject();
+    if (!root) {
+        ESP_LOGE(TAG, "Error: cJSON_CreateObject");
+        return false;
+    }
+    if (!probe_get_json(root) ||
+        !thing_get_publish_json(root) ||
+        !automation_get_json(root) ||
+        !history_get_json(root) ||
+#if CONFIG_RIOTBOX_GATEWAY
+        !gateway_get_json(root) ||
+#endif
+        !cJSON_PrintPreallocated(root, thing_probe_buffer, sizeof(thing_probe_buffer), 0)) {
+        cJSON_Delete(root);
+        ESP_LOGE(TAG, "Error: probe_get_json");
+        return false;
+    }
+    cJSON_Delete(root);
+    return mqtt_publish(thing_mqtt_topic_pub_latency, thing_probe_buffer);
+}
+
+static void thing_mqtt_received_echo_cb(const char *data, int data_len)
+{
+    cJSON *echo = cJSON_ParseWithLength(data, data_len);
+    cJSON *t = cJSON_GetObjectItem(echo, "t");
+    if (cJSON_IsNumber(t)) {
+        int64_t now_ms = esp_timer_get_time() / 1000;
+        probe_record(PROBE_ECHO, (uint32_t)(now_ms - (int64_t)t->valuedouble));
+    } else {
+        ESP_LOGE(TAG, "Error: Echo without timestamp");
+    }
+    cJSON_Delete(echo);
+}
 
-    if (!thing_value || !mobile_value || !value || !root) {
-        ESP_LOGE(TAG, "Error: !thing_value || !mobile_value || !value || !root");
-        goto error;
+static bool thing_create_mqtt_topic_sub_rules(void)
+{
+    char thing_id[ID_SIZE];
+    if (!id_get(thing_id)){
+        ESP_LOGE(TAG, "Error: id_get");
+        return false;
     }
 
-    cJSON *readwrite = cJSON_CreateObject();
-    cJSON *read = cJSON_CreateObject();
-    if (!readwrite || !read || 
-        !cJSON_AddItemToObject(thing_value, "readwrite", readwrite) ||
-        !cJSON_AddItemToObject(thing_value, "read", read)) {
-        ESP_LOGE(TAG, "Error: !readwrite || !read");
-        goto error;
+    size_t topic_size = strlen(MQTT_TOPIC_SUB_BASE) + strlen(thing_id) + strlen(MQTT_TOPIC_ACTION_RULES) + 1;
+    
+    if (topic_size > MQTT_TOPIC_MAX_SIZE) {
+        ESP_LOGE(TAG, "Error: Topic size is too large");
+        return false;
     }
 
-    if (!type_get_value_json(thing_value)){
-        ESP_LOGE(TAG, "Error: type_get_value_json");
-        goto error;
+    int ret = snprintf(thing_mqtt_topic_sub_rules, topic_size, "%s%s%s", MQTT_TOPIC_SUB_BASE, thing_id, MQTT_TOPIC_ACTION_RULES);
+    if (ret < 0 || ret > topic_size) {
+        ESP_LOGE(TAG, "Error: snprintf");
+        return false;
     }
+    return true;
+}
 
-    cJSON_AddStringToObject(read, "hw_version", thing_hw_version);
-    cJSON_AddStringToObject(read, "fw_version", PROJECT_VER);
+static bool thing_create_mqtt_topic_pub_gateway(void)
+{
+    char thing_id[ID_SIZE];
+    if (!id_get(thing_id)){
+        ESP_LOGE(TAG, "Error: id_get");
+        return false;
+    }
 
-    if (!mobile_get_value_json(mobile_value)) {
-        ESP_LOGE(TAG, "Error: mobile_get_value_json");
-        goto error;
+    size_t topic_size = strlen(MQTT_TOPIC_PUB_BASE) + strlen(thing_id) + strlen(MQTT_TOPIC_ACTION_GATEWAY) + 1;
+    
+    if (topic_size > MQTT_TOPIC_MAX_SIZE) {
+        ESP_LOGE(TAG, "Error: Topic size is too large");
+        return false;
     }
 
-    if (!cJSON_AddItemToObject(value, "thing_value", thing_value) ||
-        !cJSON_AddItemToObject(value, "mobile_value", mobile_value)) {
-        ESP_LOGE(TAG, "Error: cJSON_AddItemToObject");
-        goto error;
+    int ret = snprintf(thing_mqtt_topic_pub_gateway, topic_size, "%s%s%s", MQTT_TOPIC_PUB_BASE, thing_id, MQTT_TOPIC_ACTION_GATEWAY);
+    if (ret < 0 || ret > topic_size) {
+        ESP_LOGE(TAG, "Error: snprintf");
+        return false;
     }
+    return true;
+}
 
-    if (!cJSON_PrintPreallocated(value, thing_mqtt_data_buffer, sizeof(thing_mqtt_data_buffer), 0)) {
-        ESP_LOGE(TAG, "Error: cJSON_PrintPreallocated value");
-        goto error;
+static bool thing_create_mqtt_topic_pub_history(void)
+{
+    char thing_id[ID_SIZE];
+    if (!id_get(thing_id)){
+        ESP_LOGE(TAG, "Error: id_get");
+        return false;
     }
 
-    cJSON_AddStringToObject(root, "value", thing_mqtt_data_buffer);
+    size_t topic_size = strlen(MQTT_TOPIC_PUB_BASE) + strlen(thing_id) + strlen(MQTT_TOPIC_ACTION_HISTORY) + 1;
+    
+    if (topic_size > MQTT_TOPIC_MAX_SIZE) {
+        ESP_LOGE(TAG, "Error: Topic size is too large");
+        return false;
+    }
 
-    if (!cJSON_PrintPreallocated(root, thing_mqtt_data_buffer, sizeof(thing_mqtt_data_buffer), 0)) {
-        ESP_LOGE(TAG, "Error: cJSON_PrintPreallocated root");
-        goto error;
+    int ret = snprintf(thing_mqtt_topic_pub_history, topic_size, "%s%s%s", MQTT_TOPIC_PUB_BASE, thing_id, MQTT_TOPIC_ACTION_HISTORY);
+    if (ret < 0 || ret > topic_size) {
+        ESP_LOGE(TAG, "Error: snprintf");
+        return false;
     }
+    return true;
+}
 
-    cJSON_Delete(root);
-    cJSON_Delete(value);
+static bool thing_create_mqtt_topic_sub_history(void)
+{
+    char thing_id[ID_SIZE];
+    if (!id_get(thing_id)){
+        ESP_LOGE(TAG, "Error: id_get");
+        return false;
+    }
 
+    size_t topic_size = strlen(MQTT_TOPIC_SUB_BASE) + strlen(thing_id) + strlen(MQTT_TOPIC_ACTION_HISTORY) + 1;
+    
+    if (topic_size > MQTT_TOPIC_MAX_SIZE) {
+        ESP_LOGE(TAG, "Error: Topic size is too large");
+        return false;
+    }
+
+    int ret = snprintf(thing_mqtt_topic_sub_history, topic_size, "%s%s%s", MQTT_TOPIC_SUB_BASE, thing_id, MQTT_TOPIC_ACTION_HISTORY);
+    if (ret < 0 || ret > topic_size) {
+        ESP_LOGE(TAG, "Error: snprintf");
+        return false;
+    }
     return true;
+}
 
-error:
-    cJSON_Delete(thing_value);
-    cJSON_Delete(mobile_value);
-    cJSON_Delete(value);
-    cJSON_Delete(root);
-    ESP_LOGE(TAG, "Error: goto error");
-    return false;
+static void thing_mqtt_received_history_cb(const char *data, int data_len)
+{
+    // Only queued here, the history task reads the flash and publishes the answer
+    if (!history_query(data, data_len)) {
+        ESP_LOGE(TAG, "Error: history_query");
+    }
 }
 
-static void thing_schedule_ota_task(void* arg) 
+static void thing_mqtt_received_rules_cb(const char *data, int data_len)
 {
-    while(true) {
-        vTaskDelay(THING_OTA_SCHEDULE_SECONDS / portTICK_PERIOD_MS);
-        ESP_LOGI(TAG, "thing_mqtt_publish_otaurl_cb triggered!");
-        event_trigger(EVENT_THING_PUBLISH_OTAURL);
+    // Rare and small, so applied straight from the MQTT task instead of through thing_run()
+    if (!automation_set_rules(data, data_len)) {
+        ESP_LOGE(TAG, "Error: automation_set_rules");
     }
 }
 
 static void thing_mqtt_publish_value_cb(void) 
 {
+    if (__atomic_exchange_n(&thing_value_publish_requested, true, __ATOMIC_ACQ_REL)) {
+        // A publish is already on its way and will carry this change too
+        return;
+    }
     ESP_LOGI(TAG, "thing_mqtt_publish_value_cb triggered!");
-    event_trigger(EVENT_THING_PUBLISH_VALUE);
+    if (!event_trigger(EVENT_THING_PUBLISH_VALUE)) {
+        // Nothing is on its way after all, so the next change has to try again
+        __atomic_store_n(&thing_value_publish_requested, false, __ATOMIC_RELEASE);
+    }
+}
+
+static bool thing_value_get_version(const char *data, int data_len, uint32_t *version)
+{
+    // Only the root level "version" counts, an endpoint or mobile value may use the same key
+    json_reader_t reader;
+    if (!json_reader_parse(&reader, thing_version_tokens, THING_JSON_MAX_TOKENS, data, data_len)) {
+        return false;
+    }
+    double value;
+    if (!json_reader_get_number(&reader, json_reader_find(&reader, 0, THING_VALUE_KEY_VERSION), &value)) {
+        return false;
+    }
+    if (value < 0 || value > UINT32_MAX || value != (uint32_t)value) {
+        ESP_LOGW(TAG, "Invalid value version %f", value);
+        return false;
+    }
+    *version = (uint32_t)value;
+    return true;
 }
 
 static void thing_mqtt_received_value_cb(const char *data, int data_len)
 {
-    if(!thing_take_mqtt_buffer_lock()){
-        ESP_LOGE(TAG, "Error: thing_take_mqtt_buffer_lock");
+    if (data_len >= sizeof(thing_value_pending_buffer)){
+        ESP_LOGE(TAG, "Error: MQTT data too long for buffer");
         return;
     }
-    if (data_len > sizeof(thing_mqtt_data_buffer)){
-        ESP_LOGI(TAG, "Error: MQTT data too long for buffer");
+
+    uint32_t version = 0;
+    bool has_version = thing_value_get_version(data, data_len, &version);
+
+    if (!thing_take_value_pending_lock(THING_VALUE_PENDING_TIMEOUT_MS)){
+        ESP_LOGE(TAG, "Error: thing_take_value_pending_lock");
         return;
     }
-    memcpy(thing_mqtt_data_buffer, data, data_len);
+    thing_value_stats.received++;
+    if (thing_value_pending){
+        // Keep the queued command if the cloud says it is newer than this one
+        if (has_version && thing_value_pending_has_version && version <= thing_value_pending_version){
+            thing_value_stats.stale++;
+            thing_give_value_pending_lock();
+            ESP_LOGW(TAG, "Drop value version %" PRIu32 ", version %" PRIu32 " is pending", version, thing_value_pending_version);
+            return;
+        }
+        // The queued command was never applied, only the newest one will be
+        thing_value_stats.collapsed++;
+    }
+    memcpy(thing_value_pending_buffer, data, data_len);
+    thing_value_pending_buffer[data_len] = '\0';
+    thing_value_pending = true;
+    thing_value_pending_has_version = has_version;
+    thing_value_pending_version = version;
+    thing_give_value_pending_lock();
 
     ESP_LOGI(TAG, "thing_mqtt_received_value_cb triggered!");
+    // Every command triggers an event, as an event may be ignored by thing_run().
+    // Events finding no pending command are no-ops.
     event_trigger(EVENT_THING_RECEIVED_VALUE);
 }
 
+static bool thing_load_pending_value(void)
+{
+    if (!thing_take_mqtt_buffer_lock()){
+        ESP_LOGE(TAG, "Error: thing_take_mqtt_buffer_lock");
+        return false;
+    }
+    if (!thing_take_value_pending_lock(THING_VALUE_PENDING_TIMEOUT_MS)){
+        thing_give_mqtt_buffer_lock();
+        ESP_LOGE(TAG, "Error: thing_take_value_pending_lock");
+        return false;
+    }
+    if (!thing_value_pending){
+        // Already applied as part of an earlier event
+        thing_give_value_pending_lock();
+        thing_give_mqtt_buffer_lock();
+        return false;
+    }
+    // Check the version before applying, so a command the device already moved past is
+    // rejected instead of undoing a local change. Commands without a version always apply.
+    if (thing_value_pending_has_version && thing_value_pending_version <= version_get()){
+        thing_value_pending = false;
+        thing_value_rejected = true;
+        thing_value_stats.stale++;
+        thing_give_value_pending_lock();
+        thing_give_mqtt_buffer_lock();
+        ESP_LOGW(TAG, "Reject value version %" PRIu32 ", device is at version %" PRIu32, thing_value_pending_version, version_get());
+        return false;
+    }
+    memcpy(thing_mqtt_data_buffer, thing_value_pending_buffer, sizeof(thing_mqtt_data_buffer));
+    thing_value_cache_valid = false;
+    thing_value_pending = false;
+    thing_value_loaded_has_version = thing_value_pending_has_version;
+    thing_value_loaded_version = thing_value_pending_version;
+    thing_value_stats.applied++;
+    thing_give_value_pending_lock();
+
+    ESP_LOGI(TAG, "Value commands: received %" PRIu32 ", applied %" PRIu32 ", collapsed %" PRIu32 ", stale %" PRIu32,
+             thing_value_stats.received, thing_value_stats.applied, thing_value_stats.collapsed, thing_value_stats.stale);
+    // The MQTT buffer lock is given by thing_set_value()
+    return true;
+}
+
+static void thing_commit_value_version(void)
+{
+    if (!thing_value_loaded_has_version){
+        version_local_change();
+        return;
+    }
+    // A local change while the command was applied keeps its newer version
+    if (!version_accept(thing_value_loaded_version)){
+        ESP_LOGW(TAG, "Version %" PRIu32 " overtaken while applying, device is at version %" PRIu32,
+                 thing_value_loaded_version, version_get());
+    }
+}
+
 static void thing_mqtt_received_otaurl_cb(const char *data, int data_len)
 {
     if(!thing_take_mqtt_buffer_lock()){
         ESP_LOGI(TAG, "Error: thing_take_mqtt_buffer_lock");
         return;
     }
-    if (data_len > sizeof(thing_mqtt_data_buffer)){
-        ESP_LOGI(TAG, "Error: MQTT data too long for buffer");
+    if (!thing_store_mqtt_data(data, data_len)){
+        thing_give_mqtt_buffer_lock();
+        ESP_LOGE(TAG, "Error: thing_store_mqtt_data");
         return;
     }
-    memcpy(thing_mqtt_data_buffer, data, data_len);
 
     ESP_LOGI(TAG, "thing_mqtt_received_otaurl_cb triggered!");
     event_trigger(EVENT_THING_RECEIVED_OTAURL);
@@ -385,11 +987,23 @@ static void thing_mqtt_received_bootup_cb(const char *data, int data_len)
         ESP_LOGE(TAG, "Error: thing_take_mqtt_buffer_lock");
         return;
     }
-    if (data_len > sizeof(thing_mqtt_data_buffer)){
-        ESP_LOGI(TAG, "Error: MQTT data too long for buffer");
+    if (!thing_store_mqtt_data(data, data_len)){
+        thing_give_mqtt_buffer_lock();
+        ESP_LOGE(TAG, "Error: thing_store_mqtt_data");
         return;
     }
-    memcpy(thing_mqtt_data_buffer, data, data_len);
+
+    // The version isn't persisted, continue from the one the cloud last saw instead of 0,
+    // or every command would be accepted after a reboot, however old it is
+    uint32_t version;
+    if (thing_value_get_version(data, data_len, &version) && version_accept(version)) {
+        ESP_LOGI(TAG, "Bootup version %" PRIu32, version);
+    }
+
+    if (thing_bootup_publish_time_us != 0) {
+        probe_record(PROBE_BOOTUP, (esp_timer_get_time() - thing_bootup_publish_time_us) / 1000);
+        thing_bootup_publish_time_us = 0;
+    }
 
     ESP_LOGI(TAG, "thing_mqtt_received_bootup_cb triggered!");
     event_trigger(EVENT_THING_RECEIVED_BOOTUP);
@@ -417,15 +1031,83 @@ static bool thing_publish_otaurl(void)
 
 static bool thing_publish_bootup(void)
 {
+    thing_bootup_publish_time_us = esp_timer_get_time();
     return mqtt_publish(thing_mqtt_topic_pub_bootup, "{}");
 }
 
-static bool thing_publish_value(void)
+static bool thing_heartbeat_is_due(void)
 {
+    return !thing_published_valid ||
+           esp_timer_get_time() - thing_published_time_us >= (int64_t)THING_PUBLISH_HEARTBEAT_MS * 1000;
+}
+
+static void thing_heartbeat_task(void* arg)
+{
+    while(true) {
+        vTaskDelay(THING_PUBLISH_HEARTBEAT_MS / portTICK_PERIOD_MS);
+        // Any publish within the period already proved the thing is alive
+        if (thing_heartbeat_is_due()) {
+            thing_mqtt_publish_value_cb();
+        }
+    }
+}
+
+static void thing_settle_timer_cb(void* arg)
+{
+    __atomic_store_n(&thing_settle_due, true, __ATOMIC_RELEASE);
+    thing_mqtt_publish_value_cb();
+}
+
+static bool thing_answer_command(void)
+{
+    uint32_t settle_ms = type_get_settle_ms();
+    if (settle_ms == 0 || thing_settle_timer == NULL) {
+        return thing_publish_value(THING_PUBLISH_REASON_COMMAND);
+    }
+    // Every command restarts the timer, so only the value the stream settles at is published
+    esp_timer_stop(thing_settle_timer);
+    if (esp_timer_start_once(thing_settle_timer, (uint64_t)settle_ms * 1000) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: esp_timer_start_once");
+        return thing_publish_value(THING_PUBLISH_REASON_COMMAND);
+    }
+    return true;
+}
+
+static bool thing_get_publish_json(cJSON *root)
+{
+    cJSON *publish = cJSON_CreateObject();
+    if (!publish || !cJSON_AddItemToObject(root, "publish", publish)) {
+        cJSON_Delete(publish);
+        ESP_LOGE(TAG, "Error: cJSON_AddItemToObject");
+        return false;
+    }
+    for (int i = 0; i < THING_PUBLISH_REASON_MAX; i++) {
+        cJSON_AddNumberToObject(publish, thing_publish_reason_names[i], thing_publish_counts[i]);
+    }
+    cJSON_AddNumberToObject(publish, "skipped", thing_publish_skipped);
+    return true;
+}
+
+static bool thing_publish_value(thing_publish_reason_t reason)
+{
+    // Cleared before serializing, so a change made meanwhile requests another publish
+    __atomic_store_n(&thing_value_publish_requested, false, __ATOMIC_RELEASE);
+    if (reason == THING_PUBLISH_REASON_CHANGE &&
+        thing_published_valid && thing_published_generation == dirty_get_generation(DIRTY_STATE)) {
+        thing_publish_skipped++;
+        ESP_LOGI(TAG, "Value unchanged, publish skipped (%" PRIu32 " skipped)", thing_publish_skipped);
+        return true;
+    }
     if (!thing_take_mqtt_buffer_lock()){
         ESP_LOGE(TAG, "Error: thing_take_mqtt_buffer_lock");
         return false;
     }
+    // Read before serializing, so a change made meanwhile is published again
+    uint32_t generation = dirty_get_generation(DIRTY_STATE);
+    // Every publish steps the interval controller, and carries the statistics it used
+    if (!link_update()){
+        ESP_LOGE(TAG, "Error: link_update");
+    }
     if (!thing_get_value()){
         thing_give_mqtt_buffer_lock();
         ESP_LOGE(TAG, "Error: thing_get_value");
@@ -436,7 +1118,13 @@ static bool thing_publish_value(void)
         ESP_LOGE(TAG, "Error: mqtt_publish");
         return false;
     }
+    // Link statistics alone don't make the published document worth publishing again
+    thing_published_generation = generation;
+    thing_published_valid = true;
+    thing_published_time_us = esp_timer_get_time();
+    thing_publish_counts[reason]++;
     thing_give_mqtt_buffer_lock();
+    ESP_LOGI(TAG, "Value published (%s)", thing_publish_reason_names[reason]);
     return true;
 }
 
@@ -446,7 +1134,20 @@ static bool thing_take_mqtt_buffer_lock(void)
         ESP_LOGE(TAG, "Error: xSemaphoreTake");
         return false;
     }
-    memset(thing_mqtt_data_buffer, 0, sizeof(thing_mqtt_data_buffer));
+    return true;
+}
+
+// Must be called with the MQTT data buffer lock taken
+static bool thing_store_mqtt_data(const char *data, int data_len)
+{
+    if (data_len >= sizeof(thing_mqtt_data_buffer)){
+        ESP_LOGE(TAG, "Error: MQTT data too long for buffer");
+        return false;
+    }
+    memcpy(thing_mqtt_data_buffer, data, data_len);
+    thing_mqtt_data_buffer[data_len] = '\0';
+    // The buffer no longer holds the serialized value
+    thing_value_cache_valid = false;
     return true;
 }
 
@@ -455,6 +1156,20 @@ static void thing_give_mqtt_buffer_lock(void)
     xSemaphoreGive(thing_mqtt_data_buffer_lock);
 }
 
+static bool thing_take_value_pending_lock(int timeout_ms)
+{
+    if (!(xSemaphoreTake(thing_value_pending_lock, timeout_ms / portTICK_PERIOD_MS) == pdTRUE)){
+        ESP_LOGE(TAG, "Error: xSemaphoreTake");
+        return false;
+    }
+    return true;
+}
+
+static void thing_give_value_pending_lock(void)
+{
+    xSemaphoreGive(thing_value_pending_lock);
+}
+
 static bool thing_set_has_type(void)
 {
     return storage_set_flags(THING_STORAGE_KEY_FLAGS, THING_HAS_TYPE);
@@ -549,10 +1264,15 @@ bool thing_init(void)
         ESP_LOGE(TAG, "Error: thing_load_hw_version");
         return false;
     }
-    if (!type_set_int(thing_type)){
-        ESP_LOGE(TAG, "Error: type_set_int, using Default type");
+    if (!type_set(thing_type)){
+        ESP_LOGE(TAG, "Error: type_set, using Default type");
         // Don't return false as default type can be used
     }
+    // Before the type tasks, which read the telemetry interval
+    if (!link_init()){
+        ESP_LOGE(TAG, "Error: link_init");
+        return false;
+    }
     if (!type_init(thing_mqtt_publish_value_cb)){
         ESP_LOGE(TAG, "Error: type_init");
         return false;
@@ -561,6 +1281,10 @@ bool thing_init(void)
         ESP_LOGE(TAG, "Error: mobile_init");
         return false;
     }
+    if (!automation_init(thing_mqtt_publish_value_cb)){
+        ESP_LOGE(TAG, "Error: automation_init");
+        return false;
+    }
     if (!thing_create_mqtt_topic_pub_otaurl()){
         ESP_LOGE(TAG, "Error: thing_create_mqtt_topic_pub_otaurl");
         return false;
@@ -585,6 +1309,44 @@ bool thing_init(void)
         ESP_LOGE(TAG, "Error: thing_create_mqtt_topic_sub_bootup");
         return false;
     }
+    if (!thing_create_mqtt_topic_pub_echo()){
+        ESP_LOGE(TAG, "Error: thing_create_mqtt_topic_pub_echo");
+        return false;
+    }
+    if (!thing_create_mqtt_topic_sub_echo()){
+        ESP_LOGE(TAG, "Error: thing_create_mqtt_topic_sub_echo");
+        return false;
+    }
+    if (!thing_create_mqtt_topic_pub_latency()){
+        ESP_LOGE(TAG, "Error: thing_create_mqtt_topic_pub_latency");
+        return false;
+    }
+    if (!thing_create_mqtt_topic_sub_rules()){
+        ESP_LOGE(TAG, "Error: thing_create_mqtt_topic_sub_rules");
+        return false;
+    }
+    if (!thing_create_mqtt_topic_pub_history()){
+        ESP_LOGE(TAG, "Error: thing_create_mqtt_topic_pub_history");
+        return false;
+    }
+    if (!thing_create_mqtt_topic_sub_history()){
+        ESP_LOGE(TAG, "Error: thing_create_mqtt_topic_sub_history");
+        return false;
+    }
+    if (!history_init(thing_mqtt_topic_pub_history)){
+        // Don't return false, the device works without its history
+        ESP_LOGE(TAG, "Error: history_init");
+    }
+#if CONFIG_RIOTBOX_GATEWAY
+    if (!thing_create_mqtt_topic_pub_gateway()){
+        ESP_LOGE(TAG, "Error: thing_create_mqtt_topic_pub_gateway");
+        return false;
+    }
+    if (!gateway_init(thing_mqtt_topic_pub_gateway)){
+        ESP_LOGE(TAG, "Error: gateway_init");
+        return false;
+    }
+#endif
     if (!mqtt_register_subscription(thing_mqtt_topic_sub_otaurl, thing_mqtt_received_otaurl_cb)){
         ESP_LOGE(TAG, "Error: mqtt_register_subscription");
         return false;
@@ -597,13 +1359,67 @@ bool thing_init(void)
         ESP_LOGE(TAG, "Error: mqtt_register_subscription");
         return false;
     }
+    if (!mqtt_register_subscription(thing_mqtt_topic_sub_echo, thing_mqtt_received_echo_cb)){
+        ESP_LOGE(TAG, "Error: mqtt_register_subscription");
+        return false;
+    }
+    if (!mqtt_register_subscription(thing_mqtt_topic_sub_rules, thing_mqtt_received_rules_cb)){
+        ESP_LOGE(TAG, "Error: mqtt_register_subscription");
+        return false;
+    }
+    if (!mqtt_register_subscription(thing_mqtt_topic_sub_history, thing_mqtt_received_history_cb)){
+        ESP_LOGE(TAG, "Error: mqtt_register_subscription");
+        return false;
+    }
+    // The largest documents, decoded by the thing-to-cloud Lambda
+    if (!mqtt_register_compression(thing_mqtt_topic_pub_value)){
+        ESP_LOGE(TAG, "Error: mqtt_register_compression");
+        return false;
+    }
+    if (!mqtt_register_compression(thing_mqtt_topic_pub_history)){
+        ESP_LOGE(TAG, "Error: mqtt_register_compression");
+        return false;
+    }
+    // Values answer commands and the history cursor moves past a sent batch, so the broker
+    // acknowledges them. Probes, OTA requests and gateway readings are superseded by the next one.
+    if (!mqtt_register_acknowledged(thing_mqtt_topic_pub_value)){
+        ESP_LOGE(TAG, "Error: mqtt_register_acknowledged");
+        return false;
+    }
+    if (!mqtt_register_acknowledged(thing_mqtt_topic_pub_history)){
+        ESP_LOGE(TAG, "Error: mqtt_register_acknowledged");
+        return false;
+    }
     if (xTaskCreate(thing_schedule_ota_task, "thing_schedule_ota_task", 2048, NULL, 5, NULL) != pdTRUE){
         ESP_LOGE(TAG, "Error: thing_schedule_ota_task");
         return false;
     }
+    if (!probe_init()){
+        ESP_LOGE(TAG, "Error: probe_init");
+        return false;
+    }
+    if (xTaskCreate(thing_probe_task, "thing_probe_task", 3072, NULL, 5, NULL) != pdTRUE){
+        ESP_LOGE(TAG, "Error: thing_probe_task");
+        return false;
+    }
+    const esp_timer_create_args_t settle_timer_args = {
+        .callback = thing_settle_timer_cb,
+        .name = "thing_settle",
+    };
+    if (esp_timer_create(&settle_timer_args, &thing_settle_timer) != ESP_OK){
+        ESP_LOGE(TAG, "Error: esp_timer_create");
+        return false;
+    }
+    if (xTaskCreate(thing_heartbeat_task, "thing_heartbeat_task", 2048, NULL, 5, NULL) != pdTRUE){
+        ESP_LOGE(TAG, "Error: thing_heartbeat_task");
+        return false;
+    }
 
     thing_mqtt_data_buffer_lock = xSemaphoreCreateBinary();
     thing_give_mqtt_buffer_lock();
+
+    thing_value_pending_lock = xSemaphoreCreateBinary();
+    thing_give_value_pending_lock();
     
     return true;
 }
@@ -612,6 +1428,7 @@ bool thing_run(void)
 {
     switch(event_wait()){
         case EVENT_BLE_GAP_CONNECTED:
+            history_set_connected(false);
             state_set(STATE_PROVISION);
             event_expect(EVENT_BLE_GAP_DISCONNECTED | EVENT_PROVISION_RECEIVE_POP);
             ble_set_allow_connection(true);
@@ -632,6 +1449,7 @@ bool thing_run(void)
             event_expect(   EVENT_BLE_GAP_CONNECTED | 
                             EVENT_WIFI_CONNECTED | 
                             EVENT_WIFI_DISCONNECTED);
+            history_set_connected(false);
             wifi_connect();
             break;
         case EVENT_MQTT_CONNECTED:
@@ -662,7 +1480,9 @@ bool thing_run(void)
             if (thing_set_otaurl()){
                 state_set(STATE_OTA);
             } else {
-                thing_publish_value();
+                thing_publish_value(THING_PUBLISH_REASON_CONNECT);
+                // Records kept while offline go out once the current value is published
+                history_set_connected(true);
             }
             break;
         case EVENT_THING_RECEIVED_VALUE:
@@ -671,8 +1491,19 @@ bool thing_run(void)
                             EVENT_THING_RECEIVED_VALUE |
                             EVENT_THING_PUBLISH_OTAURL |
                             EVENT_THING_PUBLISH_VALUE);
-            thing_set_value();
-            thing_publish_value();
+            // Only the newest queued command is applied and acknowledged
+            if (thing_load_pending_value()){
+                // A command that fails to apply leaves the version as it was
+                if (thing_set_value()){
+                    thing_commit_value_version();
+                }
+                // Always answered, the cloud waits for the applied value
+                thing_answer_command();
+            } else if (thing_value_rejected){
+                // Answer with the newer local value, so the app stops showing its own
+                thing_value_rejected = false;
+                thing_publish_value(THING_PUBLISH_REASON_COMMAND);
+            }
             break;
         case EVENT_THING_PUBLISH_OTAURL:
             event_expect(   EVENT_BLE_GAP_CONNECTED | 
@@ -686,9 +1517,18 @@ bool thing_run(void)
                             EVENT_MQTT_SUBSCRIBED |
                             EVENT_THING_RECEIVED_VALUE |
                             EVENT_THING_PUBLISH_VALUE);
-            thing_publish_value();
+            if (__atomic_exchange_n(&thing_settle_due, false, __ATOMIC_ACQ_REL)) {
+                thing_publish_value(THING_PUBLISH_REASON_COMMAND);
+            } else {
+                thing_publish_value(thing_heartbeat_is_due() ? THING_PUBLISH_REASON_HEARTBEAT : THING_PUBLISH_REASON_CHANGE);
+            }
             break;
         case EVENT_IGNORE:
+            // A dropped publish request is not sent again, so the next change has to make a new
+            // one. Changes until then go out with the publish that follows every (re)connect.
+            if (event_get_ignored() & EVENT_THING_PUBLISH_VALUE) {
+                __atomic_store_n(&thing_value_publish_requested, false, __ATOMIC_RELEASE);
+            }
             break;
         default:
             return false;
@@ -1,4 +1,5 @@
 #include "app/types/default.h"
+#include "app/types/type.h"
 #include <cJSON.h>
 #include <stdbool.h>
 #include <string.h>
@@ -6,87 +7,59 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
 #include "driver/gpio.h"
 #include "board/board.h"
+#include "middlewares/link.h"
+#include "utilities/schema.h"
+#include "utilities/dirty.h"
+#include "utilities/seqlock.h"
 
 static const char *TAG = "DEFAULT";
 
-static SemaphoreHandle_t default_value_lock = NULL;
+static seqlock_t default_value_lock[TYPE_MAX_ENDPOINTS];
 
 static callback_t default_publish_value = NULL;
 
-static default_value_t default_value_g = {
-    .read = {
-        /* Developer: Initialise your read-only properties here */
-    },
-    .readwrite = {
-        /* Developer: Initialise your read-write properties here */
-    }
-};
-
-static void default_task(void* arg);
-static bool default_get_struct(default_value_t *default_value);
-static bool default_set_struct(default_value_t default_value);
-static bool default_take_value_lock(void);
-static void default_give_value_lock(void);
-static bool default_update_hw(void);
+#define DEFAULT_READWRITE_FIELD(kind, field, a, b) SCHEMA_FIELD(default_readwrite_t, kind, field, a, b)
+#define DEFAULT_READ_FIELD(kind, field, a, b) SCHEMA_FIELD(default_read_t, kind, field, a, b)
 
-static bool default_take_value_lock(void)
-{
-    if (!(xSemaphoreTake(default_value_lock, 0) == pdTRUE)){
-        ESP_LOGE(TAG, "Error: xSemaphoreTake");
-        return false;
-    }
-    return true;
-}
+static const schema_field_t default_readwrite_fields[] = { DEFAULT_READWRITE_FIELDS(DEFAULT_READWRITE_FIELD) SCHEMA_FIELDS_END };
+static const schema_field_t default_read_fields[] = { DEFAULT_READ_FIELDS(DEFAULT_READ_FIELD) SCHEMA_FIELDS_END };
 
-static void default_give_value_lock(void)
-{
-    xSemaphoreGive(default_value_lock);
-}
+/* Developer: Initialise your properties in default_init() if they don't start at zero */
+static default_value_t default_value_g[TYPE_MAX_ENDPOINTS];
 
-static bool default_get_struct(default_value_t *default_value) 
-{    
-    if(!default_take_value_lock()) {
-        ESP_LOGE(TAG, "Error: default_take_value_lock");
-        return false;
-    }
-    *default_value = default_value_g;
-    default_give_value_lock();
-    return true;
-}
+static void default_task(void* arg);
+static bool default_update_hw(int endpoint);
 
-static bool default_set_struct(default_value_t default_value) 
-{
-    if(!default_take_value_lock()) {
-        ESP_LOGE(TAG, "Error: default_take_value_lock");
-        return false;
-    }
-    default_value_g.readwrite = default_value.readwrite;
-    default_give_value_lock();
-    return true;
-}
+static const type_value_t default_type_value = TYPE_VALUE(default, default_update_hw);
 
 static void default_task(void* arg) 
 {
-    default_value_t default_value;
-    if (default_get_struct(&default_value)){
-        default_update_hw();
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        default_update_hw(endpoint);
     }
 
+    uint32_t generation = dirty_get_generation(DIRTY_TYPE);
     while(true) {
-        vTaskDelay(5000 / portTICK_PERIOD_MS);
-        ESP_LOGI(TAG, "Publish default value to mobile app");
-        default_publish_value();
+        vTaskDelay(link_get_publish_interval_ms() / portTICK_PERIOD_MS);
+        /* Developer: Sample your properties here, storing a changed value marks it dirty */
+
+        // Only publish real changes, the thing layer sends a heartbeat when idle.
+        // One publish carries every endpoint.
+        if (dirty_get_generation(DIRTY_TYPE) != generation) {
+            generation = dirty_get_generation(DIRTY_TYPE);
+            ESP_LOGI(TAG, "Publish default value to mobile app");
+            default_publish_value();
+        }
     }
 }
 
-static bool default_update_hw(void)
+static bool default_update_hw(int endpoint)
 {   
     default_value_t default_value;
-    if (!default_get_struct(&default_value)) {
-        ESP_LOGE(TAG, "Error: default_get_struct");
+    if (!type_value_get(&default_type_value, endpoint, &default_value)) {
+        ESP_LOGE(TAG, "Error: type_value_get");
         return false;
     }
 
@@ -95,55 +68,6 @@ static bool default_update_hw(void)
     return true;
 }
 
-bool default_set_value_json(cJSON* value)
-{
-    default_value_t default_value;
-    if (!default_get_struct(&default_value)) {
-        ESP_LOGE(TAG, "Error: default_get_struct");
-        return false;
-    }
-
-    cJSON *read = cJSON_GetObjectItem(value, "read");
-    cJSON *readwrite = cJSON_GetObjectItem(value, "readwrite");
-    if (!read || !readwrite) {
-        ESP_LOGE(TAG, "Error: !read || !readwrite");
-        return false;
-    }
-
-    /* Developer: Parse your JSON properties here */
-
-    /* Developer: Update default_value properties here */
-
-    if (!default_set_struct(default_value)) {
-        ESP_LOGE(TAG, "Error: default_set_struct");
-        return false;
-    }
-
-    default_update_hw();
-
-    return true;
-}
-
-bool default_get_value_json(cJSON* value)
-{
-    default_value_t default_value;
-    if (!default_get_struct(&default_value)){
-        ESP_LOGE(TAG, "Error: default_get_struct");
-        return false;
-    }
-
-    cJSON *read = cJSON_GetObjectItem(value, "read");
-    cJSON *readwrite = cJSON_GetObjectItem(value, "readwrite");
-    if (!read || !readwrite) {
-        ESP_LOGE(TAG, "Error: !read || !readwrite");
-        return false;
-    }
-
-    /* Developer: Add your properties to JSON object here */
-
-    return true;
-}
-
 bool default_pre_reboot(void)
 {
     /* Developer: If you want to do anything before rebooting */
@@ -152,18 +76,20 @@ bool default_pre_reboot(void)
 
 bool default_init(callback_t callback_publish_value)
 {
-    ESP_LOGI(TAG, "Initialise");
+    ESP_LOGI(TAG, "Initialise %d endpoints", TYPE_MAX_ENDPOINTS);
     // Create a callback to trigger MQTT publish
     default_publish_value = callback_publish_value;
 
-    // Create and give default struct mutex
-    default_value_lock = xSemaphoreCreateBinary();
-
-    default_give_value_lock();
-
     if (xTaskCreate(default_task, "default_task", 2048, NULL, 5, NULL) != pdTRUE){
         ESP_LOGE(TAG, "Error: xTaskCreate");
         return false;
     }
     return true;
 }
+
+const type_ops_t default_type_ops = {
+    .name = DEFAULT_TYPE_STR,
+    .value = &default_type_value,
+    .init = default_init,
+    .pre_reboot = default_pre_reboot,
+};
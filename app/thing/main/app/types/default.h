@@ -12,18 +12,28 @@
 #include <stdio.h>
 #include <cJSON.h>
 #include "utilities/misc.h"
+#include "utilities/json_reader.h"
+#include "utilities/json_writer.h"
+#include "utilities/schema.h"
 
 
 #define DEFAULT_TYPE_STR "DEFAULT"
-#define DEFAULT_TYPE_INT 0
 
 
+/* Developer: Add one line per read-write property, e.g. X(INT, brightness, 0, 100) \ */
+#define DEFAULT_READWRITE_FIELDS(X)
+
+/* Developer: Add one line per read-only property, e.g. X(STRING, model, 16, 0) \ */
+#define DEFAULT_READ_FIELDS(X)
+
 typedef struct default_readwrite_t {
-    /* Developer: Add your read-write properties here */
+    DEFAULT_READWRITE_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
 } default_readwrite_t;
 
 typedef struct default_read_t {
-    /* Developer: Add your read-only properties here */
+    DEFAULT_READ_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
 } default_read_t;
 
 typedef struct default_value_t {
@@ -32,9 +42,9 @@ typedef struct default_value_t {
 } default_value_t;
 
 
-bool default_get_value_json(cJSON *value);
-bool default_set_value_json(cJSON *value);
 bool default_init(callback_t callback_publish_value);
 bool default_pre_reboot(void);
 
+extern const struct type_ops_t default_type_ops;
+
 #endif /* _DEFAULT_H_ */
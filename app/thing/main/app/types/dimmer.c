@@ -0,0 +1,137 @@
+/*
+ * dimmer.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "app/types/dimmer.h"
+#include "app/types/type.h"
+#include <cJSON.h>
+#include <stdbool.h>
+#include <string.h>
+#include "utilities/misc.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/ledc.h"
+#include "board/board.h"
+#include "utilities/schema.h"
+#include "utilities/dirty.h"
+#include "utilities/seqlock.h"
+
+#define DIMMER_LEDC_MODE            LEDC_LOW_SPEED_MODE
+#define DIMMER_LEDC_TIMER           LEDC_TIMER_0
+#define DIMMER_LEDC_RESOLUTION      LEDC_TIMER_13_BIT
+#define DIMMER_LEDC_MAX_DUTY        ((1 << 13) - 1)
+#define DIMMER_LEDC_FREQ_HZ         5000
+#define DIMMER_FADE_MS              300
+// A slider sends a command every few tens of ms, only the brightness it settles at is answered
+#define DIMMER_SETTLE_MS            500
+
+static const char *TAG = "DIMMER";
+
+static const int dimmer_gpios[] = THING_DIMMER_GPIOS;
+
+_Static_assert(sizeof(dimmer_gpios) / sizeof(dimmer_gpios[0]) >= TYPE_MAX_ENDPOINTS,
+               "Every dimmer endpoint needs a PWM GPIO in board.h");
+
+static seqlock_t dimmer_value_lock[TYPE_MAX_ENDPOINTS];
+
+static callback_t dimmer_publish_value = NULL;
+
+#define DIMMER_READWRITE_FIELD(kind, field, a, b) SCHEMA_FIELD(dimmer_readwrite_t, kind, field, a, b)
+#define DIMMER_READ_FIELD(kind, field, a, b) SCHEMA_FIELD(dimmer_read_t, kind, field, a, b)
+
+static const schema_field_t dimmer_readwrite_fields[] = { DIMMER_READWRITE_FIELDS(DIMMER_READWRITE_FIELD) SCHEMA_FIELDS_END };
+static const schema_field_t dimmer_read_fields[] = { DIMMER_READ_FIELDS(DIMMER_READ_FIELD) SCHEMA_FIELDS_END };
+
+// Every endpoint starts out dark
+static dimmer_value_t dimmer_value_g[TYPE_MAX_ENDPOINTS];
+
+static bool dimmer_init_ledc(void);
+static bool dimmer_update_hw(int endpoint);
+
+static const type_value_t dimmer_type_value = TYPE_VALUE(dimmer, dimmer_update_hw);
+
+static bool dimmer_init_ledc(void)
+{
+    ledc_timer_config_t timer_config = {
+        .speed_mode = DIMMER_LEDC_MODE,
+        .duty_resolution = DIMMER_LEDC_RESOLUTION,
+        .timer_num = DIMMER_LEDC_TIMER,
+        .freq_hz = DIMMER_LEDC_FREQ_HZ,
+        .clk_cfg = LEDC_AUTO_CLK,
+    };
+    if (ledc_timer_config(&timer_config) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: ledc_timer_config");
+        return false;
+    }
+
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        ledc_channel_config_t channel_config = {
+            .gpio_num = dimmer_gpios[endpoint],
+            .speed_mode = DIMMER_LEDC_MODE,
+            .channel = LEDC_CHANNEL_0 + endpoint,
+            .intr_type = LEDC_INTR_DISABLE,
+            .timer_sel = DIMMER_LEDC_TIMER,
+            .duty = 0,
+            .hpoint = 0,
+        };
+        if (ledc_channel_config(&channel_config) != ESP_OK) {
+            ESP_LOGE(TAG, "Error: ledc_channel_config");
+            return false;
+        }
+    }
+
+    if (ledc_fade_func_install(0) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: ledc_fade_func_install");
+        return false;
+    }
+    return true;
+}
+
+static bool dimmer_update_hw(int endpoint)
+{
+    dimmer_value_t dimmer_value;
+    if (!type_value_get(&dimmer_type_value, endpoint, &dimmer_value)) {
+        ESP_LOGE(TAG, "Error: type_value_get");
+        return false;
+    }
+
+    // Retarget a fade in flight from wherever it got to, instead of queueing another one
+    ledc_channel_t channel = LEDC_CHANNEL_0 + endpoint;
+    uint32_t duty = dimmer_value.readwrite.brightness * DIMMER_LEDC_MAX_DUTY / 100;
+    ledc_fade_stop(DIMMER_LEDC_MODE, channel);
+    if (ledc_set_fade_with_time(DIMMER_LEDC_MODE, channel, duty, DIMMER_FADE_MS) != ESP_OK ||
+        ledc_fade_start(DIMMER_LEDC_MODE, channel, LEDC_FADE_NO_WAIT) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: ledc fade");
+        return false;
+    }
+    return true;
+}
+
+bool dimmer_pre_reboot(void)
+{
+    return true;
+}
+
+bool dimmer_init(callback_t callback_publish_value)
+{
+    ESP_LOGI(TAG, "Initialise %d endpoints", TYPE_MAX_ENDPOINTS);
+    // Create a callback to trigger MQTT publish
+    dimmer_publish_value = callback_publish_value;
+
+    if (!dimmer_init_ledc()) {
+        ESP_LOGE(TAG, "Error: dimmer_init_ledc");
+        return false;
+    }
+    return true;
+}
+
+const type_ops_t dimmer_type_ops = {
+    .name = DIMMER_TYPE_STR,
+    .settle_ms = DIMMER_SETTLE_MS,
+    .value = &dimmer_type_value,
+    .init = dimmer_init,
+    .pre_reboot = dimmer_pre_reboot,
+};
@@ -0,0 +1,50 @@
+/*
+ * dimmer.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+
+#ifndef _DIMMER_H_
+#define _DIMMER_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <cJSON.h>
+#include "utilities/misc.h"
+#include "utilities/json_reader.h"
+#include "utilities/json_writer.h"
+#include "utilities/schema.h"
+
+
+#define DIMMER_TYPE_STR "DIMMER"
+
+
+// One line per property, see utilities/schema.h
+#define DIMMER_READWRITE_FIELDS(X) \
+    X(INT, brightness, 0, 100)
+
+#define DIMMER_READ_FIELDS(X)
+
+typedef struct dimmer_readwrite_t {
+    DIMMER_READWRITE_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
+} dimmer_readwrite_t;
+
+typedef struct dimmer_read_t {
+    DIMMER_READ_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
+} dimmer_read_t;
+
+typedef struct dimmer_value_t {
+    dimmer_readwrite_t readwrite;
+    dimmer_read_t read;
+} dimmer_value_t;
+
+
+bool dimmer_init(callback_t callback_publish_value);
+bool dimmer_pre_reboot(void);
+
+extern const struct type_ops_t dimmer_type_ops;
+
+#endif /* _DIMMER_H_ */
@@ -0,0 +1,282 @@
+/*
+ * meter.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "app/types/meter.h"
+#include "app/types/type.h"
+#include <cJSON.h>
+#include <stdbool.h>
+#include <string.h>
+#include "utilities/misc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_adc/adc_continuous.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "board/board.h"
+#include "utilities/schema.h"
+#include "utilities/dirty.h"
+#include "middlewares/link.h"
+#include "utilities/seqlock.h"
+#include "utilities/power.h"
+
+#define METER_SAMPLE_FREQ_HZ        20000   // All channels together, the ESP32 minimum
+#define METER_FRAME_CONVERSIONS     256     // 12.8 ms of conversions per DMA frame
+#define METER_FRAME_BYTES           (METER_FRAME_CONVERSIONS * SOC_ADC_DIGI_RESULT_BYTES)
+#define METER_FRAME_COUNT           2       // One filled by the ADC task while the other is processed
+#define METER_CHANNEL_MAP_SIZE      16      // The conversion result has a 4-bit channel
+#define METER_REPORT_INTERVAL_MS    10000
+
+static const char *TAG = "METER";
+
+static const adc_channel_t meter_voltage_channels[] = THING_METER_VOLTAGE_ADC_CHANNELS;
+static const adc_channel_t meter_current_channels[] = THING_METER_CURRENT_ADC_CHANNELS;
+
+_Static_assert(sizeof(meter_voltage_channels) / sizeof(meter_voltage_channels[0]) >= TYPE_MAX_ENDPOINTS &&
+               sizeof(meter_current_channels) / sizeof(meter_current_channels[0]) >= TYPE_MAX_ENDPOINTS,
+               "Every meter endpoint needs a voltage and a current ADC channel in board.h");
+
+static seqlock_t meter_value_lock[TYPE_MAX_ENDPOINTS];
+
+static callback_t meter_publish_value = NULL;
+
+#define METER_READWRITE_FIELD(kind, field, a, b) SCHEMA_FIELD(meter_readwrite_t, kind, field, a, b)
+#define METER_READ_FIELD(kind, field, a, b) SCHEMA_FIELD(meter_read_t, kind, field, a, b)
+
+static const schema_field_t meter_readwrite_fields[] = { METER_READWRITE_FIELDS(METER_READWRITE_FIELD) SCHEMA_FIELDS_END };
+static const schema_field_t meter_read_fields[] = { METER_READ_FIELDS(METER_READ_FIELD) SCHEMA_FIELDS_END };
+
+// Calibration is set from board.h in meter_init()
+static meter_value_t meter_value_g[TYPE_MAX_ENDPOINTS];
+
+typedef struct meter_frame_t {
+    uint8_t data[METER_FRAME_BYTES];
+    uint32_t len;
+} meter_frame_t;
+
+// Double buffer, indices of free frames go to the ADC task and filled ones to meter_task()
+static meter_frame_t meter_frames[METER_FRAME_COUNT];
+static QueueHandle_t meter_free_frames = NULL;
+static QueueHandle_t meter_full_frames = NULL;
+
+// Endpoint * 2 for voltage, + 1 for current, -1 for channels that are not sampled
+static int8_t meter_channel_map[METER_CHANNEL_MAP_SIZE];
+
+// Only used by meter_task()
+static uint16_t meter_voltage[TYPE_MAX_ENDPOINTS][METER_FRAME_CONVERSIONS];
+static uint16_t meter_current[TYPE_MAX_ENDPOINTS][METER_FRAME_CONVERSIONS];
+static power_sums_t meter_sums[TYPE_MAX_ENDPOINTS];
+
+static adc_continuous_handle_t meter_adc = NULL;
+
+static void meter_task(void* arg);
+static void meter_adc_task(void* arg);
+static bool meter_init_adc(void);
+static void meter_process_frame(const meter_frame_t *frame);
+static bool meter_report(int64_t elapsed_us);
+
+// Calibration is picked up at the next report, there is no hardware to update
+static const type_value_t meter_type_value = TYPE_VALUE(meter, NULL);
+
+static bool meter_init_adc(void)
+{
+    memset(meter_channel_map, -1, sizeof(meter_channel_map));
+    adc_digi_pattern_config_t pattern[2 * TYPE_MAX_ENDPOINTS];
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        // Voltage and current of an endpoint are converted back to back
+        for (int kind = 0; kind < 2; kind++) {
+            adc_channel_t channel = kind ? meter_current_channels[endpoint] : meter_voltage_channels[endpoint];
+            pattern[endpoint * 2 + kind] = (adc_digi_pattern_config_t) {
+                .atten = ADC_ATTEN_DB_11,
+                .channel = channel,
+                .unit = ADC_UNIT_1,
+                .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+            };
+            meter_channel_map[channel] = endpoint * 2 + kind;
+        }
+    }
+
+    adc_continuous_handle_cfg_t handle_config = {
+        .max_store_buf_size = METER_FRAME_BYTES * 4,
+        .conv_frame_size = METER_FRAME_BYTES,
+    };
+    if (adc_continuous_new_handle(&handle_config, &meter_adc) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: adc_continuous_new_handle");
+        return false;
+    }
+
+    adc_continuous_config_t adc_config = {
+        .pattern_num = 2 * TYPE_MAX_ENDPOINTS,
+        .adc_pattern = pattern,
+        .sample_freq_hz = METER_SAMPLE_FREQ_HZ,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+    };
+    if (adc_continuous_config(meter_adc, &adc_config) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: adc_continuous_config");
+        return false;
+    }
+    if (adc_continuous_start(meter_adc) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: adc_continuous_start");
+        return false;
+    }
+    return true;
+}
+
+static void meter_adc_task(void* arg)
+{
+    int index;
+    while(true) {
+        if (xQueueReceive(meter_free_frames, &index, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        meter_frame_t *frame = &meter_frames[index];
+        if (adc_continuous_read(meter_adc, frame->data, sizeof(frame->data), &frame->len, ADC_MAX_DELAY) != ESP_OK) {
+            ESP_LOGE(TAG, "Error: adc_continuous_read");
+            xQueueSend(meter_free_frames, &index, portMAX_DELAY);
+            continue;
+        }
+        xQueueSend(meter_full_frames, &index, portMAX_DELAY);
+    }
+}
+
+static void meter_process_frame(const meter_frame_t *frame)
+{
+    uint32_t voltage_count[TYPE_MAX_ENDPOINTS] = {0};
+    uint32_t current_count[TYPE_MAX_ENDPOINTS] = {0};
+
+    // De-interleave into one contiguous array per channel for the kernel
+    for (uint32_t n = 0; n + SOC_ADC_DIGI_RESULT_BYTES <= frame->len; n += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t *conversion = (const adc_digi_output_data_t *)&frame->data[n];
+        int slot = meter_channel_map[conversion->type1.channel];
+        if (slot < 0) {
+            continue;
+        }
+        int endpoint = slot / 2;
+        if (slot % 2) {
+            meter_current[endpoint][current_count[endpoint]++] = conversion->type1.data;
+        } else {
+            meter_voltage[endpoint][voltage_count[endpoint]++] = conversion->type1.data;
+        }
+    }
+
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        uint32_t count = voltage_count[endpoint] < current_count[endpoint] ? voltage_count[endpoint] : current_count[endpoint];
+        power_accumulate(&meter_sums[endpoint], meter_voltage[endpoint], meter_current[endpoint], count);
+    }
+}
+
+static bool meter_report(int64_t elapsed_us)
+{
+    bool updated = false;
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        meter_value_t meter_value;
+        if (!type_value_get(&meter_type_value, endpoint, &meter_value)) {
+            ESP_LOGE(TAG, "Error: type_value_get");
+            continue;
+        }
+        power_result_t result;
+        if (!power_compute(&meter_sums[endpoint], meter_value.readwrite.v_scale, meter_value.readwrite.i_scale, &result)) {
+            ESP_LOGW(TAG, "Endpoint %d: no samples", endpoint);
+            continue;
+        }
+        memset(&meter_sums[endpoint], 0, sizeof(power_sums_t));
+
+        meter_read_t read = {
+            .v_rms = result.v_rms,
+            .i_rms = result.i_rms,
+            .power_w = result.real_w,
+            .apparent_va = result.apparent_va,
+            .power_factor = result.power_factor,
+            .energy_wh = meter_value.read.energy_wh + result.real_w * (elapsed_us / 3600e6),
+        };
+        // Only a new value is worth publishing, a failed write leaves changed false
+        bool changed = false;
+        type_value_set_read(&meter_type_value, endpoint, &read, &changed);
+        updated |= changed;
+    }
+    return updated;
+}
+
+static void meter_task(void* arg)
+{
+    int64_t report_time_us = esp_timer_get_time();
+    bool publish_pending = false;
+    int64_t published_us = 0;
+    int index;
+    while(true) {
+        if (xQueueReceive(meter_full_frames, &index, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        meter_process_frame(&meter_frames[index]);
+        xQueueSend(meter_free_frames, &index, portMAX_DELAY);
+
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - report_time_us < (int64_t)METER_REPORT_INTERVAL_MS * 1000) {
+            continue;
+        }
+        // Only the periodic aggregates are published, one publish carries every endpoint, at
+        // most once per telemetry interval
+        publish_pending |= meter_report(now_us - report_time_us);
+        if (publish_pending && link_publish_is_due(&published_us)) {
+            publish_pending = false;
+            meter_publish_value();
+        }
+        report_time_us = now_us;
+    }
+}
+
+bool meter_pre_reboot(void)
+{
+    if (meter_adc) {
+        adc_continuous_stop(meter_adc);
+    }
+    return true;
+}
+
+bool meter_init(callback_t callback_publish_value)
+{
+    ESP_LOGI(TAG, "Initialise %d endpoints", TYPE_MAX_ENDPOINTS);
+    // Create a callback to trigger MQTT publish
+    meter_publish_value = callback_publish_value;
+
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        meter_value_g[endpoint].readwrite.v_scale = THING_METER_V_SCALE;
+        meter_value_g[endpoint].readwrite.i_scale = THING_METER_I_SCALE;
+    }
+
+    meter_free_frames = xQueueCreate(METER_FRAME_COUNT, sizeof(int));
+    meter_full_frames = xQueueCreate(METER_FRAME_COUNT, sizeof(int));
+    if (meter_free_frames == NULL || meter_full_frames == NULL) {
+        ESP_LOGE(TAG, "Error: xQueueCreate");
+        return false;
+    }
+    for (int index = 0; index < METER_FRAME_COUNT; index++) {
+        xQueueSend(meter_free_frames, &index, 0);
+    }
+
+    if (!meter_init_adc()) {
+        ESP_LOGE(TAG, "Error: meter_init_adc");
+        return false;
+    }
+
+    if (xTaskCreate(meter_adc_task, "meter_adc_task", 2048, NULL, 6, NULL) != pdTRUE){
+        ESP_LOGE(TAG, "Error: xTaskCreate");
+        return false;
+    }
+    if (xTaskCreate(meter_task, "meter_task", 3072, NULL, 5, NULL) != pdTRUE){
+        ESP_LOGE(TAG, "Error: xTaskCreate");
+        return false;
+    }
+    return true;
+}
+
+const type_ops_t meter_type_ops = {
+    .name = METER_TYPE_STR,
+    .value = &meter_type_value,
+    .init = meter_init,
+    .pre_reboot = meter_pre_reboot,
+};
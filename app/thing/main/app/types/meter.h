@@ -0,0 +1,59 @@
+/*
+ * meter.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+
+#ifndef _METER_H_
+#define _METER_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <cJSON.h>
+#include "utilities/misc.h"
+#include "utilities/json_reader.h"
+#include "utilities/json_writer.h"
+#include "utilities/schema.h"
+
+
+#define METER_TYPE_STR "METER"
+
+
+// One line per property, see utilities/schema.h
+// Calibration in volts and amps per ADC count, defaults from board.h
+#define METER_READWRITE_FIELDS(X) \
+    X(NUMBER, v_scale, 0, 10) \
+    X(NUMBER, i_scale, 0, 10)
+
+// Measured over the last report interval, energy since boot
+#define METER_READ_FIELDS(X) \
+    X(NUMBER, v_rms, 0, 0) \
+    X(NUMBER, i_rms, 0, 0) \
+    X(NUMBER, power_w, 0, 0) \
+    X(NUMBER, apparent_va, 0, 0) \
+    X(NUMBER, power_factor, 0, 0) \
+    X(NUMBER, energy_wh, 0, 0)
+
+typedef struct meter_readwrite_t {
+    METER_READWRITE_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
+} meter_readwrite_t;
+
+typedef struct meter_read_t {
+    METER_READ_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
+} meter_read_t;
+
+typedef struct meter_value_t {
+    meter_readwrite_t readwrite;
+    meter_read_t read;
+} meter_value_t;
+
+
+bool meter_init(callback_t callback_publish_value);
+bool meter_pre_reboot(void);
+
+extern const struct type_ops_t meter_type_ops;
+
+#endif /* _METER_H_ */
@@ -0,0 +1,220 @@
+/*
+ * sensor.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "app/types/sensor.h"
+#include "app/types/type.h"
+#include <cJSON.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include "utilities/misc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_adc/adc_oneshot.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "board/board.h"
+#include "utilities/schema.h"
+#include "utilities/dirty.h"
+#include "middlewares/link.h"
+#include "utilities/seqlock.h"
+#include "utilities/pipeline.h"
+
+#define SENSOR_SAMPLE_PERIOD_US     10000   // 100 Hz per endpoint
+#define SENSOR_DECIMATION           10      // Downsampled to 10 Hz for the percentiles
+#define SENSOR_WINDOW_SIZE          100     // One aggregate per 10 s
+#define SENSOR_PROCESS_INTERVAL_MS  500     // Drains 50 samples, the ring holds 256
+
+static const char *TAG = "SENSOR";
+
+static const adc_channel_t sensor_adc_channels[] = THING_SENSOR_ADC_CHANNELS;
+
+_Static_assert(sizeof(sensor_adc_channels) / sizeof(sensor_adc_channels[0]) >= TYPE_MAX_ENDPOINTS,
+               "Every sensor endpoint needs an ADC channel in board.h");
+
+static seqlock_t sensor_value_lock[TYPE_MAX_ENDPOINTS];
+
+static callback_t sensor_publish_value = NULL;
+
+#define SENSOR_READWRITE_FIELD(kind, field, a, b) SCHEMA_FIELD(sensor_readwrite_t, kind, field, a, b)
+#define SENSOR_READ_FIELD(kind, field, a, b) SCHEMA_FIELD(sensor_read_t, kind, field, a, b)
+
+static const schema_field_t sensor_readwrite_fields[] = { SENSOR_READWRITE_FIELDS(SENSOR_READWRITE_FIELD) SCHEMA_FIELDS_END };
+static const schema_field_t sensor_read_fields[] = { SENSOR_READ_FIELDS(SENSOR_READ_FIELD) SCHEMA_FIELDS_END };
+
+// Sampling starts when the cloud enables an endpoint
+static sensor_value_t sensor_value_g[TYPE_MAX_ENDPOINTS];
+
+// Filled by the sample timer, drained by sensor_task()
+static pipeline_t sensor_pipelines[TYPE_MAX_ENDPOINTS];
+static bool sensor_enabled[TYPE_MAX_ENDPOINTS];
+
+static adc_oneshot_unit_handle_t sensor_adc = NULL;
+static esp_timer_handle_t sensor_timer = NULL;
+
+static void sensor_task(void* arg);
+static void sensor_sample_cb(void* arg);
+static bool sensor_set_read(int endpoint, const pipeline_aggregate_t *aggregate, bool *changed);
+static bool sensor_init_adc(void);
+static bool sensor_update_hw(int endpoint);
+
+static const type_value_t sensor_type_value = TYPE_VALUE(sensor, sensor_update_hw);
+
+static bool sensor_set_read(int endpoint, const pipeline_aggregate_t *aggregate, bool *changed)
+{
+    sensor_read_t read = {
+        .min = aggregate->min,
+        .max = aggregate->max,
+        .mean = aggregate->mean,
+        .p50 = aggregate->p50,
+        .p90 = aggregate->p90,
+        .count = aggregate->count,
+        .dropped = aggregate->dropped,
+    };
+    return type_value_set_read(&sensor_type_value, endpoint, &read, changed);
+}
+
+static void sensor_sample_cb(void* arg)
+{
+    // Runs in the esp_timer task, so a oneshot read is allowed
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        if (!__atomic_load_n(&sensor_enabled[endpoint], __ATOMIC_RELAXED)) {
+            continue;
+        }
+        int raw;
+        if (adc_oneshot_read(sensor_adc, sensor_adc_channels[endpoint], &raw) == ESP_OK) {
+            pipeline_push(&sensor_pipelines[endpoint], raw);
+        }
+    }
+}
+
+static bool sensor_init_adc(void)
+{
+    adc_oneshot_unit_init_cfg_t unit_config = {
+        .unit_id = ADC_UNIT_1,
+    };
+    if (adc_oneshot_new_unit(&unit_config, &sensor_adc) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: adc_oneshot_new_unit");
+        return false;
+    }
+
+    adc_oneshot_chan_cfg_t channel_config = {
+        .atten = ADC_ATTEN_DB_11,
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        if (adc_oneshot_config_channel(sensor_adc, sensor_adc_channels[endpoint], &channel_config) != ESP_OK) {
+            ESP_LOGE(TAG, "Error: adc_oneshot_config_channel");
+            return false;
+        }
+    }
+    return true;
+}
+
+static void sensor_task(void* arg)
+{
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        sensor_update_hw(endpoint);
+    }
+
+    int64_t busy_us[TYPE_MAX_ENDPOINTS] = {0};
+    bool publish_pending = false;
+    int64_t published_us = 0;
+    while(true) {
+        vTaskDelay(SENSOR_PROCESS_INTERVAL_MS / portTICK_PERIOD_MS);
+        bool updated = false;
+        for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+            pipeline_aggregate_t aggregate;
+            int64_t start_us = esp_timer_get_time();
+            bool complete = pipeline_process(&sensor_pipelines[endpoint], &aggregate);
+            busy_us[endpoint] += esp_timer_get_time() - start_us;
+            if (!complete) {
+                continue;
+            }
+            // Processing cost of the window, as throughput of one core
+            ESP_LOGI(TAG, "Endpoint %d: %" PRIu32 " samples in %lld us, %lld samples/s on core %d",
+                     endpoint, aggregate.count, (long long)busy_us[endpoint],
+                     busy_us[endpoint] ? (long long)aggregate.count * 1000000 / busy_us[endpoint] : 0LL,
+                     xPortGetCoreID());
+            busy_us[endpoint] = 0;
+            if (aggregate.dropped) {
+                ESP_LOGW(TAG, "Endpoint %d: %" PRIu32 " samples dropped", endpoint, aggregate.dropped);
+            }
+            // Only a new aggregate is worth publishing, a failed write leaves changed false
+            bool changed = false;
+            sensor_set_read(endpoint, &aggregate, &changed);
+            updated |= changed;
+        }
+        // Only aggregates are published, one publish carries every endpoint, at most once
+        // per telemetry interval
+        publish_pending |= updated;
+        if (publish_pending && link_publish_is_due(&published_us)) {
+            publish_pending = false;
+            sensor_publish_value();
+        }
+    }
+}
+
+static bool sensor_update_hw(int endpoint)
+{
+    sensor_value_t sensor_value;
+    if (!type_value_get(&sensor_type_value, endpoint, &sensor_value)) {
+        ESP_LOGE(TAG, "Error: type_value_get");
+        return false;
+    }
+    __atomic_store_n(&sensor_enabled[endpoint], sensor_value.readwrite.enabled, __ATOMIC_RELAXED);
+    return true;
+}
+
+bool sensor_pre_reboot(void)
+{
+    if (sensor_timer) {
+        esp_timer_stop(sensor_timer);
+    }
+    return true;
+}
+
+bool sensor_init(callback_t callback_publish_value)
+{
+    ESP_LOGI(TAG, "Initialise %d endpoints", TYPE_MAX_ENDPOINTS);
+    // Create a callback to trigger MQTT publish
+    sensor_publish_value = callback_publish_value;
+
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        if (!pipeline_init(&sensor_pipelines[endpoint], SENSOR_DECIMATION, SENSOR_WINDOW_SIZE)) {
+            ESP_LOGE(TAG, "Error: pipeline_init");
+            return false;
+        }
+    }
+
+    if (!sensor_init_adc()) {
+        ESP_LOGE(TAG, "Error: sensor_init_adc");
+        return false;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = sensor_sample_cb,
+        .name = "sensor_sample",
+    };
+    if (esp_timer_create(&timer_args, &sensor_timer) != ESP_OK ||
+        esp_timer_start_periodic(sensor_timer, SENSOR_SAMPLE_PERIOD_US) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: esp_timer");
+        return false;
+    }
+
+    if (xTaskCreate(sensor_task, "sensor_task", 3072, NULL, 5, NULL) != pdTRUE){
+        ESP_LOGE(TAG, "Error: xTaskCreate");
+        return false;
+    }
+    return true;
+}
+
+const type_ops_t sensor_type_ops = {
+    .name = SENSOR_TYPE_STR,
+    .value = &sensor_type_value,
+    .init = sensor_init,
+    .pre_reboot = sensor_pre_reboot,
+};
@@ -0,0 +1,58 @@
+/*
+ * sensor.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+
+#ifndef _SENSOR_H_
+#define _SENSOR_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <cJSON.h>
+#include "utilities/misc.h"
+#include "utilities/json_reader.h"
+#include "utilities/json_writer.h"
+#include "utilities/schema.h"
+
+
+#define SENSOR_TYPE_STR "SENSOR"
+
+
+// One line per property, see utilities/schema.h
+#define SENSOR_READWRITE_FIELDS(X) \
+    X(BOOL, enabled, 0, 0)
+
+// Aggregates of the last window, in raw ADC counts
+#define SENSOR_READ_FIELDS(X) \
+    X(NUMBER, min, 0, 0) \
+    X(NUMBER, max, 0, 0) \
+    X(NUMBER, mean, 0, 0) \
+    X(NUMBER, p50, 0, 0) \
+    X(NUMBER, p90, 0, 0) \
+    X(INT, count, 0, 0) \
+    X(INT, dropped, 0, 0)
+
+typedef struct sensor_readwrite_t {
+    SENSOR_READWRITE_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
+} sensor_readwrite_t;
+
+typedef struct sensor_read_t {
+    SENSOR_READ_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
+} sensor_read_t;
+
+typedef struct sensor_value_t {
+    sensor_readwrite_t readwrite;
+    sensor_read_t read;
+} sensor_value_t;
+
+
+bool sensor_init(callback_t callback_publish_value);
+bool sensor_pre_reboot(void);
+
+extern const struct type_ops_t sensor_type_ops;
+
+#endif /* _SENSOR_H_ */
@@ -1,108 +1,82 @@
 #include "app/types/switch.h"
+#include "app/types/type.h"
 #include <cJSON.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include "utilities/misc.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "driver/gpio.h"
 #include "board/board.h"
+#include "utilities/schema.h"
+#include "utilities/dirty.h"
+#include "utilities/seqlock.h"
+#include "utilities/version.h"
 
 #define SWITCH_BUTTON_DEBOUNCE_MS   200
+#define SWITCH_BUTTON_QUEUE_LEN     8
 
 static const char *TAG = "SWITCH";
 
-static SemaphoreHandle_t switch_value_lock = NULL;
-static SemaphoreHandle_t switch_button_trigger = NULL;
+static const gpio_num_t switch_button_gpios[] = THING_BUTTON_GPIOS;
+static const gpio_num_t switch_led_gpios[] = THING_LED_GPIOS;
 
-static callback_t switch_publish_value = NULL;
+_Static_assert(sizeof(switch_button_gpios) / sizeof(switch_button_gpios[0]) >= TYPE_MAX_ENDPOINTS &&
+               sizeof(switch_led_gpios) / sizeof(switch_led_gpios[0]) >= TYPE_MAX_ENDPOINTS,
+               "Every switch endpoint needs a button and a LED in board.h");
 
-static switch_value_t switch_value_g = {
-    .read = {
-    },
-    .readwrite = {
-        .status = false,
-    }
-};
+static seqlock_t switch_value_lock[TYPE_MAX_ENDPOINTS];
+// Endpoints whose button was pressed, sent from the ISR
+static QueueHandle_t switch_button_queue = NULL;
 
-static void switch_task(void* arg);
-static bool switch_get_struct(switch_value_t *switch_value);
-static bool switch_set_struct(switch_value_t switch_value);
-static bool switch_take_value_lock(void);
-static void switch_give_value_lock(void);
-static bool switch_init_button(void);
-static bool switch_init_led(void);
-static void switch_do_button_trigger(void);
-static bool switch_wait_button_trigger(void);
-static bool switch_update_hw(void);
-
-static bool switch_take_value_lock(void)
-{
-    if (!(xSemaphoreTake(switch_value_lock, 0) == pdTRUE)){
-        ESP_LOGE(TAG, "Error: xSemaphoreTake");
-        return false;
-    }
-    return true;
-}
+static callback_t switch_publish_value = NULL;
 
-static void switch_give_value_lock(void)
-{
-    xSemaphoreGive(switch_value_lock);
-}
+#define SWITCH_READWRITE_FIELD(kind, field, a, b) SCHEMA_FIELD(switch_readwrite_t, kind, field, a, b)
+#define SWITCH_READ_FIELD(kind, field, a, b) SCHEMA_FIELD(switch_read_t, kind, field, a, b)
 
-static bool switch_wait_button_trigger(void)
-{
-    if (!(xSemaphoreTake(switch_button_trigger, portMAX_DELAY) == pdTRUE)){
-        ESP_LOGE(TAG, "Error: xSemaphoreTake");
-        return false;
-    }
-    return true;
-}
+static const schema_field_t switch_readwrite_fields[] = { SWITCH_READWRITE_FIELDS(SWITCH_READWRITE_FIELD) SCHEMA_FIELDS_END };
+static const schema_field_t switch_read_fields[] = { SWITCH_READ_FIELDS(SWITCH_READ_FIELD) SCHEMA_FIELDS_END };
 
-static void switch_do_button_trigger(void)
-{
-    xSemaphoreGiveFromISR(switch_button_trigger, NULL);
-}
+// Every endpoint starts out off
+static switch_value_t switch_value_g[TYPE_MAX_ENDPOINTS];
 
-static bool switch_get_struct(switch_value_t *switch_value) 
-{    
-    if(!switch_take_value_lock()) {
-        ESP_LOGE(TAG, "Error: switch_take_value_lock");
-        return false;
-    }
-    *switch_value = switch_value_g;
-    switch_give_value_lock();
-    return true;
-}
+static void switch_task(void* arg);
+static bool switch_init_button(int endpoint);
+static bool switch_init_led(int endpoint);
+static bool switch_wait_button_trigger(int *endpoint);
+static bool switch_update_hw(int endpoint);
+static bool switch_toggle(void *readwrite, void *arg);
+
+static const type_value_t switch_type_value = TYPE_VALUE(switch, switch_update_hw);
 
-static bool switch_set_struct(switch_value_t switch_value) 
+static bool switch_wait_button_trigger(int *endpoint)
 {
-    if(!switch_take_value_lock()) {
-        ESP_LOGE(TAG, "Error: switch_take_value_lock");
+    if (!(xQueueReceive(switch_button_queue, endpoint, portMAX_DELAY) == pdTRUE)){
+        ESP_LOGE(TAG, "Error: xQueueReceive");
         return false;
     }
-    switch_value_g.readwrite.status = switch_value.readwrite.status;
-    switch_give_value_lock();
     return true;
 }
 
 static void IRAM_ATTR switch_button_isr_handler(void* arg)
 {
-    static TickType_t last_time = 0;
+    static TickType_t last_time[TYPE_MAX_ENDPOINTS] = {0};
+    int endpoint = (int)(intptr_t)arg;
     TickType_t now_time = xTaskGetTickCountFromISR();
 
-    if (now_time - last_time > pdMS_TO_TICKS(SWITCH_BUTTON_DEBOUNCE_MS)){
-        switch_do_button_trigger();
+    if (now_time - last_time[endpoint] > pdMS_TO_TICKS(SWITCH_BUTTON_DEBOUNCE_MS)){
+        xQueueSendFromISR(switch_button_queue, &endpoint, NULL);
     }
-    last_time = now_time;
+    last_time[endpoint] = now_time;
 }
 
-static bool switch_init_button(void)
+static bool switch_init_button(int endpoint)
 {
     gpio_config_t button_config = {
-        .pin_bit_mask = 1ULL << THING_BUTTON_GPIO,
+        .pin_bit_mask = 1ULL << switch_button_gpios[endpoint],
         .mode = GPIO_MODE_INPUT,
         .pull_up_en = GPIO_PULLUP_ENABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
@@ -114,12 +88,7 @@ static bool switch_init_button(void)
         return false;
     }
 
-    if (gpio_install_isr_service(0) != ESP_OK) {
-        ESP_LOGE(TAG, "Error: gpio_install_isr_service");
-        return false;
-    }
-
-    if(gpio_isr_handler_add(THING_BUTTON_GPIO, switch_button_isr_handler, NULL) != ESP_OK) {
+    if(gpio_isr_handler_add(switch_button_gpios[endpoint], switch_button_isr_handler, (void*)(intptr_t)endpoint) != ESP_OK) {
         ESP_LOGE(TAG, "Error: gpio_isr_handler_add");
         return false;
     }
@@ -127,10 +96,10 @@ static bool switch_init_button(void)
     return true;
 }
 
-static bool switch_init_led(void)
+static bool switch_init_led(int endpoint)
 {
     gpio_config_t led_config = {
-        .pin_bit_mask = (1ULL << THING_LED_GPIO),
+        .pin_bit_mask = (1ULL << switch_led_gpios[endpoint]),
         .mode = GPIO_MODE_OUTPUT,
         .pull_up_en = 0,
         .pull_down_en = 0,
@@ -142,90 +111,48 @@ static bool switch_init_led(void)
         return false;
     }
 
-    gpio_set_level(THING_LED_GPIO, 0);
+    gpio_set_level(switch_led_gpios[endpoint], 0);
 
     return true;
 }
 
 static void switch_task(void* arg) 
 {
-    switch_value_t switch_value;
-    if (switch_get_struct(&switch_value)){
-        switch_update_hw();
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        switch_update_hw(endpoint);
     }
 
+    int endpoint;
     while(true) {
-        if(switch_wait_button_trigger()){
-            switch_value.readwrite.status = !switch_value.readwrite.status;
-            if (switch_set_struct(switch_value)){
-                switch_update_hw();
-                // Trigger MQTT publish of switch_value
+        if(switch_wait_button_trigger(&endpoint)){
+            // Toggled under the writer lock, so a command arriving at the same time isn't lost
+            if (type_value_update(&switch_type_value, endpoint, switch_toggle, NULL, NULL)){
+                // A press outranks any command the app sent before seeing it
+                version_local_change();
+                switch_update_hw(endpoint);
+                // Trigger MQTT publish of switch_value, presses close together share one publish
                 switch_publish_value();
             }
         }
     }
 }
 
-static bool switch_update_hw(void)
-{   
-    switch_value_t switch_value;
-    if (!switch_get_struct(&switch_value)) {
-        ESP_LOGE(TAG, "Error: switch_get_struct");
-        return false;
-    } else {
-        gpio_set_level(THING_LED_GPIO, switch_value.readwrite.status);
-    }
-
-    return true;
-}
-
-bool switch_set_value_json(cJSON* value)
+static bool switch_toggle(void *readwrite, void *arg)
 {
-    cJSON *read = cJSON_GetObjectItem(value, "read");
-    cJSON *readwrite = cJSON_GetObjectItem(value, "readwrite");
-    if (!read || !readwrite) {
-        ESP_LOGE(TAG, "Error: !read || !readwrite");
-        return false;
-    }
-
-    cJSON *status = cJSON_GetObjectItem(readwrite, "status");
-    if (!cJSON_IsBool(status)) {
-        ESP_LOGE(TAG, "Error: cJSON_IsBool");
-        return false;
-    }
-
-    // Update the global thing struct thread safely
-    switch_value_t switch_value;
-    if (!switch_get_struct(&switch_value)) {
-        ESP_LOGE(TAG, "Error: switch_get_struct");
-        return false;
-    }
-    switch_value.readwrite.status = cJSON_IsTrue(status);
-    if (!switch_set_struct(switch_value)) {
-        ESP_LOGE(TAG, "Error: switch_set_struct");
-        return false;
-    }
-
-    switch_update_hw();
-
+    switch_readwrite_t *switch_readwrite = readwrite;
+    switch_readwrite->status = !switch_readwrite->status;
     return true;
 }
 
-bool switch_get_value_json(cJSON* value)
-{
+static bool switch_update_hw(int endpoint)
+{   
     switch_value_t switch_value;
-    if (!switch_get_struct(&switch_value)){
-        ESP_LOGE(TAG, "Error: switch_get_struct");
-        return false;
-    }
-
-    cJSON *read = cJSON_GetObjectItem(value, "read");
-    cJSON *readwrite = cJSON_GetObjectItem(value, "readwrite");
-    if (!read || !readwrite) {
-        ESP_LOGE(TAG, "Error: !read || !readwrite");
+    if (!type_value_get(&switch_type_value, endpoint, &switch_value)) {
+        ESP_LOGE(TAG, "Error: type_value_get");
         return false;
+    } else {
+        gpio_set_level(switch_led_gpios[endpoint], switch_value.readwrite.status);
     }
-    cJSON_AddBoolToObject(readwrite, "status", switch_value.readwrite.status);
 
     return true;
 }
@@ -237,17 +164,25 @@ bool switch_pre_reboot(void)
 
 bool switch_init(callback_t callback_publish_value)
 {
-    ESP_LOGI(TAG, "Initialise");
+    ESP_LOGI(TAG, "Initialise %d endpoints", TYPE_MAX_ENDPOINTS);
     // Create a callback to trigger MQTT publish
     switch_publish_value = callback_publish_value;
 
-    switch_init_button();
-    switch_init_led();
+    switch_button_queue = xQueueCreate(SWITCH_BUTTON_QUEUE_LEN, sizeof(int));
+    if (switch_button_queue == NULL) {
+        ESP_LOGE(TAG, "Error: xQueueCreate");
+        return false;
+    }
 
-    // Create and give switch struct mutex
-    switch_value_lock = xSemaphoreCreateBinary();
-    switch_button_trigger = xSemaphoreCreateBinary();
-    switch_give_value_lock();
+    if (gpio_install_isr_service(0) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: gpio_install_isr_service");
+        return false;
+    }
+
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        switch_init_button(endpoint);
+        switch_init_led(endpoint);
+    }
 
     if (xTaskCreate(switch_task, "switch_task", 2048, NULL, 5, NULL) != pdTRUE){
         ESP_LOGE(TAG, "Error: xTaskCreate");
@@ -255,3 +190,10 @@ bool switch_init(callback_t callback_publish_value)
     }
     return true;
 }
+
+const type_ops_t switch_type_ops = {
+    .name = SWITCH_TYPE_STR,
+    .value = &switch_type_value,
+    .init = switch_init,
+    .pre_reboot = switch_pre_reboot,
+};
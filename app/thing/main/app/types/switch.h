@@ -12,18 +12,28 @@
 #include <stdio.h>
 #include <cJSON.h>
 #include "utilities/misc.h"
+#include "utilities/json_reader.h"
+#include "utilities/json_writer.h"
+#include "utilities/schema.h"
 
 
 #define SWITCH_TYPE_STR "SWITCH"
-#define SWITCH_TYPE_INT 1
 
 
+// One line per property, see utilities/schema.h
+#define SWITCH_READWRITE_FIELDS(X) \
+    X(BOOL, status, 0, 0)
+
+#define SWITCH_READ_FIELDS(X)
+
 typedef struct switch_readwrite_t {
-    bool status;
+    SWITCH_READWRITE_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
 } switch_readwrite_t;
 
 typedef struct switch_read_t {
-
+    SWITCH_READ_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
 } switch_read_t;
 
 typedef struct switch_value_t {
@@ -32,9 +42,9 @@ typedef struct switch_value_t {
 } switch_value_t;
 
 
-bool switch_get_value_json(cJSON *value);
-bool switch_set_value_json(cJSON *value);
 bool switch_init(callback_t callback_publish_value);
 bool switch_pre_reboot(void);
 
+extern const struct type_ops_t switch_type_ops;
+
 #endif /* _SWITCH_H_ */
@@ -0,0 +1,254 @@
+/*
+ * thermostat.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "app/types/thermostat.h"
+#include "app/types/type.h"
+#include <cJSON.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utilities/misc.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_adc/adc_oneshot.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "board/board.h"
+#include "utilities/schema.h"
+#include "utilities/dirty.h"
+#include "middlewares/link.h"
+#include "utilities/seqlock.h"
+#include "utilities/pid.h"
+
+#define THERMOSTAT_PERIOD_MS        100
+#define THERMOSTAT_WINDOW_TICKS     100     // Relay duty is time-proportioned over 10 s
+#define THERMOSTAT_REPORT_TICKS     100     // Loop state is reported every 10 s
+#define THERMOSTAT_TASK_PRIORITY    10      // Above every network and type task
+#define THERMOSTAT_TASK_CORE        1       // Wi-Fi and lwIP run on core 0
+
+static const char *TAG = "THERMOSTAT";
+
+static const adc_channel_t thermostat_adc_channels[] = THING_THERMOSTAT_ADC_CHANNELS;
+static const int thermostat_relay_gpios[] = THING_THERMOSTAT_RELAY_GPIOS;
+
+_Static_assert(sizeof(thermostat_adc_channels) / sizeof(thermostat_adc_channels[0]) >= TYPE_MAX_ENDPOINTS &&
+               sizeof(thermostat_relay_gpios) / sizeof(thermostat_relay_gpios[0]) >= TYPE_MAX_ENDPOINTS,
+               "Every thermostat endpoint needs an ADC channel and a relay GPIO in board.h");
+
+static seqlock_t thermostat_value_lock[TYPE_MAX_ENDPOINTS];
+
+static callback_t thermostat_publish_value = NULL;
+
+#define THERMOSTAT_READWRITE_FIELD(kind, field, a, b) SCHEMA_FIELD(thermostat_readwrite_t, kind, field, a, b)
+#define THERMOSTAT_READ_FIELD(kind, field, a, b) SCHEMA_FIELD(thermostat_read_t, kind, field, a, b)
+
+static const schema_field_t thermostat_readwrite_fields[] = { THERMOSTAT_READWRITE_FIELDS(THERMOSTAT_READWRITE_FIELD) SCHEMA_FIELDS_END };
+static const schema_field_t thermostat_read_fields[] = { THERMOSTAT_READ_FIELDS(THERMOSTAT_READ_FIELD) SCHEMA_FIELDS_END };
+
+// Setpoints and gains are set in thermostat_init(), control starts when the cloud enables it
+static thermostat_value_t thermostat_value_g[TYPE_MAX_ENDPOINTS];
+
+static adc_oneshot_unit_handle_t thermostat_adc = NULL;
+
+static void thermostat_control_task(void* arg);
+static bool thermostat_init_adc(void);
+static bool thermostat_init_relay(int endpoint);
+static bool thermostat_read_temperature(int endpoint, float *temperature);
+
+// Commands are picked up by the control loop at its next period
+static const type_value_t thermostat_type_value = TYPE_VALUE(thermostat, NULL);
+
+static bool thermostat_init_adc(void)
+{
+    adc_oneshot_unit_init_cfg_t unit_config = {
+        .unit_id = ADC_UNIT_1,
+    };
+    if (adc_oneshot_new_unit(&unit_config, &thermostat_adc) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: adc_oneshot_new_unit");
+        return false;
+    }
+
+    adc_oneshot_chan_cfg_t channel_config = {
+        .atten = ADC_ATTEN_DB_11,
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        if (adc_oneshot_config_channel(thermostat_adc, thermostat_adc_channels[endpoint], &channel_config) != ESP_OK) {
+            ESP_LOGE(TAG, "Error: adc_oneshot_config_channel");
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool thermostat_init_relay(int endpoint)
+{
+    gpio_config_t relay_config = {
+        .pin_bit_mask = (1ULL << thermostat_relay_gpios[endpoint]),
+        .mode = GPIO_MODE_OUTPUT,
+        .pull_up_en = 0,
+        .pull_down_en = 0,
+        .intr_type = GPIO_INTR_DISABLE
+    };
+
+    if(gpio_config(&relay_config) != ESP_OK) {
+        ESP_LOGE(TAG, "Error: gpio_config");
+        return false;
+    }
+
+    gpio_set_level(thermostat_relay_gpios[endpoint], 0);
+
+    return true;
+}
+
+static bool thermostat_read_temperature(int endpoint, float *temperature)
+{
+    int raw;
+    if (adc_oneshot_read(thermostat_adc, thermostat_adc_channels[endpoint], &raw) != ESP_OK) {
+        return false;
+    }
+    *temperature = raw * THING_THERMOSTAT_C_PER_COUNT + THING_THERMOSTAT_C_OFFSET;
+    return true;
+}
+
+static void thermostat_control_task(void* arg)
+{
+    // Only this task touches the controllers and relays, nothing here waits on the network
+    pid_controller_t pid[TYPE_MAX_ENDPOINTS];
+    float output[TYPE_MAX_ENDPOINTS] = {0};
+    float temperature[TYPE_MAX_ENDPOINTS] = {0};
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        pid_init(&pid[endpoint], 0, 100);
+    }
+
+    uint32_t tick = 0;
+    int64_t jitter_max_us = 0;
+    int64_t exec_max_us = 0;
+    uint32_t overruns = 0;
+    bool publish_pending = false;
+    int64_t published_us = 0;
+    const float dt_s = THERMOSTAT_PERIOD_MS / 1000.0f;
+    TickType_t wake_tick = xTaskGetTickCount();
+    int64_t expected_us = esp_timer_get_time();
+
+    while(true) {
+        vTaskDelayUntil(&wake_tick, pdMS_TO_TICKS(THERMOSTAT_PERIOD_MS));
+        int64_t start_us = esp_timer_get_time();
+        expected_us += THERMOSTAT_PERIOD_MS * 1000;
+        int64_t jitter_us = llabs(start_us - expected_us);
+        if (jitter_us > jitter_max_us) {
+            jitter_max_us = jitter_us;
+        }
+
+        uint32_t window_tick = tick % THERMOSTAT_WINDOW_TICKS;
+        for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+            thermostat_value_t thermostat_value;
+            if (!type_value_get(&thermostat_type_value, endpoint, &thermostat_value)) {
+                continue;
+            }
+            if (!thermostat_value.readwrite.enabled) {
+                pid_init(&pid[endpoint], 0, 100);
+                output[endpoint] = 0;
+            } else if (thermostat_read_temperature(endpoint, &temperature[endpoint])) {
+                pid_gains_t gains = {
+                    .kp = thermostat_value.readwrite.kp,
+                    .ki = thermostat_value.readwrite.ki,
+                    .kd = thermostat_value.readwrite.kd,
+                };
+                output[endpoint] = pid_update(&pid[endpoint], &gains, thermostat_value.readwrite.setpoint,
+                                              temperature[endpoint], dt_s);
+            }
+            // Time-proportioned relay, on for output percent of each window
+            gpio_set_level(thermostat_relay_gpios[endpoint],
+                           window_tick * 100 < output[endpoint] * THERMOSTAT_WINDOW_TICKS);
+        }
+
+        int64_t exec_us = esp_timer_get_time() - start_us;
+        if (exec_us > exec_max_us) {
+            exec_max_us = exec_us;
+        }
+        if (exec_us > THERMOSTAT_PERIOD_MS * 1000) {
+            overruns++;
+        }
+
+        if (++tick % THERMOSTAT_REPORT_TICKS != 0) {
+            continue;
+        }
+        bool updated = false;
+        for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+            thermostat_read_t read = {
+                .temperature = temperature[endpoint],
+                .output = output[endpoint],
+                .jitter_max_us = jitter_max_us,
+                .exec_max_us = exec_max_us,
+                .overruns = overruns,
+            };
+            bool changed = false;
+            type_value_set_read(&thermostat_type_value, endpoint, &read, &changed);
+            updated |= changed;
+        }
+        ESP_LOGI(TAG, "Loop jitter max %lld us, execution max %lld us, %" PRIu32 " overruns",
+                 (long long)jitter_max_us, (long long)exec_max_us, overruns);
+        jitter_max_us = 0;
+        exec_max_us = 0;
+        overruns = 0;
+        // Reporting only requests a publish, the loop never waits for it. At most once per
+        // telemetry interval, a poor link gets fewer reports.
+        publish_pending |= updated;
+        if (publish_pending && link_publish_is_due(&published_us)) {
+            publish_pending = false;
+            thermostat_publish_value();
+        }
+    }
+}
+
+bool thermostat_pre_reboot(void)
+{
+    // Never leave a heater on across the reboot
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        gpio_set_level(thermostat_relay_gpios[endpoint], 0);
+    }
+    return true;
+}
+
+bool thermostat_init(callback_t callback_publish_value)
+{
+    ESP_LOGI(TAG, "Initialise %d endpoints", TYPE_MAX_ENDPOINTS);
+    // Create a callback to trigger MQTT publish
+    thermostat_publish_value = callback_publish_value;
+
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        thermostat_value_g[endpoint].readwrite.setpoint = 20;
+        thermostat_value_g[endpoint].readwrite.kp = 10;
+        thermostat_value_g[endpoint].readwrite.ki = 0.05;
+        thermostat_value_g[endpoint].readwrite.kd = 0;
+        if (!thermostat_init_relay(endpoint)) {
+            ESP_LOGE(TAG, "Error: thermostat_init_relay");
+            return false;
+        }
+    }
+
+    if (!thermostat_init_adc()) {
+        ESP_LOGE(TAG, "Error: thermostat_init_adc");
+        return false;
+    }
+
+    if (xTaskCreatePinnedToCore(thermostat_control_task, "thermostat_task", 3072, NULL,
+                                THERMOSTAT_TASK_PRIORITY, NULL, THERMOSTAT_TASK_CORE) != pdTRUE){
+        ESP_LOGE(TAG, "Error: xTaskCreatePinnedToCore");
+        return false;
+    }
+    return true;
+}
+
+const type_ops_t thermostat_type_ops = {
+    .name = THERMOSTAT_TYPE_STR,
+    .value = &thermostat_type_value,
+    .init = thermostat_init,
+    .pre_reboot = thermostat_pre_reboot,
+};
@@ -0,0 +1,60 @@
+/*
+ * thermostat.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+
+#ifndef _THERMOSTAT_H_
+#define _THERMOSTAT_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <cJSON.h>
+#include "utilities/misc.h"
+#include "utilities/json_reader.h"
+#include "utilities/json_writer.h"
+#include "utilities/schema.h"
+
+
+#define THERMOSTAT_TYPE_STR "THERMOSTAT"
+
+
+// One line per property, see utilities/schema.h
+#define THERMOSTAT_READWRITE_FIELDS(X) \
+    X(BOOL, enabled, 0, 0) \
+    X(NUMBER, setpoint, 5, 35) \
+    X(NUMBER, kp, 0, 1000) \
+    X(NUMBER, ki, 0, 100) \
+    X(NUMBER, kd, 0, 1000)
+
+// Loop state and timing over the last report interval
+#define THERMOSTAT_READ_FIELDS(X) \
+    X(NUMBER, temperature, 0, 0) \
+    X(NUMBER, output, 0, 0) \
+    X(INT, jitter_max_us, 0, 0) \
+    X(INT, exec_max_us, 0, 0) \
+    X(INT, overruns, 0, 0)
+
+typedef struct thermostat_readwrite_t {
+    THERMOSTAT_READWRITE_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
+} thermostat_readwrite_t;
+
+typedef struct thermostat_read_t {
+    THERMOSTAT_READ_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
+} thermostat_read_t;
+
+typedef struct thermostat_value_t {
+    thermostat_readwrite_t readwrite;
+    thermostat_read_t read;
+} thermostat_value_t;
+
+
+bool thermostat_init(callback_t callback_publish_value);
+bool thermostat_pre_reboot(void);
+
+extern const struct type_ops_t thermostat_type_ops;
+
+#endif /* _THERMOSTAT_H_ */
@@ -1,66 +1,303 @@
 // Include your thing type
 #include "app/types/type.h"
 #include "app/types/switch.h"
+#include "app/types/sensor.h"
+#include "app/types/meter.h"
+#include "app/types/dimmer.h"
+#include "app/types/thermostat.h"
 #include "app/types/default.h"
 #include <string.h>
 #include <cJSON.h>
 #include "esp_log.h"
+#include "utilities/dirty.h"
+#include "utilities/schema.h"
+#include "utilities/seqlock.h"
+
+#define TYPE_FNV_OFFSET_BASIS   2166136261UL
+#define TYPE_FNV_PRIME          16777619UL
 
 static const char *TAG = "TYPE";
-static int type_int = 0;
 
-// Add your new type in the if case
-bool type_set_int(const char* type_str)
+// What a set parses into the readwrite struct, one of json, reader or name
+typedef struct type_value_parse_t {
+    const type_value_t *type_value;
+    cJSON *json;
+    const json_reader_t *reader;
+    int object;
+    const char *name;
+    double number;
+} type_value_parse_t;
+
+// Add your new type here, with a Kconfig option so products only include the types they use.
+// Types left out are never referenced, so the linker drops their code.
+static const type_ops_t *const type_registry[] = {
+#if CONFIG_RIOTBOX_TYPE_SWITCH
+    &switch_type_ops,
+#endif
+#if CONFIG_RIOTBOX_TYPE_SENSOR
+    &sensor_type_ops,
+#endif
+#if CONFIG_RIOTBOX_TYPE_METER
+    &meter_type_ops,
+#endif
+#if CONFIG_RIOTBOX_TYPE_DIMMER
+    &dimmer_type_ops,
+#endif
+#if CONFIG_RIOTBOX_TYPE_THERMOSTAT
+    &thermostat_type_ops,
+#endif
+};
+
+static const type_ops_t *type_ops = &default_type_ops;
+
+static uint32_t type_hash(const char *type_str);
+static bool type_check_endpoint(int endpoint);
+static bool type_value_init(const type_value_t *type_value);
+static uint8_t *type_value_at(const type_value_t *type_value, int endpoint);
+static bool type_value_parse_json(void *readwrite, void *arg);
+static bool type_value_parse_reader(void *readwrite, void *arg);
+static bool type_value_parse_field(void *readwrite, void *arg);
+static bool type_value_set(const type_value_t *type_value, int endpoint, bool (*parse)(void *readwrite, void *arg), type_value_parse_t *arg);
+static bool type_value_set_json(const type_value_t *type_value, int endpoint, cJSON *value);
+static bool type_value_set_reader(const type_value_t *type_value, int endpoint, const json_reader_t *reader, int value);
+static bool type_value_get_writer(const type_value_t *type_value, int endpoint, json_writer_t *writer, bool readwrite);
+
+
+static uint32_t type_hash(const char *type_str)
 {
-    if (strcmp(type_str, SWITCH_TYPE_STR) == 0){
-        type_int = SWITCH_TYPE_INT;
-        return true;
+    // FNV-1a
+    uint32_t hash = TYPE_FNV_OFFSET_BASIS;
+    while (*type_str) {
+        hash ^= (uint8_t)*type_str++;
+        hash *= TYPE_FNV_PRIME;
     }
-    ESP_LOGE(TAG, "Error: type_set_int, use default type");
-    return false;
+    return hash;
 }
 
-// Add your new type in the switch case
-bool type_init(callback_t callback_publish_value)
-{   
-    ESP_LOGI(TAG, "Initialise");
-    switch(type_int){
-        case SWITCH_TYPE_INT: return switch_init(callback_publish_value);
-        default: return default_init(callback_publish_value);
+static bool type_check_endpoint(int endpoint)
+{
+    if (endpoint < 0 || endpoint >= TYPE_MAX_ENDPOINTS) {
+        ESP_LOGE(TAG, "Error: endpoint %d out of range", endpoint);
+        return false;
     }
-    ESP_LOGE(TAG, "Error: type_init");
-    return false;
+    return true;
 }
 
-// Add your new type in the switch case
-bool type_get_value_json(cJSON* value) 
+static bool type_value_init(const type_value_t *type_value)
 {
-    switch(type_int){
-        case SWITCH_TYPE_INT: return switch_get_value_json(value);
-        default: return default_get_value_json(value);
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        if (!seqlock_init(&type_value->locks[endpoint], type_value->value_size)) {
+            ESP_LOGE(TAG, "Error: seqlock_init");
+            return false;
+        }
     }
-    ESP_LOGE(TAG, "Error: type_get_value_json");
-    return false;
+    return true;
+}
+
+static uint8_t *type_value_at(const type_value_t *type_value, int endpoint)
+{
+    return (uint8_t *)type_value->values + endpoint * type_value->value_size;
+}
+
+static bool type_value_parse_json(void *readwrite, void *arg)
+{
+    const type_value_parse_t *parse = arg;
+    if (!schema_read_cjson(parse->type_value->readwrite_fields, parse->type_value->readwrite_count, parse->json, readwrite)) {
+        ESP_LOGE(TAG, "Error: schema_read_cjson");
+        return false;
+    }
+    return true;
+}
+
+static bool type_value_parse_reader(void *readwrite, void *arg)
+{
+    const type_value_parse_t *parse = arg;
+    if (!schema_read(parse->type_value->readwrite_fields, parse->type_value->readwrite_count, parse->reader, parse->object, readwrite)) {
+        ESP_LOGE(TAG, "Error: schema_read");
+        return false;
+    }
+    return true;
+}
+
+static bool type_value_parse_field(void *readwrite, void *arg)
+{
+    const type_value_parse_t *parse = arg;
+    return schema_set_number(parse->type_value->readwrite_fields, parse->type_value->readwrite_count, parse->name, parse->number, readwrite);
+}
+
+static bool type_value_set(const type_value_t *type_value, int endpoint, bool (*parse)(void *readwrite, void *arg), type_value_parse_t *arg)
+{
+    // Parsed into the current readwrite under the writer lock, so a button press or another
+    // command landing meanwhile is never overwritten by a stale copy
+    bool changed = false;
+    if (!type_value_update(type_value, endpoint, parse, arg, &changed)) {
+        ESP_LOGE(TAG, "Error: type_value_update");
+        return false;
+    }
+    // Only touch the hardware when a property actually changed
+    if (changed && type_value->update_hw) {
+        type_value->update_hw(endpoint);
+    }
+    return true;
+}
+
+static bool type_value_set_json(const type_value_t *type_value, int endpoint, cJSON *value)
+{
+    cJSON *read = cJSON_GetObjectItem(value, "read");
+    cJSON *readwrite = cJSON_GetObjectItem(value, "readwrite");
+    if (!read || !readwrite) {
+        ESP_LOGE(TAG, "Error: !read || !readwrite");
+        return false;
+    }
+    type_value_parse_t parse = {
+        .type_value = type_value,
+        .json = readwrite,
+    };
+    return type_value_set(type_value, endpoint, type_value_parse_json, &parse);
+}
+
+static bool type_value_set_reader(const type_value_t *type_value, int endpoint, const json_reader_t *reader, int value)
+{
+    int read = json_reader_find(reader, value, "read");
+    int readwrite = json_reader_find(reader, value, "readwrite");
+    if (read < 0 || readwrite < 0) {
+        ESP_LOGE(TAG, "Error: !read || !readwrite");
+        return false;
+    }
+    type_value_parse_t parse = {
+        .type_value = type_value,
+        .reader = reader,
+        .object = readwrite,
+    };
+    return type_value_set(type_value, endpoint, type_value_parse_reader, &parse);
+}
+
+static bool type_value_get_writer(const type_value_t *type_value, int endpoint, json_writer_t *writer, bool readwrite)
+{
+    size_t offset = readwrite ? type_value->readwrite_offset : type_value->read_offset;
+    size_t size = readwrite ? type_value->readwrite_size : type_value->read_size;
+    // An array of doubles so every member kind is aligned, seqlock_init checked the size
+    double value[SEQLOCK_MAX_SIZE / sizeof(double)];
+    // Never fails on contention, a copy torn by a concurrent write is retried
+    if (!seqlock_read(&type_value->locks[endpoint], value, type_value_at(type_value, endpoint) + offset, size)) {
+        ESP_LOGE(TAG, "Error: seqlock_read");
+        return false;
+    }
+    if (readwrite) {
+        schema_write(type_value->readwrite_fields, type_value->readwrite_count, writer, value);
+    } else {
+        schema_write(type_value->read_fields, type_value->read_count, writer, value);
+    }
+    return true;
 }
 
-// Add your new type in the switch case
-bool type_set_value_json(cJSON* value)
+bool type_set(const char* type_str)
 {
-    switch(type_int){
-        case SWITCH_TYPE_INT: return switch_set_value_json(value);
-        default: return default_set_value_json(value);
+    uint32_t hash = type_hash(type_str);
+    for (int i = 0; i < (int)(sizeof(type_registry) / sizeof(type_registry[0])); i++) {
+        // The hash rules out other types, strcmp only runs on a match
+        if (type_hash(type_registry[i]->name) == hash && strcmp(type_registry[i]->name, type_str) == 0) {
+            type_ops = type_registry[i];
+            return true;
+        }
     }
-    ESP_LOGE(TAG, "Error: type_set_value_json");
+    ESP_LOGE(TAG, "Error: type_set %s, use default type", type_str);
     return false;
 }
 
-// Add your new type in the switch case
+bool type_init(callback_t callback_publish_value)
+{
+    ESP_LOGI(TAG, "Initialise %s", type_ops->name);
+    // The value locks come first, the type's task may read its value straight away
+    if (!type_value_init(type_ops->value)) {
+        ESP_LOGE(TAG, "Error: type_value_init");
+        return false;
+    }
+    return type_ops->init(callback_publish_value);
+}
+
+bool type_get_readwrite_writer(int endpoint, json_writer_t *writer)
+{
+    return type_check_endpoint(endpoint) && type_value_get_writer(type_ops->value, endpoint, writer, true);
+}
+
+bool type_get_read_writer(int endpoint, json_writer_t *writer)
+{
+    return type_check_endpoint(endpoint) && type_value_get_writer(type_ops->value, endpoint, writer, false);
+}
+
+bool type_set_value_json(int endpoint, cJSON* value)
+{
+    return type_check_endpoint(endpoint) && type_value_set_json(type_ops->value, endpoint, value);
+}
+
+bool type_set_value_reader(int endpoint, const json_reader_t *reader, int value)
+{
+    return type_check_endpoint(endpoint) && type_value_set_reader(type_ops->value, endpoint, reader, value);
+}
+
+bool type_set_field(int endpoint, const char *name, double value)
+{
+    if (!type_check_endpoint(endpoint)) {
+        return false;
+    }
+    type_value_parse_t parse = {
+        .type_value = type_ops->value,
+        .name = name,
+        .number = value,
+    };
+    return type_value_set(type_ops->value, endpoint, type_value_parse_field, &parse);
+}
+
 bool type_pre_reboot(void)
 {
-    switch(type_int){
-        case SWITCH_TYPE_INT: return switch_pre_reboot();
-        default: return default_pre_reboot();
+    return type_ops->pre_reboot();
+}
+
+uint32_t type_get_settle_ms(void)
+{
+    return type_ops->settle_ms;
+}
+
+bool type_value_get(const type_value_t *type_value, int endpoint, void *value)
+{
+    // Never fails on contention, a copy torn by a concurrent write is retried
+    if (!seqlock_read(&type_value->locks[endpoint], value, type_value_at(type_value, endpoint), type_value->value_size)) {
+        ESP_LOGE(TAG, "Error: seqlock_read");
+        return false;
     }
-    ESP_LOGE(TAG, "Error: type_pre_reboot");
-    return false;
-}
\ No newline at end of file
+    return true;
+}
+
+bool type_value_update(const type_value_t *type_value, int endpoint, bool (*update)(void *readwrite, void *arg), void *arg, bool *changed)
+{
+    bool is_changed = false;
+    if (!seqlock_update(&type_value->locks[endpoint], type_value_at(type_value, endpoint) + type_value->readwrite_offset,
+                        type_value->readwrite_size, update, arg, &is_changed)) {
+        return false;
+    }
+    if (is_changed) {
+        dirty_mark(DIRTY_TYPE);
+    }
+    if (changed) {
+        *changed = is_changed;
+    }
+    return true;
+}
+
+bool type_value_set_read(const type_value_t *type_value, int endpoint, const void *read, bool *changed)
+{
+    bool is_changed = false;
+    if (!seqlock_write(&type_value->locks[endpoint], type_value_at(type_value, endpoint) + type_value->read_offset,
+                       read, type_value->read_size, &is_changed)) {
+        ESP_LOGE(TAG, "Error: seqlock_write");
+        return false;
+    }
+    if (is_changed) {
+        dirty_mark(DIRTY_TYPE);
+    }
+    if (changed) {
+        *changed = is_changed;
+    }
+    return true;
+}
@@ -12,11 +12,75 @@
 #include <stdio.h>
 #include <cJSON.h>
 #include "utilities/misc.h"
+#include "utilities/json_reader.h"
+#include "utilities/json_writer.h"
+#include "utilities/schema.h"
+#include "utilities/seqlock.h"
 
-bool type_set_int(const char *type_str);
+// Number of instances of the type on one thing, e.g. the relays on a 4-relay board
+#define TYPE_MAX_ENDPOINTS CONFIG_RIOTBOX_THING_ENDPOINTS
+
+// Where a type keeps its value: one X_value_t per endpoint, each behind its own seqlock,
+// with the readwrite and read structs described by their schema tables. Getting, setting
+// and serializing the value is the same for every type and lives in type.c.
+typedef struct type_value_t {
+    void *values;
+    seqlock_t *locks;
+    size_t value_size;
+    const schema_field_t *readwrite_fields;
+    int readwrite_count;
+    size_t readwrite_offset;
+    size_t readwrite_size;
+    const schema_field_t *read_fields;
+    int read_count;
+    size_t read_offset;
+    size_t read_size;
+    // Applies a changed readwrite to the hardware, NULL when the type's task polls it instead
+    bool (*update_hw)(int endpoint);
+} type_value_t;
+
+// For a type X with X_value_t, X_readwrite_t, X_read_t, X_value_g, X_value_lock,
+// X_readwrite_fields and X_read_fields
+#define TYPE_VALUE(prefix, update) {                                        \
+    .values = prefix##_value_g,                                             \
+    .locks = prefix##_value_lock,                                           \
+    .value_size = sizeof(prefix##_value_t),                                 \
+    .readwrite_fields = prefix##_readwrite_fields,                          \
+    .readwrite_count = SCHEMA_COUNT(prefix##_readwrite_fields),             \
+    .readwrite_offset = offsetof(prefix##_value_t, readwrite),              \
+    .readwrite_size = sizeof(prefix##_readwrite_t),                         \
+    .read_fields = prefix##_read_fields,                                    \
+    .read_count = SCHEMA_COUNT(prefix##_read_fields),                       \
+    .read_offset = offsetof(prefix##_value_t, read),                        \
+    .read_size = sizeof(prefix##_read_t),                                   \
+    .update_hw = (update),                                                  \
+}
+
+// Operations every type implements, registered in type.c
+typedef struct type_ops_t {
+    const char *name;
+    // Commands are answered once none arrived for this long, 0 answers every command
+    uint32_t settle_ms;
+    const type_value_t *value;
+    bool (*init)(callback_t callback_publish_value);
+    bool (*pre_reboot)(void);
+} type_ops_t;
+
+bool type_set(const char *type_str);
 bool type_init(callback_t callback_publish_value);
-bool type_get_value_json(cJSON *value);
-bool type_set_value_json(cJSON *value);
+bool type_get_readwrite_writer(int endpoint, json_writer_t *writer);
+bool type_get_read_writer(int endpoint, json_writer_t *writer);
+bool type_set_value_json(int endpoint, cJSON *value);
+bool type_set_value_reader(int endpoint, const json_reader_t *reader, int value);
+// Sets one BOOL, INT or NUMBER readwrite property, leaving the others as they are
+bool type_set_field(int endpoint, const char *name, double value);
 bool type_pre_reboot(void);
+uint32_t type_get_settle_ms(void);
+
+// Used by the types on their own value, endpoint is not range checked
+bool type_value_get(const type_value_t *type_value, int endpoint, void *value);
+// update edits a copy of the readwrite struct under the writer lock, see seqlock_update
+bool type_value_update(const type_value_t *type_value, int endpoint, bool (*update)(void *readwrite, void *arg), void *arg, bool *changed);
+bool type_value_set_read(const type_value_t *type_value, int endpoint, const void *read, bool *changed);
 
 #endif /* _TYPE_H_ */
\ No newline at end of file
@@ -9,10 +9,36 @@
 #define _BOARD_H_
 
 #include "driver/uart.h"
+#include "hal/adc_types.h"
 
 #define THING_BUTTON_GPIO 23
 #define THING_LED_GPIO 22
 
+// One button and one LED per endpoint, in endpoint order. A 4-relay board would be e.g.
+// { 23, 21, 19, 18 } and { 22, 25, 26, 27 } with CONFIG_RIOTBOX_THING_ENDPOINTS=4
+#define THING_BUTTON_GPIOS { THING_BUTTON_GPIO }
+#define THING_LED_GPIOS { THING_LED_GPIO }
+
+// One ADC1 channel per SENSOR endpoint, channel 6 is GPIO34
+#define THING_SENSOR_ADC_CHANNELS { ADC_CHANNEL_6 }
+
+// One voltage and one current ADC1 channel per METER endpoint, GPIO34 and GPIO35.
+// Scales are volts and amps per ADC count of the front end, calibrated per product.
+#define THING_METER_VOLTAGE_ADC_CHANNELS { ADC_CHANNEL_6 }
+#define THING_METER_CURRENT_ADC_CHANNELS { ADC_CHANNEL_7 }
+#define THING_METER_V_SCALE 0.25
+#define THING_METER_I_SCALE 0.01
+
+// One LEDC PWM GPIO per DIMMER endpoint
+#define THING_DIMMER_GPIOS { THING_LED_GPIO }
+
+// One temperature ADC1 channel and one heater relay GPIO per THERMOSTAT endpoint.
+// The linear conversion suits e.g. an LM35 behind the ADC attenuator.
+#define THING_THERMOSTAT_ADC_CHANNELS { ADC_CHANNEL_6 }
+#define THING_THERMOSTAT_RELAY_GPIOS { THING_LED_GPIO }
+#define THING_THERMOSTAT_C_PER_COUNT 0.0806f
+#define THING_THERMOSTAT_C_OFFSET 0.0f
+
 #define DEPLOY_UART_TXD 1
 #define DEPLOY_UART_RXD 3
 #define DEPLOY_UART_RTS (UART_PIN_NO_CHANGE)
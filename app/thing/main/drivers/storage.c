@@ -12,19 +12,92 @@
 #include "esp_system.h"
 #include "nvs_flash.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include <string.h>
 #include "drivers/storage.h"
 
 // Values have to be <= 15 characters
 #define NVS_NAMESPACE                   "storage"
 #define STORAGE_KEY_MAX_LEN             15 // NVS_KEY_NAME_MAX_SIZE -1 // TODO does this exist in esp-idf?
+#define STORAGE_FLAGS_KEY_SUFFIX        "_flags"
+#define STORAGE_FLAGS_CACHE_SIZE        16
+#define STORAGE_TRANSACTION_MAX_BLOBS   8
+#define STORAGE_TRANSACTION_MAX_FLAGS   8
+#define STORAGE_CHUNK_KEY_MAX_SIZE      6 // Chunks are numbered "0", "1"...
+#define STORAGE_CHUNKED_MAX_KEYS        4
+
+// Flag words are read far more often than written, so they are all kept in RAM
+typedef struct storage_flags_entry_t {
+    char key[STORAGE_KEY_MAX_LEN + 1];
+    uint32_t flags;
+} storage_flags_entry_t;
+
+// A blob write or erase held back until storage_commit(), data is NULL for an erase
+typedef struct storage_staged_blob_t {
+    char key[STORAGE_KEY_MAX_LEN + 1];
+    char *data;
+    size_t size;
+} storage_staged_blob_t;
+
+typedef struct storage_transaction_t {
+    TaskHandle_t owner;
+    bool failed;
+    storage_staged_blob_t blobs[STORAGE_TRANSACTION_MAX_BLOBS];
+    int blob_count;
+    storage_flags_entry_t flags[STORAGE_TRANSACTION_MAX_FLAGS];
+    int flags_count;
+} storage_transaction_t;
+
+// Chunks appended to the key last appended to, so an append doesn't have to count them
+typedef struct storage_chunks_t {
+    char key[STORAGE_KEY_MAX_LEN + 1];
+    int count;
+    size_t size;    // Of the whole blob, chunks and the compacted part
+} storage_chunks_t;
 
 static const char *TAG = "NVS";
 
 static SemaphoreHandle_t storage_lock = NULL;
 
+// Entries are only added, under the storage lock, and published by the count
+static storage_flags_entry_t storage_flags_cache[STORAGE_FLAGS_CACHE_SIZE];
+static int storage_flags_count = 0;
+
+static uint32_t storage_nvs_ops = 0;
+static uint32_t storage_nvs_us = 0;
+static int64_t storage_nvs_start_us = 0;
+static int storage_nvs_depth = 0;
+
+static storage_chunks_t storage_chunks;
+// Keys with chunks, so reads of every other blob don't have to look for them
+static char storage_chunked_keys[STORAGE_CHUNKED_MAX_KEYS][STORAGE_KEY_MAX_LEN + 1];
+static bool storage_chunked_overflow = false;
+
+// Only touched by the task that called storage_begin()
+static storage_transaction_t storage_transaction;
+
 static bool storage_take_lock(void);
 static void storage_give_lock(void);
+static esp_err_t storage_open_namespace(const char* name, nvs_open_mode_t open_mode, nvs_handle_t *handle);
+static esp_err_t storage_open(nvs_open_mode_t open_mode, nvs_handle_t *handle);
+static void storage_end_session(void);
+static void storage_close(nvs_handle_t handle);
+static bool storage_is_flags_key(const char* key);
+static storage_flags_entry_t *storage_find_flags(const char* key);
+static bool storage_cache_flags(const char* key, uint32_t flags);
+static bool storage_put_flags(nvs_handle_t handle, const char* key, uint32_t flags);
+static bool storage_write_flags(const char* key, uint32_t flags);
+static bool storage_load_flags(void);
+static bool storage_in_transaction(void);
+static storage_flags_entry_t *storage_stage_flags(const char* key);
+static bool storage_stage_blob(const char* key, const char* buffer, size_t size);
+static void storage_clear_transaction(void);
+static bool storage_has_chunks(const char* key);
+static void storage_mark_chunks(const char* key, bool has_chunks);
+static void storage_load_chunked(void);
+static bool storage_count_chunks(const char* key, int *count, size_t *size);
+static bool storage_erase_chunks(const char* key);
+static esp_err_t storage_read_blob(const char* key, char* blob, size_t size, size_t *len);
 
 
 static bool storage_take_lock(void)
@@ -41,162 +114,596 @@ static void storage_give_lock(void)
     xSemaphoreGive(storage_lock);
 }
 
-bool storage_has_flags(const char* key, uint32_t flags)
+static esp_err_t storage_open_namespace(const char* name, nvs_open_mode_t open_mode, nvs_handle_t *handle)
 {
-    if (!storage_take_lock()){
-        ESP_LOGE(TAG, "Error: storage_take_lock");
+    // Always called with the storage lock held. Sessions can nest, the time is
+    // counted from the outermost one.
+    if (storage_nvs_depth++ == 0) {
+        storage_nvs_start_us = esp_timer_get_time();
+    }
+    storage_nvs_ops++;
+    esp_err_t err = nvs_open(name, open_mode, handle);
+    if (err != ESP_OK) {
+        storage_end_session();
+    }
+    return err;
+}
+
+static esp_err_t storage_open(nvs_open_mode_t open_mode, nvs_handle_t *handle)
+{
+    return storage_open_namespace(NVS_NAMESPACE, open_mode, handle);
+}
+
+static void storage_end_session(void)
+{
+    if (--storage_nvs_depth == 0) {
+        storage_nvs_us += esp_timer_get_time() - storage_nvs_start_us;
+    }
+}
+
+static void storage_close(nvs_handle_t handle)
+{
+    nvs_close(handle);
+    storage_end_session();
+}
+
+static bool storage_is_flags_key(const char* key)
+{
+    size_t key_len = strlen(key);
+    size_t suffix_len = strlen(STORAGE_FLAGS_KEY_SUFFIX);
+    return key_len <= STORAGE_KEY_MAX_LEN && key_len >= suffix_len &&
+           strcmp(&key[key_len - suffix_len], STORAGE_FLAGS_KEY_SUFFIX) == 0;
+}
+
+static storage_flags_entry_t *storage_find_flags(const char* key)
+{
+    int count = __atomic_load_n(&storage_flags_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(storage_flags_cache[i].key, key) == 0) {
+            return &storage_flags_cache[i];
+        }
+    }
+    return NULL;
+}
+
+static bool storage_cache_flags(const char* key, uint32_t flags)
+{
+    storage_flags_entry_t *entry = storage_find_flags(key);
+    if (entry) {
+        __atomic_store_n(&entry->flags, flags, __ATOMIC_RELEASE);
+        return true;
+    }
+    if (storage_flags_count == STORAGE_FLAGS_CACHE_SIZE) {
+        ESP_LOGE(TAG, "Error: No flags cache entries available");
         return false;
     }
-    if (strlen(key) > STORAGE_KEY_MAX_LEN){
-        ESP_LOGE(TAG, "Error: Storage key %s is too long (max 15 characters)", key);
-        storage_give_lock();
+    entry = &storage_flags_cache[storage_flags_count];
+    strcpy(entry->key, key);
+    entry->flags = flags;
+    // Readers only see the entry once it is complete
+    __atomic_store_n(&storage_flags_count, storage_flags_count + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool storage_put_flags(nvs_handle_t handle, const char* key, uint32_t flags)
+{
+    // NVS is written first, so the cache never holds flags that a reboot would lose
+    esp_err_t err = nvs_set_u32(handle, key, flags);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error: Failed to set NVS flags: %d", err);
         return false;
     }
+    return storage_cache_flags(key, flags);
+}
+
+static bool storage_write_flags(const char* key, uint32_t flags)
+{
+    // Called with the storage lock held
     nvs_handle_t handle;
     esp_err_t err;
-    err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    err = storage_open(NVS_READWRITE, &handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error: Opening NVS failed: %d ", err);
-        storage_give_lock();
         return false;
     }
-    // Get the current flags value
-    uint32_t current_flags = 0;
-    err = nvs_get_u32(handle, key, &current_flags);
-    nvs_close(handle);
 
-    // If getting the flags value failed for a reason other than the key not being found, propagate the error
-    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGE(TAG, "Error: Failed to get NVS flags: %d", err);
-        storage_give_lock();
+    if (!storage_put_flags(handle, key, flags)) {
+        storage_close(handle);
         return false;
     }
-    // Check if the flag is set
-    if ((current_flags & flags) == flags) {
-        storage_give_lock();
-        return true;
-    } else {
-        storage_give_lock();
-        ESP_LOGE(TAG, "Error: Failed to check NVS flags: %d", err);
+
+    // Commit the write operation
+    err = nvs_commit(handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error: committing NVS failed: %d", err);
+        storage_close(handle);
         return false;
     }
+
+    // Close NVS
+    storage_close(handle);
+    return true;
 }
 
-bool storage_set_flags(const char* key, uint32_t flags)
+static bool storage_load_flags(void)
 {
-    if (!storage_take_lock()){
-        ESP_LOGE(TAG, "Error: storage_take_lock");
+    // One pass over the namespace at boot, instead of an NVS read per flag check
+    nvs_handle_t handle;
+    esp_err_t err = storage_open(NVS_READONLY, &handle);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        // Nothing has been stored yet
+        return true;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error: Opening NVS failed: %d", err);
         return false;
     }
+
+    bool ok = true;
+    nvs_iterator_t it = NULL;
+    err = nvs_entry_find(NVS_DEFAULT_PART_NAME, NVS_NAMESPACE, NVS_TYPE_U32, &it);
+    while (err == ESP_OK) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        uint32_t flags = 0;
+        if (storage_is_flags_key(info.key)) {
+            if (nvs_get_u32(handle, info.key, &flags) != ESP_OK || !storage_cache_flags(info.key, flags)) {
+                ESP_LOGE(TAG, "Error: Failed to load NVS flags %s", info.key);
+                ok = false;
+            }
+        }
+        err = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+    storage_close(handle);
+    ESP_LOGI(TAG, "Cached %d flag words", storage_flags_count);
+    return ok;
+}
+
+static bool storage_in_transaction(void)
+{
+    return storage_transaction.owner && storage_transaction.owner == xTaskGetCurrentTaskHandle();
+}
+
+static storage_flags_entry_t *storage_stage_flags(const char* key)
+{
+    // One staged word per key, starting from the committed flags
+    for (int i = 0; i < storage_transaction.flags_count; i++) {
+        if (strcmp(storage_transaction.flags[i].key, key) == 0) {
+            return &storage_transaction.flags[i];
+        }
+    }
+    if (storage_transaction.flags_count == STORAGE_TRANSACTION_MAX_FLAGS) {
+        ESP_LOGE(TAG, "Error: Too many flag words in the transaction");
+        storage_transaction.failed = true;
+        return NULL;
+    }
+    storage_flags_entry_t *staged = &storage_transaction.flags[storage_transaction.flags_count++];
+    storage_flags_entry_t *entry = storage_find_flags(key);
+    strcpy(staged->key, key);
+    staged->flags = entry ? __atomic_load_n(&entry->flags, __ATOMIC_ACQUIRE) : 0;
+    return staged;
+}
+
+static bool storage_stage_blob(const char* key, const char* buffer, size_t size)
+{
     if (strlen(key) > STORAGE_KEY_MAX_LEN){
         ESP_LOGE(TAG, "Error: Storage key %s is too long (max 15 characters)", key);
-        storage_give_lock();
+        storage_transaction.failed = true;
         return false;
     }
+    storage_staged_blob_t *staged = NULL;
+    for (int i = 0; i < storage_transaction.blob_count; i++) {
+        if (strcmp(storage_transaction.blobs[i].key, key) == 0) {
+            staged = &storage_transaction.blobs[i];
+            break;
+        }
+    }
+    if (!staged) {
+        if (storage_transaction.blob_count == STORAGE_TRANSACTION_MAX_BLOBS) {
+            ESP_LOGE(TAG, "Error: Too many blobs in the transaction");
+            storage_transaction.failed = true;
+            return false;
+        }
+        staged = &storage_transaction.blobs[storage_transaction.blob_count++];
+        strcpy(staged->key, key);
+    }
+    free(staged->data);
+    staged->data = NULL;
+    staged->size = 0;
+    if (buffer) {
+        // Copied, the caller's buffer is usually gone by the commit
+        staged->data = malloc(size);
+        if (!staged->data) {
+            ESP_LOGE(TAG, "Error: allocating memory failed");
+            storage_transaction.failed = true;
+            return false;
+        }
+        memcpy(staged->data, buffer, size);
+        staged->size = size;
+    }
+    return true;
+}
+
+static void storage_clear_transaction(void)
+{
+    for (int i = 0; i < storage_transaction.blob_count; i++) {
+        free(storage_transaction.blobs[i].data);
+    }
+    memset(&storage_transaction, 0, sizeof(storage_transaction));
+}
+
+// An appended blob is its compacted part under key, followed by the chunks appended since,
+// each in a blob of its own in a namespace named after the key. NVS keys are too short
+// to add a suffix to, and the namespace lets the chunks be erased in one go.
+
+static bool storage_has_chunks(const char* key)
+{
+    if (storage_chunked_overflow) {
+        return true;
+    }
+    for (int i = 0; i < STORAGE_CHUNKED_MAX_KEYS; i++) {
+        if (strcmp(storage_chunked_keys[i], key) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void storage_mark_chunks(const char* key, bool has_chunks)
+{
+    int free_slot = -1;
+    for (int i = 0; i < STORAGE_CHUNKED_MAX_KEYS; i++) {
+        if (strcmp(storage_chunked_keys[i], key) == 0) {
+            if (!has_chunks) {
+                storage_chunked_keys[i][0] = '\0';
+            }
+            return;
+        }
+        if (free_slot < 0 && storage_chunked_keys[i][0] == '\0') {
+            free_slot = i;
+        }
+    }
+    if (!has_chunks) {
+        return;
+    }
+    if (free_slot < 0) {
+        // Every read looks for chunks from now on
+        storage_chunked_overflow = true;
+        return;
+    }
+    strcpy(storage_chunked_keys[free_slot], key);
+}
+
+static void storage_load_chunked(void)
+{
+    // A namespace holding a chunk "0" belongs to a key that was appended to
+    nvs_iterator_t it = NULL;
+    esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, NULL, NVS_TYPE_BLOB, &it);
+    while (err == ESP_OK) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        if (strcmp(info.key, "0") == 0 && strcmp(info.namespace_name, NVS_NAMESPACE) != 0) {
+            storage_mark_chunks(info.namespace_name, true);
+        }
+        err = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+}
+
+static bool storage_count_chunks(const char* key, int *count, size_t *size)
+{
+    *count = 0;
+    *size = 0;
+    if (!storage_has_chunks(key)) {
+        return true;
+    }
     nvs_handle_t handle;
-    esp_err_t err;
-    err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    esp_err_t err = storage_open_namespace(key, NVS_READONLY, &handle);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        // Never appended to
+        return true;
+    }
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: Opening NVS failed: %d ", err);
-        storage_give_lock();
+        ESP_LOGE(TAG, "Error: Opening NVS failed: %d", err);
         return false;
     }
-
-    // Get the current flags value
-    uint32_t current_flags = 0;
-    err = nvs_get_u32(handle, key, &current_flags);
-    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGE(TAG, "Error: Failed to get NVS flags: %d", err);
-        nvs_close(handle);
-        storage_give_lock();
+    // Chunks are numbered without gaps
+    while (true) {
+        char chunk_key[STORAGE_CHUNK_KEY_MAX_SIZE];
+        snprintf(chunk_key, sizeof(chunk_key), "%d", *count);
+        size_t chunk_size;
+        err = nvs_get_blob(handle, chunk_key, NULL, &chunk_size);
+        if (err != ESP_OK) {
+            break;
+        }
+        (*count)++;
+        *size += chunk_size;
+    }
+    storage_close(handle);
+    if (err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "Error: Counting chunks failed: %d", err);
         return false;
     }
+    return true;
+}
 
-    // Set the requested flag
-    current_flags |= flags;
-
-    // Write flags back to NVS
-    err = nvs_set_u32(handle, key, current_flags);
+static bool storage_erase_chunks(const char* key)
+{
+    if (strcmp(storage_chunks.key, key) == 0) {
+        memset(&storage_chunks, 0, sizeof(storage_chunks));
+    }
+    if (!storage_has_chunks(key)) {
+        return true;
+    }
+    // Opened read only first, opening read write would create the namespace
+    nvs_handle_t handle;
+    esp_err_t err = storage_open_namespace(key, NVS_READONLY, &handle);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return true;
+    }
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: Failed to set NVS flag: %d", err);
-        nvs_close(handle);
-        storage_give_lock();
+        ESP_LOGE(TAG, "Error: Opening NVS failed: %d", err);
         return false;
     }
+    storage_close(handle);
 
-    // Commit the write operation
-    err = nvs_commit(handle);
+    err = storage_open_namespace(key, NVS_READWRITE, &handle);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: committing NVS failed: %d", err);
-        nvs_close(handle);
-        storage_give_lock();
+        ESP_LOGE(TAG, "Error: Opening NVS failed: %d", err);
         return false;
     }
+    err = nvs_erase_all(handle);
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    storage_close(handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error: Erasing chunks failed: %d", err);
+        return false;
+    }
+    storage_mark_chunks(key, false);
+    return true;
+}
 
-    // Close NVS
-    nvs_close(handle);
+static esp_err_t storage_read_blob(const char* key, char* blob, size_t size, size_t *len)
+{
+    // Called with the storage lock held. Streams the compacted part and then every chunk
+    // into blob, ESP_ERR_NVS_NOT_FOUND if there is neither.
+    *len = 0;
+    nvs_handle_t handle;
+    size_t blob_size = 0;
+    esp_err_t err = storage_open(NVS_READONLY, &handle);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(handle, key, NULL, &blob_size);
+        if (err == ESP_OK && blob_size > size) {
+            ESP_LOGE(TAG, "Error: Blob size too large: %d", err);
+            err = ESP_ERR_NVS_INVALID_LENGTH;
+        } else if (err == ESP_OK) {
+            err = nvs_get_blob(handle, key, blob, &blob_size);
+        }
+        storage_close(handle);
+    }
+    bool found = err == ESP_OK;
+    if (err == ESP_OK) {
+        *len = blob_size;
+    } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "Error: Getting blob failed: %d", err);
+        return err;
+    }
+    if (!storage_has_chunks(key)) {
+        return err;
+    }
+
+    err = storage_open_namespace(key, NVS_READONLY, &handle);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return found ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error: Opening NVS failed: %d", err);
+        return err;
+    }
+    for (int i = 0; ; i++) {
+        char chunk_key[STORAGE_CHUNK_KEY_MAX_SIZE];
+        snprintf(chunk_key, sizeof(chunk_key), "%d", i);
+        size_t chunk_size;
+        err = nvs_get_blob(handle, chunk_key, NULL, &chunk_size);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            err = found ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+            break;
+        }
+        if (err == ESP_OK && *len + chunk_size > size) {
+            ESP_LOGE(TAG, "Error: Blob size too large: %d", err);
+            err = ESP_ERR_NVS_INVALID_LENGTH;
+        } else if (err == ESP_OK) {
+            err = nvs_get_blob(handle, chunk_key, blob + *len, &chunk_size);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error: Getting chunk failed: %d", err);
+            break;
+        }
+        *len += chunk_size;
+        found = true;
+    }
+    storage_close(handle);
+    return err;
+}
+
+bool storage_has_flags(const char* key, uint32_t flags)
+{
+    // Lock free, the cache holds every flag word in NVS. A transaction sees its own writes.
+    storage_flags_entry_t *entry = NULL;
+    if (storage_in_transaction()) {
+        for (int i = 0; i < storage_transaction.flags_count && !entry; i++) {
+            if (strcmp(storage_transaction.flags[i].key, key) == 0) {
+                entry = &storage_transaction.flags[i];
+            }
+        }
+    }
+    if (!entry) {
+        entry = storage_find_flags(key);
+    }
+    uint32_t current_flags = entry ? __atomic_load_n(&entry->flags, __ATOMIC_ACQUIRE) : 0;
+    return (current_flags & flags) == flags;
+}
+
+bool storage_set_flags(const char* key, uint32_t flags)
+{
+    if (!storage_is_flags_key(key)){
+        ESP_LOGE(TAG, "Error: Storage key %s is not a flags key (*%s, max 15 characters)", key, STORAGE_FLAGS_KEY_SUFFIX);
+        return false;
+    }
+    if (storage_in_transaction()) {
+        storage_flags_entry_t *staged = storage_stage_flags(key);
+        if (staged) {
+            staged->flags |= flags;
+        }
+        return staged != NULL;
+    }
+    if (!storage_take_lock()){
+        ESP_LOGE(TAG, "Error: storage_take_lock");
+        return false;
+    }
+    storage_flags_entry_t *entry = storage_find_flags(key);
+    uint32_t current_flags = entry ? entry->flags : 0;
+    bool ok = storage_write_flags(key, current_flags | flags);
     storage_give_lock();
-    return true;
+    return ok;
 }
 
 bool storage_unset_flags(const char* key, uint32_t flags)
 {
+    if (!storage_is_flags_key(key)){
+        ESP_LOGE(TAG, "Error: Storage key %s is not a flags key (*%s, max 15 characters)", key, STORAGE_FLAGS_KEY_SUFFIX);
+        return false;
+    }
+    if (storage_in_transaction()) {
+        storage_flags_entry_t *staged = storage_stage_flags(key);
+        if (staged) {
+            staged->flags &= ~flags;
+        }
+        return staged != NULL;
+    }
     if (!storage_take_lock()){
         ESP_LOGE(TAG, "Error: storage_take_lock");
         return false;
     }
-    if (strlen(key) > STORAGE_KEY_MAX_LEN){
-        ESP_LOGE(TAG, "Error: Storage key %s is too long (max 15 characters)", key);
-        storage_give_lock();
+    storage_flags_entry_t *entry = storage_find_flags(key);
+    uint32_t current_flags = entry ? entry->flags : 0;
+    bool ok = storage_write_flags(key, current_flags & ~flags);
+    storage_give_lock();
+    return ok;
+}
+
+bool storage_begin(void)
+{
+    // Under the lock, so two tasks can't both see no owner and open a transaction
+    if (!storage_take_lock()){
+        ESP_LOGE(TAG, "Error: storage_take_lock");
         return false;
     }
-    nvs_handle_t handle;
-    esp_err_t err;
-    err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: Opening NVS failed: %d ", err);
+    if (storage_transaction.owner) {
         storage_give_lock();
+        ESP_LOGE(TAG, "Error: A transaction is already open");
         return false;
     }
+    storage_clear_transaction();
+    storage_transaction.owner = xTaskGetCurrentTaskHandle();
+    storage_give_lock();
+    return true;
+}
 
-    // Get the current flags value
-    uint32_t current_flags = 0;
-    err = nvs_get_u32(handle, key, &current_flags);
-    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
-        ESP_LOGE(TAG, "Error: Failed to get NVS flags: %d", err);
-        nvs_close(handle);
-        storage_give_lock();
+bool storage_commit(void)
+{
+    if (!storage_in_transaction()) {
+        ESP_LOGE(TAG, "Error: No transaction is open");
         return false;
     }
-
-    // Unset the requested flags
-    current_flags &= ~flags;
-    // Write flags back to NVS
-    err = nvs_set_u32(handle, key, current_flags);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: Failed to unset NVS flags: %d", err);
-        nvs_close(handle);
-        storage_give_lock();
+    if (storage_transaction.failed) {
+        ESP_LOGE(TAG, "Error: A write in the transaction failed, nothing is written");
+        storage_clear_transaction();
         return false;
     }
-
-    // Commit the write operation
-    err = nvs_commit(handle);
+    if (!storage_take_lock()){
+        ESP_LOGE(TAG, "Error: storage_take_lock");
+        storage_clear_transaction();
+        return false;
+    }
+    nvs_handle_t handle;
+    esp_err_t err = storage_open(NVS_READWRITE, &handle);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: committing NVS failed: %d", err);
-        nvs_close(handle);
+        ESP_LOGE(TAG, "Error: Opening NVS failed: %d ", err);
+        storage_clear_transaction();
         storage_give_lock();
         return false;
     }
 
-    // Close NVS
-    nvs_close(handle);
+    // NVS writes every entry as it is set, so a reset can still cut a commit short.
+    // Flags are what every reader checks first, so bits are cleared before the blobs
+    // change and only set once all of them are written.
+    bool ok = true;
+    for (int i = 0; i < storage_transaction.flags_count && ok; i++) {
+        storage_flags_entry_t *staged = &storage_transaction.flags[i];
+        storage_flags_entry_t *entry = storage_find_flags(staged->key);
+        uint32_t current_flags = entry ? entry->flags : 0;
+        if ((current_flags & staged->flags) != current_flags) {
+            ok = storage_put_flags(handle, staged->key, current_flags & staged->flags);
+        }
+    }
+    for (int i = 0; i < storage_transaction.blob_count && ok; i++) {
+        storage_staged_blob_t *staged = &storage_transaction.blobs[i];
+        if (staged->data) {
+            err = nvs_set_blob(handle, staged->key, staged->data, staged->size);
+        } else {
+            err = nvs_erase_key(handle, staged->key);
+            err = err == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : err;
+            if (err == ESP_OK && storage_find_flags(staged->key)) {
+                storage_cache_flags(staged->key, 0);
+            }
+        }
+        if (err == ESP_OK && !storage_erase_chunks(staged->key)) {
+            err = ESP_FAIL;
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error: Writing %s failed: %d", staged->key, err);
+            ok = false;
+        }
+    }
+    for (int i = 0; i < storage_transaction.flags_count && ok; i++) {
+        storage_flags_entry_t *staged = &storage_transaction.flags[i];
+        storage_flags_entry_t *entry = storage_find_flags(staged->key);
+        if (!entry || entry->flags != staged->flags) {
+            ok = storage_put_flags(handle, staged->key, staged->flags);
+        }
+    }
+    if (ok) {
+        err = nvs_commit(handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error: committing NVS failed: %d", err);
+            ok = false;
+        }
+    }
+
+    storage_close(handle);
+    storage_clear_transaction();
     storage_give_lock();
-    return true;
+    return ok;
+}
+
+void storage_abort(void)
+{
+    if (!storage_in_transaction()) {
+        ESP_LOGE(TAG, "Error: No transaction is open");
+        return;
+    }
+    storage_clear_transaction();
 }
 
 bool storage_erase_blob(const char* key) 
 {
+    if (storage_in_transaction()) {
+        return storage_stage_blob(key, NULL, 0);
+    }
     if (!storage_take_lock()){
         ESP_LOGE(TAG, "Error: storage_take_lock");
         return false;
@@ -209,7 +716,7 @@ bool storage_erase_blob(const char* key)
     nvs_handle_t handle;
     esp_err_t err;
 
-    err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    err = storage_open(NVS_READWRITE, &handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error: Opening NVS failed: %d ", err);
         storage_give_lock();
@@ -219,9 +726,12 @@ bool storage_erase_blob(const char* key)
     err = nvs_erase_key(handle, key);
     if (err == ESP_ERR_NVS_NOT_FOUND) {
         ESP_LOGE(TAG, "Error: Key not found");
+    } else if (err == ESP_OK && storage_find_flags(key)) {
+        // An erased flag word reads as no flags set
+        storage_cache_flags(key, 0);
     } else if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error: erasing key failed: %d", err);
-        nvs_close(handle);
+        storage_close(handle);
         storage_give_lock();
         return false;
     }
@@ -229,18 +739,24 @@ bool storage_erase_blob(const char* key)
     err = nvs_commit(handle);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error: committing NVS failed: %d", err);
-        nvs_close(handle);
+        storage_close(handle);
         storage_give_lock();
         return false;
     }
 
-    nvs_close(handle);
+    storage_close(handle);
+    bool ok = storage_erase_chunks(key);
     storage_give_lock();
-    return true;
+    return ok;
 }
 
 bool storage_append_blob(const char* key, const char* buffer, size_t max_size)
 {
+    if (storage_in_transaction()) {
+        ESP_LOGE(TAG, "Error: Appending is not supported in a transaction");
+        storage_transaction.failed = true;
+        return false;
+    }
     if (!storage_take_lock()){
         ESP_LOGE(TAG, "Error: storage_take_lock");
         return false;
@@ -253,57 +769,62 @@ bool storage_append_blob(const char* key, const char* buffer, size_t max_size)
     nvs_handle_t handle;
     esp_err_t err;
 
-    err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: Opening NVS failed: %d ", err);
-        storage_give_lock();
-        return false;
-    }
-
-    size_t old_size;
-    err = nvs_get_blob(handle, key, NULL, &old_size);
-    if (err == ESP_ERR_NVS_NOT_FOUND) {
-        old_size = 0;
-    } else if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: buffer size failed: %d", err);
-        nvs_close(handle);
-        storage_give_lock();
-        return false;
+    if (strcmp(storage_chunks.key, key) != 0) {
+        // First append to key since boot, or since another key was appended to
+        size_t old_size = 0;
+        err = storage_open(NVS_READONLY, &handle);
+        if (err == ESP_OK) {
+            err = nvs_get_blob(handle, key, NULL, &old_size);
+            storage_close(handle);
+        }
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            old_size = 0;
+        } else if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error: buffer size failed: %d", err);
+            storage_give_lock();
+            return false;
+        }
+        int count;
+        size_t chunks_size;
+        if (!storage_count_chunks(key, &count, &chunks_size)) {
+            ESP_LOGE(TAG, "Error: storage_count_chunks");
+            storage_give_lock();
+            return false;
+        }
+        strcpy(storage_chunks.key, key);
+        storage_chunks.count = count;
+        storage_chunks.size = old_size + chunks_size;
     }
 
+    // Stored the same as before, the row followed by a newline instead of its terminator
     size_t buffer_size = strlen(buffer) + 1;
-    size_t new_size = old_size + buffer_size;
-
-    if (new_size > max_size){
+    if (storage_chunks.size + buffer_size > max_size){
         ESP_LOGE(TAG, "Error: New size too large");
-        nvs_close(handle);
         storage_give_lock();
         return false;
     }
 
-    char* new_data = (char*) malloc(new_size);
+    char* new_data = (char*) malloc(buffer_size);
     if (new_data == NULL) {
         ESP_LOGE(TAG, "Error: allocating memory failed");
-        nvs_close(handle);
         storage_give_lock();
         return false;
     }
+    memcpy(new_data, buffer, buffer_size - 1);
+    new_data[buffer_size - 1] = '\n';
 
-    if (old_size > 0) {
-        err = nvs_get_blob(handle, key, new_data, &old_size);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Error: reading existing blob failed: %d", err);
-            free(new_data);
-            nvs_close(handle);
-            storage_give_lock();
-            return false;
-        }
+    // Only the new chunk is written, the cost of an append doesn't grow with the blob
+    char chunk_key[STORAGE_CHUNK_KEY_MAX_SIZE];
+    snprintf(chunk_key, sizeof(chunk_key), "%d", storage_chunks.count);
+    err = storage_open_namespace(key, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error: Opening NVS failed: %d ", err);
+        free(new_data);
+        storage_give_lock();
+        return false;
     }
-
-    strncpy(new_data + old_size, buffer, buffer_size - 1);
-    new_data[old_size + buffer_size - 1] = '\n';
-
-    err = nvs_set_blob(handle, key, new_data, new_size);
+    storage_mark_chunks(key, true);
+    err = nvs_set_blob(handle, chunk_key, new_data, buffer_size);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error: setting blob failed: %d", err);
     } else {
@@ -312,15 +833,27 @@ bool storage_append_blob(const char* key, const char* buffer, size_t max_size)
             ESP_LOGE(TAG, "Error: committing NVS failed: %d", err);
         }
     }
-
     free(new_data);
-    nvs_close(handle);
+    storage_close(handle);
+    if (err != ESP_OK) {
+        // Counted again on the next append
+        memset(&storage_chunks, 0, sizeof(storage_chunks));
+        storage_give_lock();
+        return false;
+    }
+    storage_chunks.count++;
+    storage_chunks.size += buffer_size;
     storage_give_lock();
     return true;
 }
 
-bool storage_set_blob(const char* key, const char* buffer, size_t size)
+bool storage_finalize_blob(const char* key, size_t max_size)
 {
+    if (storage_in_transaction()) {
+        ESP_LOGE(TAG, "Error: Finalizing is not supported in a transaction");
+        storage_transaction.failed = true;
+        return false;
+    }
     if (!storage_take_lock()){
         ESP_LOGE(TAG, "Error: storage_take_lock");
         return false;
@@ -330,40 +863,66 @@ bool storage_set_blob(const char* key, const char* buffer, size_t size)
         storage_give_lock();
         return false;
     }
-    nvs_handle_t handle;
-    esp_err_t err;
+    int count = storage_chunks.count;
+    size_t chunks_size;
+    if (strcmp(storage_chunks.key, key) != 0 && !storage_count_chunks(key, &count, &chunks_size)) {
+        ESP_LOGE(TAG, "Error: storage_count_chunks");
+        storage_give_lock();
+        return false;
+    }
+    if (count == 0) {
+        // Already compacted
+        storage_give_lock();
+        return true;
+    }
 
-    err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    char* data = (char*) malloc(max_size);
+    if (data == NULL) {
+        ESP_LOGE(TAG, "Error: allocating memory failed");
+        storage_give_lock();
+        return false;
+    }
+    size_t len;
+    esp_err_t err = storage_read_blob(key, data, max_size, &len);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: Opening NVS failed: %d ", err);
+        ESP_LOGE(TAG, "Error: storage_read_blob: %d", err);
+        free(data);
         storage_give_lock();
         return false;
     }
 
-    // Directly set the blob without any previous data considerations
-    err = nvs_set_blob(handle, key, buffer, size);
+    // Rewritten as one blob and then the chunks are dropped. A reset in between leaves
+    // both, but the caller only sets the flag that makes the blob readable afterwards.
+    nvs_handle_t handle;
+    err = storage_open(NVS_READWRITE, &handle);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: setting blob failed: %d", err);
-        nvs_close(handle);
+        ESP_LOGE(TAG, "Error: Opening NVS failed: %d ", err);
+        free(data);
         storage_give_lock();
         return false;
     }
-
-    err = nvs_commit(handle);
+    err = nvs_set_blob(handle, key, data, len);
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    storage_close(handle);
+    free(data);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: committing NVS failed: %d", err);
-        nvs_close(handle);
+        ESP_LOGE(TAG, "Error: setting blob failed: %d", err);
         storage_give_lock();
         return false;
     }
-
-    nvs_close(handle);
+    bool ok = storage_erase_chunks(key);
     storage_give_lock();
-    return true;
+    ESP_LOGI(TAG, "Compacted %d chunks of %s into %u bytes", count, key, (unsigned)len);
+    return ok;
 }
 
-bool storage_get_blob(const char* key, char* blob, size_t size) 
+bool storage_set_blob(const char* key, const char* buffer, size_t size)
 {
+    if (storage_in_transaction()) {
+        return storage_stage_blob(key, buffer, size);
+    }
     if (!storage_take_lock()){
         ESP_LOGE(TAG, "Error: storage_take_lock");
         return false;
@@ -376,32 +935,56 @@ bool storage_get_blob(const char* key, char* blob, size_t size)
     nvs_handle_t handle;
     esp_err_t err;
 
-    err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    err = storage_open(NVS_READWRITE, &handle);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: Opening NVS failed: %d", err);
+        ESP_LOGE(TAG, "Error: Opening NVS failed: %d ", err);
         storage_give_lock();
         return false;
     }
 
-    size_t blob_size;
-    err = nvs_get_blob(handle, key, NULL, &blob_size);
-    if (err != ESP_OK || blob_size > size) {
-        ESP_LOGE(TAG, "Error: Blob size too large: %d", err);
-        nvs_close(handle);
+    // Directly set the blob without any previous data considerations
+    err = nvs_set_blob(handle, key, buffer, size);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error: setting blob failed: %d", err);
+        storage_close(handle);
         storage_give_lock();
         return false;
     }
 
-    err = nvs_get_blob(handle, key, blob, &blob_size);
+    err = nvs_commit(handle);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Error: Getting blob failed: %d", err);
-        nvs_close(handle);
+        ESP_LOGE(TAG, "Error: committing NVS failed: %d", err);
+        storage_close(handle);
         storage_give_lock();
         return false;
     }
 
-    nvs_close(handle);
+    storage_close(handle);
+    // Chunks appended before would otherwise follow the new blob
+    bool ok = storage_erase_chunks(key);
     storage_give_lock();
+    return ok;
+}
+
+bool storage_get_blob(const char* key, char* blob, size_t size) 
+{
+    if (!storage_take_lock()){
+        ESP_LOGE(TAG, "Error: storage_take_lock");
+        return false;
+    }
+    if (strlen(key) > STORAGE_KEY_MAX_LEN){
+        ESP_LOGE(TAG, "Error: Storage key %s is too long (max 15 characters)", key);
+        storage_give_lock();
+        return false;
+    }
+    // Appended chunks not yet finalized are read after the main blob
+    size_t len = 0;
+    esp_err_t err = storage_read_blob(key, blob, size, &len);
+    storage_give_lock();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error: Getting blob %s failed: %d", key, err);
+        return false;
+    }
     return true;
 }
 
@@ -428,5 +1011,16 @@ bool storage_init(void)
         ESP_LOGE(TAG, "Error: Storage failed to initialise");
         return false;
     }
+    if (!storage_load_flags()) {
+        ESP_LOGE(TAG, "Error: storage_load_flags");
+        return false;
+    }
+    storage_load_chunked();
     return true;
 }
+
+void storage_get_stats(uint32_t *nvs_ops, uint32_t *nvs_us)
+{
+    *nvs_ops = storage_nvs_ops;
+    *nvs_us = storage_nvs_us;
+}
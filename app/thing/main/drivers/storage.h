@@ -20,6 +20,18 @@ bool storage_erase_blob(const char* key);
 bool storage_set_blob(const char* key, const char* buffer, size_t size);
 bool storage_get_blob(const char* key, char* buffer, size_t size);
 bool storage_append_blob(const char* key, const char* buffer, size_t max_size);
+// Appends are stored as separate chunks, storage_get_blob() joins them. Finalizing
+// rewrites the blob and its chunks as one blob once the last row is appended.
+bool storage_finalize_blob(const char* key, size_t max_size);
+// Writes from the calling task between storage_begin() and storage_commit() are held in
+// RAM and written under one NVS handle with one commit. storage_abort(), or any write
+// that fails before the commit, leaves NVS untouched. Flag reads in the transaction see
+// its own writes, blob reads see what is committed. Appending isn't supported.
+bool storage_begin(void);
+bool storage_commit(void);
+void storage_abort(void);
 bool storage_init(void);
+// NVS sessions opened since boot and the time spent in them
+void storage_get_stats(uint32_t *nvs_ops, uint32_t *nvs_us);
 
 #endif /* _STORAGE_H_ */
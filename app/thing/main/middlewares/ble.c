@@ -26,18 +26,40 @@
 #define BLE_STORAGE_KEY_FLAGS       "ble_flags"
 #define BLE_STORAGE_KEY_POP         "ble_pop"
 
+#define BLE_CENTRAL_CONNECT_TIMEOUT_MS  3000
+#define BLE_CENTRAL_READ_MAX_LEN        20
+
+typedef struct ble_central_read_t
+{
+    bool used;
+    bool connected;
+    bool done;
+    int id;
+    uint16_t conn_handle;
+    uint16_t val_handle;
+    ble_uuid16_t uuid;
+} ble_central_read_t;
+
 static const char *TAG = "BLE";
 
 static uint8_t ble_addr_type;
 static uint16_t ble_connection_handle;
 char ble_receive_buffer[BLE_BUFFER_SIZE];
 static bool ble_allow_connection = false;
+static const ble_central_callbacks_t *ble_central_callbacks = NULL;
+// Only touched from the host task, and by ble_central_read() before its connection starts
+static ble_central_read_t ble_central_reads[BLE_CENTRAL_MAX_CONNECTIONS];
 
 static int ble_event_handler(struct ble_gap_event *event, void *arg);
 static bool ble_set_has_pop(void);
 static void ble_app_on_sync(void);
 static void ble_host_task(void *param);
 static void ble_start(void);
+static int ble_central_scan_event_handler(struct ble_gap_event *event, void *arg);
+static int ble_central_event_handler(struct ble_gap_event *event, void *arg);
+static int ble_central_chr_cb(uint16_t conn_handle, const struct ble_gatt_error *error, const struct ble_gatt_chr *chr, void *arg);
+static int ble_central_read_cb(uint16_t conn_handle, const struct ble_gatt_error *error, struct ble_gatt_attr *attr, void *arg);
+static void ble_central_finish(ble_central_read_t *read, const uint8_t *data, uint16_t data_len);
 
 
 // Array to store all the service definitions
@@ -191,6 +213,154 @@ bool ble_send_notification(uint16_t ble_notification_handle, char* json_str)
     return true;
 }
 
+static int ble_central_scan_event_handler(struct ble_gap_event *event, void *arg)
+{
+    switch (event->type)
+    {
+    case BLE_GAP_EVENT_DISC:
+        ble_central_callbacks->advertised(event->disc.addr.val, event->disc.addr.type, event->disc.rssi,
+                                          event->disc.data, event->disc.length_data);
+        break;
+    case BLE_GAP_EVENT_DISC_COMPLETE:
+        ble_central_callbacks->scan_done();
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+static void ble_central_finish(ble_central_read_t *read, const uint8_t *data, uint16_t data_len)
+{
+    // Reported once, whichever of the read and the disconnect comes first
+    if (read->done) {
+        return;
+    }
+    read->done = true;
+    ble_central_callbacks->read_done(read->id, data, data_len);
+}
+
+static int ble_central_read_cb(uint16_t conn_handle, const struct ble_gatt_error *error, struct ble_gatt_attr *attr, void *arg)
+{
+    ble_central_read_t *read = arg;
+    uint8_t data[BLE_CENTRAL_READ_MAX_LEN];
+    uint16_t data_len = 0;
+    if (error->status == 0 && ble_hs_mbuf_to_flat(attr->om, data, sizeof(data), &data_len) == 0) {
+        ble_central_finish(read, data, data_len);
+    } else {
+        ESP_LOGE(TAG, "Error: Read failed %d", error->status);
+        ble_central_finish(read, NULL, 0);
+    }
+    ble_gap_terminate(conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+    return 0;
+}
+
+static int ble_central_chr_cb(uint16_t conn_handle, const struct ble_gatt_error *error, const struct ble_gatt_chr *chr, void *arg)
+{
+    ble_central_read_t *read = arg;
+    if (error->status == 0) {
+        // The first match is read once discovery is done, one ATT request at a time
+        if (read->val_handle == 0) {
+            read->val_handle = chr->val_handle;
+        }
+        return 0;
+    }
+    if (error->status == BLE_HS_EDONE && read->val_handle != 0 &&
+        ble_gattc_read(conn_handle, read->val_handle, ble_central_read_cb, read) == 0) {
+        return 0;
+    }
+    ESP_LOGE(TAG, "Error: Characteristic discovery %d", error->status);
+    ble_central_finish(read, NULL, 0);
+    ble_gap_terminate(conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+    return 0;
+}
+
+static int ble_central_event_handler(struct ble_gap_event *event, void *arg)
+{
+    ble_central_read_t *read = arg;
+    switch (event->type)
+    {
+    case BLE_GAP_EVENT_CONNECT:
+        if (event->connect.status != 0) {
+            ESP_LOGE(TAG, "Error: Connect failed %d", event->connect.status);
+            read->used = false;
+            ble_central_callbacks->connected(read->id, false);
+            break;
+        }
+        read->connected = true;
+        read->conn_handle = event->connect.conn_handle;
+        ble_central_callbacks->connected(read->id, true);
+        if (ble_gattc_disc_chrs_by_uuid(read->conn_handle, 1, 0xffff, &read->uuid.u, ble_central_chr_cb, read) != 0) {
+            ESP_LOGE(TAG, "Error: ble_gattc_disc_chrs_by_uuid");
+            ble_central_finish(read, NULL, 0);
+            ble_gap_terminate(read->conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+        }
+        break;
+    case BLE_GAP_EVENT_DISCONNECT:
+        ble_central_finish(read, NULL, 0);
+        read->used = false;
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+void ble_central_register(const ble_central_callbacks_t *callbacks)
+{
+    ble_central_callbacks = callbacks;
+}
+
+bool ble_central_is_ready(void)
+{
+    return ble_central_callbacks && ble_hs_synced();
+}
+
+bool ble_central_scan(uint32_t duration_ms)
+{
+    // Passive, the sensors' readings are in their advertisements, not in scan responses
+    struct ble_gap_disc_params disc_params;
+    memset(&disc_params, 0, sizeof(disc_params));
+    disc_params.passive = 1;
+    disc_params.filter_duplicates = 0;
+    int rc = ble_gap_disc(ble_addr_type, duration_ms, &disc_params, ble_central_scan_event_handler, NULL);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Error: ble_gap_disc %d", rc);
+        return false;
+    }
+    return true;
+}
+
+bool ble_central_read(int id, const uint8_t *addr, uint8_t addr_type, uint16_t chr_uuid16)
+{
+    ble_central_read_t *read = NULL;
+    for (int i = 0; i < BLE_CENTRAL_MAX_CONNECTIONS && !read; i++) {
+        if (!ble_central_reads[i].used) {
+            read = &ble_central_reads[i];
+        }
+    }
+    if (!read) {
+        ESP_LOGE(TAG, "Error: No central connection slots available");
+        return false;
+    }
+    *read = (ble_central_read_t) {
+        .used = true,
+        .id = id,
+        .uuid = BLE_UUID16_INIT(chr_uuid16),
+    };
+
+    ble_addr_t peer_addr = { .type = addr_type };
+    memcpy(peer_addr.val, addr, sizeof(peer_addr.val));
+    int rc = ble_gap_connect(ble_addr_type, &peer_addr, BLE_CENTRAL_CONNECT_TIMEOUT_MS, NULL,
+                             ble_central_event_handler, read);
+    if (rc != 0) {
+        read->used = false;
+        ESP_LOGE(TAG, "Error: ble_gap_connect %d", rc);
+        return false;
+    }
+    return true;
+}
+
 bool ble_init(void) 
 {
     ESP_LOGI(TAG, "Initialise");
@@ -21,12 +21,29 @@
 
 #define BLE_POP_SIZE 16
 #define BLE_BUFFER_SIZE 256
+// One connection is kept for the provisioning peripheral
+#define BLE_CENTRAL_MAX_CONNECTIONS (CONFIG_BT_NIMBLE_MAX_CONNECTIONS - 1)
+
+#if BLE_CENTRAL_MAX_CONNECTIONS < 1
+#error "CONFIG_BT_NIMBLE_MAX_CONNECTIONS must be at least 2, the central role needs one next to provisioning"
+#endif
 
 typedef enum
 {
     BLE_HAS_POP = BIT0,
 } ble_flags_t;
 
+// Central role, next to the provisioning peripheral. Callbacks run in the NimBLE host task.
+// A read connects, reads one characteristic by its 16-bit UUID and disconnects again.
+typedef struct ble_central_callbacks_t
+{
+    void (*advertised)(const uint8_t *addr, uint8_t addr_type, int8_t rssi, const uint8_t *data, uint8_t data_len);
+    void (*scan_done)(void);
+    void (*connected)(int id, bool ok);
+    // data is NULL if the read failed
+    void (*read_done)(int id, const uint8_t *data, uint16_t data_len);
+} ble_central_callbacks_t;
+
 bool ble_register_service(struct ble_gatt_svc_def service);
 bool ble_init(void);
 bool ble_set_pop(const char *pop);
@@ -35,5 +52,9 @@ bool ble_get_has_pop(void);
 bool ble_send_notification(uint16_t ble_notification_handle, char *json_str);
 void ble_set_allow_connection(bool is_allowed);
 bool ble_is_connection_allowed(void);
+void ble_central_register(const ble_central_callbacks_t *callbacks);
+bool ble_central_is_ready(void);
+bool ble_central_scan(uint32_t duration_ms);
+bool ble_central_read(int id, const uint8_t *addr, uint8_t addr_type, uint16_t chr_uuid16);
 
 #endif /* _BLE_H_ */
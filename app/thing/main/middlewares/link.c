@@ -0,0 +1,169 @@
+/*
+ * link.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "middlewares/link.h"
+#include <inttypes.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "middlewares/mqtt.h"
+#include "esp_timer.h"
+#include "utilities/dirty.h"
+#include "utilities/seqlock.h"
+
+static const char *TAG = "LINK";
+
+typedef enum {
+    LINK_DECISION_HOLD = 0,
+    LINK_DECISION_STRETCH,
+    LINK_DECISION_SHRINK,
+} link_decision_t;
+
+static const char *link_decision_names[] = {
+    [LINK_DECISION_HOLD] = "hold",
+    [LINK_DECISION_STRETCH] = "stretch",
+    [LINK_DECISION_SHRINK] = "shrink",
+};
+
+typedef struct link_value_t {
+    uint32_t interval_ms;
+    link_decision_t decision;
+    int8_t rssi;
+    uint32_t ack_ms;
+    int outbox;
+} link_value_t;
+
+// Updated by thing_run(), read by the type tasks and the value serialization
+static link_value_t link_value_g = {
+    .interval_ms = LINK_INTERVAL_DEFAULT_MS,
+    .decision = LINK_DECISION_HOLD,
+};
+static seqlock_t link_value_lock;
+
+static bool link_get_rssi(int8_t *rssi);
+static bool link_get_struct(link_value_t *link_value);
+
+
+static bool link_get_rssi(int8_t *rssi)
+{
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        return false;
+    }
+    *rssi = ap_info.rssi;
+    return true;
+}
+
+static bool link_get_struct(link_value_t *link_value)
+{
+    return seqlock_read(&link_value_lock, link_value, &link_value_g, sizeof(link_value_t));
+}
+
+bool link_update(void)
+{
+    link_value_t link_value;
+    if (!link_get_struct(&link_value)) {
+        ESP_LOGE(TAG, "Error: link_get_struct");
+        return false;
+    }
+    uint32_t previous_interval_ms = link_value.interval_ms;
+    bool has_rssi = link_get_rssi(&link_value.rssi);
+    link_value.ack_ms = mqtt_get_ack_latency_ms();
+    link_value.outbox = mqtt_get_outbox_size();
+
+    // Any poor signal stretches the interval, all signals must be good to shrink it
+    bool poor = !has_rssi ||
+                link_value.rssi < LINK_RSSI_POOR_DBM ||
+                link_value.ack_ms > LINK_ACK_POOR_MS ||
+                link_value.outbox > LINK_OUTBOX_POOR_BYTES;
+    bool good = has_rssi &&
+                link_value.rssi > LINK_RSSI_GOOD_DBM &&
+                link_value.ack_ms < LINK_ACK_GOOD_MS &&
+                link_value.outbox == 0;
+
+    uint32_t interval_ms = previous_interval_ms;
+    if (poor) {
+        interval_ms *= 2;
+    } else if (good) {
+        interval_ms -= interval_ms / 4;
+    }
+    if (interval_ms > LINK_INTERVAL_MAX_MS) {
+        interval_ms = LINK_INTERVAL_MAX_MS;
+    }
+    if (interval_ms < LINK_INTERVAL_MIN_MS) {
+        interval_ms = LINK_INTERVAL_MIN_MS;
+    }
+
+    if (interval_ms > previous_interval_ms) {
+        link_value.decision = LINK_DECISION_STRETCH;
+    } else if (interval_ms < previous_interval_ms) {
+        link_value.decision = LINK_DECISION_SHRINK;
+    } else {
+        link_value.decision = LINK_DECISION_HOLD;
+    }
+    link_value.interval_ms = interval_ms;
+    if (link_value.decision != LINK_DECISION_HOLD) {
+        ESP_LOGI(TAG, "Interval %s to %" PRIu32 " ms (rssi %d, ack %" PRIu32 " ms, outbox %d)",
+                 link_decision_names[link_value.decision], interval_ms, link_value.rssi, link_value.ack_ms, link_value.outbox);
+    }
+
+    bool changed = false;
+    if (!seqlock_write(&link_value_lock, &link_value_g, &link_value, sizeof(link_value_t), &changed)) {
+        ESP_LOGE(TAG, "Error: seqlock_write");
+        return false;
+    }
+    // Every field is published, so any of them changing makes the value document stale
+    if (changed) {
+        dirty_mark(DIRTY_LINK);
+    }
+    return true;
+}
+
+uint32_t link_get_publish_interval_ms(void)
+{
+    link_value_t link_value;
+    if (!link_get_struct(&link_value)) {
+        return LINK_INTERVAL_DEFAULT_MS;
+    }
+    return link_value.interval_ms;
+}
+
+bool link_publish_is_due(int64_t *last_publish_us)
+{
+    int64_t now_us = esp_timer_get_time();
+    if (*last_publish_us != 0 &&
+        now_us - *last_publish_us < (int64_t)link_get_publish_interval_ms() * 1000) {
+        return false;
+    }
+    *last_publish_us = now_us;
+    return true;
+}
+
+bool link_get_value_writer(json_writer_t *writer)
+{
+    link_value_t link_value;
+    if (!link_get_struct(&link_value)) {
+        ESP_LOGE(TAG, "Error: link_get_struct");
+        return false;
+    }
+    json_writer_object_begin(writer, "link");
+    json_writer_int(writer, "rssi", link_value.rssi);
+    json_writer_int(writer, "ack_ms", link_value.ack_ms);
+    json_writer_int(writer, "outbox", link_value.outbox);
+    json_writer_int(writer, "interval_ms", link_value.interval_ms);
+    json_writer_string(writer, "decision", link_decision_names[link_value.decision]);
+    json_writer_object_end(writer);
+    return true;
+}
+
+bool link_init(void)
+{
+    if (!seqlock_init(&link_value_lock, sizeof(link_value_t))) {
+        ESP_LOGE(TAG, "Error: seqlock_init");
+        return false;
+    }
+    return true;
+}
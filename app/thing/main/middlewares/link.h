@@ -0,0 +1,34 @@
+/*
+ * link.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _LINK_H_
+#define _LINK_H_
+
+#include "utilities/json_writer.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LINK_INTERVAL_DEFAULT_MS    5000
+#define LINK_INTERVAL_MIN_MS        5000
+#define LINK_INTERVAL_MAX_MS        60000
+#define LINK_RSSI_POOR_DBM          -80     // Below this the link is poor
+#define LINK_RSSI_GOOD_DBM          -67     // Above this the link is good
+#define LINK_ACK_POOR_MS            2000    // Smoothed MQTT ack latency
+#define LINK_ACK_GOOD_MS            500
+#define LINK_OUTBOX_POOR_BYTES      1024    // Unacknowledged data waiting in the MQTT outbox
+
+bool link_init(void);
+// Measures the link and runs one step of the interval controller. Called from the value
+// publish path, so the published statistics are current and the interval adapts per publish.
+bool link_update(void);
+// Telemetry interval, stretched when the link is poor and shrunk back when it recovers.
+// Only used for periodic telemetry, control traffic is always sent right away.
+uint32_t link_get_publish_interval_ms(void);
+// True, and restarts the period, once the telemetry interval has passed since *last_publish_us
+bool link_publish_is_due(int64_t *last_publish_us);
+bool link_get_value_writer(json_writer_t *writer);
+
+#endif /* _LINK_H_ */
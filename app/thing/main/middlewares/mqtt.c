@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <string.h>
+#include <stdlib.h>
 #include "esp_system.h"
 #include "esp_event.h"
 #include "esp_log.h"
@@ -21,17 +22,270 @@
 #include "utilities/auth_aws_ota.h"
 #include "utilities/auth_aws_provision.h"
 #include "middlewares/auth.h"
+#include "mbedtls/base64.h"
+#include "utilities/compress.h"
+#include "utilities/probe.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <cJSON.h>
 
 
-#define MQTT_MAX_TOPICS 3
+#define MQTT_MAX_TOPICS 6
+#define MQTT_MAX_COMPRESSED_TOPICS 3
+#define MQTT_MAX_ACKNOWLEDGED_TOPICS 3
+#define MQTT_MAX_INFLIGHT 4
+#define MQTT_CHUNK_PREFIX "{\"chunk\":"
+#define MQTT_CHUNK_ID_MAX 65535
+// Chunks needed for the largest payload, more than this can't be reassembled
+#define MQTT_CHUNK_COUNT_MAX ((MQTT_PAYLOAD_MAX_LEN + MQTT_CHUNK_DATA_MAX_LEN - 1) / MQTT_CHUNK_DATA_MAX_LEN)
+#define MQTT_PUBLISH_LOCK_TIMEOUT_MS 1000
+#define MQTT_INFLIGHT_LOCK_TIMEOUT_MS 10
 
 static const char *TAG = "MQTT";
 static esp_mqtt_client_handle_t mqtt_client = NULL;
-static const char* mqtt_topic_array[MQTT_MAX_TOPICS] = {NULL, NULL, NULL};
-static mqtt_received_callback_t mqtt_received_callbacks[MQTT_MAX_TOPICS] = {NULL, NULL, NULL};
+static const char* mqtt_topic_array[MQTT_MAX_TOPICS] = {NULL, NULL, NULL, NULL, NULL, NULL};
+static mqtt_received_callback_t mqtt_received_callbacks[MQTT_MAX_TOPICS] = {NULL, NULL, NULL, NULL, NULL, NULL};
 static bool mqtt_is_connected = false;
+static const char* mqtt_compressed_topics[MQTT_MAX_COMPRESSED_TOPICS] = {NULL, NULL, NULL};
+// Published with QoS1, the rest with QoS0. Only their acks give the ack latency.
+static const char* mqtt_acknowledged_topics[MQTT_MAX_ACKNOWLEDGED_TOPICS] = {NULL, NULL, NULL};
+static char mqtt_compress_buffer[MQTT_PAYLOAD_MAX_LEN + 1];
+static char mqtt_decompress_buffer[MQTT_PAYLOAD_MAX_LEN + 1];
+
+typedef struct mqtt_inflight_t {
+    int msg_id;
+    int64_t publish_time_us;
+} mqtt_inflight_t;
+
+// Publishes waiting for the broker to acknowledge them, shared by the publishing tasks
+// and the MQTT task. Has its own lock: mqtt_publish_lock is held while the client waits
+// for the MQTT task, which can't wait for that lock in return.
+static SemaphoreHandle_t mqtt_inflight_lock = NULL;
+static mqtt_inflight_t mqtt_inflight[MQTT_MAX_INFLIGHT];
+static int mqtt_inflight_next = 0;
+// Read by the link controller, only touched atomically
+static uint32_t mqtt_ack_latency_ms = 0;
+
+// Several tasks publish, the chunk and compress buffers are shared between them
+static SemaphoreHandle_t mqtt_publish_lock = NULL;
+static uint16_t mqtt_chunk_id = 0;
+static char mqtt_chunk_buffer[MQTT_DATA_MAX_LEN + 1];
+
+// Reassembly of messages split by the MQTT client, only the first event has a topic
+static char mqtt_receive_buffer[MQTT_PAYLOAD_MAX_LEN + 1];
+static int mqtt_receive_topic = -1;
+
+typedef struct mqtt_chunk_receive_t {
+    char *buffer; // Allocated when the first chunk arrives, freed once delivered or abandoned
+    int len;
+    int id;
+    int next;
+    int count;
+} mqtt_chunk_receive_t;
+
+// Reassembly of messages published in chunks, per topic so messages on other topics
+// arriving between two chunks don't interfere
+static mqtt_chunk_receive_t mqtt_chunk_receive[MQTT_MAX_TOPICS];
 
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
+static int mqtt_find_topic(const char *topic, int topic_len);
+static void mqtt_receive(int topic_index, const char *data, int data_len);
+static bool mqtt_receive_chunk(int topic_index, const char *data, int data_len);
+static void mqtt_receive_chunk_reset(mqtt_chunk_receive_t *receive);
+static void mqtt_deliver(int topic_index, const char *data, int data_len);
+static bool mqtt_publish_chunked(const char* topic, const char* data, size_t data_len, int qos);
+static bool mqtt_publish_data(const char* topic, const char* data, size_t data_len, int qos);
+static bool mqtt_is_compressed_topic(const char* topic);
+static bool mqtt_is_acknowledged_topic(const char* topic);
+static bool mqtt_take_inflight_lock(void);
+static void mqtt_give_inflight_lock(void);
+static void mqtt_track_publish(int msg_id);
+static void mqtt_track_published(int msg_id);
+static void mqtt_track_reset(void);
+
+
+static bool mqtt_take_inflight_lock(void)
+{
+    // Only statistics are lost if this fails, so neither task waits long for it
+    if (!(xSemaphoreTake(mqtt_inflight_lock, MQTT_INFLIGHT_LOCK_TIMEOUT_MS / portTICK_PERIOD_MS) == pdTRUE)){
+        ESP_LOGE(TAG, "Error: xSemaphoreTake");
+        return false;
+    }
+    return true;
+}
+
+static void mqtt_give_inflight_lock(void)
+{
+    xSemaphoreGive(mqtt_inflight_lock);
+}
+
+static void mqtt_track_publish(int msg_id)
+{
+    if (msg_id <= 0) {
+        return;
+    }
+    if (!mqtt_take_inflight_lock()) {
+        return;
+    }
+    mqtt_inflight[mqtt_inflight_next].publish_time_us = esp_timer_get_time();
+    mqtt_inflight[mqtt_inflight_next].msg_id = msg_id;
+    mqtt_inflight_next = (mqtt_inflight_next + 1) % MQTT_MAX_INFLIGHT;
+    mqtt_give_inflight_lock();
+}
+
+static void mqtt_track_published(int msg_id)
+{
+    if (!mqtt_take_inflight_lock()) {
+        return;
+    }
+    int64_t publish_time_us = 0;
+    for (int i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        if (mqtt_inflight[i].msg_id == msg_id) {
+            publish_time_us = mqtt_inflight[i].publish_time_us;
+            mqtt_inflight[i].msg_id = 0;
+            break;
+        }
+    }
+    mqtt_give_inflight_lock();
+    if (publish_time_us == 0) {
+        return;
+    }
+
+    uint32_t latency_ms = (esp_timer_get_time() - publish_time_us) / 1000;
+    probe_record(PROBE_ACK, latency_ms);
+    // Smooth the latency, a single slow ack shouldn't change the publish rate.
+    // Only the MQTT task writes it.
+    uint32_t smoothed_ms = __atomic_load_n(&mqtt_ack_latency_ms, __ATOMIC_RELAXED);
+    smoothed_ms = smoothed_ms == 0 ? latency_ms : (3 * smoothed_ms + latency_ms) / 4;
+    __atomic_store_n(&mqtt_ack_latency_ms, smoothed_ms, __ATOMIC_RELAXED);
+    ESP_LOGI(TAG, "Ack latency %" PRIu32 " ms, smoothed %" PRIu32 " ms", latency_ms, smoothed_ms);
+}
+
+static void mqtt_track_reset(void)
+{
+    if (!mqtt_take_inflight_lock()) {
+        return;
+    }
+    memset(mqtt_inflight, 0, sizeof(mqtt_inflight));
+    mqtt_give_inflight_lock();
+}
+
+
+static int mqtt_find_topic(const char *topic, int topic_len)
+{
+    for (int i = 0; i < MQTT_MAX_TOPICS; i++) {
+        if (mqtt_topic_array[i] != NULL && 
+            strlen(mqtt_topic_array[i]) == topic_len && 
+            strncmp(topic, mqtt_topic_array[i], topic_len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void mqtt_receive_chunk_reset(mqtt_chunk_receive_t *receive)
+{
+    free(receive->buffer);
+    receive->buffer = NULL;
+    receive->len = 0;
+    receive->id = -1;
+    receive->next = 0;
+    receive->count = 0;
+}
+
+static bool mqtt_receive_chunk(int topic_index, const char *data, int data_len)
+{
+    mqtt_chunk_receive_t *receive = &mqtt_chunk_receive[topic_index];
+    cJSON *root = cJSON_ParseWithLength(data, data_len);
+    cJSON *chunk = cJSON_GetObjectItem(root, "chunk");
+    cJSON *id = cJSON_GetObjectItem(chunk, "id");
+    cJSON *index = cJSON_GetObjectItem(chunk, "index");
+    cJSON *count = cJSON_GetObjectItem(chunk, "count");
+    cJSON *chunk_data = cJSON_GetObjectItem(root, "data");
+    if (!cJSON_IsNumber(id) || !cJSON_IsNumber(index) || !cJSON_IsNumber(count) || !cJSON_IsString(chunk_data)) {
+        cJSON_Delete(root);
+        ESP_LOGE(TAG, "Error: Invalid chunk header");
+        return false;
+    }
+    // Range checked on the double, valueint saturates instead of failing
+    if (id->valuedouble < 0 || id->valuedouble > MQTT_CHUNK_ID_MAX ||
+        count->valuedouble < 1 || count->valuedouble > MQTT_CHUNK_COUNT_MAX ||
+        index->valuedouble < 0 || index->valuedouble >= count->valuedouble ||
+        strlen(chunk_data->valuestring) > MQTT_DATA_MAX_LEN - MQTT_CHUNK_HEADER_MAX_SIZE) {
+        cJSON_Delete(root);
+        ESP_LOGE(TAG, "Error: Chunk header out of range");
+        return false;
+    }
+
+    // Chunks are expected in order, a new id or a gap restarts the reassembly
+    if (index->valueint == 0) {
+        mqtt_receive_chunk_reset(receive);
+        receive->buffer = malloc(MQTT_PAYLOAD_MAX_LEN + 1);
+        if (receive->buffer == NULL) {
+            cJSON_Delete(root);
+            ESP_LOGE(TAG, "Error: malloc");
+            return false;
+        }
+        receive->id = id->valueint;
+        receive->count = count->valueint;
+    }
+    if (receive->buffer == NULL || id->valueint != receive->id ||
+        index->valueint != receive->next || count->valueint != receive->count) {
+        mqtt_receive_chunk_reset(receive);
+        cJSON_Delete(root);
+        ESP_LOGE(TAG, "Error: Chunk %d of id %d is out of order", index->valueint, id->valueint);
+        return false;
+    }
+
+    size_t decoded_len = 0;
+    const unsigned char *encoded = (const unsigned char *)chunk_data->valuestring;
+    if (mbedtls_base64_decode((unsigned char *)&receive->buffer[receive->len],
+                              MQTT_PAYLOAD_MAX_LEN - receive->len,
+                              &decoded_len, encoded, strlen(chunk_data->valuestring)) != 0) {
+        mqtt_receive_chunk_reset(receive);
+        cJSON_Delete(root);
+        ESP_LOGE(TAG, "Error: Chunk does not fit in receive buffer");
+        return false;
+    }
+    cJSON_Delete(root);
+    receive->len += decoded_len;
+    receive->next++;
+
+    if (receive->next == receive->count) {
+        receive->buffer[receive->len] = '\0';
+        ESP_LOGI(TAG, "Reassembled %d bytes from %d chunks", receive->len, receive->count);
+        mqtt_deliver(topic_index, receive->buffer, receive->len);
+        mqtt_receive_chunk_reset(receive);
+    }
+    return true;
+}
+
+static void mqtt_deliver(int topic_index, const char *data, int data_len)
+{
+    // Compressed payloads are recognised by their header, independent of topic
+    if (compress_is_encoded(data, data_len)) {
+        size_t decoded_len = 0;
+        if (!compress_decode(data, data_len, mqtt_decompress_buffer, sizeof(mqtt_decompress_buffer), &decoded_len)) {
+            ESP_LOGE(TAG, "Error: compress_decode");
+            return;
+        }
+        data = mqtt_decompress_buffer;
+        data_len = decoded_len;
+    }
+    if (mqtt_received_callbacks[topic_index]) {
+        mqtt_received_callbacks[topic_index](data, data_len);
+    }
+}
+
+static void mqtt_receive(int topic_index, const char *data, int data_len)
+{
+    if (data_len >= strlen(MQTT_CHUNK_PREFIX) && strncmp(data, MQTT_CHUNK_PREFIX, strlen(MQTT_CHUNK_PREFIX)) == 0) {
+        mqtt_receive_chunk(topic_index, data, data_len);
+        return;
+    }
+    mqtt_deliver(topic_index, data, data_len);
+}
 
 
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
@@ -49,6 +303,11 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 
         case MQTT_EVENT_DISCONNECTED:
             mqtt_is_connected = false;
+            mqtt_track_reset();
+            // Chunks of a message interrupted by the disconnect will never complete
+            for (int i = 0; i < MQTT_MAX_TOPICS; i++) {
+                mqtt_receive_chunk_reset(&mqtt_chunk_receive[i]);
+            }
             break;
 
         case MQTT_EVENT_SUBSCRIBED:
@@ -64,6 +323,7 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
 
         case MQTT_EVENT_PUBLISHED: // Will not be triggered with QoS0 (fire&forget)
             ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+            mqtt_track_published(event->msg_id);
             break;
 
         case MQTT_EVENT_DATA:
@@ -71,14 +331,29 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
             ESP_LOGI(TAG, "Received on topic - %.*s, data - %.*s", event->topic_len, event->topic, event->data_len, event->data);
             event_trigger(EVENT_MQTT_DATA_RECEIVED);
 
-            for (int i = 0; i < MQTT_MAX_TOPICS; i++) {
-                if (mqtt_topic_array[i] != NULL && strncmp(event->topic, mqtt_topic_array[i], event->topic_len) == 0) {
-                    if (mqtt_received_callbacks[i]) {
-                        mqtt_received_callbacks[i](event->data, event->data_len);
-                    }
-                    break;
-                }
-            }            
+            // Messages larger than the MQTT buffer arrive in several events, only the first has a topic
+            if (event->current_data_offset == 0) {
+                mqtt_receive_topic = mqtt_find_topic(event->topic, event->topic_len);
+            }
+            if (mqtt_receive_topic < 0) {
+                break;
+            }
+            if (event->total_data_len == event->data_len) {
+                mqtt_receive(mqtt_receive_topic, event->data, event->data_len);
+                break;
+            }
+            if (event->total_data_len > MQTT_PAYLOAD_MAX_LEN) {
+                ESP_LOGE(TAG, "Error: Message of %d bytes is too large", event->total_data_len);
+                mqtt_receive_topic = -1;
+                break;
+            }
+            memcpy(&mqtt_receive_buffer[event->current_data_offset], event->data, event->data_len);
+            if (event->current_data_offset + event->data_len == event->total_data_len) {
+                mqtt_receive_buffer[event->total_data_len] = '\0';
+                int topic_index = mqtt_receive_topic;
+                mqtt_receive_topic = -1;
+                mqtt_receive(topic_index, mqtt_receive_buffer, event->total_data_len);
+            }
             break;
 
         case MQTT_EVENT_ERROR:
@@ -114,6 +389,50 @@ bool mqtt_register_subscription(const char* topic, mqtt_received_callback_t rece
     return false;
 }
 
+bool mqtt_register_compression(const char* topic)
+{
+    for (int i = 0; i < MQTT_MAX_COMPRESSED_TOPICS; i++) {
+        if (mqtt_compressed_topics[i] == NULL) {
+            mqtt_compressed_topics[i] = topic;
+            return true;
+        }
+    }
+    ESP_LOGE(TAG, "Error: No compressed topic slots available");
+    return false;
+}
+
+static bool mqtt_is_compressed_topic(const char* topic)
+{
+    for (int i = 0; i < MQTT_MAX_COMPRESSED_TOPICS; i++) {
+        if (mqtt_compressed_topics[i] != NULL && strcmp(mqtt_compressed_topics[i], topic) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool mqtt_register_acknowledged(const char* topic)
+{
+    for (int i = 0; i < MQTT_MAX_ACKNOWLEDGED_TOPICS; i++) {
+        if (mqtt_acknowledged_topics[i] == NULL) {
+            mqtt_acknowledged_topics[i] = topic;
+            return true;
+        }
+    }
+    ESP_LOGE(TAG, "Error: No acknowledged topic slots available");
+    return false;
+}
+
+static bool mqtt_is_acknowledged_topic(const char* topic)
+{
+    for (int i = 0; i < MQTT_MAX_ACKNOWLEDGED_TOPICS; i++) {
+        if (mqtt_acknowledged_topics[i] != NULL && strcmp(mqtt_acknowledged_topics[i], topic) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool mqtt_subscribe(void) 
 {
     for (int i = 0; i < MQTT_MAX_TOPICS; i++) {
@@ -128,24 +447,112 @@ bool mqtt_subscribe(void)
     return true;
 }
 
-bool mqtt_publish(const char* topic, const char* data)
+static bool mqtt_publish_chunked(const char* topic, const char* data, size_t data_len, int qos)
 {
-    if (!mqtt_is_connected){
-        ESP_LOGE(TAG, "Error: MQTT not connected");
-        return false;
+    uint16_t count = (data_len + MQTT_CHUNK_DATA_MAX_LEN - 1) / MQTT_CHUNK_DATA_MAX_LEN;
+    uint16_t id = ++mqtt_chunk_id;
+
+    for (uint16_t index = 0; index < count; index++) {
+        size_t offset = index * MQTT_CHUNK_DATA_MAX_LEN;
+        size_t slice_len = MIN(MQTT_CHUNK_DATA_MAX_LEN, data_len - offset);
+
+        int header_len = snprintf(mqtt_chunk_buffer, sizeof(mqtt_chunk_buffer), 
+                                  MQTT_CHUNK_PREFIX "{\"id\":%u,\"index\":%u,\"count\":%u},\"data\":\"", 
+                                  id, index, count);
+        if (header_len < 0 || header_len >= MQTT_CHUNK_HEADER_MAX_SIZE) {
+            ESP_LOGE(TAG, "Error: snprintf");
+            return false;
+        }
+        size_t encoded_len = 0;
+        if (mbedtls_base64_encode((unsigned char *)&mqtt_chunk_buffer[header_len], 
+                                  sizeof(mqtt_chunk_buffer) - header_len, 
+                                  &encoded_len, (const unsigned char *)&data[offset], slice_len) != 0) {
+            ESP_LOGE(TAG, "Error: mbedtls_base64_encode");
+            return false;
+        }
+        size_t chunk_len = header_len + encoded_len;
+        if (chunk_len + 2 > MQTT_DATA_MAX_LEN) {
+            ESP_LOGE(TAG, "Error: Chunk too large");
+            return false;
+        }
+        memcpy(&mqtt_chunk_buffer[chunk_len], "\"}", 3);
+        chunk_len += 2;
+
+        int msg_id = esp_mqtt_client_publish(mqtt_client, topic, mqtt_chunk_buffer, chunk_len, qos, 0);
+        if (msg_id < 0){
+            ESP_LOGE(TAG, "Error: Publishing chunk %u/%u failed", index + 1, count);
+            return false;
+        }
+        mqtt_track_publish(msg_id);
+    }
+    ESP_LOGI(TAG, "Published %u bytes in %u chunks to %s", (unsigned)data_len, count, topic);
+    return true;
+}
+
+static bool mqtt_publish_data(const char* topic, const char* data, size_t data_len, int qos)
+{
+    if (data_len > MQTT_DATA_MAX_LEN){
+        return mqtt_publish_chunked(topic, data, data_len, qos);
     }
     
-    int msg_id = esp_mqtt_client_publish(mqtt_client, topic, data, strlen(data), 0, 0);
+    int msg_id = esp_mqtt_client_publish(mqtt_client, topic, data, data_len, qos, 0);
 
     if (msg_id < 0){
         ESP_LOGI(TAG, "Error: Publishing failed");
         return false;
     } 
+    mqtt_track_publish(msg_id);
     ESP_LOGI(TAG, "Published msg_id: %d to %s", msg_id, topic);
-    ESP_LOGI(TAG, "Published message: %s", data);
     return true;
 }
 
+uint32_t mqtt_get_ack_latency_ms(void)
+{
+    return __atomic_load_n(&mqtt_ack_latency_ms, __ATOMIC_RELAXED);
+}
+
+int mqtt_get_outbox_size(void)
+{
+    if (mqtt_client == NULL) {
+        return 0;
+    }
+    return esp_mqtt_client_get_outbox_size(mqtt_client);
+}
+
+bool mqtt_publish(const char* topic, const char* data)
+{
+    if (!mqtt_is_connected){
+        ESP_LOGE(TAG, "Error: MQTT not connected");
+        return false;
+    }
+
+    size_t data_len = strlen(data);
+    if (data_len > MQTT_PAYLOAD_MAX_LEN){
+        ESP_LOGE(TAG, "Error: Data too large to publish");
+        return false;
+    }
+    // Payloads are up to 4 KB, only debug builds log them in full
+    ESP_LOGI(TAG, "Publish %u bytes to %s", (unsigned)data_len, topic);
+    ESP_LOGD(TAG, "Publish message: %s", data);
+
+    if (!(xSemaphoreTake(mqtt_publish_lock, MQTT_PUBLISH_LOCK_TIMEOUT_MS / portTICK_PERIOD_MS) == pdTRUE)){
+        ESP_LOGE(TAG, "Error: xSemaphoreTake");
+        return false;
+    }
+    bool published = false;
+    size_t compressed_len = 0;
+    int qos = mqtt_is_acknowledged_topic(topic) ? 1 : 0;
+    // Falls back to the plain payload if it doesn't get any smaller
+    if (mqtt_is_compressed_topic(topic) &&
+        compress_encode(data, data_len, mqtt_compress_buffer, sizeof(mqtt_compress_buffer), &compressed_len)) {
+        published = mqtt_publish_data(topic, mqtt_compress_buffer, compressed_len, qos);
+    } else {
+        published = mqtt_publish_data(topic, data, data_len, qos);
+    }
+    xSemaphoreGive(mqtt_publish_lock);
+    return published;
+}
+
 bool mqtt_stop(void)
 {
     ESP_LOGI(TAG, "Deinitialise");
@@ -176,9 +583,32 @@ bool mqtt_init(void)
 {
     ESP_LOGI(TAG, "Initialise");
 
+    // Kept across mqtt_stop(), a publishing task may be waiting on it
+    if (mqtt_publish_lock == NULL) {
+        mqtt_publish_lock = xSemaphoreCreateMutex();
+        if (mqtt_publish_lock == NULL) {
+            ESP_LOGE(TAG, "Error: xSemaphoreCreateMutex");
+            return false;
+        }
+    }
+    if (mqtt_inflight_lock == NULL) {
+        mqtt_inflight_lock = xSemaphoreCreateMutex();
+        if (mqtt_inflight_lock == NULL) {
+            ESP_LOGE(TAG, "Error: xSemaphoreCreateMutex");
+            return false;
+        }
+    }
+
     esp_mqtt_client_config_t mqtt_config;
     memset(&mqtt_config, 0, sizeof(mqtt_config));
     mqtt_config.broker.address.uri = AWS_MQTT_BROKER_ENDPOINT_URL;
+#ifdef CONFIG_RIOTBOX_MQTT_BROKER_URL_OVERRIDE
+    // Stand-in broker, e.g. a local mosquitto when comparing broker configurations
+    if (strlen(CONFIG_RIOTBOX_MQTT_BROKER_URL) > 0) {
+        ESP_LOGW(TAG, "Broker override: %s", CONFIG_RIOTBOX_MQTT_BROKER_URL);
+        mqtt_config.broker.address.uri = CONFIG_RIOTBOX_MQTT_BROKER_URL;
+    }
+#endif
 
     if (auth_get_which() == AUTH_PROVISION){
         ESP_LOGI(TAG, "USE PROVISION AUTH");
@@ -10,13 +10,22 @@
 #define MQTT_OVERHEAD_SIZE 6   // 2 (header), 2 (QoS identifier), 2 (topic length)
 #define MQTT_TOPIC_MAX_SIZE 32 // Chosen because currently longest topic is 31 bytes
 #define MQTT_DATA_MAX_LEN (CONFIG_MQTT_BUFFER_SIZE - MQTT_TOPIC_MAX_SIZE - MQTT_OVERHEAD_SIZE)
+// Largest document that can be published or received. Documents larger than MQTT_DATA_MAX_LEN
+// are split into chunks: {"chunk":{"id":1,"index":0,"count":3},"data":"<base64 slice>"}
+#define MQTT_PAYLOAD_MAX_LEN 4096
+#define MQTT_CHUNK_HEADER_MAX_SIZE 64 // {"chunk":{"id":65535,"index":65535,"count":65535},"data":""}
+#define MQTT_CHUNK_DATA_MAX_LEN (((MQTT_DATA_MAX_LEN - MQTT_CHUNK_HEADER_MAX_SIZE) / 4) * 3) // Before base64
 
 typedef void (*mqtt_received_callback_t)(const char *data, int data_len);
 
 bool mqtt_init(void);
 bool mqtt_stop(void);
 bool mqtt_register_subscription(const char* topic, mqtt_received_callback_t received_callback);
+bool mqtt_register_compression(const char* topic);
+bool mqtt_register_acknowledged(const char* topic);
 bool mqtt_subscribe(void);
 bool mqtt_publish(const char* topic, const char* data);
+uint32_t mqtt_get_ack_latency_ms(void);
+int mqtt_get_outbox_size(void);
 
 #endif /* _MQTT_H_ */
@@ -0,0 +1,107 @@
+/*
+ * arena.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/arena.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <cJSON.h>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define ARENA_ALIGNMENT 8
+
+static const char *TAG = "ARENA";
+
+static uint8_t arena_buffer[ARENA_SIZE] __attribute__((aligned(ARENA_ALIGNMENT)));
+static size_t arena_used = 0;
+static TaskHandle_t arena_owner = NULL;
+static int arena_depth = 0;
+
+static size_t arena_high_water = 0;
+static uint32_t arena_overflows = 0;
+static uint32_t arena_operations = 0;
+
+static void *arena_malloc(size_t size);
+static void arena_free(void *ptr);
+
+
+static void *arena_malloc(size_t size)
+{
+    // Other tasks never match the owner, so they don't need a lock
+    if (arena_owner != NULL && arena_owner == xTaskGetCurrentTaskHandle()) {
+        size_t aligned = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+        if (aligned <= ARENA_SIZE - arena_used) {
+            void *ptr = &arena_buffer[arena_used];
+            arena_used += aligned;
+            return ptr;
+        }
+        arena_overflows++;
+    }
+    return malloc(size);
+}
+
+static void arena_free(void *ptr)
+{
+    if ((uint8_t *)ptr >= arena_buffer && (uint8_t *)ptr < arena_buffer + ARENA_SIZE) {
+        // Released as a whole by arena_end()
+        return;
+    }
+    free(ptr);
+}
+
+bool arena_begin(void)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    if (arena_owner != NULL && arena_owner != task) {
+        ESP_LOGW(TAG, "Arena is owned by another task, using malloc");
+        return false;
+    }
+    arena_owner = task;
+    arena_depth++;
+    return true;
+}
+
+void arena_end(void)
+{
+    if (arena_owner != xTaskGetCurrentTaskHandle() || arena_depth == 0) {
+        return;
+    }
+    if (--arena_depth > 0) {
+        return;
+    }
+    if (arena_used > arena_high_water) {
+        arena_high_water = arena_used;
+    }
+    arena_used = 0;
+    arena_owner = NULL;
+
+    if (++arena_operations % ARENA_STATS_INTERVAL == 0) {
+        ESP_LOGI(TAG, "Operations %" PRIu32 ", high water %u/%u bytes, overflows %" PRIu32 ", largest free block %u bytes",
+                 arena_operations, (unsigned)arena_high_water, (unsigned)ARENA_SIZE, arena_overflows,
+                 (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    }
+}
+
+void arena_get_stats(size_t *used, size_t *high_water, uint32_t *overflows)
+{
+    *used = arena_used;
+    *high_water = arena_high_water;
+    *overflows = arena_overflows;
+}
+
+bool arena_init(void)
+{
+    ESP_LOGI(TAG, "Initialise");
+    cJSON_Hooks hooks = {
+        .malloc_fn = arena_malloc,
+        .free_fn = arena_free,
+    };
+    cJSON_InitHooks(&hooks);
+    return true;
+}
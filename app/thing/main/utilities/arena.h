@@ -0,0 +1,27 @@
+/*
+ * arena.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_SIZE              CONFIG_RIOTBOX_JSON_ARENA_SIZE
+#define ARENA_STATS_INTERVAL    100 // Log heap fragmentation every 100 operations
+
+// Bump allocator for cJSON, installed with cJSON_InitHooks(). Between arena_begin() and
+// arena_end() cJSON allocations made by the calling task come from the arena, which is
+// reset as a whole by arena_end(). Other tasks, and allocations that don't fit, use malloc().
+// Nothing allocated by cJSON during the operation may be kept after arena_end().
+bool arena_init(void);
+bool arena_begin(void);
+void arena_end(void);
+// used is what the current operation took so far, high_water the most any operation took
+void arena_get_stats(size_t *used, size_t *high_water, uint32_t *overflows);
+
+#endif /* _ARENA_H_ */
@@ -27,6 +27,11 @@ char auth_aws_provision_thing_key[AUTH_AWS_PROVISION_THING_KEY_BUFFER_SIZE];
 
 bool auth_aws_provision_set_has_root_ca(void)
 {
+    // The appended rows are compacted into one blob before it's marked as complete
+    if (!storage_finalize_blob(AUTH_AWS_PROVISION_STORAGE_KEY_ROOT_CA, AUTH_AWS_PROVISION_ROOT_CA_BUFFER_SIZE)){
+        ESP_LOGE(TAG, "Error: storage_finalize_blob");
+        return false;
+    }
     return storage_set_flags(AUTH_AWS_STORAGE_KEY_FLAGS, AUTH_AWS_PROVISION_HAS_ROOT_CA);
 }
 
@@ -37,6 +42,10 @@ bool auth_aws_provision_unset_has_root_ca(void)
 
 bool auth_aws_provision_set_has_thing_cert(void)
 {
+    if (!storage_finalize_blob(AUTH_AWS_PROVISION_STORAGE_KEY_THING_CERT, AUTH_AWS_PROVISION_THING_CERT_BUFFER_SIZE)){
+        ESP_LOGE(TAG, "Error: storage_finalize_blob");
+        return false;
+    }
     return storage_set_flags(AUTH_AWS_STORAGE_KEY_FLAGS, AUTH_AWS_PROVISION_HAS_THING_CERT);
 }
 
@@ -47,6 +56,10 @@ bool auth_aws_provision_unset_has_thing_cert(void)
 
 bool auth_aws_provision_set_has_thing_key(void)
 {
+    if (!storage_finalize_blob(AUTH_AWS_PROVISION_STORAGE_KEY_THING_KEY, AUTH_AWS_PROVISION_THING_KEY_BUFFER_SIZE)){
+        ESP_LOGE(TAG, "Error: storage_finalize_blob");
+        return false;
+    }
     return storage_set_flags(AUTH_AWS_STORAGE_KEY_FLAGS, AUTH_AWS_PROVISION_HAS_THING_KEY);
 }
 
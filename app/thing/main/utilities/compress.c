@@ -0,0 +1,138 @@
+/*
+ * compress.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <string.h>
+#include <stdint.h>
+#include "esp_log.h"
+#include "utilities/compress.h"
+
+// Preset dictionary of the words repeated in our JSON documents. Each word is replaced by a
+// single control character, which valid JSON never contains unescaped. Tab, line feed and
+// carriage return are left out as they may appear as whitespace. Longest words first, so
+// e.g. "readwrite" is matched before "read". Only append words, as changing the order
+// breaks decoding of payloads encoded with an older firmware.
+#define COMPRESS_DICTIONARY_SIZE (sizeof(compress_dictionary) / sizeof(compress_dictionary[0]))
+// Lengths are known at compile time, so the dictionary is constant and shared between tasks
+#define COMPRESS_WORD(code, word) { (code), (word), sizeof(word) - 1 }
+
+typedef struct compress_word_t {
+    uint8_t code;
+    const char *word;
+    uint8_t len;
+} compress_word_t;
+
+static const char *TAG = "COMPRESS";
+
+static const compress_word_t compress_dictionary[] = {
+    COMPRESS_WORD(0x01, "mobile_value"),
+    COMPRESS_WORD(0x02, "thing_value"),
+    COMPRESS_WORD(0x03, "hw_version"),
+    COMPRESS_WORD(0x04, "fw_version"),
+    COMPRESS_WORD(0x05, "sw_version"),
+    COMPRESS_WORD(0x06, "readwrite"),
+    COMPRESS_WORD(0x07, "wifi_scan"),
+    COMPRESS_WORD(0x08, "nickname"),
+    COMPRESS_WORD(0x0B, "network"),
+    COMPRESS_WORD(0x0C, "offline"),
+    COMPRESS_WORD(0x0E, "online"),
+    COMPRESS_WORD(0x0F, "status"),
+    COMPRESS_WORD(0x10, "false"),
+    COMPRESS_WORD(0x11, "value"),
+    COMPRESS_WORD(0x12, "count"),
+    COMPRESS_WORD(0x13, "index"),
+    COMPRESS_WORD(0x14, "chunk"),
+    COMPRESS_WORD(0x15, "true"),
+    COMPRESS_WORD(0x16, "read"),
+    COMPRESS_WORD(0x17, "type"),
+    COMPRESS_WORD(0x18, "ssid"),
+    COMPRESS_WORD(0x19, "rssi"),
+    COMPRESS_WORD(0x1A, "\\\""), // Escaped quote, as the value document is sent as an escaped string
+};
+
+static const compress_word_t *compress_find_code(uint8_t code);
+
+
+static const compress_word_t *compress_find_code(uint8_t code)
+{
+    for (size_t i = 0; i < COMPRESS_DICTIONARY_SIZE; i++) {
+        if (compress_dictionary[i].code == code) {
+            return &compress_dictionary[i];
+        }
+    }
+    return NULL;
+}
+
+bool compress_is_encoded(const char *in, size_t in_len)
+{
+    return in_len >= COMPRESS_HEADER_SIZE && memcmp(in, COMPRESS_HEADER, COMPRESS_HEADER_SIZE) == 0;
+}
+
+bool compress_encode(const char *in, size_t in_len, char *out, size_t out_size, size_t *out_len)
+{
+    if (out_size < COMPRESS_HEADER_SIZE) {
+        return false;
+    }
+    memcpy(out, COMPRESS_HEADER, COMPRESS_HEADER_SIZE);
+    size_t o = COMPRESS_HEADER_SIZE;
+
+    for (size_t i = 0; i < in_len; ) {
+        size_t w;
+        for (w = 0; w < COMPRESS_DICTIONARY_SIZE; w++) {
+            if (compress_dictionary[w].len <= in_len - i && memcmp(&in[i], compress_dictionary[w].word, compress_dictionary[w].len) == 0) {
+                break;
+            }
+        }
+        // Nothing is saved unless the output ends up smaller than the input
+        if (o >= out_size || o >= in_len) {
+            return false;
+        }
+        if (w < COMPRESS_DICTIONARY_SIZE) {
+            out[o++] = compress_dictionary[w].code;
+            i += compress_dictionary[w].len;
+        } else {
+            uint8_t c = in[i];
+            if (c < 0x20 && c != '\t' && c != '\n' && c != '\r') {
+                ESP_LOGE(TAG, "Error: Input is not JSON");
+                return false;
+            }
+            out[o++] = in[i++];
+        }
+    }
+    *out_len = o;
+    return true;
+}
+
+bool compress_decode(const char *in, size_t in_len, char *out, size_t out_size, size_t *out_len)
+{
+    if (!compress_is_encoded(in, in_len)) {
+        ESP_LOGE(TAG, "Error: compress_is_encoded");
+        return false;
+    }
+    size_t o = 0;
+    for (size_t i = COMPRESS_HEADER_SIZE; i < in_len; i++) {
+        const compress_word_t *word = NULL;
+        if ((uint8_t)in[i] < 0x20) {
+            word = compress_find_code(in[i]);
+        }
+        if (word) {
+            if (o + word->len >= out_size) {
+                ESP_LOGE(TAG, "Error: Output buffer too small");
+                return false;
+            }
+            memcpy(&out[o], word->word, word->len);
+            o += word->len;
+        } else {
+            if (o + 1 >= out_size) {
+                ESP_LOGE(TAG, "Error: Output buffer too small");
+                return false;
+            }
+            out[o++] = in[i];
+        }
+    }
+    out[o] = '\0';
+    *out_len = o;
+    return true;
+}
@@ -0,0 +1,22 @@
+/*
+ * compress.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+
+#ifndef _COMPRESS_H_
+#define _COMPRESS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Compressed payloads start with ESC 'Z' and the dictionary version. ESC never appears unescaped in JSON.
+#define COMPRESS_HEADER         "\x1bZ1"
+#define COMPRESS_HEADER_SIZE    3
+
+bool compress_is_encoded(const char *in, size_t in_len);
+bool compress_encode(const char *in, size_t in_len, char *out, size_t out_size, size_t *out_len);
+bool compress_decode(const char *in, size_t in_len, char *out, size_t out_size, size_t *out_len);
+
+#endif /* _COMPRESS_H_ */
@@ -0,0 +1,32 @@
+/*
+ * dirty.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/dirty.h"
+
+// One counter per source, marked from several tasks, so only touched atomically
+static uint32_t dirty_generations[DIRTY_SOURCES] = {0};
+
+
+void dirty_mark(uint32_t sources)
+{
+    for (int i = 0; i < DIRTY_SOURCES; i++) {
+        if (sources & (1 << i)) {
+            __atomic_fetch_add(&dirty_generations[i], 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+uint32_t dirty_get_generation(uint32_t sources)
+{
+    // Counters only ever increase, so the sum changes with every mark of a selected source
+    uint32_t generation = 0;
+    for (int i = 0; i < DIRTY_SOURCES; i++) {
+        if (sources & (1 << i)) {
+            generation += __atomic_load_n(&dirty_generations[i], __ATOMIC_ACQUIRE);
+        }
+    }
+    return generation;
+}
@@ -0,0 +1,30 @@
+/*
+ * dirty.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _DIRTY_H_
+#define _DIRTY_H_
+
+#include <stdint.h>
+
+// Sources of the state in the published value document
+#define DIRTY_TYPE      (1 << 0) // readwrite and read of the type's endpoints
+#define DIRTY_MOBILE    (1 << 1)
+#define DIRTY_VERSION   (1 << 2)
+#define DIRTY_LINK      (1 << 3) // Link statistics, only informative
+#define DIRTY_SOURCES   4
+
+#define DIRTY_ALL       ((1 << DIRTY_SOURCES) - 1)
+// What a change publish is for, link statistics ride along with the next publish
+#define DIRTY_STATE     (DIRTY_ALL & ~DIRTY_LINK)
+
+// Generation counters of the state in the published value document. Anything that
+// mutates that state calls dirty_mark() with its source, so serialized copies can tell
+// they are stale and watchers can ignore the sources they don't depend on.
+void dirty_mark(uint32_t sources);
+// Changes whenever any of the given sources is marked
+uint32_t dirty_get_generation(uint32_t sources);
+
+#endif /* _DIRTY_H_ */
@@ -18,6 +18,8 @@ static const char *event_string(events_t events);
 
 static QueueHandle_t events_handle;
 static events_t events_do_next = EVENT_IGNORE;
+// Only touched by the task calling event_wait()
+static events_t events_ignored = 0;
 
 
 events_t event_wait(void)
@@ -27,6 +29,7 @@ events_t event_wait(void)
     xQueueReceive(events_handle, &event_triggered, portMAX_DELAY);
     events_t event_do = event_triggered & events_do_next;
     events_t event_ignore = event_triggered & ~events_do_next;
+    events_ignored = event_ignore;
 
     if (event_do) {
         ESP_LOGI(TAG, "DO -> %s", event_string(event_do));
@@ -37,6 +40,11 @@ events_t event_wait(void)
     }
 }
 
+events_t event_get_ignored(void)
+{
+    return events_ignored;
+}
+
 void event_expect(events_t events)
 {
     events_do_next = events;
@@ -47,6 +47,8 @@ typedef enum
 
 bool event_init(void);
 events_t event_wait(void);
+// The events the last event_wait() dropped as unexpected, they are not delivered again
+events_t event_get_ignored(void);
 void event_expect(events_t events);
 bool event_trigger(events_t events);
 
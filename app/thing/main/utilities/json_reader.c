@@ -0,0 +1,406 @@
+/*
+ * json_reader.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/json_reader.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "esp_log.h"
+
+#define JSON_READER_NUMBER_MAX_LEN 32
+
+static const char *TAG = "JSON_READER";
+
+typedef struct json_reader_state_t {
+    json_reader_t *reader;
+    int len;
+    int pos;
+} json_reader_state_t;
+
+static void json_reader_skip_whitespace(json_reader_state_t *state);
+static int json_reader_new_token(json_reader_state_t *state, json_token_type_t type);
+static int json_reader_parse_string(json_reader_state_t *state);
+static int json_reader_parse_primitive(json_reader_state_t *state);
+static bool json_reader_is_literal(const char *json, int len);
+static bool json_reader_is_number(const char *json, int len);
+static int json_reader_digits(const char *json, int len, int pos);
+static int json_reader_parse_value(json_reader_state_t *state, int depth);
+static int json_reader_next(const json_reader_t *reader, int token);
+static int json_reader_hex(char c);
+
+
+static void json_reader_skip_whitespace(json_reader_state_t *state)
+{
+    const char *json = state->reader->json;
+    while (state->pos < state->len &&
+           (json[state->pos] == ' ' || json[state->pos] == '\t' ||
+            json[state->pos] == '\r' || json[state->pos] == '\n')) {
+        state->pos++;
+    }
+}
+
+static int json_reader_new_token(json_reader_state_t *state, json_token_type_t type)
+{
+    json_reader_t *reader = state->reader;
+    if (reader->count >= reader->max_tokens) {
+        ESP_LOGE(TAG, "Error: Out of tokens");
+        return -1;
+    }
+    json_token_t *token = &reader->tokens[reader->count];
+    token->type = type;
+    token->start = state->pos;
+    token->end = state->pos;
+    token->size = 0;
+    return reader->count++;
+}
+
+static int json_reader_parse_string(json_reader_state_t *state)
+{
+    const char *json = state->reader->json;
+    // Skip the opening quote
+    state->pos++;
+    int index = json_reader_new_token(state, JSON_TOKEN_STRING);
+    if (index < 0) {
+        return -1;
+    }
+    while (state->pos < state->len) {
+        char c = json[state->pos];
+        if (c == '"') {
+            state->reader->tokens[index].end = state->pos;
+            state->pos++;
+            return index;
+        }
+        if ((unsigned char)c < 0x20) {
+            return -1;
+        }
+        // Escapes are validated when the string is read
+        state->pos += (c == '\\') ? 2 : 1;
+    }
+    return -1;
+}
+
+static int json_reader_digits(const char *json, int len, int pos)
+{
+    while (pos < len && json[pos] >= '0' && json[pos] <= '9') {
+        pos++;
+    }
+    return pos;
+}
+
+static bool json_reader_is_literal(const char *json, int len)
+{
+    return (len == 4 && memcmp(json, "true", 4) == 0) ||
+           (len == 5 && memcmp(json, "false", 5) == 0) ||
+           (len == 4 && memcmp(json, "null", 4) == 0);
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?, so no hex, inf, nan or leading '+'
+static bool json_reader_is_number(const char *json, int len)
+{
+    int pos = 0;
+    if (pos < len && json[pos] == '-') {
+        pos++;
+    }
+    if (pos < len && json[pos] == '0') {
+        pos++;
+    } else if (pos < len && json[pos] >= '1' && json[pos] <= '9') {
+        pos = json_reader_digits(json, len, pos);
+    } else {
+        return false;
+    }
+    if (pos < len && json[pos] == '.') {
+        int start = ++pos;
+        pos = json_reader_digits(json, len, pos);
+        if (pos == start) {
+            return false;
+        }
+    }
+    if (pos < len && (json[pos] == 'e' || json[pos] == 'E')) {
+        pos++;
+        if (pos < len && (json[pos] == '+' || json[pos] == '-')) {
+            pos++;
+        }
+        int start = pos;
+        pos = json_reader_digits(json, len, pos);
+        if (pos == start) {
+            return false;
+        }
+    }
+    return pos == len;
+}
+
+static int json_reader_parse_primitive(json_reader_state_t *state)
+{
+    const char *json = state->reader->json;
+    int index = json_reader_new_token(state, JSON_TOKEN_PRIMITIVE);
+    if (index < 0) {
+        return -1;
+    }
+    while (state->pos < state->len) {
+        char c = json[state->pos];
+        if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            break;
+        }
+        state->pos++;
+    }
+    json_token_t *token = &state->reader->tokens[index];
+    token->end = state->pos;
+    // Checked here, so readers of a primitive only see valid literals and numbers
+    if (!json_reader_is_literal(&json[token->start], token->end - token->start) &&
+        !json_reader_is_number(&json[token->start], token->end - token->start)) {
+        state->pos = token->start;
+        return -1;
+    }
+    return index;
+}
+
+static int json_reader_parse_value(json_reader_state_t *state, int depth)
+{
+    const char *json = state->reader->json;
+    json_reader_skip_whitespace(state);
+    if (state->pos >= state->len) {
+        return -1;
+    }
+    char c = json[state->pos];
+    if (c == '"') {
+        return json_reader_parse_string(state);
+    }
+    if (c != '{' && c != '[') {
+        return json_reader_parse_primitive(state);
+    }
+    if (depth >= JSON_READER_MAX_DEPTH) {
+        ESP_LOGE(TAG, "Error: Too deep");
+        return -1;
+    }
+
+    bool is_object = (c == '{');
+    char close = is_object ? '}' : ']';
+    int index = json_reader_new_token(state, is_object ? JSON_TOKEN_OBJECT : JSON_TOKEN_ARRAY);
+    if (index < 0) {
+        return -1;
+    }
+    state->pos++;
+    json_reader_skip_whitespace(state);
+    if (state->pos < state->len && json[state->pos] == close) {
+        state->pos++;
+        state->reader->tokens[index].end = state->pos;
+        return index;
+    }
+    while (true) {
+        if (is_object) {
+            json_reader_skip_whitespace(state);
+            if (state->pos >= state->len || json[state->pos] != '"' || json_reader_parse_string(state) < 0) {
+                return -1;
+            }
+            json_reader_skip_whitespace(state);
+            if (state->pos >= state->len || json[state->pos] != ':') {
+                return -1;
+            }
+            state->pos++;
+        }
+        if (json_reader_parse_value(state, depth + 1) < 0) {
+            return -1;
+        }
+        state->reader->tokens[index].size++;
+        json_reader_skip_whitespace(state);
+        if (state->pos >= state->len) {
+            return -1;
+        }
+        if (json[state->pos] == ',') {
+            state->pos++;
+            continue;
+        }
+        if (json[state->pos] == close) {
+            state->pos++;
+            state->reader->tokens[index].end = state->pos;
+            return index;
+        }
+        return -1;
+    }
+}
+
+static int json_reader_next(const json_reader_t *reader, int token)
+{
+    // Children start before their parent ends, the first token after that is the next sibling
+    int next = token + 1;
+    while (next < reader->count && reader->tokens[next].start < reader->tokens[token].end) {
+        next++;
+    }
+    return next;
+}
+
+static int json_reader_hex(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool json_reader_parse(json_reader_t *reader, json_token_t *tokens, int max_tokens, const char *json, size_t json_len)
+{
+    reader->json = json;
+    reader->tokens = tokens;
+    reader->max_tokens = max_tokens;
+    reader->count = 0;
+
+    // Token positions are ints
+    if (json_len > INT_MAX) {
+        ESP_LOGE(TAG, "Error: Too long");
+        return false;
+    }
+    json_reader_state_t state = {
+        .reader = reader,
+        .len = json_len,
+        .pos = 0,
+    };
+    if (json_reader_parse_value(&state, 0) < 0) {
+        ESP_LOGE(TAG, "Error: Invalid JSON at %d", state.pos);
+        return false;
+    }
+    json_reader_skip_whitespace(&state);
+    if (state.pos != state.len) {
+        ESP_LOGE(TAG, "Error: Trailing data at %d", state.pos);
+        return false;
+    }
+    return true;
+}
+
+int json_reader_find(const json_reader_t *reader, int object, const char *key)
+{
+    if (!json_reader_is_object(reader, object)) {
+        return -1;
+    }
+    size_t key_len = strlen(key);
+    int token = object + 1;
+    for (int i = 0; i < reader->tokens[object].size; i++) {
+        const json_token_t *name = &reader->tokens[token];
+        if ((size_t)(name->end - name->start) == key_len &&
+            memcmp(&reader->json[name->start], key, key_len) == 0) {
+            return token + 1;
+        }
+        token = json_reader_next(reader, token + 1);
+    }
+    return -1;
+}
+
+bool json_reader_is_object(const json_reader_t *reader, int token)
+{
+    return token >= 0 && token < reader->count && reader->tokens[token].type == JSON_TOKEN_OBJECT;
+}
+
+bool json_reader_get_bool(const json_reader_t *reader, int token, bool *value)
+{
+    if (token < 0 || token >= reader->count || reader->tokens[token].type != JSON_TOKEN_PRIMITIVE) {
+        return false;
+    }
+    const json_token_t *t = &reader->tokens[token];
+    const char *json = &reader->json[t->start];
+    int len = t->end - t->start;
+    if (len == 4 && memcmp(json, "true", 4) == 0) {
+        *value = true;
+        return true;
+    }
+    if (len == 5 && memcmp(json, "false", 5) == 0) {
+        *value = false;
+        return true;
+    }
+    return false;
+}
+
+bool json_reader_get_number(const json_reader_t *reader, int token, double *value)
+{
+    if (token < 0 || token >= reader->count || reader->tokens[token].type != JSON_TOKEN_PRIMITIVE) {
+        return false;
+    }
+    const json_token_t *t = &reader->tokens[token];
+    int len = t->end - t->start;
+    if (len >= JSON_READER_NUMBER_MAX_LEN) {
+        return false;
+    }
+    // The document isn't terminated after the token, so strtod() needs a copy
+    char number[JSON_READER_NUMBER_MAX_LEN];
+    memcpy(number, &reader->json[t->start], len);
+    number[len] = '\0';
+    // The grammar was checked by the tokenizer, but a literal is a primitive too
+    if (!json_reader_is_number(number, len)) {
+        return false;
+    }
+    char *end = NULL;
+    double parsed = strtod(number, &end);
+    // Out of range exponents overflow to infinity
+    if (end != &number[len] || !isfinite(parsed)) {
+        return false;
+    }
+    *value = parsed;
+    return true;
+}
+
+bool json_reader_get_string(const json_reader_t *reader, int token, char *value, size_t value_size)
+{
+    if (token < 0 || token >= reader->count || reader->tokens[token].type != JSON_TOKEN_STRING || value_size == 0) {
+        return false;
+    }
+    const json_token_t *t = &reader->tokens[token];
+    const char *json = reader->json;
+    size_t out = 0;
+    for (int i = t->start; i < t->end; i++) {
+        char c = json[i];
+        if (c == '\\') {
+            i++;
+            switch (json[i]) {
+                case '"': c = '"'; break;
+                case '\\': c = '\\'; break;
+                case '/': c = '/'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'u': {
+                    if (i + 4 >= t->end) {
+                        return false;
+                    }
+                    uint32_t code = 0;
+                    for (int j = 1; j <= 4; j++) {
+                        int hex = json_reader_hex(json[i + j]);
+                        if (hex < 0) {
+                            return false;
+                        }
+                        code = (code << 4) | hex;
+                    }
+                    i += 4;
+                    // UTF-8 encode, surrogate pairs are not combined
+                    char utf8[3];
+                    int utf8_len = 0;
+                    if (code < 0x80) {
+                        utf8[utf8_len++] = code;
+                    } else if (code < 0x800) {
+                        utf8[utf8_len++] = 0xC0 | (code >> 6);
+                        utf8[utf8_len++] = 0x80 | (code & 0x3F);
+                    } else {
+                        utf8[utf8_len++] = 0xE0 | (code >> 12);
+                        utf8[utf8_len++] = 0x80 | ((code >> 6) & 0x3F);
+                        utf8[utf8_len++] = 0x80 | (code & 0x3F);
+                    }
+                    for (int j = 0; j < utf8_len && out < value_size - 1; j++) {
+                        value[out++] = utf8[j];
+                    }
+                    continue;
+                }
+                default:
+                    return false;
+            }
+        }
+        if (out < value_size - 1) {
+            value[out++] = c;
+        }
+    }
+    value[out] = '\0';
+    return true;
+}
@@ -0,0 +1,48 @@
+/*
+ * json_reader.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _JSON_READER_H_
+#define _JSON_READER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSON_READER_MAX_DEPTH 8
+
+typedef enum {
+    JSON_TOKEN_OBJECT = 0,
+    JSON_TOKEN_ARRAY,
+    JSON_TOKEN_STRING,      // start/end exclude the quotes, escapes are kept
+    JSON_TOKEN_PRIMITIVE,   // number, true, false or null
+} json_token_type_t;
+
+typedef struct json_token_t {
+    json_token_type_t type;
+    int start;
+    int end;
+    int size;               // Keys of an object, elements of an array
+} json_token_t;
+
+// Tokenizes a JSON document in one pass into a caller owned token array, without
+// allocating or copying. Tokens are stored in document order, a key is always
+// directly followed by its value.
+typedef struct json_reader_t {
+    const char *json;
+    json_token_t *tokens;
+    int max_tokens;
+    int count;
+} json_reader_t;
+
+bool json_reader_parse(json_reader_t *reader, json_token_t *tokens, int max_tokens, const char *json, size_t json_len);
+// Returns the token index of the value for key in object, or -1
+int json_reader_find(const json_reader_t *reader, int object, const char *key);
+bool json_reader_is_object(const json_reader_t *reader, int token);
+bool json_reader_get_bool(const json_reader_t *reader, int token, bool *value);
+bool json_reader_get_number(const json_reader_t *reader, int token, double *value);
+// Unescapes into value, truncated to value_size like strncpy() but always terminated
+bool json_reader_get_string(const json_reader_t *reader, int token, char *value, size_t value_size);
+
+#endif /* _JSON_READER_H_ */
@@ -0,0 +1,224 @@
+/*
+ * json_writer.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/json_writer.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+
+#define JSON_WRITER_NUMBER_MAX_LEN 32
+
+static const char *TAG = "JSON_WRITER";
+
+static void json_writer_put(json_writer_t *writer, char c);
+static void json_writer_put_raw(json_writer_t *writer, char c);
+static void json_writer_put_string(json_writer_t *writer, const char *str);
+static void json_writer_put_quoted(json_writer_t *writer, const char *str);
+static void json_writer_key(json_writer_t *writer, const char *key);
+static bool json_writer_same_number(double a, double b);
+
+
+// Same tolerance cJSON prints with, so both give the same digits
+static bool json_writer_same_number(double a, double b)
+{
+    double max = fabs(a) > fabs(b) ? fabs(a) : fabs(b);
+    return fabs(a - b) <= max * DBL_EPSILON;
+}
+
+static void json_writer_put_raw(json_writer_t *writer, char c)
+{
+    // Keep room for the terminator
+    if (writer->len + 1 >= writer->size) {
+        writer->error = true;
+        return;
+    }
+    writer->buffer[writer->len++] = c;
+}
+
+static void json_writer_put(json_writer_t *writer, char c)
+{
+    if (writer->escaped_depth >= 0 && (c == '"' || c == '\\')) {
+        json_writer_put_raw(writer, '\\');
+    }
+    json_writer_put_raw(writer, c);
+}
+
+static void json_writer_put_string(json_writer_t *writer, const char *str)
+{
+    while (*str) {
+        json_writer_put(writer, *str++);
+    }
+}
+
+static void json_writer_put_quoted(json_writer_t *writer, const char *str)
+{
+    json_writer_put(writer, '"');
+    for (const unsigned char *c = (const unsigned char *)str; *c; c++) {
+        switch (*c) {
+            case '"': json_writer_put_string(writer, "\\\""); break;
+            case '\\': json_writer_put_string(writer, "\\\\"); break;
+            case '\b': json_writer_put_string(writer, "\\b"); break;
+            case '\f': json_writer_put_string(writer, "\\f"); break;
+            case '\n': json_writer_put_string(writer, "\\n"); break;
+            case '\r': json_writer_put_string(writer, "\\r"); break;
+            case '\t': json_writer_put_string(writer, "\\t"); break;
+            default:
+                if (*c < 0x20) {
+                    char escaped[7];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+                    json_writer_put_string(writer, escaped);
+                } else {
+                    json_writer_put(writer, *c);
+                }
+        }
+    }
+    json_writer_put(writer, '"');
+}
+
+static void json_writer_key(json_writer_t *writer, const char *key)
+{
+    if (writer->need_comma[writer->depth]) {
+        json_writer_put(writer, ',');
+    }
+    writer->need_comma[writer->depth] = true;
+    if (key) {
+        json_writer_put_quoted(writer, key);
+        json_writer_put(writer, ':');
+    }
+}
+
+void json_writer_init(json_writer_t *writer, char *buffer, size_t size)
+{
+    memset(writer, 0, sizeof(json_writer_t));
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->escaped_depth = -1;
+}
+
+bool json_writer_finish(json_writer_t *writer)
+{
+    if (writer->depth != 0 || writer->escaped_depth >= 0) {
+        ESP_LOGE(TAG, "Error: Unbalanced document");
+        writer->error = true;
+    }
+    if (writer->size > 0) {
+        writer->buffer[writer->len < writer->size ? writer->len : writer->size - 1] = '\0';
+    }
+    if (writer->error) {
+        ESP_LOGE(TAG, "Error: Failed to write %u bytes", (unsigned)writer->size);
+        return false;
+    }
+    return true;
+}
+
+void json_writer_object_begin(json_writer_t *writer, const char *key)
+{
+    if (writer->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        writer->error = true;
+        return;
+    }
+    json_writer_key(writer, key);
+    json_writer_put(writer, '{');
+    writer->need_comma[++writer->depth] = false;
+}
+
+void json_writer_object_end(json_writer_t *writer)
+{
+    if (writer->depth == 0) {
+        writer->error = true;
+        return;
+    }
+    writer->depth--;
+    json_writer_put(writer, '}');
+}
+
+void json_writer_array_begin(json_writer_t *writer, const char *key)
+{
+    if (writer->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        writer->error = true;
+        return;
+    }
+    json_writer_key(writer, key);
+    json_writer_put(writer, '[');
+    writer->need_comma[++writer->depth] = false;
+}
+
+void json_writer_array_end(json_writer_t *writer)
+{
+    if (writer->depth == 0) {
+        writer->error = true;
+        return;
+    }
+    writer->depth--;
+    json_writer_put(writer, ']');
+}
+
+void json_writer_escaped_begin(json_writer_t *writer, const char *key)
+{
+    if (writer->escaped_depth >= 0 || writer->depth + 1 >= JSON_WRITER_MAX_DEPTH) {
+        writer->error = true;
+        return;
+    }
+    json_writer_key(writer, key);
+    json_writer_put(writer, '"');
+    // The embedded document starts at its own root
+    writer->escaped_depth = ++writer->depth;
+    writer->need_comma[writer->depth] = false;
+}
+
+void json_writer_escaped_end(json_writer_t *writer)
+{
+    if (writer->escaped_depth != writer->depth) {
+        writer->error = true;
+        return;
+    }
+    writer->depth--;
+    writer->escaped_depth = -1;
+    json_writer_put(writer, '"');
+}
+
+void json_writer_string(json_writer_t *writer, const char *key, const char *value)
+{
+    json_writer_key(writer, key);
+    json_writer_put_quoted(writer, value);
+}
+
+void json_writer_bool(json_writer_t *writer, const char *key, bool value)
+{
+    json_writer_key(writer, key);
+    json_writer_put_string(writer, value ? "true" : "false");
+}
+
+void json_writer_int(json_writer_t *writer, const char *key, int64_t value)
+{
+    char number[JSON_WRITER_NUMBER_MAX_LEN];
+    snprintf(number, sizeof(number), "%lld", (long long)value);
+    json_writer_key(writer, key);
+    json_writer_put_string(writer, number);
+}
+
+void json_writer_number(json_writer_t *writer, const char *key, double value)
+{
+    char number[JSON_WRITER_NUMBER_MAX_LEN];
+    if (!isfinite(value)) {
+        // Same as cJSON, JSON has no representation for these
+        snprintf(number, sizeof(number), "null");
+    } else if (fabs(value) < 1e15 && value == floor(value)) {
+        // Range checked first, casting a double outside int64_t is undefined
+        snprintf(number, sizeof(number), "%lld", (long long)value);
+    } else {
+        // 15 digits unless they don't read back as the same number, like cJSON
+        double parsed = 0;
+        snprintf(number, sizeof(number), "%1.15g", value);
+        if (sscanf(number, "%lg", &parsed) != 1 || !json_writer_same_number(parsed, value)) {
+            snprintf(number, sizeof(number), "%1.17g", value);
+        }
+    }
+    json_writer_key(writer, key);
+    json_writer_put_string(writer, number);
+}
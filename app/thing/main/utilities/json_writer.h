@@ -0,0 +1,44 @@
+/*
+ * json_writer.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _JSON_WRITER_H_
+#define _JSON_WRITER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define JSON_WRITER_MAX_DEPTH 8
+
+// Writes unformatted JSON straight into a caller owned buffer, in the same format
+// as cJSON_PrintUnformatted(). Errors are sticky and reported by json_writer_finish().
+typedef struct json_writer_t {
+    char *buffer;
+    size_t size;
+    size_t len;
+    int depth;
+    bool need_comma[JSON_WRITER_MAX_DEPTH];
+    int escaped_depth;      // Depth of the document written as a string value, or -1
+    bool error;
+} json_writer_t;
+
+void json_writer_init(json_writer_t *writer, char *buffer, size_t size);
+bool json_writer_finish(json_writer_t *writer);
+// key is NULL for the root and for array elements
+void json_writer_object_begin(json_writer_t *writer, const char *key);
+void json_writer_object_end(json_writer_t *writer);
+void json_writer_array_begin(json_writer_t *writer, const char *key);
+void json_writer_array_end(json_writer_t *writer);
+// Everything written until json_writer_escaped_end() becomes one escaped string value,
+// so a JSON document can be embedded in another without a second pass
+void json_writer_escaped_begin(json_writer_t *writer, const char *key);
+void json_writer_escaped_end(json_writer_t *writer);
+void json_writer_string(json_writer_t *writer, const char *key, const char *value);
+void json_writer_bool(json_writer_t *writer, const char *key, bool value);
+void json_writer_int(json_writer_t *writer, const char *key, int64_t value);
+void json_writer_number(json_writer_t *writer, const char *key, double value);
+
+#endif /* _JSON_WRITER_H_ */
@@ -9,6 +9,8 @@
 #define _MISC_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #define ID_SIZE               15
 
@@ -0,0 +1,290 @@
+/*
+ * peers.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/peers.h"
+#include <string.h>
+
+#define PEERS_AD_UUID16_SOME        0x02
+#define PEERS_AD_UUID16_ALL         0x03
+#define PEERS_AD_SERVICE_DATA16     0x16
+#define PEERS_BTHOME_ENCRYPTED      0x01
+#define PEERS_BTHOME_VERSION        2
+#define PEERS_BACKOFF_MIN_MS        1000
+#define PEERS_BACKOFF_MAX_SHIFT     6
+
+static bool peers_is_due(uint32_t now_ms, uint32_t due_ms);
+static bool peers_parse_bthome(const uint8_t *data, size_t len, peers_reading_t *reading);
+static void peers_merge(peers_reading_t *dst, const peers_reading_t *src);
+static int peers_find(peers_t *peers, const uint8_t addr[PEERS_ADDR_SIZE]);
+static void peers_expire(peers_t *peers, uint32_t now_ms);
+static void peers_finish(peers_t *peers, int sensor_index, const peers_reading_t *reading, uint32_t now_ms);
+
+
+static bool peers_is_due(uint32_t now_ms, uint32_t due_ms)
+{
+    // Wraps after 49 days of uptime like the tick count it comes from
+    return (int32_t)(now_ms - due_ms) >= 0;
+}
+
+static bool peers_parse_bthome(const uint8_t *data, size_t len, peers_reading_t *reading)
+{
+    if (len < 1 || (data[0] & PEERS_BTHOME_ENCRYPTED) || (data[0] >> 5) != PEERS_BTHOME_VERSION) {
+        return false;
+    }
+    // Objects are sorted by id, so parsing stops at the first unknown one
+    size_t pos = 1;
+    while (pos < len) {
+        uint8_t id = data[pos++];
+        const uint8_t *v = &data[pos];
+        size_t left = len - pos;
+        if (id == 0x00 && left >= 1) {              // Packet id
+            pos += 1;
+        } else if (id == 0x01 && left >= 1) {       // Battery, 1 %
+            reading->battery = v[0];
+            reading->fields |= PEERS_HAS_BATTERY;
+            pos += 1;
+        } else if (id == 0x02 && left >= 2) {       // Temperature, 0.01 degC
+            reading->temperature = (int16_t)(v[0] | (v[1] << 8)) * 0.01f;
+            reading->fields |= PEERS_HAS_TEMPERATURE;
+            pos += 2;
+        } else if (id == 0x03 && left >= 2) {       // Humidity, 0.01 %
+            reading->humidity = (uint16_t)(v[0] | (v[1] << 8)) * 0.01f;
+            reading->fields |= PEERS_HAS_HUMIDITY;
+            pos += 2;
+        } else if (id == 0x0C && left >= 2) {       // Voltage
+            pos += 2;
+        } else if (id == 0x2E && left >= 1) {       // Humidity, 1 %
+            reading->humidity = v[0];
+            reading->fields |= PEERS_HAS_HUMIDITY;
+            pos += 1;
+        } else if (id == 0x45 && left >= 2) {       // Temperature, 0.1 degC
+            reading->temperature = (int16_t)(v[0] | (v[1] << 8)) * 0.1f;
+            reading->fields |= PEERS_HAS_TEMPERATURE;
+            pos += 2;
+        } else {
+            break;
+        }
+    }
+    return reading->fields != 0;
+}
+
+static void peers_merge(peers_reading_t *dst, const peers_reading_t *src)
+{
+    if (src->fields & PEERS_HAS_TEMPERATURE) {
+        dst->temperature = src->temperature;
+    }
+    if (src->fields & PEERS_HAS_HUMIDITY) {
+        dst->humidity = src->humidity;
+    }
+    if (src->fields & PEERS_HAS_BATTERY) {
+        dst->battery = src->battery;
+    }
+    dst->fields |= src->fields;
+}
+
+static int peers_find(peers_t *peers, const uint8_t addr[PEERS_ADDR_SIZE])
+{
+    for (int i = 0; i < PEERS_MAX; i++) {
+        if (peers->sensors[i].used && memcmp(peers->sensors[i].addr, addr, PEERS_ADDR_SIZE) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void peers_expire(peers_t *peers, uint32_t now_ms)
+{
+    for (int i = 0; i < PEERS_MAX; i++) {
+        peers_sensor_t *sensor = &peers->sensors[i];
+        if (sensor->used && !sensor->reading && peers_is_due(now_ms, sensor->seen_ms + peers->config.timeout_ms)) {
+            sensor->used = false;
+            peers->stats.expired++;
+        }
+    }
+}
+
+void peers_init(peers_t *peers, const peers_config_t *config)
+{
+    memset(peers, 0, sizeof(peers_t));
+    peers->config = *config;
+    // The first scan starts right away
+    peers->scan_started_ms = 0 - config->scan_interval_ms;
+}
+
+bool peers_parse_adv(const uint8_t *data, size_t len, bool *connectable, peers_reading_t *reading)
+{
+    memset(reading, 0, sizeof(peers_reading_t));
+    *connectable = false;
+    bool bthome = false;
+    size_t pos = 0;
+    while (pos + 1 < len) {
+        size_t field_len = data[pos];
+        if (field_len == 0 || pos + 1 + field_len > len) {
+            break;
+        }
+        uint8_t type = data[pos + 1];
+        const uint8_t *field = &data[pos + 2];
+        size_t field_data_len = field_len - 1;
+
+        if (type == PEERS_AD_SERVICE_DATA16 && field_data_len >= 2 &&
+            (field[0] | (field[1] << 8)) == PEERS_BTHOME_UUID) {
+            bthome = peers_parse_bthome(&field[2], field_data_len - 2, reading);
+        } else if (type == PEERS_AD_UUID16_SOME || type == PEERS_AD_UUID16_ALL) {
+            for (size_t i = 0; i + 1 < field_data_len; i += 2) {
+                if ((field[i] | (field[i + 1] << 8)) == PEERS_ESS_UUID) {
+                    *connectable = true;
+                }
+            }
+        }
+        pos += 1 + field_len;
+    }
+    // A sensor that broadcasts its readings is never connected to
+    if (bthome) {
+        *connectable = false;
+    }
+    return bthome || *connectable;
+}
+
+int peers_advertised(peers_t *peers, const uint8_t addr[PEERS_ADDR_SIZE], uint8_t addr_type, int8_t rssi,
+                     bool connectable, const peers_reading_t *reading, uint32_t now_ms)
+{
+    peers->stats.adverts++;
+    int index = peers_find(peers, addr);
+    if (index < 0) {
+        for (int i = 0; i < PEERS_MAX && index < 0; i++) {
+            if (!peers->sensors[i].used) {
+                index = i;
+            }
+        }
+        if (index < 0) {
+            peers->stats.dropped++;
+            return -1;
+        }
+        peers_sensor_t *sensor = &peers->sensors[index];
+        memset(sensor, 0, sizeof(peers_sensor_t));
+        sensor->used = true;
+        memcpy(sensor->addr, addr, PEERS_ADDR_SIZE);
+        sensor->due_ms = now_ms;
+    }
+
+    peers_sensor_t *sensor = &peers->sensors[index];
+    sensor->addr_type = addr_type;
+    sensor->connectable = connectable;
+    sensor->rssi = rssi;
+    sensor->seen_ms = now_ms;
+    if (reading && reading->fields) {
+        peers_merge(&sensor->reading_value, reading);
+        sensor->updated_ms = now_ms;
+        sensor->fresh = true;
+    }
+    return index;
+}
+
+peers_action_t peers_schedule(peers_t *peers, uint32_t now_ms, int *sensor)
+{
+    peers_expire(peers, now_ms);
+    if (peers->scanning || peers->connecting) {
+        return PEERS_ACTION_NONE;
+    }
+    // Scanning first, it is how sensors are found and how broadcast ones are read
+    if (peers_is_due(now_ms, peers->scan_started_ms + peers->config.scan_interval_ms)) {
+        peers->scanning = true;
+        peers->scan_started_ms = now_ms;
+        return PEERS_ACTION_SCAN;
+    }
+    if (peers->connections >= peers->config.max_connections) {
+        return PEERS_ACTION_NONE;
+    }
+
+    int most_overdue = -1;
+    for (int i = 0; i < PEERS_MAX; i++) {
+        peers_sensor_t *candidate = &peers->sensors[i];
+        if (!candidate->used || !candidate->connectable || candidate->reading ||
+            !peers_is_due(now_ms, candidate->due_ms)) {
+            continue;
+        }
+        if (most_overdue < 0 || (int32_t)(candidate->due_ms - peers->sensors[most_overdue].due_ms) < 0) {
+            most_overdue = i;
+        }
+    }
+    if (most_overdue < 0) {
+        return PEERS_ACTION_NONE;
+    }
+    peers->sensors[most_overdue].reading = true;
+    peers->connecting = true;
+    *sensor = most_overdue;
+    return PEERS_ACTION_READ;
+}
+
+void peers_scan_done(peers_t *peers)
+{
+    peers->scanning = false;
+}
+
+void peers_connected(peers_t *peers, int sensor, bool ok, uint32_t now_ms)
+{
+    peers->connecting = false;
+    if (ok) {
+        peers->connections++;
+        return;
+    }
+    // Never connected, so there is no connection to give back
+    peers_finish(peers, sensor, NULL, now_ms);
+}
+
+void peers_read_done(peers_t *peers, int sensor, const peers_reading_t *reading, uint32_t now_ms)
+{
+    peers->connections--;
+    peers_finish(peers, sensor, reading, now_ms);
+}
+
+static void peers_finish(peers_t *peers, int sensor_index, const peers_reading_t *reading, uint32_t now_ms)
+{
+    peers_sensor_t *sensor = &peers->sensors[sensor_index];
+    sensor->reading = false;
+    if (reading) {
+        peers->stats.reads++;
+        sensor->failures = 0;
+        peers_merge(&sensor->reading_value, reading);
+        sensor->updated_ms = now_ms;
+        sensor->fresh = true;
+        sensor->due_ms = now_ms + peers->config.read_interval_ms;
+        return;
+    }
+    // Out of range or busy, retry sooner than the read interval but back off exponentially
+    peers->stats.read_failures++;
+    int shift = sensor->failures < PEERS_BACKOFF_MAX_SHIFT ? sensor->failures : PEERS_BACKOFF_MAX_SHIFT;
+    uint32_t backoff_ms = PEERS_BACKOFF_MIN_MS << shift;
+    if (backoff_ms > peers->config.read_interval_ms) {
+        backoff_ms = peers->config.read_interval_ms;
+    }
+    if (sensor->failures < UINT8_MAX) {
+        sensor->failures++;
+    }
+    sensor->due_ms = now_ms + backoff_ms;
+}
+
+int peers_collect(peers_t *peers, uint32_t now_ms, void (*batch)(void *context, const peers_sensor_t *sensor), void *context)
+{
+    int count = 0;
+    uint32_t latency_max_ms = 0;
+    for (int i = 0; i < PEERS_MAX; i++) {
+        peers_sensor_t *sensor = &peers->sensors[i];
+        if (!sensor->used || !sensor->fresh) {
+            continue;
+        }
+        batch(context, sensor);
+        sensor->fresh = false;
+        if (now_ms - sensor->updated_ms > latency_max_ms) {
+            latency_max_ms = now_ms - sensor->updated_ms;
+        }
+        count++;
+    }
+    if (count > 0) {
+        peers->stats.latency_max_ms = latency_max_ms;
+    }
+    return count;
+}
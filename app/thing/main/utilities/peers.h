@@ -0,0 +1,105 @@
+/*
+ * peers.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _PEERS_H_
+#define _PEERS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// State table and scheduler of the BLE sensors a gateway bridges. Two kinds of sensor:
+//   broadcast    BTHome v2 advertisements, readings are taken from the scan
+//   connectable  advertise the Environmental Sensing service, the gateway connects
+//                every read interval and reads the temperature characteristic
+// The radio either scans or establishes one connection at a time, so the scheduler
+// interleaves scan windows with connections, most overdue sensor first, and backs off
+// sensors that fail to connect. Readings are collected until the next batched publish.
+// Has no ESP-IDF dependencies, so it also builds for the host.
+
+#define PEERS_MAX                   32
+#define PEERS_ADDR_SIZE             6
+#define PEERS_BTHOME_UUID           0xFCD2
+#define PEERS_ESS_UUID              0x181A  // Environmental Sensing service
+#define PEERS_ESS_TEMPERATURE_UUID  0x2A6E  // sint16, 0.01 degC
+
+typedef enum {
+    PEERS_ACTION_NONE = 0,
+    PEERS_ACTION_SCAN,
+    PEERS_ACTION_READ,
+} peers_action_t;
+
+typedef enum {
+    PEERS_HAS_TEMPERATURE = 1 << 0,
+    PEERS_HAS_HUMIDITY = 1 << 1,
+    PEERS_HAS_BATTERY = 1 << 2,
+} peers_fields_t;
+
+typedef struct peers_reading_t {
+    uint8_t fields;         // peers_fields_t
+    float temperature;      // degC
+    float humidity;         // %
+    float battery;          // %
+} peers_reading_t;
+
+typedef struct peers_sensor_t {
+    bool used;
+    bool connectable;
+    bool reading;           // A connection to it is in progress
+    bool fresh;             // Has a reading that wasn't published yet
+    uint8_t addr[PEERS_ADDR_SIZE];
+    uint8_t addr_type;
+    int8_t rssi;
+    uint8_t failures;
+    peers_reading_t reading_value;
+    uint32_t seen_ms;       // Last advertisement
+    uint32_t updated_ms;    // Last reading
+    uint32_t due_ms;        // Next connection, connectable sensors only
+} peers_sensor_t;
+
+typedef struct peers_config_t {
+    uint32_t scan_interval_ms;  // Start of one scan window to the next, a window ends with peers_scan_done()
+    uint32_t read_interval_ms;  // Of connectable sensors
+    uint32_t timeout_ms;        // Sensors not seen for this long are forgotten
+    int max_connections;
+} peers_config_t;
+
+typedef struct peers_stats_t {
+    uint32_t adverts;
+    uint32_t reads;
+    uint32_t read_failures;
+    uint32_t dropped;       // New sensors that didn't fit in the table
+    uint32_t expired;
+    uint32_t latency_max_ms; // Age of the oldest reading in the last batch
+} peers_stats_t;
+
+typedef struct peers_t {
+    peers_config_t config;
+    peers_sensor_t sensors[PEERS_MAX];
+    peers_stats_t stats;
+    uint32_t scan_started_ms;
+    bool scanning;
+    bool connecting;
+    int connections;
+} peers_t;
+
+void peers_init(peers_t *peers, const peers_config_t *config);
+// Parses one advertisement, returns false if it isn't from a supported sensor
+bool peers_parse_adv(const uint8_t *data, size_t len, bool *connectable, peers_reading_t *reading);
+// Records an advertisement, returns the sensor index or -1 if the table is full
+int peers_advertised(peers_t *peers, const uint8_t addr[PEERS_ADDR_SIZE], uint8_t addr_type, int8_t rssi,
+                     bool connectable, const peers_reading_t *reading, uint32_t now_ms);
+// Decides what the radio does next. For PEERS_ACTION_READ, sensor is the index to connect to.
+peers_action_t peers_schedule(peers_t *peers, uint32_t now_ms, int *sensor);
+void peers_scan_done(peers_t *peers);
+// The connection is established (or failed), the radio is free for the next one
+void peers_connected(peers_t *peers, int sensor, bool ok, uint32_t now_ms);
+// reading is NULL if the read failed
+void peers_read_done(peers_t *peers, int sensor, const peers_reading_t *reading, uint32_t now_ms);
+// Calls batch for every sensor with an unpublished reading and marks it published, returns the count
+int peers_collect(peers_t *peers, uint32_t now_ms, void (*batch)(void *context, const peers_sensor_t *sensor), void *context);
+
+#endif /* _PEERS_H_ */
@@ -0,0 +1,40 @@
+/*
+ * pid.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/pid.h"
+#include <string.h>
+
+static float pid_clamp(float value, float min, float max);
+
+
+static float pid_clamp(float value, float min, float max)
+{
+    return value < min ? min : value > max ? max : value;
+}
+
+void pid_init(pid_controller_t *pid, float output_min, float output_max)
+{
+    memset(pid, 0, sizeof(pid_controller_t));
+    pid->output_min = output_min;
+    pid->output_max = output_max;
+}
+
+float pid_update(pid_controller_t *pid, const pid_gains_t *gains, float setpoint, float measured, float dt_s)
+{
+    float error = setpoint - measured;
+
+    float derivative = 0;
+    if (pid->has_previous && dt_s > 0) {
+        derivative = -(measured - pid->previous_measured) / dt_s;
+    }
+    pid->previous_measured = measured;
+    pid->has_previous = true;
+
+    // The integral alone may never push the output past its limits
+    pid->integral = pid_clamp(pid->integral + gains->ki * error * dt_s, pid->output_min, pid->output_max);
+
+    return pid_clamp(gains->kp * error + pid->integral + gains->kd * derivative, pid->output_min, pid->output_max);
+}
@@ -0,0 +1,34 @@
+/*
+ * pid.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _PID_H_
+#define _PID_H_
+
+#include <stdbool.h>
+
+// PID controller with derivative on measurement, so setpoint steps don't kick the output,
+// and a clamped integral, so a saturated output doesn't wind up.
+// Has no ESP-IDF dependencies, so it also builds for the host.
+
+typedef struct pid_gains_t {
+    float kp;
+    float ki;
+    float kd;
+} pid_gains_t;
+
+typedef struct pid_controller_t {
+    float integral;
+    float previous_measured;
+    bool has_previous;
+    float output_min;
+    float output_max;
+} pid_controller_t;
+
+void pid_init(pid_controller_t *pid, float output_min, float output_max);
+// dt_s is the time since the previous update, in seconds
+float pid_update(pid_controller_t *pid, const pid_gains_t *gains, float setpoint, float measured, float dt_s);
+
+#endif /* _PID_H_ */
@@ -0,0 +1,136 @@
+/*
+ * pipeline.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/pipeline.h"
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PIPELINE_RING_MASK (PIPELINE_RING_SIZE - 1)
+
+_Static_assert((PIPELINE_RING_SIZE & PIPELINE_RING_MASK) == 0, "PIPELINE_RING_SIZE must be a power of two");
+
+static void pipeline_reset_window(pipeline_t *pipeline);
+static int pipeline_compare(const void *a, const void *b);
+static float pipeline_get_percentile(const float *sorted, uint32_t count, uint32_t percent);
+
+
+static void pipeline_reset_window(pipeline_t *pipeline)
+{
+    pipeline->decimation_sum = 0;
+    pipeline->decimation_count = 0;
+    pipeline->window_count = 0;
+    pipeline->raw_min = FLT_MAX;
+    pipeline->raw_max = -FLT_MAX;
+    pipeline->raw_sum = 0;
+    pipeline->raw_count = 0;
+}
+
+static int pipeline_compare(const void *a, const void *b)
+{
+    float fa = *(const float *)a;
+    float fb = *(const float *)b;
+    return (fa > fb) - (fa < fb);
+}
+
+static float pipeline_get_percentile(const float *sorted, uint32_t count, uint32_t percent)
+{
+    // Nearest rank
+    uint32_t rank = (percent * count + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+bool pipeline_init(pipeline_t *pipeline, uint32_t decimation, uint32_t window_size)
+{
+    if (decimation == 0 || window_size == 0 || window_size > PIPELINE_WINDOW_MAX) {
+        return false;
+    }
+    memset(pipeline, 0, sizeof(pipeline_t));
+    pipeline->decimation = decimation;
+    pipeline->window_size = window_size;
+    pipeline_reset_window(pipeline);
+    return true;
+}
+
+bool pipeline_push(pipeline_t *pipeline, float sample)
+{
+    uint32_t head = pipeline->head;
+    uint32_t tail = __atomic_load_n(&pipeline->tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= PIPELINE_RING_SIZE) {
+        __atomic_fetch_add(&pipeline->dropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    pipeline->ring[head & PIPELINE_RING_MASK] = sample;
+    // Publish the sample before the consumer can see the new head
+    __atomic_store_n(&pipeline->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool pipeline_process(pipeline_t *pipeline, pipeline_aggregate_t *aggregate)
+{
+    uint32_t head = __atomic_load_n(&pipeline->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = pipeline->tail;
+    bool complete = false;
+
+    while (tail != head && !complete) {
+        float sample = pipeline->ring[tail & PIPELINE_RING_MASK];
+        tail++;
+
+        if (sample < pipeline->raw_min) {
+            pipeline->raw_min = sample;
+        }
+        if (sample > pipeline->raw_max) {
+            pipeline->raw_max = sample;
+        }
+        pipeline->raw_sum += sample;
+        pipeline->raw_count++;
+
+        pipeline->decimation_sum += sample;
+        if (++pipeline->decimation_count < pipeline->decimation) {
+            continue;
+        }
+        pipeline->window[pipeline->window_count++] = pipeline->decimation_sum / pipeline->decimation;
+        pipeline->decimation_sum = 0;
+        pipeline->decimation_count = 0;
+        complete = pipeline->window_count >= pipeline->window_size;
+    }
+    __atomic_store_n(&pipeline->tail, tail, __ATOMIC_RELEASE);
+
+    if (!complete) {
+        return false;
+    }
+    pipeline_aggregate(pipeline->window, pipeline->window_count, aggregate);
+    // min, max and mean are exact, not limited to the downsampled window
+    aggregate->min = pipeline->raw_min;
+    aggregate->max = pipeline->raw_max;
+    aggregate->mean = (float)(pipeline->raw_sum / pipeline->raw_count);
+    aggregate->count = pipeline->raw_count;
+    uint32_t dropped = __atomic_load_n(&pipeline->dropped, __ATOMIC_RELAXED);
+    aggregate->dropped = dropped - pipeline->dropped_reported;
+    pipeline->dropped_reported = dropped;
+    pipeline_reset_window(pipeline);
+    return true;
+}
+
+bool pipeline_aggregate(float *samples, uint32_t count, pipeline_aggregate_t *aggregate)
+{
+    if (count == 0) {
+        return false;
+    }
+    double sum = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    qsort(samples, count, sizeof(float), pipeline_compare);
+    aggregate->min = samples[0];
+    aggregate->max = samples[count - 1];
+    aggregate->mean = (float)(sum / count);
+    aggregate->p50 = pipeline_get_percentile(samples, count, 50);
+    aggregate->p90 = pipeline_get_percentile(samples, count, 90);
+    aggregate->count = count;
+    aggregate->dropped = 0;
+    return true;
+}
@@ -0,0 +1,60 @@
+/*
+ * pipeline.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Sampling pipeline: a producer (e.g. a timer) pushes raw samples into a lock-free ring,
+// a consumer task drains it, box-car downsamples by a fixed factor into a window, and
+// summarises every full window into one aggregate. Only aggregates leave the device.
+// Has no ESP-IDF dependencies, so it also builds for the host.
+
+#define PIPELINE_RING_SIZE      256 // Power of two, raw samples between two drains
+#define PIPELINE_WINDOW_MAX     128 // Downsampled samples per aggregate
+
+typedef struct pipeline_aggregate_t {
+    float min;      // Of the raw samples
+    float max;      // Of the raw samples
+    float mean;     // Of the raw samples
+    float p50;      // Of the downsampled samples
+    float p90;      // Of the downsampled samples
+    uint32_t count; // Raw samples in the window
+    uint32_t dropped; // Raw samples lost to a full ring since the last aggregate
+} pipeline_aggregate_t;
+
+typedef struct pipeline_t {
+    // Producer side, head is only written by pipeline_push()
+    float ring[PIPELINE_RING_SIZE];
+    uint32_t head;
+    uint32_t dropped;
+    // Consumer side, only touched by pipeline_process()
+    uint32_t tail;
+    uint32_t decimation;
+    uint32_t window_size;
+    float decimation_sum;
+    uint32_t decimation_count;
+    float window[PIPELINE_WINDOW_MAX];
+    uint32_t window_count;
+    float raw_min;
+    float raw_max;
+    double raw_sum;
+    uint32_t raw_count;
+    uint32_t dropped_reported;
+} pipeline_t;
+
+bool pipeline_init(pipeline_t *pipeline, uint32_t decimation, uint32_t window_size);
+// Single producer, safe to call from a timer callback. Fails when the ring is full.
+bool pipeline_push(pipeline_t *pipeline, float sample);
+// Single consumer. Drains the ring and returns true when a window completed.
+// Samples left in the ring are kept for the next call.
+bool pipeline_process(pipeline_t *pipeline, pipeline_aggregate_t *aggregate);
+// Summarises samples in place, they are sorted afterwards
+bool pipeline_aggregate(float *samples, uint32_t count, pipeline_aggregate_t *aggregate);
+
+#endif /* _PIPELINE_H_ */
@@ -0,0 +1,74 @@
+/*
+ * power.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/power.h"
+#include <math.h>
+
+// Centred 12-bit samples square to at most 2^22, so 2^8 of them fit an int32 sum
+#define POWER_BLOCK_SIZE    256
+
+
+void power_accumulate(power_sums_t *sums, const uint16_t *voltage, const uint16_t *current, uint32_t count)
+{
+    uint32_t n = 0;
+    while (n < count) {
+        uint32_t end = n + POWER_BLOCK_SIZE < count ? n + POWER_BLOCK_SIZE : count;
+        // 32-bit partial sums per block, the cores have a single cycle 32-bit MAC
+        // but no 64-bit one. Unrolled by 4 to keep loads and MACs in flight.
+        int32_t v = 0, i = 0, vv = 0, ii = 0, vi = 0;
+        for (; n + 4 <= end; n += 4) {
+            int32_t v0 = (int32_t)voltage[n] - POWER_ADC_MIDSCALE;
+            int32_t v1 = (int32_t)voltage[n + 1] - POWER_ADC_MIDSCALE;
+            int32_t v2 = (int32_t)voltage[n + 2] - POWER_ADC_MIDSCALE;
+            int32_t v3 = (int32_t)voltage[n + 3] - POWER_ADC_MIDSCALE;
+            int32_t i0 = (int32_t)current[n] - POWER_ADC_MIDSCALE;
+            int32_t i1 = (int32_t)current[n + 1] - POWER_ADC_MIDSCALE;
+            int32_t i2 = (int32_t)current[n + 2] - POWER_ADC_MIDSCALE;
+            int32_t i3 = (int32_t)current[n + 3] - POWER_ADC_MIDSCALE;
+            v += v0 + v1 + v2 + v3;
+            i += i0 + i1 + i2 + i3;
+            vv += v0 * v0 + v1 * v1 + v2 * v2 + v3 * v3;
+            ii += i0 * i0 + i1 * i1 + i2 * i2 + i3 * i3;
+            vi += v0 * i0 + v1 * i1 + v2 * i2 + v3 * i3;
+        }
+        for (; n < end; n++) {
+            int32_t v0 = (int32_t)voltage[n] - POWER_ADC_MIDSCALE;
+            int32_t i0 = (int32_t)current[n] - POWER_ADC_MIDSCALE;
+            v += v0;
+            i += i0;
+            vv += v0 * v0;
+            ii += i0 * i0;
+            vi += v0 * i0;
+        }
+        sums->v += v;
+        sums->i += i;
+        sums->vv += vv;
+        sums->ii += ii;
+        sums->vi += vi;
+    }
+    sums->count += count;
+}
+
+bool power_compute(const power_sums_t *sums, float v_scale, float i_scale, power_result_t *result)
+{
+    if (sums->count == 0) {
+        return false;
+    }
+    double n = sums->count;
+    double v_mean = sums->v / n;
+    double i_mean = sums->i / n;
+    // Variance and covariance around the measured offset, not the nominal midscale
+    double v_var = sums->vv / n - v_mean * v_mean;
+    double i_var = sums->ii / n - i_mean * i_mean;
+    double vi_cov = sums->vi / n - v_mean * i_mean;
+
+    result->v_rms = (float)(sqrt(v_var > 0 ? v_var : 0) * v_scale);
+    result->i_rms = (float)(sqrt(i_var > 0 ? i_var : 0) * i_scale);
+    result->real_w = (float)(vi_cov * v_scale * i_scale);
+    result->apparent_va = result->v_rms * result->i_rms;
+    result->power_factor = result->apparent_va > 0 ? result->real_w / result->apparent_va : 0;
+    return true;
+}
@@ -0,0 +1,41 @@
+/*
+ * power.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _POWER_H_
+#define _POWER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Fixed-point kernels for AC power measurement from raw ADC samples. Samples are
+// accumulated as integer sums, offsets and scaling are applied once per report.
+// Has no ESP-IDF dependencies, so it also builds for the host.
+
+#define POWER_ADC_MIDSCALE  2048 // 12-bit ADC, keeps squares of a block within int32
+
+typedef struct power_sums_t {
+    int64_t v;
+    int64_t i;
+    int64_t vv;
+    int64_t ii;
+    int64_t vi;
+    uint32_t count;
+} power_sums_t;
+
+typedef struct power_result_t {
+    float v_rms;
+    float i_rms;
+    float real_w;
+    float apparent_va;
+    float power_factor;
+} power_result_t;
+
+// voltage[n] and current[n] must be sampled as close together as possible
+void power_accumulate(power_sums_t *sums, const uint16_t *voltage, const uint16_t *current, uint32_t count);
+// Removes the DC offset of both channels and scales counts to volts and amps
+bool power_compute(const power_sums_t *sums, float v_scale, float i_scale, power_result_t *result);
+
+#endif /* _POWER_H_ */
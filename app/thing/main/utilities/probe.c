@@ -0,0 +1,136 @@
+/*
+ * probe.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/probe.h"
+#include <inttypes.h>
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Only held for a memcpy or a bucket increment, a sample waiting this long is dropped
+#define PROBE_LOCK_TIMEOUT_MS 10
+
+static const char *TAG = "PROBE";
+
+// Upper bound of each bucket in ms, the last bucket takes everything above
+static const uint32_t probe_bucket_limits_ms[PROBE_BUCKET_COUNT] = {
+    10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 30000, UINT32_MAX
+};
+
+static const char *probe_kind_names[PROBE_MAX] = {
+    [PROBE_ACK] = "ack",
+    [PROBE_ECHO] = "echo",
+    [PROBE_BOOTUP] = "bootup",
+};
+
+typedef struct probe_histogram_t {
+    uint32_t buckets[PROBE_BUCKET_COUNT];
+    uint32_t count;
+    uint32_t max_ms;
+} probe_histogram_t;
+
+static probe_histogram_t probe_histograms[PROBE_MAX];
+
+static SemaphoreHandle_t probe_lock = NULL;
+
+static bool probe_take_lock(void);
+static void probe_give_lock(void);
+static uint32_t probe_get_percentile(const probe_histogram_t *histogram, uint32_t percent);
+
+
+static bool probe_take_lock(void)
+{
+    if (!(xSemaphoreTake(probe_lock, PROBE_LOCK_TIMEOUT_MS / portTICK_PERIOD_MS) == pdTRUE)){
+        ESP_LOGE(TAG, "Error: xSemaphoreTake");
+        return false;
+    }
+    return true;
+}
+
+static void probe_give_lock(void)
+{
+    xSemaphoreGive(probe_lock);
+}
+
+static uint32_t probe_get_percentile(const probe_histogram_t *histogram, uint32_t percent)
+{
+    // Resolution is one bucket, reported as the upper bound of the bucket
+    uint32_t rank = (histogram->count * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < PROBE_BUCKET_COUNT; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            return probe_bucket_limits_ms[i] < histogram->max_ms ? probe_bucket_limits_ms[i] : histogram->max_ms;
+        }
+    }
+    return histogram->max_ms;
+}
+
+void probe_record(probe_kind_t kind, uint32_t rtt_ms)
+{
+    if (kind >= PROBE_MAX || probe_lock == NULL) {
+        return;
+    }
+    // A sample lost to contention doesn't matter, callers are never blocked
+    if (!probe_take_lock()) {
+        return;
+    }
+    probe_histogram_t *histogram = &probe_histograms[kind];
+    int i = 0;
+    while (rtt_ms > probe_bucket_limits_ms[i]) {
+        i++;
+    }
+    histogram->buckets[i]++;
+    histogram->count++;
+    if (rtt_ms > histogram->max_ms) {
+        histogram->max_ms = rtt_ms;
+    }
+    probe_give_lock();
+    ESP_LOGI(TAG, "%s rtt %" PRIu32 " ms", probe_kind_names[kind], rtt_ms);
+}
+
+bool probe_get_json(cJSON *root)
+{
+    if (!probe_take_lock()) {
+        ESP_LOGE(TAG, "Error: probe_take_lock");
+        return false;
+    }
+    probe_histogram_t histograms[PROBE_MAX];
+    memcpy(histograms, probe_histograms, sizeof(histograms));
+    memset(probe_histograms, 0, sizeof(probe_histograms));
+    probe_give_lock();
+
+    for (int kind = 0; kind < PROBE_MAX; kind++) {
+        const probe_histogram_t *histogram = &histograms[kind];
+        cJSON *stats = cJSON_CreateObject();
+        if (!stats || !cJSON_AddItemToObject(root, probe_kind_names[kind], stats)) {
+            cJSON_Delete(stats);
+            ESP_LOGE(TAG, "Error: cJSON_AddItemToObject");
+            return false;
+        }
+        cJSON_AddNumberToObject(stats, "count", histogram->count);
+        if (histogram->count == 0) {
+            continue;
+        }
+        cJSON_AddNumberToObject(stats, "p50", probe_get_percentile(histogram, 50));
+        cJSON_AddNumberToObject(stats, "p90", probe_get_percentile(histogram, 90));
+        cJSON_AddNumberToObject(stats, "p99", probe_get_percentile(histogram, 99));
+        cJSON_AddNumberToObject(stats, "max", histogram->max_ms);
+    }
+    return true;
+}
+
+bool probe_init(void)
+{
+    probe_lock = xSemaphoreCreateBinary();
+    if (probe_lock == NULL) {
+        ESP_LOGE(TAG, "Error: xSemaphoreCreateBinary");
+        return false;
+    }
+    probe_give_lock();
+    return true;
+}
@@ -0,0 +1,28 @@
+/*
+ * probe.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _PROBE_H_
+#define _PROBE_H_
+
+#include <cJSON.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PROBE_BUCKET_COUNT 12
+
+typedef enum {
+    PROBE_ACK = 0,  // Publish until acknowledged by the broker (QoS1)
+    PROBE_ECHO,     // Publish on the echo topic until the broker routes it back
+    PROBE_BOOTUP,   // Bootup request until the cloud Lambda answers
+    PROBE_MAX,
+} probe_kind_t;
+
+bool probe_init(void);
+void probe_record(probe_kind_t kind, uint32_t rtt_ms);
+// Adds count, p50, p90, p99 and max per kind, then starts a new window
+bool probe_get_json(cJSON *root);
+
+#endif /* _PROBE_H_ */
@@ -0,0 +1,238 @@
+/*
+ * rules.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/rules.h"
+#include <string.h>
+
+#define RULES_HEADER_SIZE   7
+#define RULES_RULE_SIZE     9   // Without the code
+
+static uint16_t rules_read_u16(const uint8_t *data);
+static float rules_read_float(const uint8_t *data);
+static bool rules_verify_code(const uint8_t *code, int code_len, int name_count, int max_endpoints);
+static bool rules_parse(rules_t *rules, const uint8_t *bytecode, size_t size, int max_endpoints);
+static bool rules_run(const rules_t *rules, const rules_rule_t *rule, rules_get_field_t get_field, void *context,
+                      bool *result, uint32_t *instructions);
+
+
+static uint16_t rules_read_u16(const uint8_t *data)
+{
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+static float rules_read_float(const uint8_t *data)
+{
+    // Unaligned in the bytecode, both the ESP32 and the host are little endian
+    float value;
+    memcpy(&value, data, sizeof(float));
+    return value;
+}
+
+static bool rules_verify_code(const uint8_t *code, int code_len, int name_count, int max_endpoints)
+{
+    // Straight line code, so tracking the stack depth once proves every evaluation stays in bounds
+    int depth = 0;
+    int pc = 0;
+    while (pc < code_len) {
+        switch (code[pc]) {
+        case RULES_OP_CONST:
+            if (pc + 5 > code_len) {
+                return false;
+            }
+            pc += 5;
+            depth++;
+            break;
+        case RULES_OP_FIELD:
+            if (pc + 3 > code_len || code[pc + 1] >= max_endpoints || code[pc + 2] >= name_count) {
+                return false;
+            }
+            pc += 3;
+            depth++;
+            break;
+        case RULES_OP_NOT:
+            if (depth < 1) {
+                return false;
+            }
+            pc++;
+            break;
+        case RULES_OP_LT: case RULES_OP_GT: case RULES_OP_LE: case RULES_OP_GE:
+        case RULES_OP_EQ: case RULES_OP_NE: case RULES_OP_AND: case RULES_OP_OR:
+        case RULES_OP_ADD: case RULES_OP_SUB: case RULES_OP_MUL:
+            if (depth < 2) {
+                return false;
+            }
+            pc++;
+            depth--;
+            break;
+        default:
+            return false;
+        }
+        if (depth > RULES_MAX_STACK) {
+            return false;
+        }
+    }
+    return depth == 1;
+}
+
+static bool rules_parse(rules_t *rules, const uint8_t *bytecode, size_t size, int max_endpoints)
+{
+    // With rules NULL it only verifies, so a bad rule set never replaces a loaded one
+    if (rules_get_size(bytecode, size) != size) {
+        return false;
+    }
+    int rule_count = bytecode[3];
+    int name_count = bytecode[4];
+    if (bytecode[2] != RULES_FORMAT || rule_count > RULES_MAX_RULES || name_count > RULES_MAX_NAMES) {
+        return false;
+    }
+
+    size_t offset = RULES_HEADER_SIZE;
+    for (int i = 0; i < name_count; i++) {
+        const uint8_t *end = memchr(&bytecode[offset], '\0', size - offset);
+        if (!end || end == &bytecode[offset]) {
+            return false;
+        }
+        if (rules) {
+            rules->names[i] = (const char *)&rules->bytecode[offset];
+        }
+        offset = end - bytecode + 1;
+    }
+
+    for (int i = 0; i < rule_count; i++) {
+        if (offset + RULES_RULE_SIZE > size) {
+            return false;
+        }
+        const uint8_t *header = &bytecode[offset];
+        int code_len = header[8];
+        offset += RULES_RULE_SIZE;
+        if (header[2] >= max_endpoints || header[3] >= name_count ||
+            code_len > RULES_MAX_CODE || offset + code_len > size ||
+            !rules_verify_code(&bytecode[offset], code_len, name_count, max_endpoints)) {
+            return false;
+        }
+        if (rules) {
+            rules->rules[i] = (rules_rule_t) {
+                .hold_s = rules_read_u16(&header[0]),
+                .endpoint = header[2],
+                .name = header[3],
+                .value = rules_read_float(&header[4]),
+                .code_offset = offset,
+                .code_len = code_len,
+            };
+        }
+        offset += code_len;
+    }
+    if (offset != size) {
+        return false;
+    }
+    if (rules) {
+        rules->size = size;
+        rules->name_count = name_count;
+        rules->rule_count = rule_count;
+    }
+    return true;
+}
+
+static bool rules_run(const rules_t *rules, const rules_rule_t *rule, rules_get_field_t get_field, void *context,
+                      bool *result, uint32_t *instructions)
+{
+    // Bounds were verified on load, so the loop needs no checks of its own
+    float stack[RULES_MAX_STACK];
+    int top = -1;
+    const uint8_t *code = &rules->bytecode[rule->code_offset];
+    int pc = 0;
+    while (pc < rule->code_len) {
+        uint8_t op = code[pc];
+        (*instructions)++;
+        switch (op) {
+        case RULES_OP_CONST:
+            stack[++top] = rules_read_float(&code[pc + 1]);
+            pc += 5;
+            continue;
+        case RULES_OP_FIELD:
+            if (!get_field(context, code[pc + 1], rules->names[code[pc + 2]], &stack[++top])) {
+                return false;
+            }
+            pc += 3;
+            continue;
+        case RULES_OP_NOT:
+            stack[top] = stack[top] == 0;
+            pc++;
+            continue;
+        default:
+            break;
+        }
+        float b = stack[top--];
+        float a = stack[top];
+        switch (op) {
+        case RULES_OP_LT:  stack[top] = a < b; break;
+        case RULES_OP_GT:  stack[top] = a > b; break;
+        case RULES_OP_LE:  stack[top] = a <= b; break;
+        case RULES_OP_GE:  stack[top] = a >= b; break;
+        case RULES_OP_EQ:  stack[top] = a == b; break;
+        case RULES_OP_NE:  stack[top] = a != b; break;
+        case RULES_OP_AND: stack[top] = a != 0 && b != 0; break;
+        case RULES_OP_OR:  stack[top] = a != 0 || b != 0; break;
+        case RULES_OP_ADD: stack[top] = a + b; break;
+        case RULES_OP_SUB: stack[top] = a - b; break;
+        case RULES_OP_MUL: stack[top] = a * b; break;
+        default: break;
+        }
+        pc++;
+    }
+    *result = stack[0] != 0;
+    return true;
+}
+
+size_t rules_get_size(const uint8_t *bytecode, size_t size)
+{
+    if (size < RULES_HEADER_SIZE || bytecode[0] != 'R' || bytecode[1] != 'B') {
+        return 0;
+    }
+    size_t total = rules_read_u16(&bytecode[5]);
+    return total <= RULES_MAX_SIZE ? total : 0;
+}
+
+bool rules_load(rules_t *rules, const uint8_t *bytecode, size_t size, int max_endpoints)
+{
+    if (!rules_parse(NULL, bytecode, size, max_endpoints)) {
+        return false;
+    }
+    memset(rules, 0, sizeof(rules_t));
+    memcpy(rules->bytecode, bytecode, size);
+    return rules_parse(rules, rules->bytecode, size, max_endpoints);
+}
+
+void rules_clear(rules_t *rules)
+{
+    rules->size = 0;
+    rules->name_count = 0;
+    rules->rule_count = 0;
+}
+
+uint32_t rules_evaluate(rules_t *rules, uint32_t now_s, rules_get_field_t get_field, rules_set_field_t set_field, void *context)
+{
+    uint32_t instructions = 0;
+    for (int i = 0; i < rules->rule_count; i++) {
+        rules_rule_t *rule = &rules->rules[i];
+        bool result = false;
+        if (!rules_run(rules, rule, get_field, context, &result, &instructions) || !result) {
+            rule->holding = false;
+            rule->fired = false;
+            continue;
+        }
+        if (!rule->holding) {
+            rule->holding = true;
+            rule->holding_since_s = now_s;
+        }
+        // Fires once per time the condition turns true, so its own action can't retrigger it
+        if (!rule->fired && now_s - rule->holding_since_s >= rule->hold_s) {
+            rule->fired = true;
+            set_field(context, rule->endpoint, rules->names[rule->name], rule->value);
+        }
+    }
+    return instructions;
+}
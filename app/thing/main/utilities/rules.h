@@ -0,0 +1,81 @@
+/*
+ * rules.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _RULES_H_
+#define _RULES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Local automation rules, compiled off-device into bytecode (little endian):
+//   header  'R' 'B' format(1) rule_count(1) name_count(1) size(2)
+//   names   name_count NUL terminated field names
+//   rules   rule_count times: hold_s(2) endpoint(1) name(1) value(4, float) code_len(1) code
+// A rule sets field name of endpoint to value once its condition has been true for
+// hold_s seconds, and re-arms when the condition turns false. The condition is stack code
+// over floats (bools are 0 and 1). Code has no jumps and is verified on load, so one
+// evaluation runs at most RULES_MAX_RULES * RULES_MAX_CODE instructions.
+// Has no ESP-IDF dependencies, so it also builds for the host.
+
+#define RULES_FORMAT        1
+#define RULES_MAX_SIZE      1024
+#define RULES_MAX_RULES     16
+#define RULES_MAX_NAMES     16
+#define RULES_MAX_CODE      64  // Bytes of condition code per rule
+#define RULES_MAX_STACK     8
+
+typedef enum {
+    RULES_OP_CONST = 1, // value(4, float)  -> value
+    RULES_OP_FIELD,     // endpoint(1) name(1) -> field value, a missing field makes the condition false
+    RULES_OP_LT,        // a b -> a < b
+    RULES_OP_GT,
+    RULES_OP_LE,
+    RULES_OP_GE,
+    RULES_OP_EQ,
+    RULES_OP_NE,
+    RULES_OP_AND,
+    RULES_OP_OR,
+    RULES_OP_NOT,       // a -> !a
+    RULES_OP_ADD,
+    RULES_OP_SUB,
+    RULES_OP_MUL,
+} rules_op_t;
+
+typedef struct rules_rule_t {
+    uint16_t hold_s;
+    uint8_t endpoint;
+    uint8_t name;
+    float value;
+    uint16_t code_offset;
+    uint8_t code_len;
+    // Evaluation state
+    bool holding;
+    bool fired;
+    uint32_t holding_since_s;
+} rules_rule_t;
+
+typedef struct rules_t {
+    uint8_t bytecode[RULES_MAX_SIZE];
+    size_t size;
+    const char *names[RULES_MAX_NAMES]; // Point into bytecode
+    int name_count;
+    rules_rule_t rules[RULES_MAX_RULES];
+    int rule_count;
+} rules_t;
+
+typedef bool (*rules_get_field_t)(void *context, int endpoint, const char *name, float *value);
+typedef bool (*rules_set_field_t)(void *context, int endpoint, const char *name, float value);
+
+// Returns the total size from the header, 0 if it isn't a rule set header
+size_t rules_get_size(const uint8_t *bytecode, size_t size);
+// Verifies the whole rule set before replacing the loaded one, rules is unchanged on failure
+bool rules_load(rules_t *rules, const uint8_t *bytecode, size_t size, int max_endpoints);
+void rules_clear(rules_t *rules);
+// Evaluates every rule once and runs the actions that are due, returns the instructions executed
+uint32_t rules_evaluate(rules_t *rules, uint32_t now_s, rules_get_field_t get_field, rules_set_field_t set_field, void *context);
+
+#endif /* _RULES_H_ */
@@ -0,0 +1,188 @@
+/*
+ * schema.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/schema.h"
+#include <math.h>
+#include <string.h>
+#include "esp_log.h"
+
+static const char *TAG = "SCHEMA";
+
+typedef struct schema_input_t {
+    bool boolean;
+    double number;
+    const char *string;
+} schema_input_t;
+
+static bool schema_validate(const schema_field_t *field, const schema_input_t *input);
+static void schema_store(const schema_field_t *field, const schema_input_t *input, void *dst);
+
+
+static bool schema_validate(const schema_field_t *field, const schema_input_t *input)
+{
+    switch (field->kind) {
+        case SCHEMA_INT:
+        case SCHEMA_NUMBER:
+            // NaN compares false against both limits, so it would pass the range check
+            if (!isfinite(input->number)) {
+                ESP_LOGE(TAG, "Error: %s is not finite", field->name);
+                return false;
+            }
+            if (field->kind == SCHEMA_INT && input->number != floor(input->number)) {
+                ESP_LOGE(TAG, "Error: %s is not an integer", field->name);
+                return false;
+            }
+            if (input->number < field->min || input->number > field->max) {
+                ESP_LOGE(TAG, "Error: %s out of range", field->name);
+                return false;
+            }
+            return true;
+        case SCHEMA_STRING:
+            if (input->string && strlen(input->string) >= field->size) {
+                ESP_LOGE(TAG, "Error: %s too long", field->name);
+                return false;
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+static void schema_store(const schema_field_t *field, const schema_input_t *input, void *dst)
+{
+    void *member = (uint8_t *)dst + field->offset;
+    switch (field->kind) {
+        case SCHEMA_BOOL:
+            *(bool *)member = input->boolean;
+            break;
+        case SCHEMA_INT:
+            *(int32_t *)member = (int32_t)input->number;
+            break;
+        case SCHEMA_NUMBER:
+            *(double *)member = input->number;
+            break;
+        case SCHEMA_STRING:
+            strcpy((char *)member, input->string);
+            break;
+    }
+}
+
+bool schema_read(const schema_field_t *fields, int count, const json_reader_t *reader, int object, void *dst)
+{
+    // One byte larger than any string field, so a string that doesn't fit is rejected, not truncated
+    char string[SCHEMA_STRING_MAX_SIZE + 1];
+    for (int i = 0; i < count; i++) {
+        const schema_field_t *field = &fields[i];
+        int token = json_reader_find(reader, object, field->name);
+        schema_input_t input = {0};
+        bool valid = false;
+        switch (field->kind) {
+            case SCHEMA_BOOL:
+                valid = json_reader_get_bool(reader, token, &input.boolean);
+                break;
+            case SCHEMA_INT:
+            case SCHEMA_NUMBER:
+                valid = json_reader_get_number(reader, token, &input.number);
+                break;
+            case SCHEMA_STRING:
+                // SCHEMA_MEMBER_STRING checks the size when the struct is declared
+                valid = field->size <= SCHEMA_STRING_MAX_SIZE &&
+                        json_reader_get_string(reader, token, string, field->size + 1);
+                input.string = string;
+                break;
+        }
+        if (!valid) {
+            ESP_LOGE(TAG, "Error: %s missing or wrong type", field->name);
+            return false;
+        }
+        if (!schema_validate(field, &input)) {
+            return false;
+        }
+        schema_store(field, &input, dst);
+    }
+    return true;
+}
+
+bool schema_read_cjson(const schema_field_t *fields, int count, const cJSON *object, void *dst)
+{
+    for (int i = 0; i < count; i++) {
+        const schema_field_t *field = &fields[i];
+        const cJSON *item = cJSON_GetObjectItemCaseSensitive(object, field->name);
+        schema_input_t input = {0};
+        bool valid = false;
+        switch (field->kind) {
+            case SCHEMA_BOOL:
+                valid = cJSON_IsBool(item);
+                input.boolean = cJSON_IsTrue(item);
+                break;
+            case SCHEMA_INT:
+            case SCHEMA_NUMBER:
+                valid = cJSON_IsNumber(item);
+                input.number = valid ? item->valuedouble : 0;
+                break;
+            case SCHEMA_STRING:
+                valid = cJSON_IsString(item);
+                input.string = valid ? item->valuestring : NULL;
+                break;
+        }
+        if (!valid) {
+            ESP_LOGE(TAG, "Error: %s missing or wrong type", field->name);
+            return false;
+        }
+        if (!schema_validate(field, &input)) {
+            return false;
+        }
+        schema_store(field, &input, dst);
+    }
+    return true;
+}
+
+void schema_write(const schema_field_t *fields, int count, json_writer_t *writer, const void *src)
+{
+    for (int i = 0; i < count; i++) {
+        const schema_field_t *field = &fields[i];
+        const void *member = (const uint8_t *)src + field->offset;
+        switch (field->kind) {
+            case SCHEMA_BOOL:
+                json_writer_bool(writer, field->name, *(const bool *)member);
+                break;
+            case SCHEMA_INT:
+                json_writer_int(writer, field->name, *(const int32_t *)member);
+                break;
+            case SCHEMA_NUMBER:
+                json_writer_number(writer, field->name, *(const double *)member);
+                break;
+            case SCHEMA_STRING:
+                json_writer_string(writer, field->name, (const char *)member);
+                break;
+        }
+    }
+}
+
+bool schema_set_number(const schema_field_t *fields, int count, const char *name, double number, void *dst)
+{
+    for (int i = 0; i < count; i++) {
+        const schema_field_t *field = &fields[i];
+        if (strcmp(field->name, name) != 0) {
+            continue;
+        }
+        if (field->kind == SCHEMA_STRING) {
+            ESP_LOGE(TAG, "Error: %s is a string", name);
+            return false;
+        }
+        schema_input_t input = {
+            .boolean = number != 0,
+            .number = number,
+        };
+        if (!schema_validate(field, &input)) {
+            return false;
+        }
+        schema_store(field, &input, dst);
+        return true;
+    }
+    ESP_LOGE(TAG, "Error: %s not found", name);
+    return false;
+}
@@ -0,0 +1,77 @@
+/*
+ * schema.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _SCHEMA_H_
+#define _SCHEMA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cJSON.h>
+#include "utilities/json_reader.h"
+#include "utilities/json_writer.h"
+
+// Types declare their properties once as an X-macro list, one X(kind, field, a, b) per property:
+//   X(BOOL, field, 0, 0)       bool
+//   X(INT, field, min, max)    int32_t, validated to [min, max]
+//   X(NUMBER, field, min, max) double, validated to [min, max]
+//   X(STRING, field, size, 0)  char[size], including the terminator
+// The list generates the struct members with SCHEMA_MEMBER and the field table with
+// SCHEMA_FIELD, which drives parsing, serialization and validation.
+// Structs end with SCHEMA_MEMBERS_END and tables with SCHEMA_FIELDS_END, so an empty list
+// still gives a valid struct and table.
+
+#define SCHEMA_STRING_MAX_SIZE 64 // Parsing checks the length in a buffer of this size on the stack
+
+typedef enum {
+    SCHEMA_BOOL = 0,
+    SCHEMA_INT,
+    SCHEMA_NUMBER,
+    SCHEMA_STRING,
+} schema_kind_t;
+
+typedef struct schema_field_t {
+    const char *name;
+    schema_kind_t kind;
+    size_t offset;
+    size_t size;
+    double min;
+    double max;
+} schema_field_t;
+
+#define SCHEMA_MEMBER_BOOL(field, a, b)     bool field;
+#define SCHEMA_MEMBER_INT(field, a, b)      int32_t field;
+#define SCHEMA_MEMBER_NUMBER(field, a, b)   double field;
+#define SCHEMA_MEMBER_STRING(field, a, b)   char field[a]; \
+    _Static_assert((a) <= SCHEMA_STRING_MAX_SIZE, #field " is larger than SCHEMA_STRING_MAX_SIZE");
+#define SCHEMA_MEMBER(kind, field, a, b)    SCHEMA_MEMBER_##kind(field, a, b)
+// Never parsed or serialized, it only keeps the struct non-empty
+#define SCHEMA_MEMBERS_END                  uint8_t schema_end;
+
+// Parameters are kept short as they would otherwise replace the member designators
+#define SCHEMA_FIELD(t, k, f, a, b) {               \
+    .name = #f,                                     \
+    .kind = SCHEMA_##k,                             \
+    .offset = offsetof(t, f),                       \
+    .size = sizeof(((t *)0)->f),                    \
+    .min = (a),                                     \
+    .max = (b),                                     \
+},
+
+#define SCHEMA_FIELDS_END { .name = NULL }
+
+// Number of fields in a table, not counting SCHEMA_FIELDS_END
+#define SCHEMA_COUNT(fields) ((int)(sizeof(fields) / sizeof(schema_field_t)) - 1)
+
+// All fields are required. dst is only partially updated on failure, so parse into a copy.
+// Whether anything changed is up to the caller, type.c compares the copy in seqlock_update.
+bool schema_read(const schema_field_t *fields, int count, const json_reader_t *reader, int object, void *dst);
+bool schema_read_cjson(const schema_field_t *fields, int count, const cJSON *object, void *dst);
+void schema_write(const schema_field_t *fields, int count, json_writer_t *writer, const void *src);
+// Sets the BOOL, INT or NUMBER field called name, a BOOL is set when number is not 0
+bool schema_set_number(const schema_field_t *fields, int count, const char *name, double number, void *dst);
+
+#endif /* _SCHEMA_H_ */
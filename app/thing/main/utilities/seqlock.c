@@ -0,0 +1,131 @@
+/*
+ * seqlock.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/seqlock.h"
+#include <inttypes.h>
+#include <string.h>
+#include "esp_log.h"
+#include "freertos/task.h"
+
+// A reader that preempted the writer on its own core would spin forever, so it
+// sleeps a tick after this many attempts to let the writer finish
+#define SEQLOCK_SPIN_RETRIES    16
+// The copy seqlock_update() edits is an array of doubles, so every member kind is aligned
+#define SEQLOCK_SCRATCH_LEN         (SEQLOCK_MAX_SIZE / sizeof(double))
+
+static const char *TAG = "SEQLOCK";
+
+static bool seqlock_check(seqlock_t *lock, size_t size);
+static bool seqlock_store(seqlock_t *lock, void *dst, const void *src, size_t size);
+
+static bool seqlock_check(seqlock_t *lock, size_t size)
+{
+    if (lock->writer_lock == NULL) {
+        ESP_LOGE(TAG, "Error: seqlock not initialised");
+        return false;
+    }
+    if (size > lock->size) {
+        ESP_LOGE(TAG, "Error: %u bytes, the seqlock protects %u", (unsigned)size, (unsigned)lock->size);
+        return false;
+    }
+    return true;
+}
+
+static bool seqlock_store(seqlock_t *lock, void *dst, const void *src, size_t size)
+{
+    // Writers are serialised, so dst can be compared without a retry
+    if (memcmp(dst, src, size) == 0) {
+        return false;
+    }
+    __atomic_fetch_add(&lock->sequence, 1, __ATOMIC_RELAXED);
+    // The odd sequence must be visible before any byte of dst changes
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(dst, src, size);
+    __atomic_fetch_add(&lock->sequence, 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool seqlock_init(seqlock_t *lock, size_t size)
+{
+    if (size > SEQLOCK_MAX_SIZE) {
+        ESP_LOGE(TAG, "Error: %u bytes, larger than SEQLOCK_MAX_SIZE", (unsigned)size);
+        return false;
+    }
+    lock->sequence = 0;
+    lock->size = size;
+    // A mutex rather than a binary semaphore, for priority inheritance between writers
+    lock->writer_lock = xSemaphoreCreateMutex();
+    if (lock->writer_lock == NULL) {
+        ESP_LOGE(TAG, "Error: xSemaphoreCreateMutex");
+        return false;
+    }
+    return true;
+}
+
+bool seqlock_read(seqlock_t *lock, void *dst, const void *src, size_t size)
+{
+    if (!seqlock_check(lock, size)) {
+        return false;
+    }
+    uint32_t attempts = 0;
+    while (true) {
+        uint32_t start = __atomic_load_n(&lock->sequence, __ATOMIC_ACQUIRE);
+        if ((start & 1) == 0) {
+            memcpy(dst, src, size);
+            // The copy must complete before the sequence is checked again
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&lock->sequence, __ATOMIC_RELAXED) == start) {
+                break;
+            }
+        }
+        attempts++;
+        if (attempts % SEQLOCK_SPIN_RETRIES == 0) {
+            vTaskDelay(1);
+        }
+    }
+    if (attempts >= SEQLOCK_SPIN_RETRIES) {
+        ESP_LOGW(TAG, "Read retried %" PRIu32 " times", attempts);
+    }
+    return true;
+}
+
+bool seqlock_write(seqlock_t *lock, void *dst, const void *src, size_t size, bool *changed)
+{
+    if (!seqlock_check(lock, size)) {
+        return false;
+    }
+    if (xSemaphoreTake(lock->writer_lock, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Error: xSemaphoreTake");
+        return false;
+    }
+    bool is_changed = seqlock_store(lock, dst, src, size);
+    xSemaphoreGive(lock->writer_lock);
+    if (changed) {
+        *changed = is_changed;
+    }
+    return true;
+}
+
+bool seqlock_update(seqlock_t *lock, void *data, size_t size, bool (*update)(void *value, void *arg), void *arg, bool *changed)
+{
+    if (!seqlock_check(lock, size)) {
+        return false;
+    }
+    if (xSemaphoreTake(lock->writer_lock, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Error: xSemaphoreTake");
+        return false;
+    }
+    // Only writers change data and they are all locked out, so it is read without a retry
+    double value[SEQLOCK_SCRATCH_LEN];
+    memcpy(value, data, size);
+    bool is_updated = update(value, arg);
+    bool is_changed = is_updated && seqlock_store(lock, data, value, size);
+    xSemaphoreGive(lock->writer_lock);
+    if (changed) {
+        *changed = is_changed;
+    }
+    return is_updated;
+}
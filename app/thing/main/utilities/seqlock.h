@@ -0,0 +1,37 @@
+/*
+ * seqlock.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _SEQLOCK_H_
+#define _SEQLOCK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Sequence lock for small value structs that are read far more often than written.
+// Readers never block and never fail, they copy again if a write happened meanwhile.
+// Writers are serialised by a mutex, so they wait for each other instead of failing.
+// A change computed from the current value goes through seqlock_update, which holds the
+// mutex from the read to the write, so a concurrent writer's change is never lost.
+#define SEQLOCK_MAX_SIZE 128 // Largest protected struct, seqlock_update edits a copy on the stack
+
+typedef struct seqlock_t {
+    uint32_t sequence; // Odd while a write is in progress
+    SemaphoreHandle_t writer_lock;
+    size_t size;
+} seqlock_t;
+
+// size is the size of the protected struct, accesses may cover part of it
+bool seqlock_init(seqlock_t *lock, size_t size);
+bool seqlock_read(seqlock_t *lock, void *dst, const void *src, size_t size);
+bool seqlock_write(seqlock_t *lock, void *dst, const void *src, size_t size, bool *changed);
+// update edits a copy of data and returns false to leave data as it is, which makes
+// seqlock_update return false. It runs with the writer lock held, so it must not block.
+bool seqlock_update(seqlock_t *lock, void *data, size_t size, bool (*update)(void *value, void *arg), void *arg, bool *changed);
+
+#endif /* _SEQLOCK_H_ */
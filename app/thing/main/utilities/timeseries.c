@@ -0,0 +1,140 @@
+/*
+ * timeseries.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/timeseries.h"
+#include <math.h>
+#include <string.h>
+
+#define TIMESERIES_ERASED 0xFF
+
+static size_t timeseries_put_varint(uint8_t *out, size_t pos, size_t size, uint32_t value);
+static size_t timeseries_get_varint(const uint8_t *in, size_t pos, size_t size, uint32_t *value);
+static uint32_t timeseries_zigzag(int32_t value);
+static int32_t timeseries_unzigzag(uint32_t value);
+static int32_t timeseries_fixed(float value);
+
+
+static size_t timeseries_put_varint(uint8_t *out, size_t pos, size_t size, uint32_t value)
+{
+    // Returns the position after the varint, or size + 1 when it doesn't fit
+    do {
+        if (pos >= size) {
+            return size + 1;
+        }
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out[pos++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return pos;
+}
+
+static size_t timeseries_get_varint(const uint8_t *in, size_t pos, size_t size, uint32_t *value)
+{
+    // Returns the position after the varint, or 0 when it is truncated or too long
+    *value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (pos >= size) {
+            return 0;
+        }
+        uint8_t byte = in[pos++];
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return pos;
+        }
+    }
+    return 0;
+}
+
+static uint32_t timeseries_zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t timeseries_unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static int32_t timeseries_fixed(float value)
+{
+    float scaled = roundf(value * TIMESERIES_SCALE);
+    if (!(scaled > INT32_MIN / 2)) {
+        return INT32_MIN / 2;
+    }
+    if (!(scaled < INT32_MAX / 2)) {
+        return INT32_MAX / 2;
+    }
+    return (int32_t)scaled;
+}
+
+void timeseries_reset(timeseries_state_t *state, uint32_t base_ts)
+{
+    memset(state, 0, sizeof(timeseries_state_t));
+    state->ts = base_ts;
+}
+
+size_t timeseries_encode(timeseries_state_t *state, const timeseries_record_t *record, uint8_t *out, size_t size)
+{
+    if (record->endpoint >= TIMESERIES_MAX_ENDPOINTS || record->count > TIMESERIES_MAX_FIELDS) {
+        return 0;
+    }
+    int32_t values[TIMESERIES_MAX_FIELDS];
+    size_t pos = timeseries_put_varint(out, 1, size, timeseries_zigzag((int32_t)(record->ts - state->ts)));
+    if (pos + 2 > size) {
+        return 0;
+    }
+    out[pos++] = record->endpoint;
+    out[pos++] = record->count;
+    for (int i = 0; i < record->count; i++) {
+        values[i] = timeseries_fixed(record->values[i]);
+        int32_t delta = values[i] - state->values[record->endpoint][i];
+        pos = timeseries_put_varint(out, pos, size, timeseries_zigzag(delta));
+    }
+    if (pos > size) {
+        return 0;
+    }
+    out[0] = pos - 1;
+
+    state->ts = record->ts;
+    memcpy(state->values[record->endpoint], values, record->count * sizeof(int32_t));
+    return pos;
+}
+
+size_t timeseries_decode(timeseries_state_t *state, const uint8_t *in, size_t size, timeseries_record_t *record)
+{
+    if (size < 1 || in[0] == TIMESERIES_ERASED || in[0] == 0 || (size_t)in[0] + 1 > size) {
+        return 0;
+    }
+    size_t end = in[0] + 1;
+    uint32_t ts_delta;
+    size_t pos = timeseries_get_varint(in, 1, end, &ts_delta);
+    if (pos == 0 || pos + 2 > end) {
+        return 0;
+    }
+    record->endpoint = in[pos++];
+    record->count = in[pos++];
+    if (record->endpoint >= TIMESERIES_MAX_ENDPOINTS || record->count > TIMESERIES_MAX_FIELDS) {
+        return 0;
+    }
+    int32_t *values = state->values[record->endpoint];
+    int32_t decoded[TIMESERIES_MAX_FIELDS];
+    for (int i = 0; i < record->count; i++) {
+        uint32_t delta;
+        pos = timeseries_get_varint(in, pos, end, &delta);
+        if (pos == 0) {
+            return 0;
+        }
+        decoded[i] = values[i] + timeseries_unzigzag(delta);
+        record->values[i] = (float)decoded[i] / TIMESERIES_SCALE;
+    }
+    if (pos != end) {
+        return 0;
+    }
+    state->ts += (uint32_t)timeseries_unzigzag(ts_delta);
+    record->ts = state->ts;
+    memcpy(values, decoded, record->count * sizeof(int32_t));
+    return end;
+}
@@ -0,0 +1,45 @@
+/*
+ * timeseries.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _TIMESERIES_H_
+#define _TIMESERIES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Delta encoding of time-series records: the numeric fields of one endpoint at one time.
+// A record is framed as length(1) payload, with the payload
+//   ts delta(zigzag varint) endpoint(1) count(1) count x value delta(zigzag varint)
+// Values are fixed point with two decimals, deltas are against the previous record of the
+// same endpoint. A length of 0xFF is erased flash and ends the log.
+// The state is reset at every flash sector, so each sector decodes on its own.
+// Has no ESP-IDF dependencies, so it also builds for the host.
+
+#define TIMESERIES_MAX_FIELDS       16
+#define TIMESERIES_MAX_ENDPOINTS    8
+#define TIMESERIES_SCALE            100
+#define TIMESERIES_RECORD_MAX_SIZE  (1 + 5 + 1 + 1 + TIMESERIES_MAX_FIELDS * 5)
+
+typedef struct timeseries_record_t {
+    uint32_t ts;
+    uint8_t endpoint;
+    uint8_t count;
+    float values[TIMESERIES_MAX_FIELDS];
+} timeseries_record_t;
+
+typedef struct timeseries_state_t {
+    uint32_t ts;
+    int32_t values[TIMESERIES_MAX_ENDPOINTS][TIMESERIES_MAX_FIELDS];
+} timeseries_state_t;
+
+void timeseries_reset(timeseries_state_t *state, uint32_t base_ts);
+// Returns the framed size, 0 if it doesn't fit in size. state only advances if it fits.
+size_t timeseries_encode(timeseries_state_t *state, const timeseries_record_t *record, uint8_t *out, size_t size);
+// Returns the framed size consumed, 0 at the end of the log or on a corrupt record
+size_t timeseries_decode(timeseries_state_t *state, const uint8_t *in, size_t size, timeseries_record_t *record);
+
+#endif /* _TIMESERIES_H_ */
@@ -0,0 +1,37 @@
+/*
+ * version.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include "utilities/version.h"
+#include "utilities/dirty.h"
+
+// Changed from type tasks and thing_run(), so only touched atomically
+static uint32_t version_current = 0;
+
+
+uint32_t version_get(void)
+{
+    return __atomic_load_n(&version_current, __ATOMIC_ACQUIRE);
+}
+
+uint32_t version_local_change(void)
+{
+    uint32_t version = __atomic_add_fetch(&version_current, 1, __ATOMIC_ACQ_REL);
+    dirty_mark(DIRTY_VERSION);
+    return version;
+}
+
+bool version_accept(uint32_t remote_version)
+{
+    uint32_t version = __atomic_load_n(&version_current, __ATOMIC_ACQUIRE);
+    do {
+        if (remote_version <= version) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&version_current, &version, remote_version,
+                                          false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    dirty_mark(DIRTY_VERSION);
+    return true;
+}
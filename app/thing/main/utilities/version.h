@@ -0,0 +1,22 @@
+/*
+ * version.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _VERSION_H_
+#define _VERSION_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Version of the readwrite state, published as "version" in the value document.
+// A local change (e.g. a button) increments it. A cloud command carries the version it
+// wants to become: it is applied if newer than the device's version and rejected otherwise,
+// so a command based on state the device already moved past can't undo that change.
+uint32_t version_get(void);
+uint32_t version_local_change(void);
+// Returns false, without changing anything, if the remote version is not newer
+bool version_accept(uint32_t remote_version);
+
+#endif /* _VERSION_H_ */
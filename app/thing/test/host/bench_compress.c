@@ -0,0 +1,56 @@
+/*
+ * bench_compress.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "utilities/compress.h"
+#include "test_documents.h"
+
+#define BENCH_ROUNDS        200000
+#define BENCH_BUFFER_SIZE   4096
+
+static char bench_encoded[BENCH_BUFFER_SIZE];
+static char bench_decoded[BENCH_BUFFER_SIZE];
+
+static double bench_now_s(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+    size_t checksum = 0;
+    for (int i = 0; i < TEST_DOCUMENTS_COUNT; i++) {
+        const char *json = test_documents_json[i];
+        size_t len = strlen(json);
+        size_t encoded_len = 0;
+        size_t decoded_len = 0;
+
+        double start_s = bench_now_s();
+        for (int round = 0; round < BENCH_ROUNDS; round++) {
+            compress_encode(json, len, bench_encoded, sizeof(bench_encoded), &encoded_len);
+        }
+        double encode_s = bench_now_s() - start_s;
+
+        start_s = bench_now_s();
+        for (int round = 0; round < BENCH_ROUNDS; round++) {
+            compress_decode(bench_encoded, encoded_len, bench_decoded, sizeof(bench_decoded), &decoded_len);
+        }
+        double decode_s = bench_now_s() - start_s;
+        checksum += encoded_len + decoded_len;
+
+        printf("%-17s %4zu -> %4zu bytes (%2.0f %%), encode %6.2f ns/byte, decode %5.2f ns/byte\n",
+               test_document_names[i], len, encoded_len, 100.0 * encoded_len / len,
+               encode_s * 1e9 / BENCH_ROUNDS / len, decode_s * 1e9 / BENCH_ROUNDS / len);
+    }
+    // Keeps the results alive, so the loops aren't optimised away
+    printf("(checksum %zu)\n", checksum);
+    return 0;
+}
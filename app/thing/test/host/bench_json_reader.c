@@ -0,0 +1,134 @@
+/*
+ * bench_json_reader.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cJSON.h>
+#include "utilities/json_reader.h"
+#include "utilities/schema.h"
+#include "app/types/thermostat.h"
+#include "test_heap.h"
+
+// The receive path of thing_set_value(): the type's readwrite fields go through the schema
+// and the three mobile strings are copied out. The cJSON path parses the buffer twice,
+// like thing_set_value_cjson() and mobile_set_value_json() do.
+#define BENCH_ROUNDS        200000
+#define BENCH_MAX_TOKENS    128     // THING_JSON_MAX_TOKENS
+#define BENCH_STRING_LEN    16      // MOBILE_STRING_MAX_LEN
+
+#define BENCH_FIELD(kind, field, a, b) SCHEMA_FIELD(thermostat_readwrite_t, kind, field, a, b)
+static const schema_field_t bench_fields[] = { THERMOSTAT_READWRITE_FIELDS(BENCH_FIELD) SCHEMA_FIELDS_END };
+
+static const char bench_command[] =
+    "{\"thing_value\":{\"readwrite\":{\"enabled\":true,\"setpoint\":21.5,\"kp\":40,\"ki\":0.5,\"kd\":10},"
+    "\"read\":{}},\"version\":13,\"mobile_value\":{\"readwrite\":{\"network\":\"online\"},"
+    "\"read\":{\"nickname\":\"Hallway\",\"sw_version\":\"2.1.0\"}}}";
+
+typedef struct bench_mobile_t {
+    char network[BENCH_STRING_LEN];
+    char nickname[BENCH_STRING_LEN];
+    char sw_version[BENCH_STRING_LEN];
+} bench_mobile_t;
+
+static json_token_t bench_tokens[BENCH_MAX_TOKENS];
+static thermostat_readwrite_t bench_readwrite;
+static bench_mobile_t bench_mobile;
+
+static double bench_now_s(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static bool bench_reader(void)
+{
+    json_reader_t reader;
+    if (!json_reader_parse(&reader, bench_tokens, BENCH_MAX_TOKENS, bench_command, sizeof(bench_command) - 1)) {
+        return false;
+    }
+    int thing_value = json_reader_find(&reader, 0, "thing_value");
+    int mobile_value = json_reader_find(&reader, 0, "mobile_value");
+    int mobile_readwrite = json_reader_find(&reader, mobile_value, "readwrite");
+    int mobile_read = json_reader_find(&reader, mobile_value, "read");
+    return schema_read(bench_fields, SCHEMA_COUNT(bench_fields), &reader,
+                       json_reader_find(&reader, thing_value, "readwrite"), &bench_readwrite) &&
+           json_reader_get_string(&reader, json_reader_find(&reader, mobile_readwrite, "network"),
+                                  bench_mobile.network, BENCH_STRING_LEN) &&
+           json_reader_get_string(&reader, json_reader_find(&reader, mobile_read, "nickname"),
+                                  bench_mobile.nickname, BENCH_STRING_LEN) &&
+           json_reader_get_string(&reader, json_reader_find(&reader, mobile_read, "sw_version"),
+                                  bench_mobile.sw_version, BENCH_STRING_LEN);
+}
+
+static bool bench_cjson_string(const cJSON *object, const char *name, char *value)
+{
+    const cJSON *item = cJSON_GetObjectItemCaseSensitive(object, name);
+    if (!cJSON_IsString(item)) {
+        return false;
+    }
+    strncpy(value, item->valuestring, BENCH_STRING_LEN - 1);
+    value[BENCH_STRING_LEN - 1] = '\0';
+    return true;
+}
+
+static bool bench_cjson(void)
+{
+    cJSON *value = cJSON_Parse(bench_command);
+    if (!value) {
+        return false;
+    }
+    const cJSON *thing_value = cJSON_GetObjectItemCaseSensitive(value, "thing_value");
+    const cJSON *readwrite = cJSON_GetObjectItemCaseSensitive(thing_value, "readwrite");
+    bool ok = schema_read_cjson(bench_fields, SCHEMA_COUNT(bench_fields), readwrite, &bench_readwrite);
+    cJSON_Delete(value);
+
+    cJSON *mobile = cJSON_Parse(bench_command);
+    if (!mobile) {
+        return false;
+    }
+    const cJSON *mobile_value = cJSON_GetObjectItemCaseSensitive(mobile, "mobile_value");
+    const cJSON *mobile_readwrite = cJSON_GetObjectItemCaseSensitive(mobile_value, "readwrite");
+    const cJSON *mobile_read = cJSON_GetObjectItemCaseSensitive(mobile_value, "read");
+    ok = ok && bench_cjson_string(mobile_readwrite, "network", bench_mobile.network) &&
+         bench_cjson_string(mobile_read, "nickname", bench_mobile.nickname) &&
+         bench_cjson_string(mobile_read, "sw_version", bench_mobile.sw_version);
+    cJSON_Delete(mobile);
+    return ok;
+}
+
+static void bench_run(const char *name, bool (*set_value)(void))
+{
+    test_heap_reset();
+    if (!set_value() || strcmp(bench_mobile.nickname, "Hallway") != 0 || bench_readwrite.setpoint != 21.5) {
+        fprintf(stderr, "FAIL %s: command not applied\n", name);
+        exit(1);
+    }
+    test_heap_stats_t heap = test_heap_stats;
+
+    double start_s = bench_now_s();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        set_value();
+    }
+    double elapsed_s = bench_now_s() - start_s;
+    printf("%-12s %7.0f ns/command, %3u allocations, %5zu bytes peak heap\n",
+           name, elapsed_s * 1e9 / BENCH_ROUNDS, heap.allocations, heap.peak_bytes);
+}
+
+int main(void)
+{
+    cJSON_Hooks hooks = { test_heap_malloc, test_heap_free };
+    cJSON_InitHooks(&hooks);
+
+    printf("%zu byte command, %zu bytes of tokens\n", sizeof(bench_command) - 1, sizeof(bench_tokens));
+    bench_run("json_reader", bench_reader);
+    bench_run("cJSON", bench_cjson);
+    return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * bench_json_writer.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cJSON.h>
+#include "test_heap.h"
+#include "test_value.h"
+
+// The send path of thing_get_value() for every type: json_writer straight into the
+// payload buffer against the cJSON tree that was printed twice
+#define BENCH_ROUNDS        100000
+#define BENCH_BUFFER_SIZE   4096    // MQTT_PAYLOAD_MAX_LEN
+
+static char bench_buffer[BENCH_BUFFER_SIZE];
+
+static double bench_now_s(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Typical readings, one per field
+static void bench_fill(const schema_field_t *fields, int count, uint8_t *dst)
+{
+    for (int i = 0; i < count; i++) {
+        void *member = dst + fields[i].offset;
+        switch (fields[i].kind) {
+            case SCHEMA_BOOL:
+                *(bool *)member = true;
+                break;
+            case SCHEMA_INT:
+                *(int32_t *)member = 40 + i;
+                break;
+            case SCHEMA_NUMBER:
+                *(double *)member = 21.5 + i * 0.37;
+                break;
+            case SCHEMA_STRING:
+                snprintf((char *)member, fields[i].size, "label");
+                break;
+        }
+    }
+}
+
+static double bench_run(const test_value_type_t *type, const test_value_t *value,
+                        bool (*get_value)(const test_value_type_t *, const test_value_t *, char *, size_t),
+                        test_heap_stats_t *heap)
+{
+    test_heap_reset();
+    if (!get_value(type, value, bench_buffer, sizeof(bench_buffer))) {
+        fprintf(stderr, "FAIL %s: document not written\n", type->name);
+        exit(1);
+    }
+    *heap = test_heap_stats;
+
+    double start_s = bench_now_s();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        get_value(type, value, bench_buffer, sizeof(bench_buffer));
+    }
+    return (bench_now_s() - start_s) * 1e9 / BENCH_ROUNDS;
+}
+
+int main(void)
+{
+    cJSON_Hooks hooks = { test_heap_malloc, test_heap_free };
+    cJSON_InitHooks(&hooks);
+
+    test_value_t value = {
+        .hw_version = "1.0.0",
+        .fw_version = "1.4.2",
+        .version = 13,
+        .nickname = "Hallway",
+        .sw_version = "2.1.0",
+    };
+    for (int t = 0; t < TEST_VALUE_TYPES_COUNT; t++) {
+        const test_value_type_t *type = &test_value_types[t];
+        bench_fill(type->readwrite_fields, type->readwrite_count, value.readwrite);
+        bench_fill(type->read_fields, type->read_count, value.read);
+
+        test_heap_stats_t writer_heap;
+        test_heap_stats_t cjson_heap;
+        double writer_ns = bench_run(type, &value, test_value_write, &writer_heap);
+        double cjson_ns = bench_run(type, &value, test_value_cjson, &cjson_heap);
+        printf("%-11s %4zu bytes, json_writer %6.0f ns %2u allocations, cJSON %6.0f ns %3u allocations %5zu bytes peak\n",
+               type->name, strlen(bench_buffer), writer_ns, writer_heap.allocations,
+               cjson_ns, cjson_heap.allocations, cjson_heap.peak_bytes);
+    }
+    return 0;
+}
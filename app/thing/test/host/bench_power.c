@@ -0,0 +1,56 @@
+/*
+ * bench_power.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "utilities/power.h"
+
+// One meter frame of conversions per call, as meter_task() hands them to the kernel
+#define BENCH_FRAME_SAMPLES     512
+#define BENCH_FRAMES            200000
+
+static uint16_t bench_voltage[BENCH_FRAME_SAMPLES];
+static uint16_t bench_current[BENCH_FRAME_SAMPLES];
+
+static double bench_now_s(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+    for (uint32_t n = 0; n < BENCH_FRAME_SAMPLES; n++) {
+        double phase = 2 * M_PI * n / 64;
+        bench_voltage[n] = (uint16_t)lround(2048 + 1600 * sin(phase));
+        bench_current[n] = (uint16_t)lround(2048 + 400 * sin(phase - 0.5));
+    }
+
+    power_sums_t sums = {0};
+    double start_s = bench_now_s();
+    for (uint32_t frame = 0; frame < BENCH_FRAMES; frame++) {
+        power_accumulate(&sums, bench_voltage, bench_current, BENCH_FRAME_SAMPLES);
+    }
+    double accumulate_s = bench_now_s() - start_s;
+
+    power_result_t result;
+    start_s = bench_now_s();
+    for (uint32_t frame = 0; frame < BENCH_FRAMES; frame++) {
+        power_compute(&sums, 0.2f, 0.02f, &result);
+    }
+    double compute_s = bench_now_s() - start_s;
+
+    double samples = (double)BENCH_FRAME_SAMPLES * BENCH_FRAMES;
+    printf("power_accumulate: %.2f ns/sample, %.1f Msamples/s\n",
+           accumulate_s * 1e9 / samples, samples / accumulate_s / 1e6);
+    printf("power_compute: %.1f ns/call\n", compute_s * 1e9 / BENCH_FRAMES);
+    // Keeps the result alive, so the loops aren't optimised away
+    printf("(power factor %.3f)\n", result.power_factor);
+    return 0;
+}
@@ -0,0 +1,14 @@
+/*
+ * esp_err.h
+ *
+ * Host stub, only the codes main/ checks for.
+ */
+#ifndef _ESP_ERR_H_
+#define _ESP_ERR_H_
+
+typedef int esp_err_t;
+
+#define ESP_OK      0
+#define ESP_FAIL    -1
+
+#endif /* _ESP_ERR_H_ */
@@ -0,0 +1,20 @@
+/*
+ * esp_heap_caps.h
+ *
+ * Host stub, the largest free block is only logged.
+ */
+#ifndef _ESP_HEAP_CAPS_H_
+#define _ESP_HEAP_CAPS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+
+static inline size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    (void)caps;
+    return 0;
+}
+
+#endif /* _ESP_HEAP_CAPS_H_ */
@@ -0,0 +1,32 @@
+/*
+ * esp_partition.h
+ *
+ * Host stub, the partitions are simulated in RAM by the test that uses them.
+ */
+#ifndef _ESP_PARTITION_H_
+#define _ESP_PARTITION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef int esp_partition_subtype_t;
+
+typedef struct esp_partition_t {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t size;
+    const char *label;
+} esp_partition_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+
+#endif /* _ESP_PARTITION_H_ */
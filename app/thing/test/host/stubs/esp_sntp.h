@@ -0,0 +1,28 @@
+/*
+ * esp_sntp.h
+ *
+ * Host stub, SNTP never runs. Tests set the time themselves.
+ */
+#ifndef _ESP_SNTP_H_
+#define _ESP_SNTP_H_
+
+#include <stdint.h>
+
+#define SNTP_OPMODE_POLL 0
+
+static inline void sntp_setoperatingmode(uint8_t mode)
+{
+    (void)mode;
+}
+
+static inline void sntp_setservername(uint8_t index, const char *server)
+{
+    (void)index;
+    (void)server;
+}
+
+static inline void sntp_init(void)
+{
+}
+
+#endif /* _ESP_SNTP_H_ */
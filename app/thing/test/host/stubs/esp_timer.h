@@ -0,0 +1,13 @@
+/*
+ * esp_timer.h
+ *
+ * Host stub, defined by the test so it controls the uptime.
+ */
+#ifndef _ESP_TIMER_H_
+#define _ESP_TIMER_H_
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif /* _ESP_TIMER_H_ */
@@ -0,0 +1,19 @@
+/*
+ * FreeRTOS.h
+ *
+ * Host stub, only what main/utilities needs.
+ */
+#ifndef _FREERTOS_H_
+#define _FREERTOS_H_
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#define pdTRUE          1
+#define pdFALSE         0
+#define portMAX_DELAY   0xffffffffUL
+#define portTICK_PERIOD_MS 1
+
+#endif /* _FREERTOS_H_ */
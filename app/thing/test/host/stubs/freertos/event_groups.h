@@ -0,0 +1,14 @@
+/*
+ * event_groups.h
+ *
+ * Host stub, only the types headers under test declare.
+ */
+#ifndef _EVENT_GROUPS_H_
+#define _EVENT_GROUPS_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *EventGroupHandle_t;
+typedef TickType_t EventBits_t;
+
+#endif /* _EVENT_GROUPS_H_ */
@@ -0,0 +1,37 @@
+/*
+ * semphr.h
+ *
+ * Host stub, a FreeRTOS mutex is a pthread mutex. Timeouts other than portMAX_DELAY
+ * are not needed by the code under test.
+ */
+#ifndef _SEMPHR_H_
+#define _SEMPHR_H_
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+
+typedef pthread_mutex_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t mutex = malloc(sizeof(pthread_mutex_t));
+    if (mutex && pthread_mutex_init(mutex, NULL) != 0) {
+        free(mutex);
+        return NULL;
+    }
+    return mutex;
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks)
+{
+    (void)ticks;
+    return pthread_mutex_lock(mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+    return pthread_mutex_unlock(mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+#endif /* _SEMPHR_H_ */
@@ -0,0 +1,47 @@
+/*
+ * task.h
+ *
+ * Host stub, one tick is one millisecond. Tasks aren't started, tests run what the task
+ * function does step by step.
+ */
+#ifndef _TASK_H_
+#define _TASK_H_
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+
+// A task is a thread
+static inline TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return (TaskHandle_t)pthread_self();
+}
+
+static inline void vTaskDelay(TickType_t ticks)
+{
+    usleep(ticks * 1000);
+}
+
+static inline TickType_t xTaskGetTickCount(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static inline BaseType_t xTaskCreate(void (*task)(void *), const char *name, uint32_t stack_size, void *arg,
+                                     int priority, TaskHandle_t *handle)
+{
+    (void)task;
+    (void)name;
+    (void)stack_size;
+    (void)arg;
+    (void)priority;
+    (void)handle;
+    return pdTRUE;
+}
+
+#endif /* _TASK_H_ */
@@ -0,0 +1,221 @@
+/*
+ * test_arena.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <malloc.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <cJSON.h>
+#include "utilities/arena.h"
+#include "test_documents.h"
+
+// Replays events like app.c's main loop does, each between arena_begin() and arena_end(),
+// and checks the arena is reset after every one and nothing that fell back to malloc is left
+#define TEST_EVENTS             100000
+#define TEST_EVENT_KINDS        7
+#define TEST_OTHER_TASK_EVERY   10000   // Events between a second task using cJSON meanwhile
+#define TEST_LARGE_EVENTS       1000
+#define TEST_LARGE_ENTRIES      300     // A wifi scan this long doesn't fit the arena
+
+static char test_large[TEST_LARGE_ENTRIES * 40];
+static size_t test_expected_high_water = 0;
+static int test_failures = 0;
+
+static void test_fail(int event, const char *what)
+{
+    if (test_failures++ < 10) {
+        fprintf(stderr, "FAIL event %d: %s\n", event, what);
+    }
+}
+
+static size_t test_arena_used(void)
+{
+    size_t used, high_water;
+    uint32_t overflows;
+    arena_get_stats(&used, &high_water, &overflows);
+    return used;
+}
+
+static uint32_t test_arena_overflows(void)
+{
+    size_t used, high_water;
+    uint32_t overflows;
+    arena_get_stats(&used, &high_water, &overflows);
+    return overflows;
+}
+
+// A received document, with the value embedded as a string parsed again like thing.c did
+static bool test_parse(const char *json)
+{
+    cJSON *root = cJSON_Parse(json);
+    if (!root) {
+        return false;
+    }
+    const cJSON *value = cJSON_GetObjectItemCaseSensitive(root, "value");
+    if (cJSON_IsString(value)) {
+        cJSON *inner = cJSON_Parse(value->valuestring);
+        char *printed = cJSON_PrintUnformatted(inner);
+        cJSON_free(printed);
+        cJSON_Delete(inner);
+        if (!printed) {
+            cJSON_Delete(root);
+            return false;
+        }
+    }
+    cJSON_Delete(root);
+    return true;
+}
+
+// A value document built as a tree and printed, the way it was published before json_writer
+static bool test_build(int n)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON *readwrite = cJSON_AddObjectToObject(root, "readwrite");
+    cJSON *read = cJSON_AddObjectToObject(root, "read");
+    cJSON_AddBoolToObject(readwrite, "enabled", n & 1);
+    cJSON_AddNumberToObject(readwrite, "setpoint", 21.5 + n % 7);
+    cJSON_AddNumberToObject(read, "temperature", 20.875);
+    cJSON_AddStringToObject(read, "hw_version", "1.0.0");
+    char *printed = cJSON_PrintUnformatted(root);
+    bool ok = printed != NULL;
+    cJSON_free(printed);
+    cJSON_Delete(root);
+    return ok;
+}
+
+static void *test_other_task(void *arg)
+{
+    bool *ok = arg;
+    // The arena belongs to the main task, this one gets malloc
+    *ok = !arena_begin() && test_parse(test_documents_json[0]);
+    arena_end();
+    return NULL;
+}
+
+static bool test_event(int event)
+{
+    switch (event % TEST_EVENT_KINDS) {
+        case 0:
+        case 1:
+        case 2:
+        case 3:
+            return test_parse(test_documents_json[event % TEST_EVENT_KINDS]);
+        case 4:
+            return test_build(event);
+        case 5: {
+            // Nested operations share the arena, only the outermost end resets it
+            if (!arena_begin() || !test_parse(test_documents_json[1])) {
+                return false;
+            }
+            size_t used = test_arena_used();
+            arena_end();
+            if (test_arena_used() != used || used == 0) {
+                test_fail(event, "nested arena_end reset the arena");
+            }
+            return test_build(event);
+        }
+        default:
+            // Events that don't touch cJSON
+            return true;
+    }
+}
+
+static void test_replay(int first, int count)
+{
+    for (int event = first; event < first + count; event++) {
+        if (!arena_begin()) {
+            test_fail(event, "arena_begin");
+            continue;
+        }
+        uint32_t overflows = test_arena_overflows();
+        if (!test_event(event)) {
+            test_fail(event, "cJSON failed");
+        }
+        if (test_arena_overflows() != overflows) {
+            test_fail(event, "overflow");
+        }
+        if (event % TEST_OTHER_TASK_EVERY == 0) {
+            size_t used = test_arena_used();
+            bool ok = false;
+            pthread_t thread;
+            pthread_create(&thread, NULL, test_other_task, &ok);
+            pthread_join(thread, NULL);
+            if (!ok || test_arena_used() != used) {
+                test_fail(event, "another task used the arena");
+            }
+        }
+        size_t used = test_arena_used();
+        if (used > test_expected_high_water) {
+            test_expected_high_water = used;
+        }
+        arena_end();
+        if (test_arena_used() != 0) {
+            test_fail(event, "arena not reset by arena_end");
+        }
+    }
+}
+
+// Fills the arena, the rest comes from malloc and is freed by cJSON_Delete
+static void test_replay_large(int count)
+{
+    for (int event = 0; event < count; event++) {
+        uint32_t overflows = test_arena_overflows();
+        arena_begin();
+        if (!test_parse(test_large)) {
+            test_fail(event, "large cJSON failed");
+        }
+        arena_end();
+        if (test_arena_overflows() == overflows || test_arena_used() != 0) {
+            test_fail(event, "large scan fit the arena or wasn't reset");
+        }
+    }
+}
+
+int main(void)
+{
+    arena_init();
+
+    size_t len = snprintf(test_large, sizeof(test_large), "{\"type\":\"wifi_scan\",\"value\":[");
+    for (int i = 0; i < TEST_LARGE_ENTRIES; i++) {
+        len += snprintf(&test_large[len], sizeof(test_large) - len, "%s{\"ssid\":\"Network %d\",\"rssi\":%d}",
+                        i ? "," : "", i, -40 - i % 50);
+    }
+    snprintf(&test_large[len], sizeof(test_large) - len, "]}");
+
+    // One round first, so what the C library keeps for itself is in the baseline. Nothing
+    // is printed until the heap is measured, stdout takes a buffer on first use.
+    test_replay(0, TEST_EVENT_KINDS);
+    size_t baseline = mallinfo2().uordblks;
+    test_replay(TEST_EVENT_KINDS, TEST_EVENTS);
+    size_t leaked = mallinfo2().uordblks - baseline;
+
+    size_t used, high_water;
+    uint32_t overflows;
+    arena_get_stats(&used, &high_water, &overflows);
+    if (high_water != test_expected_high_water || high_water == 0 || high_water >= CONFIG_RIOTBOX_JSON_ARENA_SIZE) {
+        fprintf(stderr, "FAIL high water %zu, expected %zu\n", high_water, test_expected_high_water);
+        test_failures++;
+    }
+
+    test_replay_large(1);
+    baseline = mallinfo2().uordblks;
+    test_replay_large(TEST_LARGE_EVENTS);
+    leaked += mallinfo2().uordblks - baseline;
+    uint32_t large_overflows;
+    arena_get_stats(&used, &high_water, &large_overflows);
+
+    printf("%d events, high water %zu/%d bytes\n", TEST_EVENTS, test_expected_high_water, CONFIG_RIOTBOX_JSON_ARENA_SIZE);
+    printf("%d large events, %u allocations from malloc\n", TEST_LARGE_EVENTS, large_overflows - overflows);
+    if (leaked != 0) {
+        fprintf(stderr, "FAIL %zu bytes leaked\n", leaked);
+        test_failures++;
+    }
+
+    printf("%s test_arena\n", test_failures ? "FAIL" : "PASS");
+    return test_failures ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * test_compress.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utilities/compress.h"
+#include "test_documents.h"
+
+#define TEST_BUFFER_SIZE    4096
+#define TEST_JS_LINE_MAX    256
+#define TEST_CODES          0x20    // Only control characters can be dictionary codes
+
+// Path of the cloud decoder, set by the Makefile
+#ifndef TEST_COMPRESS_JS
+#define TEST_COMPRESS_JS "compress.js"
+#endif
+
+static char test_encoded[TEST_BUFFER_SIZE];
+static char test_decoded[TEST_BUFFER_SIZE];
+static int test_failures = 0;
+
+static void test_fail(const char *test, const char *message)
+{
+    fprintf(stderr, "FAIL %s: %s\n", test, message);
+    test_failures++;
+}
+
+static void test_round_trip(const char *test, const char *json)
+{
+    size_t len = strlen(json);
+    size_t encoded_len = 0;
+    size_t decoded_len = 0;
+    if (!compress_encode(json, len, test_encoded, sizeof(test_encoded), &encoded_len)) {
+        test_fail(test, "compress_encode");
+        return;
+    }
+    if (encoded_len >= len || !compress_is_encoded(test_encoded, encoded_len)) {
+        test_fail(test, "not smaller or no header");
+    }
+    if (!compress_decode(test_encoded, encoded_len, test_decoded, sizeof(test_decoded), &decoded_len)) {
+        test_fail(test, "compress_decode");
+        return;
+    }
+    if (decoded_len != len || memcmp(test_decoded, json, len) != 0) {
+        test_fail(test, "decoded payload differs");
+    }
+}
+
+static void test_documents(void)
+{
+    for (int i = 0; i < TEST_DOCUMENTS_COUNT; i++) {
+        test_round_trip(test_document_names[i], test_documents_json[i]);
+    }
+    // Every word in a row, longest match first must still decode to the same text
+    test_round_trip("words", "{\"mobile_value\":{\"thing_value\":{\"readwrite\":{\"read\":true,\"type\":false}},"
+                    "\"hw_version\":\"fw_version\",\"sw_version\":\"wifi_scan\",\"nickname\":\"network\","
+                    "\"offline\":\"online\",\"status\":\"value\",\"count\":\"index\",\"chunk\":\"ssid\",\"rssi\":\"readreadwrite\"}}");
+    // Bytes above 0x7f, e.g. UTF-8 in a nickname, pass through untouched
+    test_round_trip("utf-8", "{\"nickname\":\"K\xc3\xb6k \xe2\x80\x93 f\xc3\xb6nster\",\"nickname\":\"nickname\"}");
+}
+
+static void test_rejected(void)
+{
+    size_t len = 0;
+    // Nothing to gain, the caller sends it plain
+    if (compress_encode("{\"a\":1}", 7, test_encoded, sizeof(test_encoded), &len)) {
+        test_fail("rejected", "payload that doesn't shrink was encoded");
+    }
+    // An unescaped control character would be mistaken for a word when decoded
+    if (compress_encode("{\"readwrite\":\"\x01\"}", 17, test_encoded, sizeof(test_encoded), &len)) {
+        test_fail("rejected", "control character was encoded");
+    }
+    const char *json = test_documents_json[0];
+    if (compress_encode(json, strlen(json), test_encoded, 16, &len)) {
+        test_fail("rejected", "encoded into a too small buffer");
+    }
+    if (compress_decode(json, strlen(json), test_decoded, sizeof(test_decoded), &len)) {
+        test_fail("rejected", "decoded a payload without header");
+    }
+    size_t encoded_len = 0;
+    compress_encode(json, strlen(json), test_encoded, sizeof(test_encoded), &encoded_len);
+    if (compress_decode(test_encoded, encoded_len, test_decoded, strlen(json), &len)) {
+        test_fail("rejected", "decoded into a buffer without room for the terminator");
+    }
+}
+
+// Unescapes a single quoted JavaScript string in place, only \\ and \' and \" are used
+static bool test_js_unescape(char *s)
+{
+    char *out = s;
+    for (char *in = s; *in; in++) {
+        if (*in == '\\') {
+            in++;
+            if (*in != '\\' && *in != '\'' && *in != '"') {
+                return false;
+            }
+        }
+        *out++ = *in;
+    }
+    *out = '\0';
+    return true;
+}
+
+// The cloud decodes with its own copy of the dictionary, every code must mean the same word
+static void test_dictionary(void)
+{
+    char words[TEST_CODES][TEST_JS_LINE_MAX] = {{0}};
+    bool defined[TEST_CODES] = {false};
+    FILE *file = fopen(TEST_COMPRESS_JS, "r");
+    if (!file) {
+        test_fail("dictionary", "can't open " TEST_COMPRESS_JS);
+        return;
+    }
+    char line[TEST_JS_LINE_MAX];
+    int entries = 0;
+    while (fgets(line, sizeof(line), file)) {
+        unsigned code;
+        char word[TEST_JS_LINE_MAX];
+        // e.g.     0x1A: '\\"',
+        if (sscanf(line, " 0x%2x: '%[^\n]", &code, word) != 2) {
+            continue;
+        }
+        char *end = strrchr(word, '\'');
+        if (!end || code >= TEST_CODES || defined[code]) {
+            test_fail("dictionary", line);
+            continue;
+        }
+        *end = '\0';
+        if (!test_js_unescape(word)) {
+            test_fail("dictionary", line);
+            continue;
+        }
+        strcpy(words[code], word);
+        defined[code] = true;
+        entries++;
+    }
+    fclose(file);
+    if (entries == 0) {
+        test_fail("dictionary", "no words in " TEST_COMPRESS_JS);
+        return;
+    }
+
+    for (unsigned code = 1; code < TEST_CODES; code++) {
+        char encoded[COMPRESS_HEADER_SIZE + 1];
+        memcpy(encoded, COMPRESS_HEADER, COMPRESS_HEADER_SIZE);
+        encoded[COMPRESS_HEADER_SIZE] = (char)code;
+        size_t len = 0;
+        if (!compress_decode(encoded, sizeof(encoded), test_decoded, sizeof(test_decoded), &len)) {
+            test_fail("dictionary", "compress_decode");
+            continue;
+        }
+        // Codes without a word decode to themselves
+        bool device_defined = !(len == 1 && (uint8_t)test_decoded[0] == code);
+        if (device_defined != defined[code] || (defined[code] && strcmp(test_decoded, words[code]) != 0)) {
+            fprintf(stderr, "FAIL dictionary: code 0x%02X is \"%s\" on the device, \"%s\" in compress.js\n",
+                    code, device_defined ? test_decoded : "", defined[code] ? words[code] : "");
+            test_failures++;
+        }
+    }
+}
+
+int main(void)
+{
+    test_documents();
+    test_rejected();
+    test_dictionary();
+
+    printf("%s test_compress\n", test_failures ? "FAIL" : "PASS");
+    return test_failures ? 1 : 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * test_documents.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _TEST_DOCUMENTS_H_
+#define _TEST_DOCUMENTS_H_
+
+// Documents as the thing publishes them, captured from thing_get_value() and the
+// provisioning notifications
+#define TEST_DOCUMENTS_COUNT 4
+
+static const char *const test_document_names[TEST_DOCUMENTS_COUNT] = {
+    "switch value",
+    "thermostat value",
+    "meter value",
+    "wifi scan",
+};
+
+static const char *const test_documents_json[TEST_DOCUMENTS_COUNT] = {
+    "{\"value\":\"{\\\"thing_value\\\":{\\\"readwrite\\\":{\\\"status\\\":true},\\\"read\\\":{"
+    "\\\"hw_version\\\":\\\"1.0.0\\\",\\\"fw_version\\\":\\\"1.4.2\\\",\\\"link\\\":{\\\"rssi\\\":-61,"
+    "\\\"ack_ms\\\":84,\\\"outbox\\\":0,\\\"interval_ms\\\":5000,\\\"decision\\\":\\\"hold\\\"}}},"
+    "\\\"version\\\":12,\\\"mobile_value\\\":{\\\"readwrite\\\":{\\\"network\\\":\\\"online\\\"},"
+    "\\\"read\\\":{\\\"nickname\\\":\\\"Kitchen lamp\\\",\\\"sw_version\\\":\\\"2.1.0\\\"}}}\"}",
+
+    "{\"value\":\"{\\\"thing_value\\\":{\\\"readwrite\\\":{\\\"enabled\\\":true,\\\"setpoint\\\":21.5,"
+    "\\\"kp\\\":40,\\\"ki\\\":0.5,\\\"kd\\\":10},\\\"read\\\":{\\\"temperature\\\":20.875,"
+    "\\\"output\\\":0.4375,\\\"jitter_max_us\\\":212,\\\"exec_max_us\\\":96,\\\"overruns\\\":0,"
+    "\\\"hw_version\\\":\\\"1.0.0\\\",\\\"fw_version\\\":\\\"1.4.2\\\",\\\"link\\\":{\\\"rssi\\\":-70,"
+    "\\\"ack_ms\\\":131,\\\"outbox\\\":1,\\\"interval_ms\\\":10000,\\\"decision\\\":\\\"slower\\\"}}},"
+    "\\\"version\\\":3,\\\"mobile_value\\\":{\\\"readwrite\\\":{\\\"network\\\":\\\"online\\\"},"
+    "\\\"read\\\":{\\\"nickname\\\":\\\"Hallway\\\",\\\"sw_version\\\":\\\"2.1.0\\\"}}}\"}",
+
+    "{\"value\":\"{\\\"thing_value\\\":{\\\"readwrite\\\":{\\\"v_scale\\\":0.2,\\\"i_scale\\\":0.02},"
+    "\\\"read\\\":{\\\"v_rms\\\":229.81,\\\"i_rms\\\":4.125,\\\"power_w\\\":871.3,\\\"apparent_va\\\":947.96,"
+    "\\\"power_factor\\\":0.919,\\\"energy_wh\\\":15532.7,\\\"hw_version\\\":\\\"1.0.0\\\","
+    "\\\"fw_version\\\":\\\"1.4.2\\\",\\\"link\\\":{\\\"rssi\\\":-55,\\\"ack_ms\\\":62,\\\"outbox\\\":0,"
+    "\\\"interval_ms\\\":2500,\\\"decision\\\":\\\"faster\\\"}},\\\"endpoints\\\":[{\\\"readwrite\\\":"
+    "{\\\"v_scale\\\":0.2,\\\"i_scale\\\":0.02},\\\"read\\\":{\\\"v_rms\\\":229.6,\\\"i_rms\\\":0.5,"
+    "\\\"power_w\\\":98.1,\\\"apparent_va\\\":114.8,\\\"power_factor\\\":0.854,\\\"energy_wh\\\":2210.4}}]},"
+    "\\\"version\\\":41,\\\"mobile_value\\\":{\\\"readwrite\\\":{\\\"network\\\":\\\"online\\\"},"
+    "\\\"read\\\":{\\\"nickname\\\":\\\"Fuse box\\\",\\\"sw_version\\\":\\\"2.1.0\\\"}}}\"}",
+
+    "{\"type\":\"wifi_scan\",\"value\":[{\"ssid\":\"HomeNetwork\",\"rssi\":-48},"
+    "{\"ssid\":\"HomeNetwork-5G\",\"rssi\":-57},{\"ssid\":\"Neighbour\",\"rssi\":-71},"
+    "{\"ssid\":\"Guest\",\"rssi\":-74},{\"ssid\":\"PrinterSetup\",\"rssi\":-80},"
+    "{\"ssid\":\"Cafe Wifi\",\"rssi\":-86}],\"count\":6,\"status\":\"online\"}",
+};
+
+#endif /* _TEST_DOCUMENTS_H_ */
@@ -0,0 +1,62 @@
+/*
+ * test_heap.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _TEST_HEAP_H_
+#define _TEST_HEAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Counting malloc and free, installed with cJSON_InitHooks() to see what cJSON takes
+// from the heap. Single threaded.
+typedef struct test_heap_stats_t {
+    uint32_t allocations;
+    uint32_t frees;
+    size_t live_bytes;
+    size_t peak_bytes;
+} test_heap_stats_t;
+
+// Keeps the size in front of the block, aligned for any type
+typedef union test_heap_header_t {
+    size_t size;
+    max_align_t align;
+} test_heap_header_t;
+
+static test_heap_stats_t test_heap_stats;
+
+static inline void test_heap_reset(void)
+{
+    test_heap_stats = (test_heap_stats_t){0};
+}
+
+static inline void *test_heap_malloc(size_t size)
+{
+    test_heap_header_t *header = malloc(sizeof(test_heap_header_t) + size);
+    if (!header) {
+        return NULL;
+    }
+    header->size = size;
+    test_heap_stats.allocations++;
+    test_heap_stats.live_bytes += size;
+    if (test_heap_stats.live_bytes > test_heap_stats.peak_bytes) {
+        test_heap_stats.peak_bytes = test_heap_stats.live_bytes;
+    }
+    return header + 1;
+}
+
+static inline void test_heap_free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    test_heap_header_t *header = (test_heap_header_t *)ptr - 1;
+    test_heap_stats.frees++;
+    test_heap_stats.live_bytes -= header->size;
+    free(header);
+}
+
+#endif /* _TEST_HEAP_H_ */
@@ -0,0 +1,359 @@
+/*
+ * test_history.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "drivers/storage.h"
+#include "middlewares/mqtt.h"
+#include "utilities/json_reader.h"
+
+// Included rather than linked, so the test runs the steps of history_task() itself
+#include "app/history.c"
+
+// The history partition in RAM, as NOR flash: erasing sets a sector to 0xFF, writing only
+// clears bits. Boots, SNTP syncs and outages are replayed against it and every record
+// that reaches MQTT is checked against the time and value it was sampled with.
+#define TEST_SECTORS            4
+#define TEST_STEP_S             7       // Between two changes of a field
+#define TEST_BOOT_UNIX_S        1790000000
+#define TEST_WRAP_CHANGES       3000    // Enough to go around the ring
+#define TEST_MAX_RECORDS        8192
+#define TEST_MAX_TOKENS         1024
+#define TEST_TOPIC              "thingpub/test/history"
+
+typedef struct test_record_t {
+    uint32_t ts;
+    int endpoint;
+    float status;
+} test_record_t;
+
+static uint8_t test_flash[TEST_SECTORS * HISTORY_SECTOR_SIZE];
+static const esp_partition_t test_partition = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = HISTORY_PARTITION_SUBTYPE,
+    .size = sizeof(test_flash),
+    .label = HISTORY_PARTITION_LABEL,
+};
+static uint32_t test_flash_violations = 0;
+
+// The clock: uptime since boot, and Unix time once SNTP has synced or the RTC kept it
+static uint32_t test_uptime_s = 0;
+static uint32_t test_boot_unix_s = TEST_BOOT_UNIX_S;
+static bool test_time_set = false;
+
+static history_cursor_t test_stored_cursor;
+static bool test_has_stored_cursor = false;
+
+// The type's value, and what the test expects history to have sampled
+static float test_status[TYPE_MAX_ENDPOINTS];
+static float test_sampled_status[TYPE_MAX_ENDPOINTS];
+static bool test_has_sampled[TYPE_MAX_ENDPOINTS];
+static test_record_t test_expected[TEST_MAX_RECORDS];
+static int test_expected_count = 0;
+static int test_uploaded_count = 0;    // Of test_expected
+
+static test_record_t test_received[TEST_MAX_RECORDS];
+static int test_received_count = 0;
+static json_token_t test_tokens[TEST_MAX_TOKENS];
+static int test_failures = 0;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    return type == test_partition.type && subtype == test_partition.subtype && strcmp(label, test_partition.label) == 0 ?
+           &test_partition : NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size)
+{
+    if (offset + size > partition->size) {
+        return ESP_FAIL;
+    }
+    memcpy(dst, &test_flash[offset], size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *src, size_t size)
+{
+    if (offset + size > partition->size) {
+        return ESP_FAIL;
+    }
+    const uint8_t *data = src;
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] & ~test_flash[offset + i]) {
+            test_flash_violations++;
+        }
+        test_flash[offset + i] &= data[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    if (offset % HISTORY_SECTOR_SIZE || size % HISTORY_SECTOR_SIZE || offset + size > partition->size) {
+        return ESP_FAIL;
+    }
+    memset(&test_flash[offset], 0xFF, size);
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (int64_t)test_uptime_s * 1000000;
+}
+
+// Linked with --wrap=time. Before SNTP has synced the system time counts from boot.
+time_t __wrap_time(time_t *now)
+{
+    time_t value = test_time_set ? test_boot_unix_s + test_uptime_s : test_uptime_s;
+    if (now) {
+        *now = value;
+    }
+    return value;
+}
+
+bool storage_get_blob(const char* key, char* buffer, size_t size)
+{
+    if (!test_has_stored_cursor || size != sizeof(test_stored_cursor)) {
+        return false;
+    }
+    memcpy(buffer, &test_stored_cursor, size);
+    return true;
+}
+
+bool storage_set_blob(const char* key, const char* buffer, size_t size)
+{
+    if (size != sizeof(test_stored_cursor)) {
+        return false;
+    }
+    memcpy(&test_stored_cursor, buffer, size);
+    test_has_stored_cursor = true;
+    return true;
+}
+
+bool type_get_readwrite_writer(int endpoint, json_writer_t *writer)
+{
+    json_writer_number(writer, "status", test_status[endpoint]);
+    json_writer_bool(writer, "enabled", true);
+    return true;
+}
+
+bool type_get_read_writer(int endpoint, json_writer_t *writer)
+{
+    json_writer_number(writer, "temperature", 20.5 + endpoint);
+    json_writer_string(writer, "label", "hall");
+    return true;
+}
+
+bool mqtt_publish(const char* topic, const char* data)
+{
+    json_reader_t reader;
+    if (strcmp(topic, TEST_TOPIC) != 0 ||
+        !json_reader_parse(&reader, test_tokens, TEST_MAX_TOKENS, data, strlen(data))) {
+        fprintf(stderr, "FAIL publish to %s: %.60s\n", topic, data);
+        test_failures++;
+        return false;
+    }
+    char name[HISTORY_FIELD_NAME_MAX_SIZE];
+    int fields = json_reader_find(&reader, 0, "fields");
+    if (fields < 0 || reader.tokens[fields].size != 3 || !json_reader_get_string(&reader, fields + 1, name, sizeof(name)) ||
+        strcmp(name, "status") != 0) {
+        fprintf(stderr, "FAIL fields: %.60s\n", data);
+        test_failures++;
+    }
+    // Records are flat arrays of numbers, one after the other
+    int records = json_reader_find(&reader, 0, "records");
+    int token = records + 1;
+    for (int i = 0; records >= 0 && i < reader.tokens[records].size; i++) {
+        double ts, endpoint, status;
+        test_record_t *record = &test_received[test_received_count];
+        if (test_received_count == TEST_MAX_RECORDS ||
+            !json_reader_get_number(&reader, token + 1, &ts) ||
+            !json_reader_get_number(&reader, token + 2, &endpoint) ||
+            !json_reader_get_number(&reader, token + 3, &status)) {
+            fprintf(stderr, "FAIL record %d: %.60s\n", i, data);
+            test_failures++;
+            return false;
+        }
+        *record = (test_record_t) { .ts = ts, .endpoint = endpoint, .status = status };
+        test_received_count++;
+        token += reader.tokens[token].size + 1;
+    }
+    return true;
+}
+
+static void test_expect(bool ok, const char *what)
+{
+    if (!ok) {
+        fprintf(stderr, "FAIL %s\n", what);
+        test_failures++;
+    }
+}
+
+// What history_task() does every sample period
+static void test_step(bool expected)
+{
+    test_uptime_s += TEST_STEP_S;
+    history_check_sync();
+    history_sample();
+    for (int endpoint = 0; endpoint < TYPE_MAX_ENDPOINTS; endpoint++) {
+        if (test_has_sampled[endpoint] && test_sampled_status[endpoint] == test_status[endpoint]) {
+            continue;
+        }
+        test_sampled_status[endpoint] = test_status[endpoint];
+        test_has_sampled[endpoint] = true;
+        // Records of a boot that never syncs are never uploaded
+        if (expected) {
+            test_expected[test_expected_count++] = (test_record_t) {
+                .ts = test_boot_unix_s + test_uptime_s,
+                .endpoint = endpoint,
+                .status = test_status[endpoint],
+            };
+        }
+    }
+}
+
+static void test_changes(int count, bool expected)
+{
+    for (int i = 0; i < count; i++) {
+        test_status[i % TYPE_MAX_ENDPOINTS] += 1;
+        test_step(expected);
+    }
+}
+
+// A reset, RAM is lost and the flash and NVS are kept
+static void test_boot(bool time_kept, bool expected)
+{
+    test_boot_unix_s += test_uptime_s + 3600;
+    test_uptime_s = 0;
+    test_time_set = time_kept;
+    memset(history_has_last, 0, sizeof(history_has_last));
+    memset(test_has_sampled, 0, sizeof(test_has_sampled));
+    history_cursor = (history_cursor_t) {0};
+    test_expect(history_init(TEST_TOPIC), "history_init");
+    test_step(expected);
+}
+
+// Uploads like history_task() does once connected, until nothing is left
+static int test_upload(void)
+{
+    test_received_count = 0;
+    bool more = history_synced;
+    while (more) {
+        if (!history_upload(&more)) {
+            test_expect(false, "history_upload");
+            break;
+        }
+    }
+    return test_received_count;
+}
+
+static bool test_same(const test_record_t *a, const test_record_t *b)
+{
+    return a->ts == b->ts && a->endpoint == b->endpoint && a->status == b->status;
+}
+
+// The received records are the expected ones not uploaded yet, in order, skipping lost ones
+static void test_check_upload(const char *phase, int lost)
+{
+    int pending = test_expected_count - test_uploaded_count;
+    if (test_received_count != pending - lost) {
+        fprintf(stderr, "FAIL %s: %d records uploaded, expected %d\n", phase, test_received_count, pending - lost);
+        test_failures++;
+        return;
+    }
+    for (int i = 0; i < test_received_count; i++) {
+        const test_record_t *expected = &test_expected[test_uploaded_count + lost + i];
+        const test_record_t *received = &test_received[i];
+        if (!test_same(received, expected)) {
+            fprintf(stderr, "FAIL %s record %d: ts %u endpoint %d status %g, expected ts %u endpoint %d status %g\n",
+                    phase, i, received->ts, received->endpoint, received->status,
+                    expected->ts, expected->endpoint, expected->status);
+            test_failures++;
+            return;
+        }
+    }
+    test_uploaded_count = test_expected_count;
+}
+
+static void test_sync(void)
+{
+    // Offline from the first boot until SNTP syncs, nothing can be uploaded
+    test_boot(false, true);
+    test_changes(40, true);
+    test_expect(!history_synced && test_upload() == 0, "uploaded before the time was synced");
+    test_received_count = 0;
+    history_answer_query(0);
+    test_expect(test_received_count == 0, "query answered with records stamped with the uptime");
+
+    // The records since boot are rebased once it syncs, and go out first
+    test_time_set = true;
+    test_changes(10, true);
+    test_expect(history_synced, "not synced");
+    test_upload();
+    test_check_upload("first sync", 0);
+
+    test_changes(30, true);
+    test_upload();
+    test_check_upload("synced", 0);
+    test_expect(test_upload() == 0, "uploaded twice");
+}
+
+static void test_reboots(void)
+{
+    // The RTC kept the time over a reset, the newest sector is carried on
+    uint32_t rotations = history_stats.rotations;
+    test_boot(true, true);
+    test_changes(20, true);
+    test_expect(history_stats.rotations == rotations, "sector not carried on after a reset with the time kept");
+    test_upload();
+    test_check_upload("time kept", 0);
+
+    // A boot that never syncs leaves records that can't be placed, the next one's are rebased
+    test_boot(false, false);
+    test_changes(20, false);
+    test_boot(false, true);
+    test_changes(20, true);
+    test_time_set = true;
+    test_changes(5, true);
+    test_upload();
+    test_check_upload("boot without sync", 0);
+}
+
+static void test_wrap(void)
+{
+    // Offline for long enough that the ring overwrites records before they are uploaded
+    uint32_t overwritten = history_stats.overwritten;
+    test_changes(TEST_WRAP_CHANGES, true);
+    test_expect(history_stats.overwritten > overwritten, "ring didn't wrap");
+    test_upload();
+    int pending = test_expected_count - test_uploaded_count;
+    test_check_upload("wrap", pending - test_received_count);
+    test_expect(test_received_count > TEST_WRAP_CHANGES / 2, "too few records kept by the ring");
+
+    // A query is answered from the first record at or after since
+    const test_record_t *from = &test_expected[test_expected_count - 100];
+    test_received_count = 0;
+    test_expect(history_answer_query(from->ts) && test_received_count > 0 && test_same(&test_received[0], from),
+                "query since");
+}
+
+int main(void)
+{
+    memset(test_flash, 0xFF, sizeof(test_flash));
+    test_sync();
+    test_reboots();
+    test_wrap();
+
+    test_expect(test_flash_violations == 0, "flash bits written from 0 to 1");
+    test_expect(history_stats.write_errors == 0, "write errors");
+    printf("%d records, %u rotations, %u sectors overwritten\n",
+           test_expected_count, history_stats.rotations, history_stats.overwritten);
+    printf("%s test_history\n", test_failures ? "FAIL" : "PASS");
+    return test_failures ? 1 : 0;
+}
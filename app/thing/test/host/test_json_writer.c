@@ -0,0 +1,149 @@
+/*
+ * test_json_writer.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <cJSON.h>
+#include "utilities/json_writer.h"
+#include "test_value.h"
+
+#define TEST_BUFFER_SIZE    4096    // MQTT_PAYLOAD_MAX_LEN
+#define TEST_ROUNDS         16      // Each round gives every field another value
+
+// Values the cloud has to get back exactly, whatever formatting each side picks
+static const double test_numbers[] = {
+    0, -0.0, 1, -1, 21.5, 0.1 + 0.2, 1.0 / 3, 229.81, 1e-7, 123456789.125,
+    2147483647.0, 2147483648.0, -2147483649.0, 999999999999999.0, 1e15, 1e15 + 0.5, 1e300, -1e-300,
+    DBL_MAX, DBL_MIN, NAN, INFINITY,
+};
+static const int32_t test_ints[] = { 0, 1, -1, 100, INT32_MAX, INT32_MIN };
+static const char *const test_strings[] = {
+    "", "Kitchen", "say \"hi\"", "back\\slash", "tab\there", "new\nline", "\x01\x1f", "K\xc3\xb6k", "/",
+};
+
+#define TEST_COUNT(array) ((int)(sizeof(array) / sizeof(array[0])))
+
+static char test_written[TEST_BUFFER_SIZE];
+static char test_printed[TEST_BUFFER_SIZE];
+static int test_failures = 0;
+
+static void test_fill(const schema_field_t *fields, int count, uint8_t *dst, int round)
+{
+    for (int i = 0; i < count; i++) {
+        void *member = dst + fields[i].offset;
+        int n = round + i;
+        switch (fields[i].kind) {
+            case SCHEMA_BOOL:
+                *(bool *)member = n & 1;
+                break;
+            case SCHEMA_INT:
+                *(int32_t *)member = test_ints[n % TEST_COUNT(test_ints)];
+                break;
+            case SCHEMA_NUMBER:
+                *(double *)member = test_numbers[n % TEST_COUNT(test_numbers)];
+                break;
+            case SCHEMA_STRING:
+                snprintf((char *)member, fields[i].size, "%s", test_strings[n % TEST_COUNT(test_strings)]);
+                break;
+        }
+    }
+}
+
+static void test_compare(const char *test, const test_value_type_t *type, const test_value_t *value)
+{
+    bool written = test_value_write(type, value, test_written, sizeof(test_written));
+    bool printed = test_value_cjson(type, value, test_printed, sizeof(test_printed));
+    if (!written || !printed) {
+        fprintf(stderr, "FAIL %s %s: json_writer %d, cJSON %d\n", test, type->name, written, printed);
+        test_failures++;
+        return;
+    }
+    if (strcmp(test_written, test_printed) != 0) {
+        size_t at = 0;
+        while (test_written[at] == test_printed[at]) {
+            at++;
+        }
+        fprintf(stderr, "FAIL %s %s: differs at byte %zu\n  json_writer: %.60s\n  cJSON:       %.60s\n",
+                test, type->name, at, &test_written[at > 30 ? at - 30 : 0], &test_printed[at > 30 ? at - 30 : 0]);
+        test_failures++;
+    }
+}
+
+static void test_types(void)
+{
+    test_value_t value = {
+        .hw_version = "1.0.0",
+        .fw_version = "1.4.2",
+        .sw_version = "2.1.0",
+    };
+    for (int t = 0; t < TEST_VALUE_TYPES_COUNT; t++) {
+        const test_value_type_t *type = &test_value_types[t];
+        for (int round = 0; round < TEST_ROUNDS; round++) {
+            test_fill(type->readwrite_fields, type->readwrite_count, value.readwrite, round);
+            test_fill(type->read_fields, type->read_count, value.read, round + 1);
+            value.version = test_ints[round % TEST_COUNT(test_ints)];
+            value.nickname = test_strings[round % TEST_COUNT(test_strings)];
+            test_compare("type", type, &value);
+        }
+    }
+}
+
+// Every number on its own, so none hides behind the rounds' combinations
+static void test_numbers_all(void)
+{
+    test_value_t value = {
+        .hw_version = "1.0.0",
+        .fw_version = "1.4.2",
+        .nickname = "Hallway",
+        .sw_version = "2.1.0",
+    };
+    const test_value_type_t *type = &test_value_types[TEST_VALUE_TYPES_COUNT - 1];
+    for (int n = 0; n < TEST_COUNT(test_numbers); n++) {
+        test_fill(type->readwrite_fields, type->readwrite_count, value.readwrite, 0);
+        ((test_readwrite_t *)value.readwrite)->level = test_numbers[n];
+        test_compare("number", type, &value);
+    }
+}
+
+static void test_overflow(void)
+{
+    // Errors are sticky, a document that doesn't fit is never reported as written
+    const test_value_type_t *type = &test_value_types[0];
+    test_value_t value = {
+        .hw_version = "1.0.0",
+        .fw_version = "1.4.2",
+        .nickname = "Hallway",
+        .sw_version = "2.1.0",
+    };
+    test_value_write(type, &value, test_written, sizeof(test_written));
+    size_t len = strlen(test_written);
+    for (size_t size = 0; size <= len; size++) {
+        if (test_value_write(type, &value, test_written, size)) {
+            fprintf(stderr, "FAIL overflow: %zu byte document written into %zu bytes\n", len, size);
+            test_failures++;
+            return;
+        }
+    }
+    if (!test_value_write(type, &value, test_written, len + 1)) {
+        fprintf(stderr, "FAIL overflow: %zu byte document not written into %zu bytes\n", len, len + 1);
+        test_failures++;
+    }
+}
+
+int main(void)
+{
+    test_types();
+    test_numbers_all();
+    test_overflow();
+
+    printf("%s test_json_writer\n", test_failures ? "FAIL" : "PASS");
+    return test_failures ? 1 : 0;
+}
@@ -0,0 +1,287 @@
+/*
+ * test_peers.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "utilities/peers.h"
+
+// Config of gateway.c with the Kconfig default read interval
+#define TEST_SCAN_INTERVAL_MS   5000
+#define TEST_READ_INTERVAL_MS   60000
+#define TEST_TIMEOUT_MS         (5 * 60 * 1000)
+#define TEST_MAX_CONNECTIONS    1
+
+static const peers_config_t test_config = {
+    .scan_interval_ms = TEST_SCAN_INTERVAL_MS,
+    .read_interval_ms = TEST_READ_INTERVAL_MS,
+    .timeout_ms = TEST_TIMEOUT_MS,
+    .max_connections = TEST_MAX_CONNECTIONS,
+};
+
+static peers_t test_peers;
+static int test_failures = 0;
+
+static void test_expect(bool ok, const char *what)
+{
+    if (!ok) {
+        fprintf(stderr, "FAIL %s\n", what);
+        test_failures++;
+    }
+}
+
+static bool test_near(float value, float expected)
+{
+    return fabsf(value - expected) < 0.001f;
+}
+
+static void test_addr(uint8_t addr[PEERS_ADDR_SIZE], int n)
+{
+    memset(addr, 0, PEERS_ADDR_SIZE);
+    addr[0] = n;
+    addr[5] = 0xA4;
+}
+
+static int test_advertise(int n, bool connectable, const peers_reading_t *reading, uint32_t now_ms)
+{
+    uint8_t addr[PEERS_ADDR_SIZE];
+    test_addr(addr, n);
+    return peers_advertised(&test_peers, addr, 0, -60, connectable, reading, now_ms);
+}
+
+// Advertisements as sensors send them, flags first
+static void test_parse(void)
+{
+    bool connectable;
+    peers_reading_t reading;
+
+    // BTHome v2, packet id, battery 97 %, temperature 21.37 degC, humidity 45.5 %
+    const uint8_t bthome[] = {
+        0x02, 0x01, 0x06,
+        0x0E, 0x16, 0xD2, 0xFC, 0x40, 0x00, 0x11, 0x01, 0x61, 0x02, 0x59, 0x08, 0x03, 0xC6, 0x11,
+    };
+    test_expect(peers_parse_adv(bthome, sizeof(bthome), &connectable, &reading) && !connectable &&
+                reading.fields == (PEERS_HAS_TEMPERATURE | PEERS_HAS_HUMIDITY | PEERS_HAS_BATTERY) &&
+                test_near(reading.battery, 97) && test_near(reading.temperature, 21.37f) &&
+                test_near(reading.humidity, 45.5f), "BTHome advertisement");
+
+    // Negative temperature in 0.1 degC, humidity in 1 %
+    const uint8_t coarse[] = { 0x09, 0x16, 0xD2, 0xFC, 0x40, 0x2E, 0x37, 0x45, 0x9C, 0xFF };
+    test_expect(peers_parse_adv(coarse, sizeof(coarse), &connectable, &reading) &&
+                test_near(reading.temperature, -10.0f) && test_near(reading.humidity, 55),
+                "BTHome coarse objects");
+
+    // Objects after an unknown one aren't read, the ones before are
+    const uint8_t unknown[] = { 0x0A, 0x16, 0xD2, 0xFC, 0x40, 0x01, 0x50, 0x7F, 0x02, 0x00, 0x01 };
+    test_expect(peers_parse_adv(unknown, sizeof(unknown), &connectable, &reading) &&
+                reading.fields == PEERS_HAS_BATTERY, "BTHome unknown object");
+
+    // A truncated object is dropped
+    const uint8_t truncated[] = { 0x05, 0x16, 0xD2, 0xFC, 0x40, 0x02, 0x59 };
+    test_expect(!peers_parse_adv(truncated, sizeof(truncated), &connectable, &reading), "BTHome truncated object");
+
+    const uint8_t encrypted[] = { 0x06, 0x16, 0xD2, 0xFC, 0x41, 0x01, 0x61 };
+    test_expect(!peers_parse_adv(encrypted, sizeof(encrypted), &connectable, &reading), "BTHome encrypted");
+    const uint8_t version1[] = { 0x06, 0x16, 0xD2, 0xFC, 0x20, 0x01, 0x61 };
+    test_expect(!peers_parse_adv(version1, sizeof(version1), &connectable, &reading), "BTHome v1");
+    const uint8_t other_uuid[] = { 0x06, 0x16, 0xD3, 0xFC, 0x40, 0x01, 0x61 };
+    test_expect(!peers_parse_adv(other_uuid, sizeof(other_uuid), &connectable, &reading), "other service data");
+
+    // Environmental Sensing in either list of 16-bit UUIDs
+    const uint8_t ess[] = { 0x02, 0x01, 0x06, 0x05, 0x03, 0x0F, 0x18, 0x1A, 0x18 };
+    test_expect(peers_parse_adv(ess, sizeof(ess), &connectable, &reading) && connectable && reading.fields == 0,
+                "Environmental Sensing advertisement");
+    const uint8_t ess_some[] = { 0x03, 0x02, 0x1A, 0x18 };
+    test_expect(peers_parse_adv(ess_some, sizeof(ess_some), &connectable, &reading) && connectable,
+                "Environmental Sensing in incomplete list");
+
+    // Both, the broadcast readings win
+    const uint8_t both[] = { 0x03, 0x03, 0x1A, 0x18, 0x06, 0x16, 0xD2, 0xFC, 0x40, 0x01, 0x61 };
+    test_expect(peers_parse_adv(both, sizeof(both), &connectable, &reading) && !connectable &&
+                reading.fields == PEERS_HAS_BATTERY, "BTHome and Environmental Sensing");
+
+    // Malformed fields end parsing without reading past the advertisement
+    const uint8_t overlong[] = { 0x02, 0x01, 0x06, 0x09, 0x16, 0xD2, 0xFC, 0x40, 0x01, 0x61 };
+    test_expect(!peers_parse_adv(overlong, sizeof(overlong), &connectable, &reading), "field longer than advertisement");
+    const uint8_t zero[] = { 0x00, 0x03, 0x03, 0x1A, 0x18 };
+    test_expect(!peers_parse_adv(zero, sizeof(zero), &connectable, &reading), "zero length field");
+    const uint8_t other[] = { 0x02, 0x01, 0x06, 0x03, 0x03, 0x0D, 0x18 };
+    test_expect(!peers_parse_adv(other, sizeof(other), &connectable, &reading), "other device");
+    test_expect(!peers_parse_adv(NULL, 0, &connectable, &reading), "empty advertisement");
+}
+
+// Schedules the next action, sensors still around advertise during the scans in between
+static peers_action_t test_next(uint32_t now_ms, int *sensor)
+{
+    peers_action_t action;
+    while ((action = peers_schedule(&test_peers, now_ms, sensor)) == PEERS_ACTION_SCAN) {
+        for (int i = 0; i < PEERS_MAX; i++) {
+            peers_sensor_t *seen = &test_peers.sensors[i];
+            if (seen->used) {
+                peers_advertised(&test_peers, seen->addr, seen->addr_type, seen->rssi, seen->connectable, NULL, now_ms);
+            }
+        }
+        peers_scan_done(&test_peers);
+    }
+    return action;
+}
+
+static void test_batch(void *context, const peers_sensor_t *sensor)
+{
+    (*(int *)context)++;
+}
+
+static void test_schedule(void)
+{
+    int sensor = -1;
+    uint32_t now_ms = 1000;
+    peers_init(&test_peers, &test_config);
+
+    // The first scan starts right away and nothing else runs during it
+    test_expect(peers_schedule(&test_peers, now_ms, &sensor) == PEERS_ACTION_SCAN, "first scan");
+    peers_reading_t broadcast = { .fields = PEERS_HAS_TEMPERATURE, .temperature = 20 };
+    int broadcaster = test_advertise(1, false, &broadcast, now_ms);
+    int early = test_advertise(2, true, NULL, now_ms);
+    int late = test_advertise(3, true, NULL, now_ms + 100);
+    test_expect(peers_schedule(&test_peers, now_ms + 500, &sensor) == PEERS_ACTION_NONE, "action while scanning");
+    peers_scan_done(&test_peers);
+
+    // Most overdue first, one connection at a time
+    now_ms += 1000;
+    test_expect(peers_schedule(&test_peers, now_ms, &sensor) == PEERS_ACTION_READ && sensor == early,
+                "most overdue not read first");
+    test_expect(peers_schedule(&test_peers, now_ms, &sensor) == PEERS_ACTION_NONE, "action while connecting");
+    peers_connected(&test_peers, early, true, now_ms);
+    test_expect(peers_schedule(&test_peers, now_ms, &sensor) == PEERS_ACTION_NONE,
+                "read above max_connections");
+    peers_reading_t read = { .fields = PEERS_HAS_TEMPERATURE, .temperature = 22.5f };
+    peers_read_done(&test_peers, early, &read, now_ms + 200);
+    test_expect(test_peers.sensors[early].fresh && test_peers.sensors[early].due_ms == now_ms + 200 + TEST_READ_INTERVAL_MS &&
+                test_near(test_peers.sensors[early].reading_value.temperature, 22.5f), "read not recorded");
+    test_expect(peers_schedule(&test_peers, now_ms + 300, &sensor) == PEERS_ACTION_READ && sensor == late,
+                "second sensor not read");
+
+    peers_connected(&test_peers, late, false, now_ms + 300);
+
+    // Broadcast sensors are never connected to
+    test_expect(!test_peers.sensors[broadcaster].connectable, "broadcast sensor connectable");
+
+    // Only unpublished readings are batched, once
+    int batched = 0;
+    test_expect(peers_collect(&test_peers, now_ms, test_batch, &batched) == 2 && batched == 2, "first batch");
+    test_expect(peers_collect(&test_peers, now_ms, test_batch, &batched) == 0 && batched == 2, "batch repeated");
+}
+
+// A sensor that fails to connect is retried sooner than the read interval, backing off exponentially
+static void test_backoff(void)
+{
+    int sensor = -1;
+    uint32_t now_ms = 1000;
+    peers_init(&test_peers, &test_config);
+    test_next(now_ms, &sensor);
+    int failing = test_advertise(1, true, NULL, now_ms);
+    uint32_t backoff_ms = 1000;
+    for (int i = 0; i < 10; i++) {
+        if (test_next(now_ms - 1, &sensor) != PEERS_ACTION_NONE ||
+            test_next(now_ms, &sensor) != PEERS_ACTION_READ || sensor != failing) {
+            fprintf(stderr, "FAIL failure %d not retried when due\n", i);
+            test_failures++;
+            return;
+        }
+        peers_connected(&test_peers, failing, false, now_ms);
+        if (test_peers.sensors[failing].due_ms != now_ms + backoff_ms || test_peers.connections != 0) {
+            fprintf(stderr, "FAIL failure %d retried after %u ms, expected %u ms\n",
+                    i + 1, test_peers.sensors[failing].due_ms - now_ms, backoff_ms);
+            test_failures++;
+        }
+        now_ms = test_peers.sensors[failing].due_ms;
+        backoff_ms = backoff_ms * 2 < TEST_READ_INTERVAL_MS ? backoff_ms * 2 : TEST_READ_INTERVAL_MS;
+    }
+    test_expect(test_peers.stats.read_failures == 10, "read failures not counted");
+
+    // A connection that drops before the read gives its connection back
+    test_expect(test_next(now_ms, &sensor) == PEERS_ACTION_READ && sensor == failing, "failed sensor not retried");
+    peers_connected(&test_peers, failing, true, now_ms);
+    peers_read_done(&test_peers, failing, NULL, now_ms);
+    test_expect(test_peers.connections == 0 && test_peers.sensors[failing].failures == 11 &&
+                !test_peers.sensors[failing].reading, "dropped connection");
+
+    // A successful read resets the backoff
+    now_ms = test_peers.sensors[failing].due_ms;
+    test_next(now_ms, &sensor);
+    peers_connected(&test_peers, failing, true, now_ms);
+    peers_reading_t read = { .fields = PEERS_HAS_TEMPERATURE, .temperature = 19 };
+    peers_read_done(&test_peers, failing, &read, now_ms);
+    test_expect(test_peers.sensors[failing].failures == 0 && test_peers.stats.reads == 1, "backoff not reset");
+}
+
+static void test_expiry(void)
+{
+    int sensor = -1;
+    uint32_t now_ms = 0;
+    peers_init(&test_peers, &test_config);
+    peers_schedule(&test_peers, now_ms, &sensor);
+    peers_scan_done(&test_peers);
+
+    // The table keeps PEERS_MAX sensors, the rest are dropped until one expires
+    for (int i = 0; i < PEERS_MAX; i++) {
+        test_advertise(i, false, NULL, now_ms + i);
+    }
+    test_expect(test_advertise(PEERS_MAX, false, NULL, now_ms) < 0 && test_peers.stats.dropped == 1, "full table");
+    test_expect(test_advertise(0, false, NULL, now_ms + 1000) == 0, "known sensor dropped on full table");
+
+    // A sensor being read isn't forgotten under the connection
+    int connected = test_advertise(1, true, NULL, now_ms + 1000);
+    test_expect(peers_schedule(&test_peers, now_ms + 1000, &sensor) == PEERS_ACTION_READ && sensor == connected,
+                "connectable sensor not read");
+    now_ms += 1000 + TEST_TIMEOUT_MS;
+    peers_schedule(&test_peers, now_ms - 1, &sensor);
+    test_expect(test_peers.sensors[0].used && !test_peers.sensors[2].used, "sensor expired early");
+    peers_schedule(&test_peers, now_ms, &sensor);
+    test_expect(!test_peers.sensors[0].used && test_peers.sensors[connected].used &&
+                test_peers.stats.expired == PEERS_MAX - 1, "sensors not expired");
+    test_expect(test_advertise(PEERS_MAX, false, NULL, now_ms) >= 0, "new sensor after expiry");
+}
+
+// The tick count wraps after 49 days, due times across it still compare in order
+static void test_wrap(void)
+{
+    int sensor = -1;
+    uint32_t now_ms = 0;
+    peers_init(&test_peers, &test_config);
+    // Scan after scan until right before the wrap, like the gateway task polling all along
+    while (now_ms < UINT32_MAX - 2000 - TEST_SCAN_INTERVAL_MS) {
+        if (test_next(now_ms, &sensor) != PEERS_ACTION_NONE) {
+            test_expect(false, "action without sensors");
+            return;
+        }
+        now_ms += TEST_SCAN_INTERVAL_MS;
+    }
+    now_ms = UINT32_MAX - 2000;
+    test_next(now_ms, &sensor);
+    int a = test_advertise(1, true, NULL, now_ms);
+    test_expect(peers_schedule(&test_peers, now_ms, &sensor) == PEERS_ACTION_READ && sensor == a, "read near wrap");
+    peers_connected(&test_peers, a, false, now_ms);
+    test_expect(peers_schedule(&test_peers, now_ms + 999, &sensor) == PEERS_ACTION_NONE, "retried early across wrap");
+    test_expect(peers_schedule(&test_peers, now_ms + 1000, &sensor) == PEERS_ACTION_READ, "not retried across wrap");
+    peers_connected(&test_peers, a, false, now_ms + 1000);
+    now_ms += TEST_SCAN_INTERVAL_MS;
+    test_expect(peers_schedule(&test_peers, now_ms, &sensor) == PEERS_ACTION_SCAN, "no scan across wrap");
+}
+
+int main(void)
+{
+    test_parse();
+    test_schedule();
+    test_backoff();
+    test_expiry();
+    test_wrap();
+
+    printf("%s test_peers\n", test_failures ? "FAIL" : "PASS");
+    return test_failures ? 1 : 0;
+}
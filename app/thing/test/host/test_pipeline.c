@@ -0,0 +1,157 @@
+/*
+ * test_pipeline.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "utilities/pipeline.h"
+
+#define TEST_TOLERANCE      1e-3
+
+static int test_failures = 0;
+
+static void test_expect(const char *test, const char *name, double actual, double expected)
+{
+    if (fabs(actual - expected) > TEST_TOLERANCE) {
+        fprintf(stderr, "FAIL %s: %s is %g, expected %g\n", test, name, actual, expected);
+        test_failures++;
+    }
+}
+
+// Pushes count samples of signal(i), draining every chunk samples like the sensor task does.
+// Returns the number of aggregates, the last one in aggregate.
+static int test_run(pipeline_t *pipeline, float (*signal)(uint32_t i), uint32_t count, uint32_t chunk,
+                    pipeline_aggregate_t *aggregate)
+{
+    int aggregates = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        pipeline_push(pipeline, signal(i));
+        if ((i + 1) % chunk == 0 || i + 1 == count) {
+            while (pipeline_process(pipeline, aggregate)) {
+                aggregates++;
+            }
+        }
+    }
+    return aggregates;
+}
+
+static float test_ramp(uint32_t i)
+{
+    return (float)i;
+}
+
+// Full scale noise on top of a constant, at the highest frequency there is
+static float test_alternating(uint32_t i)
+{
+    return 100.0f + ((i & 1) ? 50.0f : -50.0f);
+}
+
+// Exactly one period per decimation block
+static float test_sine(uint32_t i)
+{
+    return 2048.0f + 1000.0f * (float)sin(2 * M_PI * (i % 10) / 10.0);
+}
+
+static void test_ramp_window(uint32_t chunk)
+{
+    // 1000 raw samples, downsampled by 10 into one window of 100
+    pipeline_t pipeline;
+    pipeline_aggregate_t aggregate;
+    pipeline_init(&pipeline, 10, 100);
+    int aggregates = test_run(&pipeline, test_ramp, 1000, chunk, &aggregate);
+    test_expect("ramp", "aggregates", aggregates, 1);
+    test_expect("ramp", "min", aggregate.min, 0);
+    test_expect("ramp", "max", aggregate.max, 999);
+    test_expect("ramp", "mean", aggregate.mean, 499.5);
+    test_expect("ramp", "count", aggregate.count, 1000);
+    test_expect("ramp", "dropped", aggregate.dropped, 0);
+    // Block k averages to 10k + 4.5, nearest rank 50 and 90 of 100 blocks
+    test_expect("ramp", "p50", aggregate.p50, 494.5);
+    test_expect("ramp", "p90", aggregate.p90, 894.5);
+}
+
+static void test_filter(void)
+{
+    // The box-car average cancels the noise, the percentiles only see the constant,
+    // while min and max still report the raw extremes
+    pipeline_t pipeline;
+    pipeline_aggregate_t aggregate;
+    pipeline_init(&pipeline, 10, 100);
+    test_run(&pipeline, test_alternating, 1000, 50, &aggregate);
+    test_expect("filter", "min", aggregate.min, 50);
+    test_expect("filter", "max", aggregate.max, 150);
+    test_expect("filter", "mean", aggregate.mean, 100);
+    test_expect("filter", "p50", aggregate.p50, 100);
+    test_expect("filter", "p90", aggregate.p90, 100);
+
+    pipeline_init(&pipeline, 10, 100);
+    test_run(&pipeline, test_sine, 1000, 50, &aggregate);
+    test_expect("sine", "min", aggregate.min, 2048 - 1000 * sin(2 * M_PI * 3 / 10.0));
+    test_expect("sine", "max", aggregate.max, 2048 + 1000 * sin(2 * M_PI * 2 / 10.0));
+    test_expect("sine", "mean", aggregate.mean, 2048);
+    test_expect("sine", "p50", aggregate.p50, 2048);
+    test_expect("sine", "p90", aggregate.p90, 2048);
+}
+
+static void test_dropped(void)
+{
+    // The ring overflows when it isn't drained in time, the next aggregate reports the loss once
+    pipeline_t pipeline;
+    pipeline_aggregate_t aggregate;
+    pipeline_init(&pipeline, 1, 128);
+    uint32_t accepted = 0;
+    for (uint32_t i = 0; i < PIPELINE_RING_SIZE + 44; i++) {
+        accepted += pipeline_push(&pipeline, (float)i);
+    }
+    test_expect("dropped", "accepted", accepted, PIPELINE_RING_SIZE);
+    test_expect("dropped", "first window", pipeline_process(&pipeline, &aggregate), true);
+    test_expect("dropped", "dropped", aggregate.dropped, 44);
+    test_expect("dropped", "max", aggregate.max, 127);
+    test_expect("dropped", "second window", pipeline_process(&pipeline, &aggregate), true);
+    test_expect("dropped", "dropped again", aggregate.dropped, 0);
+    test_expect("dropped", "min", aggregate.min, 128);
+    test_expect("dropped", "drained", pipeline_process(&pipeline, &aggregate), false);
+}
+
+static void test_percentiles(void)
+{
+    // Nearest rank, on unsorted input
+    pipeline_aggregate_t aggregate;
+    float five[] = { 5, 1, 3, 2, 4 };
+    pipeline_aggregate(five, 5, &aggregate);
+    test_expect("percentiles", "p50 of 5", aggregate.p50, 3);
+    test_expect("percentiles", "p90 of 5", aggregate.p90, 5);
+    float one[] = { 7 };
+    pipeline_aggregate(one, 1, &aggregate);
+    test_expect("percentiles", "p50 of 1", aggregate.p50, 7);
+    test_expect("percentiles", "p90 of 1", aggregate.p90, 7);
+    test_expect("percentiles", "empty", pipeline_aggregate(one, 0, &aggregate), false);
+}
+
+static void test_init(void)
+{
+    pipeline_t pipeline;
+    test_expect("init", "no decimation", pipeline_init(&pipeline, 0, 10), false);
+    test_expect("init", "no window", pipeline_init(&pipeline, 10, 0), false);
+    test_expect("init", "window too large", pipeline_init(&pipeline, 10, PIPELINE_WINDOW_MAX + 1), false);
+    test_expect("init", "valid", pipeline_init(&pipeline, 10, PIPELINE_WINDOW_MAX), true);
+}
+
+int main(void)
+{
+    // A window completes the same however the samples are split over drains
+    test_ramp_window(200);
+    test_ramp_window(50);
+    test_ramp_window(37);
+    test_filter();
+    test_dropped();
+    test_percentiles();
+    test_init();
+
+    printf("%s test_pipeline\n", test_failures ? "FAIL" : "PASS");
+    return test_failures ? 1 : 0;
+}
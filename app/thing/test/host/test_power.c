@@ -0,0 +1,218 @@
+/*
+ * test_power.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "utilities/power.h"
+
+#define TEST_SAMPLES_MAX    4096
+#define TEST_TOLERANCE      1e-4    // Relative, the result is single precision
+
+typedef struct test_vector_t {
+    const char *name;
+    uint16_t voltage[TEST_SAMPLES_MAX];
+    uint16_t current[TEST_SAMPLES_MAX];
+    uint32_t count;
+    float v_scale;
+    float i_scale;
+    power_result_t expected;
+} test_vector_t;
+
+static test_vector_t test_vector;
+static int test_failures = 0;
+
+static void test_expect(const char *test, const char *name, double actual, double expected)
+{
+    if (fabs(actual - expected) > TEST_TOLERANCE * fmax(1, fabs(expected))) {
+        fprintf(stderr, "FAIL %s: %s is %.9g, expected %.9g\n", test, name, actual, expected);
+        test_failures++;
+    }
+}
+
+static void test_expect_result(const char *test, const power_result_t *actual, const power_result_t *expected)
+{
+    test_expect(test, "v_rms", actual->v_rms, expected->v_rms);
+    test_expect(test, "i_rms", actual->i_rms, expected->i_rms);
+    test_expect(test, "real_w", actual->real_w, expected->real_w);
+    test_expect(test, "apparent_va", actual->apparent_va, expected->apparent_va);
+    test_expect(test, "power_factor", actual->power_factor, expected->power_factor);
+}
+
+// Straightforward double precision definition, the reference for the integer kernel
+static void test_reference(const test_vector_t *vector, power_result_t *result)
+{
+    double v_mean = 0, i_mean = 0;
+    for (uint32_t n = 0; n < vector->count; n++) {
+        v_mean += vector->voltage[n];
+        i_mean += vector->current[n];
+    }
+    v_mean /= vector->count;
+    i_mean /= vector->count;
+    double vv = 0, ii = 0, vi = 0;
+    for (uint32_t n = 0; n < vector->count; n++) {
+        double v = vector->voltage[n] - v_mean;
+        double i = vector->current[n] - i_mean;
+        vv += v * v;
+        ii += i * i;
+        vi += v * i;
+    }
+    result->v_rms = sqrt(vv / vector->count) * vector->v_scale;
+    result->i_rms = sqrt(ii / vector->count) * vector->i_scale;
+    result->real_w = vi / vector->count * vector->v_scale * vector->i_scale;
+    result->apparent_va = result->v_rms * result->i_rms;
+    result->power_factor = result->apparent_va > 0 ? result->real_w / result->apparent_va : 0;
+}
+
+// Sums the vector in calls of chunk samples, the result must not depend on the split
+static void test_run(const test_vector_t *vector, uint32_t chunk)
+{
+    power_sums_t sums = {0};
+    for (uint32_t n = 0; n < vector->count; n += chunk) {
+        uint32_t count = vector->count - n < chunk ? vector->count - n : chunk;
+        power_accumulate(&sums, &vector->voltage[n], &vector->current[n], count);
+    }
+    power_result_t result;
+    if (!power_compute(&sums, vector->v_scale, vector->i_scale, &result)) {
+        fprintf(stderr, "FAIL %s: power_compute\n", vector->name);
+        test_failures++;
+        return;
+    }
+    power_result_t reference;
+    test_reference(vector, &reference);
+    // Golden values derived by hand, then the reference on the same quantised samples
+    test_expect_result(vector->name, &result, &vector->expected);
+    test_expect_result(vector->name, &result, &reference);
+}
+
+static void test_run_splits(const test_vector_t *vector)
+{
+    test_run(vector, vector->count);
+    test_run(vector, 256);   // The kernel's block size
+    test_run(vector, 7);     // Misses the unrolled loop's stride
+}
+
+// A square wave of amplitude a around offset, shifted by quarter periods of 4 samples
+static uint16_t test_square(uint32_t n, int offset, int a, int shift)
+{
+    return (uint16_t)(offset + ((((n + shift) / 2) & 1) ? -a : a));
+}
+
+static void test_squares(void)
+{
+    test_vector_t *vector = &test_vector;
+    vector->count = 1028;
+    vector->v_scale = 0.25f;
+    vector->i_scale = 0.01f;
+
+    // In phase: 250 V and 5 A rms, 1250 W at power factor 1
+    vector->name = "square in phase";
+    for (uint32_t n = 0; n < vector->count; n++) {
+        vector->voltage[n] = test_square(n, 2048, 1000, 0);
+        vector->current[n] = test_square(n, 2048, 500, 0);
+    }
+    vector->expected = (power_result_t){ 250, 5, 1250, 1250, 1 };
+    test_run_splits(vector);
+
+    // Current reversed, e.g. a solar inverter feeding back
+    vector->name = "square anti phase";
+    for (uint32_t n = 0; n < vector->count; n++) {
+        vector->current[n] = test_square(n, 2048, 500, 2);
+    }
+    vector->expected = (power_result_t){ 250, 5, -1250, 1250, -1 };
+    test_run_splits(vector);
+
+    // A quarter period apart, purely reactive
+    vector->name = "square quadrature";
+    for (uint32_t n = 0; n < vector->count; n++) {
+        vector->current[n] = test_square(n, 2048, 500, 1);
+    }
+    vector->expected = (power_result_t){ 250, 5, 0, 1250, 0 };
+    test_run_splits(vector);
+
+    // Offsets away from midscale are removed, not mistaken for power
+    vector->name = "square offset";
+    for (uint32_t n = 0; n < vector->count; n++) {
+        vector->voltage[n] = test_square(n, 2300, 1000, 0);
+        vector->current[n] = test_square(n, 1900, 500, 0);
+    }
+    vector->expected = (power_result_t){ 250, 5, 1250, 1250, 1 };
+    test_run_splits(vector);
+
+    // Nothing but DC
+    vector->name = "dc";
+    for (uint32_t n = 0; n < vector->count; n++) {
+        vector->voltage[n] = 3000;
+        vector->current[n] = 1000;
+    }
+    vector->expected = (power_result_t){ 0, 0, 0, 0, 0 };
+    test_run_splits(vector);
+
+    // Rail to rail, the largest squares the 32-bit block sums must hold
+    vector->name = "full scale";
+    vector->v_scale = 1;
+    vector->i_scale = 1;
+    for (uint32_t n = 0; n < vector->count; n++) {
+        vector->voltage[n] = (n & 1) ? 0 : 4095;
+        vector->current[n] = (n & 1) ? 0 : 4095;
+    }
+    vector->expected = (power_result_t){ 2047.5, 2047.5, 2047.5 * 2047.5, 2047.5 * 2047.5, 1 };
+    test_run_splits(vector);
+}
+
+static void test_sine(void)
+{
+    // 50 periods of 80 samples, current lagging 60 degrees, so the power factor is 0.5
+    test_vector_t *vector = &test_vector;
+    vector->name = "sine lagging";
+    vector->count = 4000;
+    vector->v_scale = 0.2f;
+    vector->i_scale = 0.02f;
+    for (uint32_t n = 0; n < vector->count; n++) {
+        double phase = 2 * M_PI * n / 80;
+        vector->voltage[n] = (uint16_t)lround(2048 + 1600 * sin(phase));
+        vector->current[n] = (uint16_t)lround(2000 + 400 * sin(phase - M_PI / 3));
+    }
+    // 1600 / sqrt(2) * 0.2 V, 400 / sqrt(2) * 0.02 A. Quantisation moves these slightly,
+    // the reference run checks the exact values.
+    double v_rms = 1600 / M_SQRT2 * 0.2;
+    double i_rms = 400 / M_SQRT2 * 0.02;
+    vector->expected = (power_result_t){ v_rms, i_rms, v_rms * i_rms * 0.5, v_rms * i_rms, 0.5 };
+    power_sums_t sums = {0};
+    power_accumulate(&sums, vector->voltage, vector->current, vector->count);
+    power_result_t result, reference;
+    power_compute(&sums, vector->v_scale, vector->i_scale, &result);
+    test_reference(vector, &reference);
+    test_expect_result(vector->name, &result, &reference);
+    // Hand derived values hold to the ADC's resolution, within 0.1 %
+    if (fabs(result.v_rms / vector->expected.v_rms - 1) > 1e-3 || fabs(result.i_rms / vector->expected.i_rms - 1) > 1e-3 ||
+        fabs(result.power_factor - vector->expected.power_factor) > 1e-3) {
+        fprintf(stderr, "FAIL %s: %g V, %g A, power factor %g\n", vector->name,
+                result.v_rms, result.i_rms, result.power_factor);
+        test_failures++;
+    }
+}
+
+static void test_empty(void)
+{
+    power_sums_t sums = {0};
+    power_result_t result;
+    if (power_compute(&sums, 1, 1, &result)) {
+        fprintf(stderr, "FAIL empty: power_compute without samples\n");
+        test_failures++;
+    }
+}
+
+int main(void)
+{
+    test_squares();
+    test_sine();
+    test_empty();
+
+    printf("%s test_power\n", test_failures ? "FAIL" : "PASS");
+    return test_failures ? 1 : 0;
+}
@@ -0,0 +1,379 @@
+/*
+ * test_rules.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "utilities/rules.h"
+
+#define TEST_ENDPOINTS  2
+#define TEST_MAX_CODE   (RULES_MAX_CODE + 16) // Room for code that is too long
+
+// Rule sets are assembled here the way the cloud's compiler lays them out
+typedef struct test_code_t {
+    uint8_t code[TEST_MAX_CODE];
+    int len;
+} test_code_t;
+
+typedef struct test_bytecode_t {
+    uint8_t data[RULES_MAX_SIZE + 64];
+    size_t size;
+} test_bytecode_t;
+
+// The thing's fields as automation.c reads and writes them
+typedef struct test_fields_t {
+    float temperature[TEST_ENDPOINTS];
+    float status[TEST_ENDPOINTS];
+    int sets;
+    int set_endpoint;
+    float set_value;
+} test_fields_t;
+
+static const char *const test_names[] = { "temperature", "status" };
+#define TEST_TEMPERATURE    0
+#define TEST_STATUS         1
+#define TEST_NAMES_COUNT    2
+
+static int test_failures = 0;
+
+static void test_expect(bool ok, const char *what)
+{
+    if (!ok) {
+        fprintf(stderr, "FAIL %s\n", what);
+        test_failures++;
+    }
+}
+
+static void test_put(test_bytecode_t *b, const void *data, size_t len)
+{
+    memcpy(&b->data[b->size], data, len);
+    b->size += len;
+}
+
+static void test_put_u8(test_bytecode_t *b, uint8_t value)
+{
+    test_put(b, &value, 1);
+}
+
+static void test_code_op(test_code_t *c, rules_op_t op)
+{
+    c->code[c->len++] = op;
+}
+
+static void test_code_const(test_code_t *c, float value)
+{
+    test_code_op(c, RULES_OP_CONST);
+    memcpy(&c->code[c->len], &value, sizeof(value));
+    c->len += sizeof(value);
+}
+
+static void test_code_field(test_code_t *c, int endpoint, int name)
+{
+    test_code_op(c, RULES_OP_FIELD);
+    c->code[c->len++] = endpoint;
+    c->code[c->len++] = name;
+}
+
+static void test_begin(test_bytecode_t *b, int rule_count)
+{
+    b->size = 0;
+    test_put(b, "RB", 2);
+    test_put_u8(b, RULES_FORMAT);
+    test_put_u8(b, rule_count);
+    test_put_u8(b, TEST_NAMES_COUNT);
+    test_put(b, "\0\0", 2); // Size, set by test_end()
+    for (int i = 0; i < TEST_NAMES_COUNT; i++) {
+        test_put(b, test_names[i], strlen(test_names[i]) + 1);
+    }
+}
+
+static void test_rule(test_bytecode_t *b, uint16_t hold_s, int endpoint, int name, float value, const test_code_t *c)
+{
+    test_put(b, &hold_s, sizeof(hold_s));
+    test_put_u8(b, endpoint);
+    test_put_u8(b, name);
+    test_put(b, &value, sizeof(value));
+    test_put_u8(b, c->len);
+    test_put(b, c->code, c->len);
+}
+
+static void test_end(test_bytecode_t *b)
+{
+    b->data[5] = b->size & 0xff;
+    b->data[6] = b->size >> 8;
+}
+
+static bool test_get_field(void *context, int endpoint, const char *name, float *value)
+{
+    test_fields_t *fields = context;
+    if (strcmp(name, "temperature") == 0) {
+        *value = fields->temperature[endpoint];
+        return true;
+    }
+    if (strcmp(name, "status") == 0) {
+        *value = fields->status[endpoint];
+        return true;
+    }
+    return false;
+}
+
+static bool test_set_field(void *context, int endpoint, const char *name, float value)
+{
+    test_fields_t *fields = context;
+    fields->sets++;
+    fields->set_endpoint = endpoint;
+    fields->set_value = value;
+    if (strcmp(name, "status") == 0) {
+        fields->status[endpoint] = value;
+    }
+    return true;
+}
+
+// One rule setting status of endpoint 1 to 1 with the given condition
+static bool test_load_condition(rules_t *rules, const test_code_t *c)
+{
+    test_bytecode_t b;
+    test_begin(&b, 1);
+    test_rule(&b, 0, 1, TEST_STATUS, 1, c);
+    test_end(&b);
+    return rules_load(rules, b.data, b.size, TEST_ENDPOINTS);
+}
+
+static void test_reject(void)
+{
+    static rules_t rules;
+    test_code_t valid = {0};
+    test_code_field(&valid, 0, TEST_TEMPERATURE);
+    test_code_const(&valid, 25);
+    test_code_op(&valid, RULES_OP_GT);
+    test_expect(test_load_condition(&rules, &valid), "valid rule set rejected");
+
+    // Stack depth
+    test_code_t code = {0};
+    test_code_const(&code, 1);
+    test_code_op(&code, RULES_OP_LT);
+    test_expect(!test_load_condition(&rules, &code), "stack underflow accepted");
+    code = (test_code_t){0};
+    test_code_op(&code, RULES_OP_NOT);
+    test_expect(!test_load_condition(&rules, &code), "unary on empty stack accepted");
+    code = (test_code_t){0};
+    for (int i = 0; i <= RULES_MAX_STACK; i++) {
+        test_code_const(&code, i);
+    }
+    for (int i = 0; i < RULES_MAX_STACK; i++) {
+        test_code_op(&code, RULES_OP_ADD);
+    }
+    test_expect(!test_load_condition(&rules, &code), "stack overflow accepted");
+    code = (test_code_t){0};
+    test_code_const(&code, 1);
+    test_code_const(&code, 2);
+    test_expect(!test_load_condition(&rules, &code), "two results accepted");
+    code = (test_code_t){0};
+    test_expect(!test_load_condition(&rules, &code), "empty condition accepted");
+
+    // Code
+    code = (test_code_t){0};
+    test_code_const(&code, 1);
+    code.len -= 2;
+    test_expect(!test_load_condition(&rules, &code), "truncated constant accepted");
+    code = (test_code_t){0};
+    test_code_const(&code, 1);
+    test_code_op(&code, 0x7f);
+    test_expect(!test_load_condition(&rules, &code), "unknown opcode accepted");
+    code = (test_code_t){0};
+    test_code_const(&code, 1);
+    while (code.len + 6 <= TEST_MAX_CODE && code.len <= RULES_MAX_CODE) {
+        test_code_const(&code, 1);
+        test_code_op(&code, RULES_OP_AND);
+    }
+    test_expect(code.len > RULES_MAX_CODE && !test_load_condition(&rules, &code), "code longer than RULES_MAX_CODE accepted");
+
+    // Indexes
+    code = (test_code_t){0};
+    test_code_field(&code, TEST_ENDPOINTS, TEST_TEMPERATURE);
+    test_expect(!test_load_condition(&rules, &code), "field endpoint out of range accepted");
+    code = (test_code_t){0};
+    test_code_field(&code, 0, TEST_NAMES_COUNT);
+    test_expect(!test_load_condition(&rules, &code), "field name out of range accepted");
+    test_bytecode_t b;
+    test_begin(&b, 1);
+    test_rule(&b, 0, TEST_ENDPOINTS, TEST_STATUS, 1, &valid);
+    test_end(&b);
+    test_expect(!rules_load(&rules, b.data, b.size, TEST_ENDPOINTS), "action endpoint out of range accepted");
+    test_begin(&b, 1);
+    test_rule(&b, 0, 0, TEST_NAMES_COUNT, 1, &valid);
+    test_end(&b);
+    test_expect(!rules_load(&rules, b.data, b.size, TEST_ENDPOINTS), "action name out of range accepted");
+
+    // Header and sizes
+    test_begin(&b, 1);
+    test_rule(&b, 0, 0, TEST_STATUS, 1, &valid);
+    test_end(&b);
+    test_expect(!rules_load(&rules, b.data, b.size - 1, TEST_ENDPOINTS), "shorter than its header size accepted");
+    test_expect(!rules_load(&rules, b.data, b.size + 1, TEST_ENDPOINTS), "longer than its header size accepted");
+    b.data[5]++;
+    test_expect(!rules_load(&rules, b.data, b.size + 1, TEST_ENDPOINTS), "trailing byte accepted");
+    b.data[5]--;
+    b.data[3] = 2;
+    test_expect(!rules_load(&rules, b.data, b.size, TEST_ENDPOINTS), "missing rule accepted");
+    b.data[3] = 1;
+    b.data[2] = RULES_FORMAT + 1;
+    test_expect(!rules_load(&rules, b.data, b.size, TEST_ENDPOINTS), "unknown format accepted");
+    b.data[2] = RULES_FORMAT;
+    b.data[0] = 'X';
+    test_expect(rules_get_size(b.data, b.size) == 0 && !rules_load(&rules, b.data, b.size, TEST_ENDPOINTS),
+                "bad magic accepted");
+    b.data[0] = 'R';
+    b.data[4] = 3;
+    test_expect(!rules_load(&rules, b.data, b.size, TEST_ENDPOINTS), "missing name accepted");
+    b.data[4] = TEST_NAMES_COUNT;
+    b.data[5] = (RULES_MAX_SIZE + 1) & 0xff;
+    b.data[6] = (RULES_MAX_SIZE + 1) >> 8;
+    test_expect(rules_get_size(b.data, b.size) == 0, "size above RULES_MAX_SIZE accepted");
+
+    // A rejected set leaves the loaded one in place
+    test_expect(test_load_condition(&rules, &valid), "valid rule set rejected");
+    rules_t before = rules;
+    test_expect(!test_load_condition(&rules, &code), "bad rule set accepted");
+    test_expect(memcmp(&before, &rules, sizeof(rules)) == 0, "rejected rule set changed the loaded one");
+}
+
+// Every operator, with the value of the condition as the action's trigger
+static void test_evaluate(void)
+{
+    static rules_t rules;
+    static const struct {
+        rules_op_t op;
+        float a;
+        float b;
+        bool result;
+    } cases[] = {
+        { RULES_OP_LT, 1, 2, true },    { RULES_OP_LT, 2, 2, false },
+        { RULES_OP_GT, 3, 2, true },    { RULES_OP_GT, 2, 2, false },
+        { RULES_OP_LE, 2, 2, true },    { RULES_OP_LE, 3, 2, false },
+        { RULES_OP_GE, 2, 2, true },    { RULES_OP_GE, 1, 2, false },
+        { RULES_OP_EQ, 2, 2, true },    { RULES_OP_EQ, 1, 2, false },
+        { RULES_OP_NE, 1, 2, true },    { RULES_OP_NE, 2, 2, false },
+        { RULES_OP_AND, 1, 5, true },   { RULES_OP_AND, 1, 0, false },
+        { RULES_OP_OR, 0, 5, true },    { RULES_OP_OR, 0, 0, false },
+        { RULES_OP_ADD, -2, 2, false }, { RULES_OP_ADD, -2, 3, true },
+        { RULES_OP_SUB, 2, 2, false },  { RULES_OP_SUB, 3, 2, true },
+        { RULES_OP_MUL, 0, 7, false },  { RULES_OP_MUL, 0.5, 4, true },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        test_code_t code = {0};
+        test_code_const(&code, cases[i].a);
+        test_code_const(&code, cases[i].b);
+        test_code_op(&code, cases[i].op);
+        test_fields_t fields = {0};
+        if (!test_load_condition(&rules, &code)) {
+            test_expect(false, "operator rule set rejected");
+            continue;
+        }
+        uint32_t instructions = rules_evaluate(&rules, 0, test_get_field, test_set_field, &fields);
+        if ((fields.sets == 1) != cases[i].result || instructions != 3) {
+            fprintf(stderr, "FAIL op %d on %g, %g: %d sets, %u instructions\n",
+                    cases[i].op, cases[i].a, cases[i].b, fields.sets, instructions);
+            test_failures++;
+        }
+    }
+
+    // status of endpoint 1 = 1 when temperature of endpoint 0 * 2 - 1 > 40 and not status of endpoint 1
+    test_code_t code = {0};
+    test_code_field(&code, 0, TEST_TEMPERATURE);
+    test_code_const(&code, 2);
+    test_code_op(&code, RULES_OP_MUL);
+    test_code_const(&code, 1);
+    test_code_op(&code, RULES_OP_SUB);
+    test_code_const(&code, 40);
+    test_code_op(&code, RULES_OP_GT);
+    test_code_field(&code, 1, TEST_STATUS);
+    test_code_op(&code, RULES_OP_NOT);
+    test_code_op(&code, RULES_OP_AND);
+    test_expect(test_load_condition(&rules, &code), "combined rule set rejected");
+    test_fields_t fields = { .temperature = { 20.5, 0 } };
+    rules_evaluate(&rules, 0, test_get_field, test_set_field, &fields);
+    test_expect(fields.sets == 0, "combined condition fired below its threshold");
+    fields.temperature[0] = 21;
+    rules_evaluate(&rules, 1, test_get_field, test_set_field, &fields);
+    test_expect(fields.sets == 1 && fields.set_endpoint == 1 && fields.set_value == 1 && fields.status[1] == 1,
+                "combined condition didn't set status of endpoint 1");
+
+    // A field the type doesn't have makes the condition false
+    code = (test_code_t){0};
+    test_code_field(&code, 0, TEST_TEMPERATURE);
+    test_code_op(&code, RULES_OP_NOT);
+    test_expect(test_load_condition(&rules, &code), "missing field rule set rejected");
+    test_fields_t missing = {0};
+    rules.names[TEST_TEMPERATURE] = "humidity";
+    rules_evaluate(&rules, 0, test_get_field, test_set_field, &missing);
+    test_expect(missing.sets == 0, "missing field evaluated as 0");
+}
+
+// A rule fires once its condition held for hold_s, once per time the condition turns true
+static void test_hold(void)
+{
+    static rules_t rules;
+    test_code_t code = {0};
+    test_code_field(&code, 0, TEST_TEMPERATURE);
+    test_code_const(&code, 25);
+    test_code_op(&code, RULES_OP_GT);
+    test_bytecode_t b;
+    test_begin(&b, 2);
+    test_rule(&b, 10, 0, TEST_STATUS, 1, &code);
+    test_rule(&b, 0, 1, TEST_STATUS, 1, &code);
+    test_end(&b);
+    test_expect(rules_load(&rules, b.data, b.size, TEST_ENDPOINTS), "hold rule set rejected");
+
+    test_fields_t fields = { .temperature = { 30, 0 } };
+    uint32_t now_s = 100;
+    rules_evaluate(&rules, now_s, test_get_field, test_set_field, &fields);
+    test_expect(fields.sets == 1 && fields.set_endpoint == 1, "rule without hold didn't fire straight away");
+    rules_evaluate(&rules, now_s + 9, test_get_field, test_set_field, &fields);
+    test_expect(fields.sets == 1, "rule fired before its hold time");
+    rules_evaluate(&rules, now_s + 10, test_get_field, test_set_field, &fields);
+    test_expect(fields.sets == 2 && fields.set_endpoint == 0, "rule didn't fire after its hold time");
+    for (int s = 11; s < 100; s++) {
+        rules_evaluate(&rules, now_s + s, test_get_field, test_set_field, &fields);
+    }
+    test_expect(fields.sets == 2, "rule fired again while its condition stayed true");
+
+    // Dropping below for one evaluation re-arms both, and restarts the hold
+    fields.temperature[0] = 20;
+    rules_evaluate(&rules, now_s + 100, test_get_field, test_set_field, &fields);
+    fields.temperature[0] = 30;
+    rules_evaluate(&rules, now_s + 101, test_get_field, test_set_field, &fields);
+    test_expect(fields.sets == 3 && fields.set_endpoint == 1, "rule without hold not re-armed");
+    rules_evaluate(&rules, now_s + 110, test_get_field, test_set_field, &fields);
+    test_expect(fields.sets == 3, "hold not restarted when re-armed");
+    rules_evaluate(&rules, now_s + 111, test_get_field, test_set_field, &fields);
+    test_expect(fields.sets == 4 && fields.set_endpoint == 0, "rule not re-armed");
+
+    // The hold survives the seconds counter wrapping
+    fields.temperature[0] = 20;
+    rules_evaluate(&rules, UINT32_MAX - 4, test_get_field, test_set_field, &fields);
+    fields.temperature[0] = 30;
+    rules_evaluate(&rules, UINT32_MAX - 4, test_get_field, test_set_field, &fields);
+    int sets = fields.sets;
+    rules_evaluate(&rules, 4, test_get_field, test_set_field, &fields);
+    test_expect(fields.sets == sets, "rule fired early across the wrap");
+    rules_evaluate(&rules, 5, test_get_field, test_set_field, &fields);
+    test_expect(fields.sets == sets + 1, "rule didn't fire across the wrap");
+
+    rules_clear(&rules);
+    test_expect(rules_evaluate(&rules, 0, test_get_field, test_set_field, &fields) == 0, "cleared rules evaluated");
+}
+
+int main(void)
+{
+    test_reject();
+    test_evaluate();
+    test_hold();
+
+    printf("%s test_rules\n", test_failures ? "FAIL" : "PASS");
+    return test_failures ? 1 : 0;
+}
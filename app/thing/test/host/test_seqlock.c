@@ -0,0 +1,171 @@
+/*
+ * test_seqlock.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "utilities/seqlock.h"
+
+#define TEST_WORDS          32      // Large enough for a torn copy to show
+#define TEST_READERS        4
+#define TEST_WRITERS        4
+#define TEST_WRITES         200000  // Per writer
+#define TEST_UPDATES        200000  // Per writer
+
+// Every word holds the same value, a torn copy mixes two of them
+typedef struct test_value_t {
+    uint32_t words[TEST_WORDS];
+} test_value_t;
+
+static seqlock_t test_lock;
+static test_value_t test_value;
+static volatile bool test_writing;
+static uint64_t test_torn;
+static uint64_t test_reads;
+static uint64_t test_rejected;
+
+static bool test_check(const test_value_t *value)
+{
+    for (int i = 1; i < TEST_WORDS; i++) {
+        if (value->words[i] != value->words[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *test_reader(void *arg)
+{
+    uint64_t torn = 0;
+    uint64_t reads = 0;
+    while (__atomic_load_n(&test_writing, __ATOMIC_RELAXED)) {
+        test_value_t value;
+        seqlock_read(&test_lock, &value, &test_value, sizeof(value));
+        torn += !test_check(&value);
+        reads++;
+    }
+    __atomic_fetch_add(&test_torn, torn, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&test_reads, reads, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static void *test_writer(void *arg)
+{
+    uint32_t base = (uint32_t)(uintptr_t)arg * TEST_WRITES;
+    for (uint32_t n = 0; n < TEST_WRITES; n++) {
+        test_value_t value;
+        for (int i = 0; i < TEST_WORDS; i++) {
+            value.words[i] = base + n;
+        }
+        seqlock_write(&test_lock, &test_value, &value, sizeof(value), NULL);
+    }
+    return NULL;
+}
+
+static bool test_increment(void *value, void *arg)
+{
+    test_value_t *test = value;
+    for (int i = 0; i < TEST_WORDS; i++) {
+        test->words[i]++;
+    }
+    return true;
+}
+
+static bool test_reject(void *value, void *arg)
+{
+    test_value_t *test = value;
+    test->words[0] = 0xdeadbeef;
+    return false;
+}
+
+static void *test_updater(void *arg)
+{
+    for (int n = 0; n < TEST_UPDATES; n++) {
+        seqlock_update(&test_lock, &test_value, sizeof(test_value), test_increment, NULL, NULL);
+        // A rejected update must leave no trace, even when it edited its copy
+        if ((n & 0xff) == 0 && seqlock_update(&test_lock, &test_value, sizeof(test_value), test_reject, NULL, NULL)) {
+            __atomic_fetch_add(&test_rejected, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+static void test_run(void *(*writer)(void *))
+{
+    pthread_t readers[TEST_READERS];
+    pthread_t writers[TEST_WRITERS];
+    test_writing = true;
+    for (int i = 0; i < TEST_READERS; i++) {
+        pthread_create(&readers[i], NULL, test_reader, NULL);
+    }
+    for (int i = 0; i < TEST_WRITERS; i++) {
+        pthread_create(&writers[i], NULL, writer, (void *)(uintptr_t)i);
+    }
+    for (int i = 0; i < TEST_WRITERS; i++) {
+        pthread_join(writers[i], NULL);
+    }
+    __atomic_store_n(&test_writing, false, __ATOMIC_RELAXED);
+    for (int i = 0; i < TEST_READERS; i++) {
+        pthread_join(readers[i], NULL);
+    }
+}
+
+int main(void)
+{
+    int failures = 0;
+    if (!seqlock_init(&test_lock, sizeof(test_value))) {
+        fprintf(stderr, "FAIL: seqlock_init\n");
+        return 1;
+    }
+
+    // Concurrent writers, readers never see a mix of two writes
+    test_run(test_writer);
+    if (test_torn != 0 || !test_check(&test_value)) {
+        fprintf(stderr, "FAIL: write, %llu of %llu reads torn\n",
+                (unsigned long long)test_torn, (unsigned long long)test_reads);
+        failures++;
+    }
+
+    // Concurrent read-modify-writes, no increment is lost
+    memset(&test_value, 0, sizeof(test_value));
+    test_torn = 0;
+    test_reads = 0;
+    test_run(test_updater);
+    uint32_t expected = TEST_WRITERS * TEST_UPDATES;
+    if (test_torn != 0 || test_rejected != 0 || !test_check(&test_value) || test_value.words[0] != expected) {
+        fprintf(stderr, "FAIL: update, %u of %u increments, %llu of %llu reads torn, %llu rejected applied\n",
+                test_value.words[0], expected, (unsigned long long)test_torn, (unsigned long long)test_reads,
+                (unsigned long long)test_rejected);
+        failures++;
+    }
+
+    // Changed is only reported when the bytes differ
+    bool changed = true;
+    test_value_t same = test_value;
+    seqlock_write(&test_lock, &test_value, &same, sizeof(same), &changed);
+    if (changed) {
+        fprintf(stderr, "FAIL: unchanged write reported as changed\n");
+        failures++;
+    }
+    seqlock_update(&test_lock, &test_value, sizeof(test_value), test_increment, NULL, &changed);
+    if (!changed) {
+        fprintf(stderr, "FAIL: changing update reported as unchanged\n");
+        failures++;
+    }
+
+    // seqlock_update copies into a fixed buffer, so larger structs are refused up front
+    seqlock_t large_lock;
+    if (seqlock_init(&large_lock, SEQLOCK_MAX_SIZE + 1) ||
+        seqlock_update(&test_lock, &test_value, sizeof(test_value) + 1, test_increment, NULL, NULL)) {
+        fprintf(stderr, "FAIL: size beyond the protected struct accepted\n");
+        failures++;
+    }
+
+    printf("%s test_seqlock\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * test_type.c
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "app/types/type.h"
+#include "utilities/dirty.h"
+#include "utilities/json_reader.h"
+#include "utilities/json_writer.h"
+
+// The tasks that touch a type's value at the same time on the thing: the button task
+// editing the readwrite, MQTT commands replacing it, the type's task storing the read and
+// the publisher serializing both. Every writer keeps level == level_check and
+// samples == samples_check, so a torn or mixed copy shows in what is published.
+#define TEST_COMMANDS       20000
+#define TEST_PRESSES        50000
+#define TEST_SAMPLES        50000
+#define TEST_RULES          50000
+#define TEST_PUBLISHERS     2
+#define TEST_BUFFER_SIZE    512
+#define TEST_MAX_TOKENS     32
+
+#define TEST_READWRITE_FIELDS(X) \
+    X(INT, presses, 0, INT32_MAX) \
+    X(NUMBER, level, -1e9, 1e9) \
+    X(NUMBER, level_check, -1e9, 1e9) \
+    X(BOOL, enabled, 0, 0)
+#define TEST_READ_FIELDS(X) \
+    X(INT, samples, 0, INT32_MAX) \
+    X(INT, samples_check, 0, INT32_MAX)
+
+typedef struct test_readwrite_t {
+    TEST_READWRITE_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
+} test_readwrite_t;
+
+typedef struct test_read_t {
+    TEST_READ_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
+} test_read_t;
+
+typedef struct test_value_t {
+    test_readwrite_t readwrite;
+    test_read_t read;
+} test_value_t;
+
+#define TEST_READWRITE_FIELD(kind, field, a, b) SCHEMA_FIELD(test_readwrite_t, kind, field, a, b)
+#define TEST_READ_FIELD(kind, field, a, b) SCHEMA_FIELD(test_read_t, kind, field, a, b)
+
+static const schema_field_t test_readwrite_fields[] = { TEST_READWRITE_FIELDS(TEST_READWRITE_FIELD) SCHEMA_FIELDS_END };
+static const schema_field_t test_read_fields[] = { TEST_READ_FIELDS(TEST_READ_FIELD) SCHEMA_FIELDS_END };
+
+static seqlock_t test_value_lock[TYPE_MAX_ENDPOINTS];
+static test_value_t test_value_g[TYPE_MAX_ENDPOINTS];
+static volatile uint32_t test_hw_updates = 0;
+
+static bool test_update_hw(int endpoint);
+static bool test_init(callback_t callback_publish_value);
+static bool test_pre_reboot(void);
+
+static const type_value_t test_type_value = TYPE_VALUE(test, test_update_hw);
+
+// Stands in for default.c, type.c falls back to it with no type configured
+const type_ops_t default_type_ops = {
+    .name = "test",
+    .value = &test_type_value,
+    .init = test_init,
+    .pre_reboot = test_pre_reboot,
+};
+
+static volatile bool test_running;
+static uint64_t test_published;
+static uint64_t test_torn;
+static int test_failures = 0;
+
+static bool test_update_hw(int endpoint)
+{
+    __atomic_fetch_add(&test_hw_updates, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+static bool test_init(callback_t callback_publish_value)
+{
+    return true;
+}
+
+static bool test_pre_reboot(void)
+{
+    return true;
+}
+
+static void test_fail(const char *what)
+{
+    __atomic_fetch_add(&test_failures, 1, __ATOMIC_RELAXED);
+    fprintf(stderr, "FAIL %s\n", what);
+}
+
+// What the switch task does for a button press, on the current value. Yields halfway, so
+// the other tasks run while the press holds its copy, on one core as well.
+static bool test_press(void *readwrite, void *arg)
+{
+    test_readwrite_t *value = readwrite;
+    value->presses++;
+    sched_yield();
+    value->level += 0.5;
+    value->level_check = value->level;
+    return true;
+}
+
+static void *test_button(void *arg)
+{
+    for (int i = 0; i < TEST_PRESSES; i++) {
+        if (!type_value_update(&test_type_value, 0, test_press, NULL, NULL)) {
+            test_fail("button type_value_update");
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void *test_mqtt(void *arg)
+{
+    char command[TEST_BUFFER_SIZE];
+    json_token_t tokens[TEST_MAX_TOKENS];
+    for (int i = 1; i <= TEST_COMMANDS; i++) {
+        int len = snprintf(command, sizeof(command),
+                           "{\"readwrite\":{\"presses\":%d,\"level\":%d,\"level_check\":%d,\"enabled\":%s},\"read\":{}}",
+                           i, -i, -i, (i & 1) ? "true" : "false");
+        json_reader_t reader;
+        if (!json_reader_parse(&reader, tokens, TEST_MAX_TOKENS, command, len) ||
+            !type_set_value_reader(0, &reader, 0)) {
+            test_fail("mqtt type_set_value_reader");
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void *test_sensor(void *arg)
+{
+    for (int i = 1; i <= TEST_SAMPLES; i++) {
+        test_read_t read = { .samples = i, .samples_check = i };
+        if (!type_value_set_read(&test_type_value, 0, &read, NULL)) {
+            test_fail("sensor type_value_set_read");
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Automations set single properties, next to the button presses
+static void *test_rules(void *arg)
+{
+    for (int i = 0; i < TEST_RULES; i++) {
+        if (!type_set_field(0, "enabled", i & 1)) {
+            test_fail("rules type_set_field");
+            break;
+        }
+    }
+    return NULL;
+}
+
+static bool test_publish(char *buffer, json_token_t *tokens, double *numbers)
+{
+    json_writer_t writer;
+    json_writer_init(&writer, buffer, TEST_BUFFER_SIZE);
+    json_writer_object_begin(&writer, NULL);
+    json_writer_object_begin(&writer, "readwrite");
+    type_get_readwrite_writer(0, &writer);
+    json_writer_object_end(&writer);
+    json_writer_object_begin(&writer, "read");
+    type_get_read_writer(0, &writer);
+    json_writer_object_end(&writer);
+    json_writer_object_end(&writer);
+    if (!json_writer_finish(&writer)) {
+        return false;
+    }
+
+    json_reader_t reader;
+    if (!json_reader_parse(&reader, tokens, TEST_MAX_TOKENS, buffer, strlen(buffer))) {
+        return false;
+    }
+    int readwrite = json_reader_find(&reader, 0, "readwrite");
+    int read = json_reader_find(&reader, 0, "read");
+    return json_reader_get_number(&reader, json_reader_find(&reader, readwrite, "level"), &numbers[0]) &&
+           json_reader_get_number(&reader, json_reader_find(&reader, readwrite, "level_check"), &numbers[1]) &&
+           json_reader_get_number(&reader, json_reader_find(&reader, read, "samples"), &numbers[2]) &&
+           json_reader_get_number(&reader, json_reader_find(&reader, read, "samples_check"), &numbers[3]);
+}
+
+static void *test_publisher(void *arg)
+{
+    char buffer[TEST_BUFFER_SIZE];
+    json_token_t tokens[TEST_MAX_TOKENS];
+    uint64_t published = 0;
+    uint64_t torn = 0;
+    while (__atomic_load_n(&test_running, __ATOMIC_RELAXED)) {
+        double numbers[4];
+        if (!test_publish(buffer, tokens, numbers)) {
+            test_fail("publisher");
+            break;
+        }
+        torn += numbers[0] != numbers[1] || numbers[2] != numbers[3];
+        published++;
+        // The publisher waits for its next event, a busy loop would starve the writers on one core
+        sched_yield();
+    }
+    __atomic_fetch_add(&test_published, published, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&test_torn, torn, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// Runs the writers with the publishers serializing the value until they are done
+static void test_run(void *(*const writers[])(void *), int count)
+{
+    pthread_t publishers[TEST_PUBLISHERS];
+    pthread_t threads[count];
+    __atomic_store_n(&test_running, true, __ATOMIC_RELAXED);
+    for (int i = 0; i < TEST_PUBLISHERS; i++) {
+        pthread_create(&publishers[i], NULL, test_publisher, NULL);
+    }
+    for (int i = 0; i < count; i++) {
+        pthread_create(&threads[i], NULL, writers[i], NULL);
+    }
+    for (int i = 0; i < count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    __atomic_store_n(&test_running, false, __ATOMIC_RELAXED);
+    for (int i = 0; i < TEST_PUBLISHERS; i++) {
+        pthread_join(publishers[i], NULL);
+    }
+}
+
+int main(void)
+{
+    if (!type_init(NULL)) {
+        fprintf(stderr, "FAIL: type_init\n");
+        return 1;
+    }
+    uint32_t generation = dirty_get_generation(DIRTY_TYPE);
+
+    // Commands replace the whole readwrite, the button edits whatever is current
+    void *(*const commands[])(void *) = { test_button, test_mqtt, test_sensor };
+    test_run(commands, sizeof(commands) / sizeof(commands[0]));
+    test_value_t value;
+    type_value_get(&test_type_value, 0, &value);
+    if (value.read.samples != TEST_SAMPLES || value.readwrite.level != value.readwrite.level_check) {
+        test_fail("final value after commands");
+    }
+
+    // Neither a button press nor an automation is lost to the other
+    int32_t presses = value.readwrite.presses;
+    void *(*const edits[])(void *) = { test_button, test_rules };
+    test_run(edits, sizeof(edits) / sizeof(edits[0]));
+    type_value_get(&test_type_value, 0, &value);
+    if (value.readwrite.presses != presses + TEST_PRESSES || value.readwrite.enabled != ((TEST_RULES - 1) & 1)) {
+        fprintf(stderr, "FAIL presses %d, expected %d\n", (int)value.readwrite.presses, (int)(presses + TEST_PRESSES));
+        test_failures++;
+    }
+
+    // Other endpoints are never touched
+    type_value_get(&test_type_value, 1, &value);
+    test_value_t untouched = {0};
+    if (memcmp(&value, &untouched, sizeof(value)) != 0) {
+        test_fail("endpoint 1 changed");
+    }
+    if (dirty_get_generation(DIRTY_TYPE) == generation || test_hw_updates == 0) {
+        test_fail("changes not marked dirty or applied");
+    }
+
+    printf("%llu values published, %llu torn, %u hardware updates\n",
+           (unsigned long long)test_published, (unsigned long long)test_torn, test_hw_updates);
+    if (test_torn != 0 || test_published == 0) {
+        test_failures++;
+    }
+    printf("%s test_type\n", test_failures ? "FAIL" : "PASS");
+    return test_failures ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * test_value.h
+ *
+ *  Created on: 19 oct 2026
+ *      Author: klaslofstedt
+ */
+#ifndef _TEST_VALUE_H_
+#define _TEST_VALUE_H_
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <cJSON.h>
+#include "utilities/json_writer.h"
+#include "utilities/schema.h"
+#include "app/types/default.h"
+#include "app/types/dimmer.h"
+#include "app/types/meter.h"
+#include "app/types/sensor.h"
+#include "app/types/switch.h"
+#include "app/types/thermostat.h"
+
+// The value document of every type, written like thing_get_value() does with json_writer
+// and like it did before with a cJSON tree printed twice
+
+// No type has a string property yet, this one covers them
+#define TEST_READWRITE_FIELDS(X) \
+    X(STRING, label, 24, 0) \
+    X(NUMBER, level, 0, 0)
+#define TEST_READ_FIELDS(X) \
+    X(STRING, model, 8, 0)
+
+typedef struct test_readwrite_t {
+    TEST_READWRITE_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
+} test_readwrite_t;
+
+typedef struct test_read_t {
+    TEST_READ_FIELDS(SCHEMA_MEMBER)
+    SCHEMA_MEMBERS_END
+} test_read_t;
+
+#define TEST_VALUE_TYPE(prefix, PREFIX)                                                     \
+    static const schema_field_t prefix##_readwrite_fields[] = {                              \
+        PREFIX##_READWRITE_FIELDS(prefix##_READWRITE_FIELD) SCHEMA_FIELDS_END };            \
+    static const schema_field_t prefix##_read_fields[] = {                                   \
+        PREFIX##_READ_FIELDS(prefix##_READ_FIELD) SCHEMA_FIELDS_END };
+
+#define default_READWRITE_FIELD(k, f, a, b) SCHEMA_FIELD(default_readwrite_t, k, f, a, b)
+#define default_READ_FIELD(k, f, a, b) SCHEMA_FIELD(default_read_t, k, f, a, b)
+#define dimmer_READWRITE_FIELD(k, f, a, b) SCHEMA_FIELD(dimmer_readwrite_t, k, f, a, b)
+#define dimmer_READ_FIELD(k, f, a, b) SCHEMA_FIELD(dimmer_read_t, k, f, a, b)
+#define meter_READWRITE_FIELD(k, f, a, b) SCHEMA_FIELD(meter_readwrite_t, k, f, a, b)
+#define meter_READ_FIELD(k, f, a, b) SCHEMA_FIELD(meter_read_t, k, f, a, b)
+#define sensor_READWRITE_FIELD(k, f, a, b) SCHEMA_FIELD(sensor_readwrite_t, k, f, a, b)
+#define sensor_READ_FIELD(k, f, a, b) SCHEMA_FIELD(sensor_read_t, k, f, a, b)
+#define switch_READWRITE_FIELD(k, f, a, b) SCHEMA_FIELD(switch_readwrite_t, k, f, a, b)
+#define switch_READ_FIELD(k, f, a, b) SCHEMA_FIELD(switch_read_t, k, f, a, b)
+#define thermostat_READWRITE_FIELD(k, f, a, b) SCHEMA_FIELD(thermostat_readwrite_t, k, f, a, b)
+#define thermostat_READ_FIELD(k, f, a, b) SCHEMA_FIELD(thermostat_read_t, k, f, a, b)
+#define test_READWRITE_FIELD(k, f, a, b) SCHEMA_FIELD(test_readwrite_t, k, f, a, b)
+#define test_READ_FIELD(k, f, a, b) SCHEMA_FIELD(test_read_t, k, f, a, b)
+
+TEST_VALUE_TYPE(default, DEFAULT)
+TEST_VALUE_TYPE(dimmer, DIMMER)
+TEST_VALUE_TYPE(meter, METER)
+TEST_VALUE_TYPE(sensor, SENSOR)
+TEST_VALUE_TYPE(switch, SWITCH)
+TEST_VALUE_TYPE(thermostat, THERMOSTAT)
+TEST_VALUE_TYPE(test, TEST)
+
+#define TEST_VALUE_MAX_SIZE 256
+
+typedef struct test_value_type_t {
+    const char *name;
+    const schema_field_t *readwrite_fields;
+    int readwrite_count;
+    const schema_field_t *read_fields;
+    int read_count;
+} test_value_type_t;
+
+#define TEST_VALUE_TYPE_ENTRY(prefix) { #prefix,                                                \
+    prefix##_readwrite_fields, SCHEMA_COUNT(prefix##_readwrite_fields),                         \
+    prefix##_read_fields, SCHEMA_COUNT(prefix##_read_fields) }
+
+static const test_value_type_t test_value_types[] = {
+    TEST_VALUE_TYPE_ENTRY(default),
+    TEST_VALUE_TYPE_ENTRY(dimmer),
+    TEST_VALUE_TYPE_ENTRY(meter),
+    TEST_VALUE_TYPE_ENTRY(sensor),
+    TEST_VALUE_TYPE_ENTRY(switch),
+    TEST_VALUE_TYPE_ENTRY(thermostat),
+    TEST_VALUE_TYPE_ENTRY(test),
+};
+
+#define TEST_VALUE_TYPES_COUNT ((int)(sizeof(test_value_types) / sizeof(test_value_types[0])))
+
+// Everything else in the document, as thing.c and mobile.c add it
+typedef struct test_value_t {
+    uint8_t readwrite[TEST_VALUE_MAX_SIZE];
+    uint8_t read[TEST_VALUE_MAX_SIZE];
+    const char *hw_version;
+    const char *fw_version;
+    int32_t version;
+    const char *nickname;
+    const char *sw_version;
+} test_value_t;
+
+// Same layout as thing_get_value(), without the link object
+static inline bool test_value_write(const test_value_type_t *type, const test_value_t *value, char *buffer, size_t size)
+{
+    json_writer_t writer;
+    json_writer_init(&writer, buffer, size);
+    json_writer_object_begin(&writer, NULL);
+    json_writer_escaped_begin(&writer, "value");
+    json_writer_object_begin(&writer, NULL);
+    json_writer_object_begin(&writer, "thing_value");
+    json_writer_object_begin(&writer, "readwrite");
+    schema_write(type->readwrite_fields, type->readwrite_count, &writer, value->readwrite);
+    json_writer_object_end(&writer);
+    json_writer_object_begin(&writer, "read");
+    schema_write(type->read_fields, type->read_count, &writer, value->read);
+    json_writer_string(&writer, "hw_version", value->hw_version);
+    json_writer_string(&writer, "fw_version", value->fw_version);
+    json_writer_object_end(&writer);
+    json_writer_object_end(&writer);
+    json_writer_int(&writer, "version", value->version);
+    json_writer_object_begin(&writer, "mobile_value");
+    json_writer_object_begin(&writer, "readwrite");
+    json_writer_string(&writer, "network", "online");
+    json_writer_object_end(&writer);
+    json_writer_object_begin(&writer, "read");
+    json_writer_string(&writer, "nickname", value->nickname);
+    json_writer_string(&writer, "sw_version", value->sw_version);
+    json_writer_object_end(&writer);
+    json_writer_object_end(&writer);
+    json_writer_object_end(&writer);
+    json_writer_escaped_end(&writer);
+    json_writer_object_end(&writer);
+    return json_writer_finish(&writer);
+}
+
+// What the types added to the tree before the schema, one cJSON_Add per property
+static inline void test_value_cjson_fields(cJSON *object, const schema_field_t *fields, int count, const void *src)
+{
+    for (int i = 0; i < count; i++) {
+        const void *member = (const uint8_t *)src + fields[i].offset;
+        switch (fields[i].kind) {
+            case SCHEMA_BOOL:
+                cJSON_AddBoolToObject(object, fields[i].name, *(const bool *)member);
+                break;
+            case SCHEMA_INT:
+                cJSON_AddNumberToObject(object, fields[i].name, *(const int32_t *)member);
+                break;
+            case SCHEMA_NUMBER:
+                cJSON_AddNumberToObject(object, fields[i].name, *(const double *)member);
+                break;
+            case SCHEMA_STRING:
+                cJSON_AddStringToObject(object, fields[i].name, (const char *)member);
+                break;
+        }
+    }
+}
+
+// The tree thing_get_value() built before json_writer: printed once for the value and
+// once more to embed it as an escaped string
+static inline bool test_value_cjson(const test_value_type_t *type, const test_value_t *value, char *buffer, size_t size)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON *document = cJSON_CreateObject();
+    cJSON *thing_value = cJSON_AddObjectToObject(document, "thing_value");
+    cJSON *readwrite = cJSON_AddObjectToObject(thing_value, "readwrite");
+    cJSON *read = cJSON_AddObjectToObject(thing_value, "read");
+    test_value_cjson_fields(readwrite, type->readwrite_fields, type->readwrite_count, value->readwrite);
+    test_value_cjson_fields(read, type->read_fields, type->read_count, value->read);
+    cJSON_AddStringToObject(read, "hw_version", value->hw_version);
+    cJSON_AddStringToObject(read, "fw_version", value->fw_version);
+    cJSON_AddNumberToObject(document, "version", value->version);
+    cJSON *mobile_value = cJSON_AddObjectToObject(document, "mobile_value");
+    cJSON_AddStringToObject(cJSON_AddObjectToObject(mobile_value, "readwrite"), "network", "online");
+    cJSON *mobile_read = cJSON_AddObjectToObject(mobile_value, "read");
+    cJSON_AddStringToObject(mobile_read, "nickname", value->nickname);
+    cJSON_AddStringToObject(mobile_read, "sw_version", value->sw_version);
+
+    bool ok = cJSON_PrintPreallocated(document, buffer, size, false);
+    if (ok) {
+        cJSON_AddStringToObject(root, "value", buffer);
+        ok = cJSON_PrintPreallocated(root, buffer, size, false);
+    }
+    cJSON_Delete(document);
+    cJSON_Delete(root);
+    return ok;
+}
+
+#endif /* _TEST_VALUE_H_ */